@@ -78,3 +78,29 @@ void ARMAPBDevice::WriteRegisterByOffset(uint32_t offset, uint32_t value)
 {
 	m_ap->WriteWord(m_address + offset, value);
 }
+
+/**
+	@brief Polls a register until (value & mask) == match (see ARMDebugMemAccessPort::PollWord())
+
+	@param index		Index of the register to poll
+	@param mask			Bits of the register to check
+	@param match		Expected value of the masked bits
+	@param timeout_us	Give up after this many microseconds
+	@param value		The last value read
+	@param writes		(index, data) pairs to write, in order, in the same batch as the first reads
+
+	@return True if the condition was met, false on timeout
+ */
+bool ARMAPBDevice::PollRegisterByIndex(
+	uint32_t index,
+	uint32_t mask,
+	uint32_t match,
+	unsigned int timeout_us,
+	uint32_t& value,
+	const std::vector< std::pair<uint32_t, uint32_t> >& writes)
+{
+	std::vector< std::pair<uint32_t, uint32_t> > wabs;
+	for(auto w : writes)
+		wabs.push_back(std::pair<uint32_t, uint32_t>(m_address + w.first*4, w.second));
+	return m_ap->PollWord(m_address + index*4, mask, match, timeout_us, value, wabs);
+}
@@ -59,6 +59,10 @@ public:
 	virtual std::string GetDescription() =0;
 	virtual void PrintInfo() =0;
 
+	///Gets the Mem-AP the device is attached to
+	ARMDebugMemAccessPort* GetMemAccessPort()
+	{ return m_ap; }
+
 protected:
 
 	///reads a register given the offset from our base address
@@ -73,6 +77,14 @@ protected:
 	///writes a register given the offset from our base address
 	void WriteRegisterByOffset(uint32_t offset, uint32_t value);
 
+	bool PollRegisterByIndex(
+		uint32_t index,
+		uint32_t mask,
+		uint32_t match,
+		unsigned int timeout_us,
+		uint32_t& value,
+		const std::vector< std::pair<uint32_t, uint32_t> >& writes = std::vector< std::pair<uint32_t, uint32_t> >());
+
 	///The Mem-AP
 	ARMDebugMemAccessPort* m_ap;
 
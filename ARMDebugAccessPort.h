@@ -116,6 +116,13 @@ public:
 	uint8_t GetAPNumber()
 	{ return m_apnum; }
 
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Register caching
+
+	///Discards any shadow copies of AP registers (called by the DP after an abort or error)
+	virtual void InvalidateCache()
+	{}
+
 protected:
 	ARMDebugPort* m_dp;
 	uint8_t m_apnum;
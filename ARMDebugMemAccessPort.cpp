@@ -48,6 +48,21 @@ static const char* g_cswLenNames[]=
 
 using namespace std;
 
+///Number of ROM table entries to fetch in the first block read (most tables are short)
+#define ROM_TABLE_FIRST_CHUNK 8
+
+///Maximum number of ROM table entries to fetch per block read
+#define ROM_TABLE_CHUNK 64
+
+///Number of speculative reads queued behind the writes in PollWord(), before handing off to the DP
+#define POLL_SPECULATIVE_READS 4
+
+///Components found by previous ROM table walks, keyed by (DP ID, AP IDR, debug base address)
+static map< tuple<uint32_t, uint32_t, uint32_t>, vector<ARMDebugMemAccessPort::RomComponent> > g_topologyCache;
+
+///Protects g_topologyCache
+static mutex g_topologyCacheMutex;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -55,6 +70,11 @@ ARMDebugMemAccessPort::ARMDebugMemAccessPort(ARMDebugPort* dp, uint8_t apnum, AR
 	: ARMDebugAccessPort(dp, apnum, id)
 	, m_debugBusIsDedicated(false)
 	, m_hasDebugRom(true)
+	, m_cswValid(false)
+	, m_tarValid(false)
+	, m_modesProbed(false)
+	, m_narrowSupported(false)
+	, m_packedSupported(false)
 {
 	if(m_daptype >= DAP_INVALID)
 	{
@@ -63,13 +83,9 @@ ARMDebugMemAccessPort::ARMDebugMemAccessPort(ARMDebugPort* dp, uint8_t apnum, AR
 			"");
 	}
 
-	//If the access size is not 32-bit, make it 32-bit
-	ARMDebugMemAPControlStatusWord csw = GetStatusRegister();
-	if(csw.bits.size != ACCESS_WORD)
-	{
-		csw.bits.size = ACCESS_WORD;
-		m_dp->APRegisterWrite(m_apnum, ARMDebugPort::REG_MEM_CSW, csw.word);
-	}
+	//Use 32-bit accesses, and have TAR advance after each one so sequential accesses don't need to rewrite it
+	GetStatusRegister(true);
+	SetTransferMode(ACCESS_WORD, 1);
 }
 
 void ARMDebugMemAccessPort::Initialize()
@@ -82,7 +98,35 @@ void ARMDebugMemAccessPort::Initialize()
 		LogIndenter li;
 		FindRootRomTable();
 		if(m_hasDebugRom)
-			LoadROMTable(m_debugBaseAddress);
+		{
+			//If we've already walked the ROM on an identical chip, replay what we found instead of reading it again
+			tuple<uint32_t, uint32_t, uint32_t> key(m_dp->GetDebugPortID(), (uint32_t)m_id.word, m_debugBaseAddress);
+			vector<RomComponent> cached;
+			bool hit = false;
+			{
+				lock_guard<mutex> lock(g_topologyCacheMutex);
+				auto it = g_topologyCache.find(key);
+				if(it != g_topologyCache.end())
+				{
+					cached = it->second;
+					hit = true;
+				}
+			}
+
+			if(hit)
+			{
+				LogTrace("Using cached ROM table contents (%zu components)\n", cached.size());
+				for(auto c : cached)
+					ProcessDebugBlock(c.address, c.memtype, c.idreg);
+			}
+			else
+			{
+				LoadROMTable(m_debugBaseAddress);
+
+				lock_guard<mutex> lock(g_topologyCacheMutex);
+				g_topologyCache[key] = m_romComponents;
+			}
+		}
 		else
 			LogTrace("No debug ROM found\n");
 	}
@@ -99,17 +143,26 @@ ARMDebugMemAccessPort::~ARMDebugMemAccessPort()
 	m_debugDevices.clear();
 }
 
+/**
+	@brief Forgets all cached ROM table contents, so the next attach walks the ROM again
+ */
+void ARMDebugMemAccessPort::ClearTopologyCache()
+{
+	lock_guard<mutex> lock(g_topologyCacheMutex);
+	g_topologyCache.clear();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // General device info
 
 bool ARMDebugMemAccessPort::IsEnabled()
 {
-	return GetStatusRegister().bits.enable;
+	return GetStatusRegister(true).bits.enable;
 }
 
 void ARMDebugMemAccessPort::PrintStatusRegister()
 {
-	ARMDebugMemAPControlStatusWord csw = GetStatusRegister();
+	ARMDebugMemAPControlStatusWord csw = GetStatusRegister(true);
 	LogIndenter li;
 	LogNotice("Status register for AP %u:\n", m_apnum);
 	LogIndenter li2;
@@ -131,32 +184,875 @@ string ARMDebugMemAccessPort::GetDescription()
 	return "";
 }
 
-ARMDebugMemAPControlStatusWord ARMDebugMemAccessPort::GetStatusRegister()
+/**
+	@brief Gets the contents of the CSW register
+
+	@param refresh		Read the register from hardware even if we have a shadow copy. The configuration bits can only
+						change when we write them, but the status bits (enable, busy) are live.
+ */
+ARMDebugMemAPControlStatusWord ARMDebugMemAccessPort::GetStatusRegister(bool refresh)
 {
-	ARMDebugMemAPControlStatusWord csw;
-	csw.word = m_dp->APRegisterRead(m_apnum, ARMDebugPort::REG_MEM_CSW);
-	return csw;
+	m_dp->CheckDeviceCaches();
+	if(refresh || !m_cswValid)
+	{
+		m_csw.word = m_dp->APRegisterRead(m_apnum, ARMDebugPort::REG_MEM_CSW);
+		m_cswValid = true;
+	}
+	return m_csw;
+}
+
+/**
+	@brief Writes the CSW register, unless it already holds the requested configuration
+ */
+void ARMDebugMemAccessPort::SetStatusRegister(ARMDebugMemAPControlStatusWord csw)
+{
+	m_dp->CheckDeviceCaches();
+	if(m_cswValid && (m_csw.word == csw.word) )
+		return;
+
+	//The TAR increment depends on the CSW settings, so stop trusting it until we know the write went through
+	m_cswValid = false;
+	m_tarValid = false;
+	m_dp->APRegisterWrite(m_apnum, ARMDebugPort::REG_MEM_CSW, csw.word);
+	m_csw = csw;
+	m_cswValid = true;
+}
+
+/**
+	@brief Sets the access size and address increment mode in CSW, if they aren't already set that way
+
+	@param size			Size of each access
+	@param increment	Address increment mode (0 = none, 1 = single, 2 = packed)
+ */
+void ARMDebugMemAccessPort::SetTransferMode(AccessSize size, unsigned int increment)
+{
+	ARMDebugMemAPControlStatusWord csw = GetStatusRegister();
+	csw.bits.size = size;
+	csw.bits.auto_increment = increment;
+	SetStatusRegister(csw);
+}
+
+/**
+	@brief Finds out which access sizes and increment modes the AP implements
+
+	Byte/halfword accesses and packed transfers are both optional (ADIv5 7.6.4). Unsupported CSW values don't stick,
+	so we write a byte-sized, packed configuration and see what reads back.
+ */
+void ARMDebugMemAccessPort::ProbeTransferModes()
+{
+	m_modesProbed = true;
+
+	ARMDebugMemAPControlStatusWord csw = GetStatusRegister();
+	csw.bits.size = ACCESS_BYTE;
+	csw.bits.auto_increment = 2;
+	m_cswValid = false;
+	m_tarValid = false;
+	m_dp->APRegisterWrite(m_apnum, ARMDebugPort::REG_MEM_CSW, csw.word);
+	csw = GetStatusRegister(true);
+
+	m_narrowSupported = (csw.bits.size == ACCESS_BYTE);
+	m_packedSupported = m_narrowSupported && (csw.bits.auto_increment == 2);
+	LogTrace("AP %u: narrow accesses %s, packed transfers %s\n",
+		m_apnum,
+		m_narrowSupported ? "supported" : "not supported",
+		m_packedSupported ? "supported" : "not supported");
+
+	SetTransferMode(ACCESS_WORD, 1);
+}
+
+bool ARMDebugMemAccessPort::IsNarrowAccessSupported()
+{
+	if(!m_modesProbed)
+		ProbeTransferModes();
+	return m_narrowSupported;
+}
+
+bool ARMDebugMemAccessPort::IsPackedTransferSupported()
+{
+	if(!m_modesProbed)
+		ProbeTransferModes();
+	return m_packedSupported;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Register caching
+
+/**
+	@brief Forgets the shadow copies of CSW and TAR, so the next access reloads them
+ */
+void ARMDebugMemAccessPort::InvalidateCache()
+{
+	m_cswValid = false;
+	m_tarValid = false;
+}
+
+/**
+	@brief Updates the shadow copy of TAR after a successful data access to addr
+
+	TAR auto-increment is only guaranteed within a 1 KB block (ADIv5 7.2.2), so we stop trusting it when the next
+	address would cross into the next block.
+ */
+void ARMDebugMemAccessPort::UpdateCachedAddress(uint32_t addr)
+{
+	m_tarValid = false;
+	if(!m_cswValid)
+		return;
+
+	switch(m_csw.bits.auto_increment)
+	{
+		//No increment
+		case 0:
+			m_tar = addr;
+			m_tarValid = true;
+			break;
+
+		//Single increment
+		case 1:
+			m_tar = addr + (1 << m_csw.bits.size);
+			m_tarValid = ( (m_tar & 0x3ff) != 0 );
+			break;
+
+		//Packed (or reserved): don't try to predict it
+		default:
+			break;
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Memory access
 
+/**
+	@brief Does a single data access through DRW
+
+	Narrow accesses use the byte lanes matching the low address bits (ADIv5 7.2.4), so the value read back is the raw
+	32-bit DRW contents and the caller has to shift it down.
+
+	@param addr			Address to read
+	@param size			Access size
+ */
+uint32_t ARMDebugMemAccessPort::ReadSingle(uint32_t addr, AccessSize size)
+{
+	m_dp->CheckDeviceCaches();
+
+	SetTransferMode(size, 1);
+
+	//Write the address (unless TAR already points there), then read the data back
+	//(batched, so a remote DAP can do both in one round trip)
+	vector<ARMDebugPort::APTransaction> batch;
+	if(!m_tarValid || (m_tar != addr) )
+		batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_TAR, true, addr));
+	batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_DRW, false));
+
+	try
+	{
+		m_dp->MemAPBatch(m_apnum, batch, m_tar);
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	UpdateCachedAddress(addr);
+	return batch.back().value;
+}
+
+/**
+	@brief Does a single data write through DRW
+
+	@param addr			Address to write
+	@param size			Access size
+	@param value		Raw DRW value (narrow data must already be shifted into the right byte lane)
+ */
+void ARMDebugMemAccessPort::WriteSingle(uint32_t addr, AccessSize size, uint32_t value)
+{
+	m_dp->CheckDeviceCaches();
+
+	SetTransferMode(size, 1);
+
+	//Write the address (unless TAR already points there), then the data
+	vector<ARMDebugPort::APTransaction> batch;
+	if(!m_tarValid || (m_tar != addr) )
+		batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_TAR, true, addr));
+	batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_DRW, true, value));
+
+	try
+	{
+		m_dp->MemAPBatch(m_apnum, batch, m_tar);
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	UpdateCachedAddress(addr);
+}
+
 uint32_t ARMDebugMemAccessPort::ReadWord(uint32_t addr)
 {
-	//Write the address
-	m_dp->APRegisterWrite(m_apnum, ARMDebugPort::REG_MEM_TAR, addr);
+	return ReadSingle(addr, ACCESS_WORD);
+}
+
+uint16_t ARMDebugMemAccessPort::ReadHalfword(uint32_t addr)
+{
+	if(addr & 1)
+	{
+		throw JtagExceptionWrapper(
+			"Halfword accesses must be aligned",
+			"");
+	}
 
-	//Read the data back
-	return m_dp->APRegisterRead(m_apnum, ARMDebugPort::REG_MEM_DRW);
+	uint32_t shift = (addr & 2) * 8;
+	if(!IsNarrowAccessSupported())
+		return ReadWord(addr & ~3) >> shift;
+	return ReadSingle(addr, ACCESS_HALFWORD) >> shift;
+}
+
+uint8_t ARMDebugMemAccessPort::ReadByte(uint32_t addr)
+{
+	uint32_t shift = (addr & 3) * 8;
+	if(!IsNarrowAccessSupported())
+		return ReadWord(addr & ~3) >> shift;
+	return ReadSingle(addr, ACCESS_BYTE) >> shift;
 }
 
 void ARMDebugMemAccessPort::WriteWord(uint32_t addr, uint32_t value)
 {
-	//Write the address
-	m_dp->APRegisterWrite(m_apnum, ARMDebugPort::REG_MEM_TAR, addr);
+	WriteSingle(addr, ACCESS_WORD, value);
+}
+
+/**
+	@brief Writes a 16-bit halfword
 
-	//Write data
-	m_dp->APRegisterWrite(m_apnum, ARMDebugPort::REG_MEM_DRW, value);
+	If the AP can only do word accesses, this falls back to a read-modify-write of the containing word, which is not
+	atomic with respect to the target and may misbehave on registers with side effects.
+ */
+void ARMDebugMemAccessPort::WriteHalfword(uint32_t addr, uint16_t value)
+{
+	if(addr & 1)
+	{
+		throw JtagExceptionWrapper(
+			"Halfword accesses must be aligned",
+			"");
+	}
+
+	uint32_t shift = (addr & 2) * 8;
+	if(!IsNarrowAccessSupported())
+	{
+		uint32_t word = ReadWord(addr & ~3);
+		word = (word & ~(0xffff << shift)) | (value << shift);
+		WriteWord(addr & ~3, word);
+		return;
+	}
+	WriteSingle(addr, ACCESS_HALFWORD, value << shift);
+}
+
+/**
+	@brief Writes a single byte (see WriteHalfword() for the caveats on word-only APs)
+ */
+void ARMDebugMemAccessPort::WriteByte(uint32_t addr, uint8_t value)
+{
+	uint32_t shift = (addr & 3) * 8;
+	if(!IsNarrowAccessSupported())
+	{
+		uint32_t word = ReadWord(addr & ~3);
+		word = (word & ~(0xff << shift)) | (value << shift);
+		WriteWord(addr & ~3, word);
+		return;
+	}
+	WriteSingle(addr, ACCESS_BYTE, value << shift);
+}
+
+/**
+	@brief Reads a block of consecutive words, using TAR auto-increment
+
+	@param addr			Address of the first word
+	@param data			Output buffer
+	@param count		Number of words to read
+ */
+void ARMDebugMemAccessPort::ReadBlock(uint32_t addr, uint32_t* data, size_t count)
+{
+	if(count == 0)
+		return;
+
+	m_dp->CheckDeviceCaches();
+
+	SetTransferMode(ACCESS_WORD, 1);
+	try
+	{
+		m_dp->MemAPReadBlock(m_apnum, addr, data, count);
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	UpdateCachedAddress(addr + (count-1)*4);
+}
+
+/**
+	@brief Writes a block of consecutive words, using TAR auto-increment
+
+	@param addr			Address of the first word
+	@param data			Data to write
+	@param count		Number of words to write
+ */
+void ARMDebugMemAccessPort::WriteBlock(uint32_t addr, const uint32_t* data, size_t count)
+{
+	if(count == 0)
+		return;
+
+	m_dp->CheckDeviceCaches();
+
+	SetTransferMode(ACCESS_WORD, 1);
+	try
+	{
+		m_dp->MemAPWriteBlock(m_apnum, addr, data, count);
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	UpdateCachedAddress(addr + (count-1)*4);
+}
+
+/**
+	@brief Runs a batch of accesses to a 16-byte aligned block of registers, using the banked data registers
+
+	TAR is pointed at the block once (if it isn't already) and then left alone, since BD0-BD3 don't auto-increment.
+	This is a good fit for small groups of related registers that have to be hit in a fixed sequence, such as the
+	ARMv7-M DHCSR/DCRSR/DCRDR core register interface: the whole sequence is one batch, with no TAR writes.
+
+	@param base			Address of the block (must be 16-byte aligned)
+	@param accesses		The accesses to make, in order. Read results are returned in place.
+ */
+void ARMDebugMemAccessPort::BankedBatch(uint32_t base, vector<BankedAccess>& accesses)
+{
+	if(base & 0xf)
+	{
+		throw JtagExceptionWrapper(
+			"Banked register accesses need a 16-byte aligned base address",
+			"");
+	}
+
+	m_dp->CheckDeviceCaches();
+
+	SetTransferMode(ACCESS_WORD, 1);
+
+	vector<ARMDebugPort::APTransaction> batch;
+	if(!m_tarValid || (m_tar != base) )
+		batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_TAR, true, base));
+	size_t first = batch.size();
+	for(auto a : accesses)
+	{
+		auto reg = static_cast<ARMDebugPort::ApReg>(ARMDebugPort::REG_MEM_BD0 + (a.offset & 0xc));
+		batch.push_back(ARMDebugPort::APTransaction(m_apnum, reg, a.write, a.value));
+	}
+
+	try
+	{
+		m_dp->MemAPBatch(m_apnum, batch, m_tar);
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	m_tar = base;
+	m_tarValid = true;
+
+	for(size_t i=0; i<accesses.size(); i++)
+	{
+		if(!accesses[i].write)
+			accesses[i].value = batch[first + i].value;
+	}
+}
+
+/**
+	@brief Runs several block reads and writes as a single batch of AP transactions (see DebuggerInterface::MemoryBatch())
+
+	TAR is written at the start of each transfer and at every 1 KB boundary, except where auto-increment already left
+	it pointing at the right place (e.g. a transfer that picks up where the previous one stopped).
+
+	@param transfers	The transfers to perform, in order
+ */
+void ARMDebugMemAccessPort::TransferBatch(vector<DebuggerInterface::MemoryTransfer>& transfers)
+{
+	m_dp->CheckDeviceCaches();
+
+	SetTransferMode(ACCESS_WORD, 1);
+
+	vector<ARMDebugPort::APTransaction> batch;
+	vector<size_t> firsts;
+	bool tarValid = m_tarValid;
+	uint32_t tar = m_tar;
+	for(auto& t : transfers)
+	{
+		if(t.address & 3)
+		{
+			throw JtagExceptionWrapper(
+				"Batched memory transfers must be 4-byte aligned",
+				"");
+		}
+
+		firsts.push_back(batch.size());
+		for(size_t i=0; i<t.count; i++)
+		{
+			uint32_t waddr = t.address + i*4;
+			if(!tarValid || (tar != waddr) )
+				batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_TAR, true, waddr));
+			batch.push_back(ARMDebugPort::APTransaction(
+				m_apnum, ARMDebugPort::REG_MEM_DRW, t.write, t.write ? t.data[i] : 0));
+
+			tar = waddr + 4;
+			tarValid = ( (tar & 0x3ff) != 0 );
+		}
+	}
+	if(batch.empty())
+		return;
+
+	try
+	{
+		m_dp->MemAPBatch(m_apnum, batch, m_tar);
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	m_tar = tar;
+	m_tarValid = tarValid;
+
+	//Pick the read data out, skipping over any TAR writes
+	for(size_t i=0; i<transfers.size(); i++)
+	{
+		auto& t = transfers[i];
+		if(t.write)
+			continue;
+
+		size_t j = firsts[i];
+		for(size_t k=0; k<t.count; j++)
+		{
+			if(batch[j].addr == ARMDebugPort::REG_MEM_DRW)
+				t.data[k++] = batch[j].value;
+		}
+	}
+}
+
+/**
+	@brief Reads a list of unrelated words in one batch, using the banked data registers
+
+	TAR is only written when an address is in a different 16-byte block from the one before it, so reading the same
+	register over and over (or a few registers in the same block) costs one AP transaction per word.
+
+	@param addrs		Addresses to read (must be 4-byte aligned)
+	@param data			Output buffer
+	@param count		Number of words to read
+ */
+void ARMDebugMemAccessPort::ReadScattered(const uint32_t* addrs, uint32_t* data, size_t count)
+{
+	if(count == 0)
+		return;
+
+	m_dp->CheckDeviceCaches();
+
+	SetTransferMode(ACCESS_WORD, 1);
+
+	vector<ARMDebugPort::APTransaction> batch;
+	vector<size_t> slots(count);
+	bool tarValid = m_tarValid;
+	uint32_t tar = m_tar;
+	for(size_t i=0; i<count; i++)
+	{
+		if(addrs[i] & 3)
+		{
+			throw JtagExceptionWrapper(
+				"Scattered read addresses must be 4-byte aligned",
+				"");
+		}
+
+		uint32_t block = addrs[i] & ~0xf;
+		if(!tarValid || (tar != block) )
+			batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_TAR, true, block));
+		tar = block;
+		tarValid = true;
+
+		slots[i] = batch.size();
+		auto reg = static_cast<ARMDebugPort::ApReg>(ARMDebugPort::REG_MEM_BD0 + (addrs[i] & 0xc));
+		batch.push_back(ARMDebugPort::APTransaction(m_apnum, reg, false));
+	}
+
+	try
+	{
+		m_dp->MemAPBatch(m_apnum, batch, m_tar);
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	m_tar = tar;
+	m_tarValid = true;
+
+	for(size_t i=0; i<count; i++)
+		data[i] = batch[slots[i]].value;
+}
+
+/**
+	@brief Polls a word until (value & mask) == match, optionally writing some other words first
+
+	The writes and a few reads of the polled word go out as one batch, using the banked data registers so TAR only
+	has to be written when moving to a different 16-byte block. Status bits that flip within a few microseconds of
+	the write that triggered them (halting or resuming a CPU, core register transfers, etc) are therefore usually
+	seen in a single adapter round trip. If none of the speculative reads match, the rest of the polling is left to
+	ARMDebugPort::MemAPPoll(), which a remote debug port may run on the server.
+
+	@param addr			Address of the word to poll (must be 4-byte aligned)
+	@param mask			Bits of the word to check
+	@param match		Expected value of the masked bits
+	@param timeout_us	Give up after this many microseconds
+	@param value		The last value read
+	@param writes		(address, data) pairs to write, in order, before the first read
+
+	@return True if the condition was met, false on timeout
+ */
+bool ARMDebugMemAccessPort::PollWord(
+	uint32_t addr,
+	uint32_t mask,
+	uint32_t match,
+	unsigned int timeout_us,
+	uint32_t& value,
+	const vector< pair<uint32_t, uint32_t> >& writes)
+{
+	if(addr & 3)
+	{
+		throw JtagExceptionWrapper(
+			"Polled address must be 4-byte aligned",
+			"");
+	}
+
+	m_dp->CheckDeviceCaches();
+
+	SetTransferMode(ACCESS_WORD, 1);
+
+	vector<ARMDebugPort::APTransaction> batch;
+	bool tarValid = m_tarValid;
+	uint32_t tar = m_tar;
+	for(auto w : writes)
+	{
+		if(w.first & 3)
+		{
+			throw JtagExceptionWrapper(
+				"Write address must be 4-byte aligned",
+				"");
+		}
+
+		uint32_t block = w.first & ~0xf;
+		if(!tarValid || (tar != block) )
+			batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_TAR, true, block));
+		tar = block;
+		tarValid = true;
+
+		auto reg = static_cast<ARMDebugPort::ApReg>(ARMDebugPort::REG_MEM_BD0 + (w.first & 0xc));
+		batch.push_back(ARMDebugPort::APTransaction(m_apnum, reg, true, w.second));
+	}
+
+	uint32_t block = addr & ~0xf;
+	if(!tarValid || (tar != block) )
+		batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_TAR, true, block));
+	size_t first = batch.size();
+	auto reg = static_cast<ARMDebugPort::ApReg>(ARMDebugPort::REG_MEM_BD0 + (addr & 0xc));
+	for(size_t i=0; i<POLL_SPECULATIVE_READS; i++)
+		batch.push_back(ARMDebugPort::APTransaction(m_apnum, reg, false));
+
+	try
+	{
+		m_dp->MemAPBatch(m_apnum, batch, m_tar);
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	m_tar = block;
+	m_tarValid = true;
+
+	for(size_t i=first; i<batch.size(); i++)
+	{
+		value = batch[i].value;
+		if( (value & mask) == match)
+			return true;
+	}
+
+	//Not there yet, keep going the slow way
+	return m_dp->MemAPPoll(m_apnum, addr, mask, match, timeout_us, value);
+}
+
+/**
+	@brief Reads an arbitrary range of bytes, using the widest accesses the alignment allows
+
+	The word-aligned middle of the range is streamed as a block. Any unaligned head or tail uses single byte or
+	halfword accesses.
+
+	@param addr			Address of the first byte
+	@param data			Output buffer
+	@param len			Number of bytes to read
+	@param maxSize		Widest access the target memory can handle. If this is narrower than a word, the middle of the
+						range is moved using packed transfers (several narrow accesses per DRW transfer) if the AP
+						supports them, and one narrow access per DRW transfer if not.
+ */
+void ARMDebugMemAccessPort::ReadBytes(uint32_t addr, uint8_t* data, size_t len, AccessSize maxSize)
+{
+	//If the AP can only do word accesses, there's no point in going narrower
+	if( (maxSize != ACCESS_WORD) && !IsNarrowAccessSupported())
+		maxSize = ACCESS_WORD;
+
+	while(len > 0)
+	{
+		//Aligned middle
+		if( ( (addr & 3) == 0) && (len >= 4) )
+		{
+			size_t n = len & ~3;
+			if(maxSize == ACCESS_WORD)
+			{
+				vector<uint32_t> words(n / 4);
+				ReadBlock(addr, &words[0], words.size());
+				memcpy(data, &words[0], n);
+			}
+			else if(IsPackedTransferSupported())
+				ReadPacked(addr, data, n, maxSize);
+			else
+				ReadNarrowBlock(addr, data, n, maxSize);
+
+			addr += n;
+			data += n;
+			len -= n;
+			continue;
+		}
+
+		//Unaligned head, or tail
+		if( ( (addr & 1) == 0) && (len >= 2) && (maxSize >= ACCESS_HALFWORD) )
+		{
+			uint16_t v = ReadHalfword(addr);
+			memcpy(data, &v, 2);
+			addr += 2;
+			data += 2;
+			len -= 2;
+		}
+		else
+		{
+			*data = ReadByte(addr);
+			addr ++;
+			data ++;
+			len --;
+		}
+	}
+}
+
+/**
+	@brief Writes an arbitrary range of bytes (see ReadBytes())
+
+	@param addr			Address of the first byte
+	@param data			Data to write
+	@param len			Number of bytes to write
+	@param maxSize		Widest access the target memory can handle
+ */
+void ARMDebugMemAccessPort::WriteBytes(uint32_t addr, const uint8_t* data, size_t len, AccessSize maxSize)
+{
+	if( (maxSize != ACCESS_WORD) && !IsNarrowAccessSupported())
+		maxSize = ACCESS_WORD;
+
+	while(len > 0)
+	{
+		//Aligned middle
+		if( ( (addr & 3) == 0) && (len >= 4) )
+		{
+			size_t n = len & ~3;
+			if(maxSize == ACCESS_WORD)
+			{
+				vector<uint32_t> words(n / 4);
+				memcpy(&words[0], data, n);
+				WriteBlock(addr, &words[0], words.size());
+			}
+			else if(IsPackedTransferSupported())
+				WritePacked(addr, data, n, maxSize);
+			else
+				WriteNarrowBlock(addr, data, n, maxSize);
+
+			addr += n;
+			data += n;
+			len -= n;
+			continue;
+		}
+
+		//Unaligned head, or tail
+		if( ( (addr & 1) == 0) && (len >= 2) && (maxSize >= ACCESS_HALFWORD) )
+		{
+			uint16_t v;
+			memcpy(&v, data, 2);
+			WriteHalfword(addr, v);
+			addr += 2;
+			data += 2;
+			len -= 2;
+		}
+		else
+		{
+			WriteByte(addr, *data);
+			addr ++;
+			data ++;
+			len --;
+		}
+	}
+}
+
+/**
+	@brief Reads a word-aligned range using packed narrow transfers
+
+	In packed mode each DRW transfer covers a whole word, which the AP splits into several narrow accesses, and TAR
+	advances by four bytes per transfer. To the DP this looks exactly like a 32-bit block transfer.
+
+	@param addr			Address of the first byte (must be word aligned)
+	@param data			Output buffer
+	@param len			Number of bytes to read (must be a multiple of 4)
+	@param size			Size of the individual bus accesses
+ */
+void ARMDebugMemAccessPort::ReadPacked(uint32_t addr, uint8_t* data, size_t len, AccessSize size)
+{
+	vector<uint32_t> words(len / 4);
+
+	SetTransferMode(size, 2);
+	try
+	{
+		m_dp->MemAPReadBlock(m_apnum, addr, &words[0], words.size());
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	memcpy(data, &words[0], len);
+}
+
+/**
+	@brief Writes a word-aligned range using packed narrow transfers (see ReadPacked())
+ */
+void ARMDebugMemAccessPort::WritePacked(uint32_t addr, const uint8_t* data, size_t len, AccessSize size)
+{
+	vector<uint32_t> words(len / 4);
+	memcpy(&words[0], data, len);
+
+	SetTransferMode(size, 2);
+	try
+	{
+		m_dp->MemAPWriteBlock(m_apnum, addr, &words[0], words.size());
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+}
+
+/**
+	@brief Reads a range using individual narrow accesses, for APs that can't do packed transfers
+
+	Each DRW transfer moves one byte or halfword and TAR auto-increments by that much, so this is still streamed in
+	batches of up to 1 KB.
+
+	@param addr			Address of the first byte (must be aligned to the access size)
+	@param data			Output buffer
+	@param len			Number of bytes to read (must be a multiple of the access size)
+	@param size			Size of the individual bus accesses
+ */
+void ARMDebugMemAccessPort::ReadNarrowBlock(uint32_t addr, uint8_t* data, size_t len, AccessSize size)
+{
+	size_t step = 1 << size;
+
+	SetTransferMode(size, 1);
+	m_tarValid = false;
+
+	vector<ARMDebugPort::APTransaction> batch;
+	size_t i = 0;
+	try
+	{
+		while(i < len)
+		{
+			//Read up to the end of the current 1 KB block
+			uint32_t baddr = addr + i;
+			size_t n = min(len - i, (size_t)(0x400 - (baddr & 0x3ff)));
+
+			batch.clear();
+			batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_TAR, true, baddr));
+			for(size_t j=0; j<n; j+=step)
+				batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_DRW, false));
+			m_dp->MemAPBatch(m_apnum, batch, m_tar);
+
+			//Pull each element out of its byte lane
+			for(size_t j=0; j<n; j+=step)
+			{
+				uint32_t v = batch[j/step + 1].value >> ( ( (baddr + j) & 3) * 8);
+				memcpy(data + i + j, &v, step);
+			}
+			i += n;
+		}
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	UpdateCachedAddress(addr + len - step);
+}
+
+/**
+	@brief Writes a range using individual narrow accesses (see ReadNarrowBlock())
+ */
+void ARMDebugMemAccessPort::WriteNarrowBlock(uint32_t addr, const uint8_t* data, size_t len, AccessSize size)
+{
+	size_t step = 1 << size;
+
+	SetTransferMode(size, 1);
+	m_tarValid = false;
+
+	vector<ARMDebugPort::APTransaction> batch;
+	size_t i = 0;
+	try
+	{
+		while(i < len)
+		{
+			uint32_t baddr = addr + i;
+			size_t n = min(len - i, (size_t)(0x400 - (baddr & 0x3ff)));
+
+			batch.clear();
+			batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_TAR, true, baddr));
+			for(size_t j=0; j<n; j+=step)
+			{
+				uint32_t v = 0;
+				memcpy(&v, data + i + j, step);
+				v <<= ( ( (baddr + j) & 3) * 8);
+				batch.push_back(ARMDebugPort::APTransaction(m_apnum, ARMDebugPort::REG_MEM_DRW, true, v));
+			}
+			m_dp->MemAPBatch(m_apnum, batch, m_tar);
+			i += n;
+		}
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateCache();
+		throw;
+	}
+
+	UpdateCachedAddress(addr + len - step);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -199,7 +1095,14 @@ void ARMDebugMemAccessPort::LoadROMTable(uint32_t baseAddress)
 	LogTrace("Loading ROM table at address %08x\n", baseAddress);
 	LogIndenter li;
 
-	//Read ROM table entries until we get to an invalid one
+	//Read ROM table entries until we get to an invalid one.
+	//Fetch them a block at a time, starting small and doubling the block size each time we run off the end.
+	//If a block read fails, drop back to single words so we stop at the bad one.
+	uint32_t entries[ROM_TABLE_CHUNK];
+	int chunkStart = 0;
+	int chunkLen = 0;
+	int nextChunk = ROM_TABLE_FIRST_CHUNK;
+	bool singleWords = false;
 	for(int i=0; i<960; i++)
 	{
 		//Read the next entry and stop if it's a terminator
@@ -207,7 +1110,25 @@ void ARMDebugMemAccessPort::LoadROMTable(uint32_t baseAddress)
 		uint32_t entryAddr = (baseAddress + i*4);
 		try
 		{
-			entry = ReadWord(entryAddr);
+			if(!singleWords && (i >= chunkStart + chunkLen) )
+			{
+				chunkStart = i;
+				chunkLen = min(nextChunk, 960 - i);
+				nextChunk = min(nextChunk * 2, ROM_TABLE_CHUNK);
+				try
+				{
+					ReadBlock(entryAddr, entries, chunkLen);
+				}
+				catch(const JtagException& e)
+				{
+					singleWords = true;
+				}
+			}
+
+			if(singleWords)
+				entry = ReadWord(entryAddr);
+			else
+				entry = entries[i - chunkStart];
 		}
 		catch(const JtagException& e)
 		{
@@ -245,10 +1166,14 @@ void ARMDebugMemAccessPort::LoadROMTable(uint32_t baseAddress)
 
 		try
 		{
-			//Walk this table entry
-			uint32_t compid_raw[4];
-			for(int j=0; j<4; j++)
-				compid_raw[j] = ReadWord(address + 0xff0 + 4*j);
+			//Walk this table entry.
+			//The memory type (0xfcc), peripheral ID (0xfd0 - 0xfec) and component ID (0xff0 - 0xffc) registers are
+			//contiguous, so grab them all in one go.
+			uint32_t idblock[13];
+			ReadBlock(address + 0xfcc, idblock, 13);
+			uint32_t memtype = idblock[0];
+			uint32_t* idregs = idblock + 1;
+			uint32_t* compid_raw = idregs + 8;
 			uint32_t compid =
 				((compid_raw[3] & 0xff) << 24) |
 				((compid_raw[2] & 0xff) << 16) |
@@ -261,9 +1186,9 @@ void ARMDebugMemAccessPort::LoadROMTable(uint32_t baseAddress)
 			//Look up peripheral ID
 			uint64_t periphid_raw[8];
 			for(int i=0; i<4; i++)
-				periphid_raw[i] = ReadWord(address + 0xfe0 + 4*i);
+				periphid_raw[i] = idregs[i+4];
 			for(int i=0; i<4; i++)
-				periphid_raw[i+4] = ReadWord(address + 0xfd0 + 4*i);
+				periphid_raw[i+4] = idregs[i];
 			ARMDebugPeripheralIDRegister idr;
 			idr.word =
 				(periphid_raw[7] << 56) |
@@ -279,11 +1204,7 @@ void ARMDebugMemAccessPort::LoadROMTable(uint32_t baseAddress)
 			if(i > 0)
 			{
 				for(int j=0; j<12; j++)
-				{
-					uint32_t base = address + 0xfd0 + 4*j;
-					uint32_t val = ReadWord(base);
-					LogTrace("0x%08x => 0x%08x\n", base, val);
-				}
+					LogTrace("0x%08x => 0x%08x\n", address + 0xfd0 + 4*j, idregs[j]);
 			}
 
 			/*{
@@ -310,7 +1231,6 @@ void ARMDebugMemAccessPort::LoadROMTable(uint32_t baseAddress)
 			}
 
 			//If the peripheral has >1 page, back off to the START (the rom table points to the LAST page)
-			uint32_t id_base = address;
 			if(idr.bits.log_4k_blocks != 0)
 			{
 				address -= (num_extra_pages - 1) * 0x1000;
@@ -325,7 +1245,7 @@ void ARMDebugMemAccessPort::LoadROMTable(uint32_t baseAddress)
 				//Process CoreSight and "generic IP" blocks
 				case CLASS_CORESIGHT:
 				case CLASS_GENERIC_IP:
-					ProcessDebugBlock(address, id_base, idr);
+					ProcessDebugBlock(address, memtype, idr);
 					break;
 
 				//Additional ROM table
@@ -359,12 +1279,14 @@ void ARMDebugMemAccessPort::LoadROMTable(uint32_t baseAddress)
 }
 
 /**
-	@brief Reads the ROM table for a debug block to figure out what's going on
+	@brief Creates the device object for a debug block, given the ID registers read from its ROM table entry
+
+	This doesn't access the bus itself (although the constructors of the objects it creates may), so that it can also
+	be used to replay a cached ROM table walk.
  */
-void ARMDebugMemAccessPort::ProcessDebugBlock(uint32_t base_address, uint32_t id_base, ARMDebugPeripheralIDRegister reg)
+void ARMDebugMemAccessPort::ProcessDebugBlock(uint32_t base_address, uint32_t memtype, ARMDebugPeripheralIDRegister reg)
 {
 	//See if the mem is dedicated or not
-	uint32_t memtype = ReadWord(id_base + 0xfcc);
 	m_debugBusIsDedicated = (memtype & 1) ? false : true;
 
 	//TODO: handle legacy ASCII identity code
@@ -375,6 +1297,8 @@ void ARMDebugMemAccessPort::ProcessDebugBlock(uint32_t base_address, uint32_t id
 			"");
 	}
 
+	m_romComponents.push_back(RomComponent(base_address, memtype, reg));
+
 	unsigned int blockcount = (1 << reg.bits.log_4k_blocks);
 	LogTrace("Found debug component at %08x (rev %u.%u.%u, %u 4KB pages)\n",
 		base_address, reg.bits.revnum, reg.bits.cust_mod, reg.bits.revand, blockcount);
@@ -85,6 +85,7 @@ union ARMDebugMemAPControlStatusWord
 } __attribute__ ((packed));
 
 #include "ARMDebugPeripheralIDRegister.h"
+#include "DebuggerInterface.h"
 
 class ARMDebugAccessPort;
 class ARMAPBDevice;
@@ -106,13 +107,6 @@ public:
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Memory access
 
-	uint32_t ReadWord(uint32_t addr);
-
-	void WriteWord(uint32_t addr, uint32_t value);
-
-	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	// General device info
-
 	enum AccessSize
 	{
 		ACCESS_BYTE		= 0,
@@ -121,6 +115,59 @@ public:
 		ACCESS_INVALID	= 3,
 	};
 
+	uint32_t ReadWord(uint32_t addr);
+	uint16_t ReadHalfword(uint32_t addr);
+	uint8_t ReadByte(uint32_t addr);
+
+	void WriteWord(uint32_t addr, uint32_t value);
+	void WriteHalfword(uint32_t addr, uint16_t value);
+	void WriteByte(uint32_t addr, uint8_t value);
+
+	void ReadBlock(uint32_t addr, uint32_t* data, size_t count);
+	void ReadScattered(const uint32_t* addrs, uint32_t* data, size_t count);
+	void TransferBatch(std::vector<DebuggerInterface::MemoryTransfer>& transfers);
+	void WriteBlock(uint32_t addr, const uint32_t* data, size_t count);
+
+	void ReadBytes(uint32_t addr, uint8_t* data, size_t len, AccessSize maxSize = ACCESS_WORD);
+	void WriteBytes(uint32_t addr, const uint8_t* data, size_t len, AccessSize maxSize = ACCESS_WORD);
+
+	/**
+		@brief A single access to one of the four banked data registers (see BankedBatch())
+	 */
+	struct BankedAccess
+	{
+		BankedAccess(uint32_t o, bool w, uint32_t v = 0)
+		: offset(o)
+		, write(w)
+		, value(v)
+		{}
+
+		///Offset of the word from the 16-byte aligned base (0x0, 0x4, 0x8 or 0xc)
+		uint32_t offset;
+
+		///True for a write, false for a read
+		bool write;
+
+		///Data to write, or the data read back once the batch has executed
+		uint32_t value;
+	};
+
+	void BankedBatch(uint32_t base, std::vector<BankedAccess>& accesses);
+
+	bool PollWord(
+		uint32_t addr,
+		uint32_t mask,
+		uint32_t match,
+		unsigned int timeout_us,
+		uint32_t& value,
+		const std::vector< std::pair<uint32_t, uint32_t> >& writes = std::vector< std::pair<uint32_t, uint32_t> >());
+
+	bool IsNarrowAccessSupported();
+	bool IsPackedTransferSupported();
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// General device info
+
 	//ADI spec table 9-3
 	enum ComponentClass
 	{
@@ -133,7 +180,8 @@ public:
 
 	virtual std::string GetDescription();
 
-	ARMDebugMemAPControlStatusWord GetStatusRegister();
+	ARMDebugMemAPControlStatusWord GetStatusRegister(bool refresh = false);
+	void SetStatusRegister(ARMDebugMemAPControlStatusWord csw);
 
 	virtual bool IsEnabled();
 
@@ -146,12 +194,58 @@ public:
 	ARMAPBDevice* GetDevice(size_t i)
 	{ return m_debugDevices[i]; }
 
+	/**
+		@brief A debug component found while walking the ROM table
+
+		This is everything ProcessDebugBlock() needs, so a cached list of these can be replayed to rebuild the device
+		objects without touching the bus.
+	 */
+	struct RomComponent
+	{
+		RomComponent(uint32_t a, uint32_t m, ARMDebugPeripheralIDRegister i)
+		: address(a)
+		, memtype(m)
+		, idreg(i)
+		{}
+
+		///Address of the first 4 KB page of the component
+		uint32_t address;
+
+		///Contents of the word at 0xFCC in the component's last page
+		uint32_t memtype;
+
+		///Peripheral ID
+		ARMDebugPeripheralIDRegister idreg;
+	};
+
+	static void ClearTopologyCache();
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Register caching
+
+	virtual void InvalidateCache();
+
+	///Forgets the shadow copy of TAR (for use when something else moved it)
+	void InvalidateAddress()
+	{ m_tarValid = false; }
+
 protected:
 
+	void UpdateCachedAddress(uint32_t addr);
+	void SetTransferMode(AccessSize size, unsigned int increment);
+	void ProbeTransferModes();
+
+	uint32_t ReadSingle(uint32_t addr, AccessSize size);
+	void WriteSingle(uint32_t addr, AccessSize size, uint32_t value);
+	void ReadPacked(uint32_t addr, uint8_t* data, size_t len, AccessSize size);
+	void WritePacked(uint32_t addr, const uint8_t* data, size_t len, AccessSize size);
+	void ReadNarrowBlock(uint32_t addr, uint8_t* data, size_t len, AccessSize size);
+	void WriteNarrowBlock(uint32_t addr, const uint8_t* data, size_t len, AccessSize size);
+
 	void FindRootRomTable();
 	void LoadROMTable(uint32_t baseAddress);
 
-	void ProcessDebugBlock(uint32_t base_address, uint32_t id_base, ARMDebugPeripheralIDRegister reg);
+	void ProcessDebugBlock(uint32_t base_address, uint32_t memtype, ARMDebugPeripheralIDRegister reg);
 
 	bool m_debugBusIsDedicated;
 	bool m_hasDebugRom;
@@ -159,6 +253,30 @@ protected:
 
 	///The list of devices found on the AP
 	std::vector<ARMAPBDevice*> m_debugDevices;
+
+	///The components found on the AP, in discovery order (see RomComponent)
+	std::vector<RomComponent> m_romComponents;
+
+	///True if m_csw holds the current contents of the CSW register
+	bool m_cswValid;
+
+	///Shadow copy of the CSW register
+	ARMDebugMemAPControlStatusWord m_csw;
+
+	///True if m_tar holds the current contents of the TAR register
+	bool m_tarValid;
+
+	///Shadow copy of the TAR register
+	uint32_t m_tar;
+
+	///True once we've checked which CSW sizes and increment modes the AP implements
+	bool m_modesProbed;
+
+	///True if the AP can do byte and halfword accesses (ADIv5 only requires word accesses)
+	bool m_narrowSupported;
+
+	///True if the AP can pack several narrow accesses into one DRW transfer
+	bool m_packedSupported;
 };
 
 #endif
@@ -29,6 +29,14 @@
 
 #include "jtaghal.h"
 
+using namespace std;
+
+///Number of reads in the first batch of a MemAPPoll()
+#define MEMAP_POLL_FIRST_DEPTH 4
+
+///Maximum number of reads per batch in MemAPPoll()
+#define MEMAP_POLL_MAX_DEPTH 64
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -42,3 +50,251 @@ ARMDebugPort::~ARMDebugPort()
 		delete x.second;
 	m_aps.clear();
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Batched operations
+
+/**
+	@brief Executes a batch of AP register accesses, in order
+
+	@param batch		The accesses to perform. Read data is written back to the "value" field of each read.
+ */
+void ARMDebugPort::APRegisterBatch(std::vector<APTransaction>& batch)
+{
+	for(auto& t : batch)
+	{
+		if(t.write)
+			APRegisterWrite(t.ap, t.addr, t.value);
+		else
+			t.value = APRegisterRead(t.ap, t.addr);
+	}
+}
+
+/**
+	@brief Executes a batch of accesses to a MEM-AP, starting it over if the debug port fails partway through
+
+	Debug ports that can tell how far a failed batch got (e.g. a JTAG-DP burst that stalled on WAIT) pick it up from
+	there themselves, so a batch only fails here if we have no idea which of its accesses ran. TAR may have moved, so
+	it's only safe to run the batch again from a known TAR, and only if running an access twice is harmless. That's
+	the case when the only writes are to TAR and CSW: the retry is done one transaction at a time, which waits out WAIT
+	responses and reports errors against the access that caused them. Reads of FIFOs and the like would still lose
+	data, but there's nothing better we can do. A batch that writes data is never replayed, since that could repeat a
+	write that already happened (e.g. to a FIFO or a flash programming register).
+
+	@param ap			The number of the MEM-AP the batch accesses
+	@param batch		The accesses to perform (see APRegisterBatch())
+	@param tar			Address the batch expects TAR to hold when it starts
+ */
+void ARMDebugPort::MemAPBatch(uint8_t ap, vector<APTransaction>& batch, uint32_t tar)
+{
+	try
+	{
+		APRegisterBatch(batch);
+		return;
+	}
+	catch(const JtagException& e)
+	{
+		InvalidateAPAddress(ap);
+		for(auto& t : batch)
+		{
+			if(t.write && (t.addr != REG_MEM_TAR) && (t.addr != REG_MEM_CSW) )
+				throw;
+		}
+		LogDebug("Mem-AP batch failed, retrying one transaction at a time\n");
+	}
+
+	bool writesTar = !batch.empty() && batch[0].write && (batch[0].ap == ap) && (batch[0].addr == REG_MEM_TAR);
+	if(!writesTar)
+		APRegisterWrite(ap, REG_MEM_TAR, tar);
+	ARMDebugPort::APRegisterBatch(batch);
+}
+
+/**
+	@brief Reads a block of 32-bit words through a MEM-AP
+
+	The caller must have configured CSW so that each DRW transfer moves one 32-bit word and advances TAR by four
+	bytes: either 32-bit accesses with single increment, or narrower accesses in packed mode. TAR is written once per 1 KB block,
+	since auto-increment is only guaranteed to work within that range (ADIv5 7.2.2), and each block is sent to
+	APRegisterBatch() in one go so that it can be pipelined.
+
+	@param ap			The number of the MEM-AP to use
+	@param addr			Address of the first word
+	@param data			Output buffer
+	@param count		Number of words to read
+ */
+void ARMDebugPort::MemAPReadBlock(uint8_t ap, uint32_t addr, uint32_t* data, size_t count)
+{
+	//TAR is about to move behind the Mem-AP's back
+	InvalidateAPAddress(ap);
+
+	vector<APTransaction> batch;
+	size_t i = 0;
+	while(i < count)
+	{
+		//Read up to the end of the current 1 KB block
+		uint32_t waddr = addr + i*4;
+		size_t n = min(count - i, (size_t)(0x400 - (waddr & 0x3ff)) / 4);
+
+		batch.clear();
+		batch.push_back(APTransaction(ap, REG_MEM_TAR, true, waddr));
+		for(size_t j=0; j<n; j++)
+			batch.push_back(APTransaction(ap, REG_MEM_DRW, false));
+		MemAPBatch(ap, batch, waddr);
+
+		for(size_t j=0; j<n; j++)
+			data[i+j] = batch[j+1].value;
+		i += n;
+	}
+}
+
+/**
+	@brief Writes a block of 32-bit words through a MEM-AP (see MemAPReadBlock())
+
+	@param ap			The number of the MEM-AP to use
+	@param addr			Address of the first word
+	@param data			Data to write
+	@param count		Number of words to write
+ */
+void ARMDebugPort::MemAPWriteBlock(uint8_t ap, uint32_t addr, const uint32_t* data, size_t count)
+{
+	InvalidateAPAddress(ap);
+
+	vector<APTransaction> batch;
+	size_t i = 0;
+	while(i < count)
+	{
+		uint32_t waddr = addr + i*4;
+		size_t n = min(count - i, (size_t)(0x400 - (waddr & 0x3ff)) / 4);
+
+		batch.clear();
+		batch.push_back(APTransaction(ap, REG_MEM_TAR, true, waddr));
+		for(size_t j=0; j<n; j++)
+			batch.push_back(APTransaction(ap, REG_MEM_DRW, true, data[i+j]));
+		MemAPBatch(ap, batch, waddr);
+
+		i += n;
+	}
+}
+
+/**
+	@brief Polls a word of memory through a MEM-AP until (value & mask) == match
+
+	TAR is pointed at the word's 16-byte block once, and the word is then read through the matching banked data
+	register, several times per batch. Each batch is twice as deep as the last (up to MEMAP_POLL_MAX_DEPTH reads), so
+	a condition that is met quickly only costs a round trip or two, while a slow one doesn't flood the adapter with
+	tiny batches. The caller must have set CSW up for 32-bit accesses.
+
+	@param ap			The number of the MEM-AP to use
+	@param addr			Address of the word to poll
+	@param mask			Bits of the word to check
+	@param match		Expected value of the masked bits
+	@param timeout_us	Give up after this many microseconds
+	@param value		The last value read
+
+	@return True if the condition was met, false on timeout
+ */
+bool ARMDebugPort::MemAPPoll(
+	uint8_t ap,
+	uint32_t addr,
+	uint32_t mask,
+	uint32_t match,
+	unsigned int timeout_us,
+	uint32_t& value)
+{
+	double deadline = GetTime() + timeout_us * 1e-6;
+	InvalidateAPAddress(ap);
+
+	auto reg = static_cast<ApReg>(REG_MEM_BD0 + (addr & 0xc));
+	vector<APTransaction> batch;
+	batch.push_back(APTransaction(ap, REG_MEM_TAR, true, addr & ~0xf));
+	size_t depth = MEMAP_POLL_FIRST_DEPTH;
+	while(true)
+	{
+		size_t first = batch.size();
+		for(size_t i=0; i<depth; i++)
+			batch.push_back(APTransaction(ap, reg, false));
+		MemAPBatch(ap, batch, addr & ~0xf);
+
+		for(size_t i=first; i<batch.size(); i++)
+		{
+			value = batch[i].value;
+			if( (value & mask) == match)
+				return true;
+		}
+		if(GetTime() > deadline)
+			return false;
+
+		batch.clear();
+		if(depth < MEMAP_POLL_MAX_DEPTH)
+			depth *= 2;
+		else
+			usleep(100);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory caching
+
+/**
+	@brief Turns on memory caching, with the device and peripheral regions of the ARM default memory map excluded
+
+	See ARMv7-M arch manual B3.1 table B3-1. Targets with peripherals elsewhere should add those regions to the cache
+	themselves.
+ */
+void ARMDebugPort::EnableMemoryCache(bool writeBack)
+{
+	DebuggerInterface::EnableMemoryCache(writeBack);
+
+	//Peripheral
+	m_memoryCache->AddUncacheableRegion(0x40000000, 0x20000000);
+
+	//External device, private peripheral bus, vendor system region
+	m_memoryCache->AddUncacheableRegion(0xa0000000, 0x60000000);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shadow register bookkeeping
+
+/**
+	@brief Called before relying on any shadow copy of DP or AP registers
+
+	No-op by default. Debug ports on a shared adapter drop their shadows here if another client may have used the DAP
+	since we last did (see JtagInterface::CheckDeviceCaches()).
+ */
+void ARMDebugPort::CheckDeviceCaches()
+{
+}
+
+/**
+	@brief Discards cached register state for every AP (e.g. after an abort)
+ */
+void ARMDebugPort::InvalidateAPCache()
+{
+	for(auto x : m_aps)
+		x.second->InvalidateCache();
+}
+
+/**
+	@brief Discards the cached TAR value for a Mem-AP
+
+	Must be called by anything that moves TAR without going through the Mem-AP object itself.
+ */
+void ARMDebugPort::InvalidateAPAddress(uint8_t ap)
+{
+	auto memap = GetMemAP(ap);
+	if(memap)
+		memap->InvalidateAddress();
+}
+
+/**
+	@brief Gets the Mem-AP with a given index
+
+	@return The AP, or NULL if there is no such AP or it's not a Mem-AP
+ */
+ARMDebugMemAccessPort* ARMDebugPort::GetMemAP(uint8_t ap)
+{
+	auto it = m_aps.find(ap);
+	if(it == m_aps.end())
+		return NULL;
+	return dynamic_cast<ARMDebugMemAccessPort*>(it->second);
+}
@@ -54,6 +54,11 @@ public:
 
 	virtual void PrintStatusRegister() =0;
 
+	virtual void EnableMemoryCache(bool writeBack = false);
+
+	///Gets the ID code of the debug port itself (used to recognize the chip when caching discovery results)
+	virtual uint32_t GetDebugPortID() =0;
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Debug register access via APB
 
@@ -86,6 +91,10 @@ public:
 		REG_MEM_TAR		= 0x04,	//Transfer address register
 
 		REG_MEM_DRW		= 0x0C,	//Data read/write
+		REG_MEM_BD0		= 0x10,	//Banked data 0-3 (read/write the four words at TAR[31:4], without moving TAR)
+		REG_MEM_BD1		= 0x14,
+		REG_MEM_BD2		= 0x18,
+		REG_MEM_BD3		= 0x1C,
 		REG_MEM_BASE	= 0xF8,	//Location of debug ROM
 
 		REG_IDR			= 0xFC	//ID code
@@ -103,6 +112,53 @@ protected:
 	virtual uint32_t APRegisterRead(uint8_t ap, ApReg addr) =0;
 	virtual void APRegisterWrite(uint8_t ap, ApReg addr, uint32_t wdata) =0;
 
+public:
+	/**
+		@brief A single AP register access, queued as part of a batch (see APRegisterBatch())
+	 */
+	struct APTransaction
+	{
+		APTransaction(uint8_t a, ApReg r, bool w, uint32_t v = 0)
+		: ap(a)
+		, addr(r)
+		, write(w)
+		, value(v)
+		{}
+
+		///The AP to access
+		uint8_t		ap;
+
+		///The AP register to access
+		ApReg		addr;
+
+		///True for a write, false for a read
+		bool		write;
+
+		///Data to write, or the data read back once the batch has executed
+		uint32_t	value;
+	};
+
+protected:
+	//Batched operations. The default implementations are simple loops around the single-register accessors above;
+	//debug ports with a smarter transport (e.g. a remote jtagd) may override them to save round trips.
+	virtual void APRegisterBatch(std::vector<APTransaction>& batch);
+	void MemAPBatch(uint8_t ap, std::vector<APTransaction>& batch, uint32_t tar);
+	virtual void MemAPReadBlock(uint8_t ap, uint32_t addr, uint32_t* data, size_t count);
+	virtual void MemAPWriteBlock(uint8_t ap, uint32_t addr, const uint32_t* data, size_t count);
+	virtual bool MemAPPoll(
+		uint8_t ap,
+		uint32_t addr,
+		uint32_t mask,
+		uint32_t match,
+		unsigned int timeout_us,
+		uint32_t& value);
+
+	//Shadow register bookkeeping
+	virtual void CheckDeviceCaches();
+	void InvalidateAPCache();
+	void InvalidateAPAddress(uint8_t ap);
+	ARMDebugMemAccessPort* GetMemAP(uint8_t ap);
+
 protected:
 
 	///Access ports
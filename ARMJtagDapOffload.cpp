@@ -0,0 +1,501 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ARMJtagDapOffload
+ */
+
+#include "jtaghal.h"
+#include "ARMJtagDapOffload.h"
+#include "ProtobufHelpers.h"
+
+using namespace std;
+
+///Longest a MemPoll operation may tie up the server, in microseconds. Longer polls are re-issued by the client.
+#define MEMPOLL_SLICE_US	2000
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+ARMJtagDapOffload::ARMJtagDapOffload(JtagInterface* iface)
+	: m_iface(iface)
+	, m_irLength(4)
+	, m_irLeadingBits(0)
+	, m_irTrailingBits(0)
+	, m_drLeadingBits(0)
+	, m_drTrailingBits(0)
+	, m_cachedIR(-1)
+	, m_cachedSelect(-1)
+{
+}
+
+ARMJtagDapOffload::~ARMJtagDapOffload()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Request processing
+
+/**
+	@brief Executes a batch of DAP operations and fills out the reply
+
+	Operations are run in order. If one fails, the DAP is aborted, the error is reported in the reply, and the rest of
+	the batch is skipped. The reply only has results for the operations before the one that failed. This function does
+	not throw.
+ */
+void ARMJtagDapOffload::Execute(const ArmDapRequest& req, ArmDapReply& reply)
+{
+	reply.Clear();
+
+	auto& pos = req.position();
+	m_irLength = pos.irlength();
+	m_irLeadingBits = pos.irleadingbits();
+	m_irTrailingBits = pos.irtrailingbits();
+	m_drLeadingBits = pos.drleadingbits();
+	m_drTrailingBits = pos.drtrailingbits();
+
+	//The client may have touched the chain with raw scans since the last batch, so forget everything we knew
+	m_cachedIR = -1;
+	m_cachedSelect = -1;
+
+	int i = 0;
+	try
+	{
+		for(; i<req.ops_size(); i++)
+		{
+			auto& op = req.ops(i);
+			uint8_t ap = op.ap();
+			ArmDapResult result;
+
+			switch(op.type())
+			{
+				//Consecutive AP accesses are pipelined, and add their own results
+				case ArmDapOperation::ApRead:
+				case ArmDapOperation::ApWrite:
+					i = APAccessRun(req, i, reply);
+					continue;
+
+				case ArmDapOperation::MemReadBlock:
+					{
+						CheckBlockSize(op.count());
+						vector<uint32_t> data(op.count());
+						if(!data.empty())
+						{
+							MemReadBlock(ap, op.address(), &data[0], data.size());
+
+							//Words are little-endian on the wire, whatever either end's byte order is
+							string* wire = result.mutable_data();
+							wire->resize(data.size() * 4);
+							for(size_t j=0; j<data.size(); j++)
+							{
+								for(size_t k=0; k<4; k++)
+									(*wire)[j*4 + k] = (data[j] >> (k*8)) & 0xff;
+							}
+						}
+					}
+					break;
+
+				case ArmDapOperation::MemWriteBlock:
+					{
+						size_t count = op.data().size() / 4;
+						CheckBlockSize(count);
+						vector<uint32_t> data(count);
+						if(count)
+						{
+							auto p = reinterpret_cast<const uint8_t*>(op.data().data());
+							for(size_t j=0; j<count; j++)
+							{
+								data[j] = p[j*4] | (p[j*4 + 1] << 8) | (p[j*4 + 2] << 16) |
+									((uint32_t)p[j*4 + 3] << 24);
+							}
+							MemWriteBlock(ap, op.address(), &data[0], count);
+						}
+					}
+					break;
+
+				case ArmDapOperation::MemPoll:
+					{
+						uint32_t value = 0;
+						result.set_matched(MemPoll(ap, op.address(), op.mask(), op.match(), op.timeoutus(), value));
+						result.set_value(value);
+					}
+					break;
+
+				default:
+					throw JtagExceptionWrapper(
+						"Unrecognized DAP operation",
+						"");
+			}
+
+			//Make sure the operation actually completed before we report it
+			CheckStatus();
+
+			*reply.add_results() = result;
+		}
+
+		reply.set_ok(true);
+	}
+	catch(const JtagException& e)
+	{
+		//A pipelined run of AP accesses only checks for errors at the end, so we can't tell which of them failed.
+		//Report the whole run as failed, and drop whatever results it added.
+		while(reply.results_size() > i)
+			reply.mutable_results()->RemoveLast();
+
+		reply.set_ok(false);
+		reply.set_failedop(i);
+		reply.set_error(e.GetDescription());
+
+		Abort();
+	}
+}
+
+/**
+	@brief Makes sure a block transfer is no bigger than we're willing to run in one go (see DAP_MAX_BLOCK_WORDS)
+
+	@throw JtagException if it's too big
+ */
+void ARMJtagDapOffload::CheckBlockSize(size_t count)
+{
+	if(count <= DAP_MAX_BLOCK_WORDS)
+		return;
+
+	throw JtagExceptionWrapper(
+		"DAP block transfer too big",
+		"");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Low level DP/AP access
+
+/**
+	@brief Loads an instruction into the DAP, with all other TAPs in BYPASS
+ */
+void ARMJtagDapOffload::SetIR(uint8_t irval)
+{
+	if(m_cachedIR == irval)
+		return;
+
+	size_t total = m_irLeadingBits + m_irLength + m_irTrailingBits;
+	vector<uint8_t> txd((total + 7) / 8, 0xff);
+	for(size_t i=0; i<m_irLength; i++)
+		PokeBit(&txd[0], m_irLeadingBits + i, PeekBit(&irval, i));
+
+	m_iface->EnterShiftIR();
+	m_iface->ShiftData(true, &txd[0], NULL, total);
+	m_iface->LeaveExit1IR();
+
+	m_cachedIR = irval;
+}
+
+/**
+	@brief Does a single 35-bit DPACC/APACC scan
+
+	@param addr_flags	A[3:2] and RnW
+	@param wdata		Data to write
+	@param rdata		Data captured by the scan (result of the previous read)
+
+	@return The ACK field
+ */
+uint8_t ARMJtagDapOffload::ScanDR(uint8_t addr_flags, uint32_t wdata, uint32_t& rdata)
+{
+	size_t total = m_drLeadingBits + 35 + m_drTrailingBits;
+	vector<uint8_t> txd((total + 7) / 8, 0x00);
+	vector<uint8_t> rxd(txd.size(), 0x00);
+	for(int i=0; i<3; i++)
+		PokeBit(&txd[0], m_drLeadingBits + i, PeekBit(&addr_flags, i));
+	for(int i=0; i<32; i++)
+		PokeBit(&txd[0], m_drLeadingBits + 3 + i, PeekBit((uint8_t*)&wdata, i));
+
+	m_iface->EnterShiftDR();
+	m_iface->ShiftData(true, &txd[0], &rxd[0], total);
+	m_iface->LeaveExit1DR();
+
+	uint8_t ack = 0;
+	for(int i=0; i<3; i++)
+		PokeBit(&ack, i, PeekBit(&rxd[0], m_drLeadingBits + i));
+	rdata = 0;
+	for(int i=0; i<32; i++)
+		PokeBit((uint8_t*)&rdata, i, PeekBit(&rxd[0], m_drLeadingBits + 3 + i));
+	return ack;
+}
+
+/**
+	@brief Posts a DPACC or APACC transaction, retrying as long as the DAP responds with WAIT
+
+	@return The data captured by the accepted scan (the result of the previous read, if any)
+ */
+uint32_t ARMJtagDapOffload::Post(uint8_t irval, uint8_t addr_flags, uint32_t wdata)
+{
+	SetIR(irval);
+
+	uint32_t rdata = 0;
+	for(int i=0; i<50; i++)
+	{
+		if(ScanDR(addr_flags, wdata, rdata) != ARMJtagDebugPort::WAIT)
+			return rdata;
+		if(i >= 1)
+			usleep(100);
+	}
+
+	throw JtagExceptionWrapper(
+		"DAP transaction still waiting after way too long",
+		"");
+}
+
+uint32_t ARMJtagDapOffload::DPRegisterRead(ARMDebugPort::DpReg addr)
+{
+	Post(ARMJtagDebugPort::INST_DPACC, (addr << 1) | ARMJtagDebugPort::OP_READ);
+	return Post(ARMJtagDebugPort::INST_DPACC, (ARMDebugPort::REG_RDBUFF << 1) | ARMJtagDebugPort::OP_READ);
+}
+
+void ARMJtagDapOffload::DPRegisterWrite(ARMDebugPort::DpReg addr, uint32_t wdata)
+{
+	Post(ARMJtagDebugPort::INST_DPACC, (addr << 1) | ARMJtagDebugPort::OP_WRITE, wdata);
+}
+
+/**
+	@brief Points SELECT at the requested AP and register bank, if it isn't already
+ */
+void ARMJtagDapOffload::SelectAP(uint8_t ap, uint32_t addr)
+{
+	uint32_t select = (ap << 24) | (addr & 0xf0);
+	if(m_cachedSelect == select)
+		return;
+
+	DPRegisterWrite(ARMDebugPort::REG_AP_SELECT, select);
+	m_cachedSelect = select;
+}
+
+/**
+	@brief Posts an AP read. The result is returned by the NEXT transaction posted.
+
+	@return Data captured by this scan (the result of the previous read, if any)
+ */
+uint32_t ARMJtagDapOffload::PostAPRead(uint8_t ap, uint32_t addr)
+{
+	SelectAP(ap, addr);
+	return Post(ARMJtagDebugPort::INST_APACC, ((addr & 0x0c) >> 1) | ARMJtagDebugPort::OP_READ);
+}
+
+/**
+	@brief Posts an AP write
+
+	@return Data captured by this scan (the result of the previous read, if any)
+ */
+uint32_t ARMJtagDapOffload::PostAPWrite(uint8_t ap, uint32_t addr, uint32_t wdata)
+{
+	SelectAP(ap, addr);
+	return Post(ARMJtagDebugPort::INST_APACC, ((addr & 0x0c) >> 1) | ARMJtagDebugPort::OP_WRITE, wdata);
+}
+
+/**
+	@brief Checks CTRL/STAT for errors (the caller is responsible for aborting and clearing them, see Abort())
+
+	@throw JtagException if the sticky error bit was set
+ */
+void ARMJtagDapOffload::CheckStatus()
+{
+	ARMJtagDebugPortStatusRegister stat;
+	stat.word = DPRegisterRead(ARMDebugPort::REG_CTRL_STAT);
+	if(!stat.bits.sticky_err)
+		return;
+
+	throw JtagExceptionWrapper(
+		"DAP transaction failed (sticky error bit set)",
+		"");
+}
+
+/**
+	@brief Aborts the AP transaction in progress and clears any sticky errors after a failed operation
+
+	Whatever failed (a fault, or an AP that kept answering WAIT) may still be holding up the DAP, so we write DAPABORT
+	to the ABORT register before the next request gets a go. This is best effort and does not throw: if the adapter
+	itself is what failed there's nothing more we can do, and the original error has already been reported.
+ */
+void ARMJtagDapOffload::Abort()
+{
+	//We no longer know what state the DAP is in
+	m_cachedIR = -1;
+	m_cachedSelect = -1;
+
+	try
+	{
+		uint32_t unused;
+		SetIR(ARMJtagDebugPort::INST_ABORT);
+		ScanDR(0, 1, unused);
+
+		//Clear the sticky error bit, if set
+		ARMJtagDebugPortStatusRegister stat;
+		stat.word = DPRegisterRead(ARMDebugPort::REG_CTRL_STAT);
+		if(stat.bits.sticky_err)
+			DPRegisterWrite(ARMDebugPort::REG_CTRL_STAT, stat.word);
+	}
+	catch(const JtagException& e)
+	{
+		LogWarning("Failed to abort DAP after a failed operation: %s\n", e.GetDescription().c_str());
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Operation handlers
+
+/**
+	@brief Executes a run of consecutive AP register accesses, starting at the given operation
+
+	Every scan returns the result of the read before it, so the accesses are posted back to back, the last read is
+	collected from RDBUFF, and CTRL/STAT is only checked once at the end of the run. Moving SELECT to a different AP or
+	register bank is a DP write, which would swallow the result of a pending read, so that is collected first.
+
+	@return Index of the last operation in the run
+ */
+int ARMJtagDapOffload::APAccessRun(const ArmDapRequest& req, int first, ArmDapReply& reply)
+{
+	int pending = -1;
+	int i = first;
+	for(; i<req.ops_size(); i++)
+	{
+		auto& op = req.ops(i);
+		bool read = (op.type() == ArmDapOperation::ApRead);
+		if(!read && (op.type() != ArmDapOperation::ApWrite) )
+			break;
+
+		reply.add_results();
+		int64_t select = (op.ap() << 24) | (op.reg() & 0xf0);
+		if( (pending >= 0) && (m_cachedSelect != select) )
+		{
+			reply.mutable_results(pending)->set_value(
+				Post(ARMJtagDebugPort::INST_DPACC, (ARMDebugPort::REG_RDBUFF << 1) | ARMJtagDebugPort::OP_READ));
+			pending = -1;
+		}
+
+		uint32_t rdata;
+		if(read)
+			rdata = PostAPRead(op.ap(), op.reg());
+		else
+			rdata = PostAPWrite(op.ap(), op.reg(), op.value());
+		if(pending >= 0)
+			reply.mutable_results(pending)->set_value(rdata);
+		pending = read ? (reply.results_size() - 1) : -1;
+	}
+
+	if(pending >= 0)
+	{
+		reply.mutable_results(pending)->set_value(
+			Post(ARMJtagDebugPort::INST_DPACC, (ARMDebugPort::REG_RDBUFF << 1) | ARMJtagDebugPort::OP_READ));
+	}
+
+	//Make sure the whole run actually completed before we report it
+	CheckStatus();
+
+	return i - 1;
+}
+
+/**
+	@brief Reads a block of words using TAR auto-increment
+
+	Every scan returns the result of the read before it, so the reads are posted back to back and the last one is
+	collected from RDBUFF. TAR is re-seeded at each 1 KB boundary since auto-increment is only guaranteed to work
+	within that range (ADIv5 7.2.2).
+ */
+void ARMJtagDapOffload::MemReadBlock(uint8_t ap, uint32_t addr, uint32_t* data, size_t count)
+{
+	if(count == 0)
+		return;
+
+	ssize_t pending = -1;
+	for(size_t i=0; i<count; i++)
+	{
+		uint32_t waddr = addr + i*4;
+		if( (i == 0) || ((waddr & 0x3ff) == 0) )
+		{
+			uint32_t rdata = PostAPWrite(ap, ARMDebugPort::REG_MEM_TAR, waddr);
+			if(pending >= 0)
+				data[pending] = rdata;
+			pending = -1;
+		}
+
+		uint32_t rdata = PostAPRead(ap, ARMDebugPort::REG_MEM_DRW);
+		if(pending >= 0)
+			data[pending] = rdata;
+		pending = i;
+	}
+
+	data[pending] = Post(ARMJtagDebugPort::INST_DPACC, (ARMDebugPort::REG_RDBUFF << 1) | ARMJtagDebugPort::OP_READ);
+}
+
+/**
+	@brief Writes a block of words using TAR auto-increment (see MemReadBlock())
+ */
+void ARMJtagDapOffload::MemWriteBlock(uint8_t ap, uint32_t addr, const uint32_t* data, size_t count)
+{
+	for(size_t i=0; i<count; i++)
+	{
+		uint32_t waddr = addr + i*4;
+		if( (i == 0) || ((waddr & 0x3ff) == 0) )
+			PostAPWrite(ap, ARMDebugPort::REG_MEM_TAR, waddr);
+		PostAPWrite(ap, ARMDebugPort::REG_MEM_DRW, data[i]);
+	}
+}
+
+/**
+	@brief Polls a word until (value & mask) == match
+
+	TAR is pointed at the word's 16-byte block once, and the word is then read through the matching banked data
+	register. Each result is collected from RDBUFF rather than by starting another read, so the word is never read
+	more times than we look at it (it may be a register with read side effects).
+
+	The server is single threaded, so the poll gives up after MEMPOLL_SLICE_US even if the client allowed longer. The
+	client sees that as a miss and sends the poll again if it still has time left, and in between the server gets back
+	to its event loop to service everybody else.
+ */
+bool ARMJtagDapOffload::MemPoll(
+	uint8_t ap,
+	uint32_t addr,
+	uint32_t mask,
+	uint32_t match,
+	unsigned int timeout_us,
+	uint32_t& value)
+{
+	double deadline = GetTime() + min(timeout_us, (unsigned int)MEMPOLL_SLICE_US) * 1e-6;
+	uint32_t reg = ARMDebugPort::REG_MEM_BD0 + (addr & 0xc);
+
+	PostAPWrite(ap, ARMDebugPort::REG_MEM_TAR, addr & ~0xf);
+	while(true)
+	{
+		PostAPRead(ap, reg);
+		value = Post(ARMJtagDebugPort::INST_DPACC, (ARMDebugPort::REG_RDBUFF << 1) | ARMJtagDebugPort::OP_READ);
+		if( (value & mask) == match)
+			return true;
+		if(GetTime() > deadline)
+			return false;
+	}
+}
@@ -0,0 +1,120 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ARMJtagDapOffload
+ */
+
+#ifndef ARMJtagDapOffload_h
+#define ARMJtagDapOffload_h
+
+class ArmDapRequest;
+class ArmDapReply;
+
+///Largest MemReadBlock / MemWriteBlock the server will run in one operation, in 32-bit words. Bigger transfers are
+///split up by the client, so that one client's block can't tie up the server (or its memory) for long.
+#define DAP_MAX_BLOCK_WORDS	4096
+
+/**
+	@brief Server-side executor for batched ARM JTAG-DP operations (see ArmDapRequest in jtaghal-net.proto)
+
+	A jtagd instance uses this class to run DAP-level work (AP register batches, MEM-AP block transfers, polls) right
+	next to the adapter, so that a remote client pays one network round trip per batch instead of several per word.
+
+	The executor does not need an initialized scan chain; the client supplies the position of the DAP within the chain
+	in each request and all padding is inserted here.
+
+	\ingroup libjtaghal
+ */
+class ARMJtagDapOffload
+{
+public:
+	ARMJtagDapOffload(JtagInterface* iface);
+	virtual ~ARMJtagDapOffload();
+
+	void Execute(const ArmDapRequest& req, ArmDapReply& reply);
+
+protected:
+	void CheckBlockSize(size_t count);
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Low level DP/AP access
+
+	void SetIR(uint8_t irval);
+	uint8_t ScanDR(uint8_t addr_flags, uint32_t wdata, uint32_t& rdata);
+	uint32_t Post(uint8_t irval, uint8_t addr_flags, uint32_t wdata = 0);
+
+	uint32_t DPRegisterRead(ARMDebugPort::DpReg addr);
+	void DPRegisterWrite(ARMDebugPort::DpReg addr, uint32_t wdata);
+
+	void SelectAP(uint8_t ap, uint32_t addr);
+	uint32_t PostAPRead(uint8_t ap, uint32_t addr);
+	uint32_t PostAPWrite(uint8_t ap, uint32_t addr, uint32_t wdata);
+
+	void CheckStatus();
+	void Abort();
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Operation handlers
+
+	int APAccessRun(const ArmDapRequest& req, int first, ArmDapReply& reply);
+	void MemReadBlock(uint8_t ap, uint32_t addr, uint32_t* data, size_t count);
+	void MemWriteBlock(uint8_t ap, uint32_t addr, const uint32_t* data, size_t count);
+	bool MemPoll(uint8_t ap, uint32_t addr, uint32_t mask, uint32_t match, unsigned int timeout_us, uint32_t& value);
+
+protected:
+
+	///The adapter we're driving
+	JtagInterface* m_iface;
+
+	///IR length of the DAP
+	size_t m_irLength;
+
+	///Total IR length of the devices before the DAP
+	size_t m_irLeadingBits;
+
+	///Total IR length of the devices after the DAP
+	size_t m_irTrailingBits;
+
+	///Number of bypassed devices before the DAP
+	size_t m_drLeadingBits;
+
+	///Number of bypassed devices after the DAP
+	size_t m_drTrailingBits;
+
+	///Instruction currently loaded in the DAP (only valid within a single request)
+	int m_cachedIR;
+
+	///Current value of the DP SELECT register (only valid within a single request)
+	int64_t m_cachedSelect;
+};
+
+#endif
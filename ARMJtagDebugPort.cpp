@@ -39,6 +39,9 @@
 
 using namespace std;
 
+///Maximum number of AP transactions to pipeline between sticky error checks (enough for a full 1 KB block plus TAR)
+#define MAX_AP_BURST		384
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -51,10 +54,26 @@ ARMJtagDebugPort::ARMJtagDebugPort(
 	: ARMDevice(idcode, iface, pos, 4)
 	, m_rev(rev)
 	, m_partnum(partnum)
+	, m_selectValid(false)
+	, m_select(0)
 {
 	//No Mem-AP for now
 	m_defaultMemAP 		= NULL;
 	m_defaultRegisterAP	= NULL;
+
+	//Keep both power domains up
+	ARMJtagDebugPortStatusRegister stat;
+	stat.word = 0;
+	stat.bits.sys_pwrup_req = 1;
+	stat.bits.debug_pwrup_req = 1;
+	m_ctrlStat = stat.word;
+
+	//If we're talking to a jtagd that can run DAP transactions next to the adapter, let it do the work
+	m_remote = dynamic_cast<NetworkedJtagInterface*>(iface);
+	if(m_remote && !m_remote->IsDapOffloadSupported())
+		m_remote = NULL;
+	if(m_remote)
+		LogTrace("Using server-side DAP offload\n");
 }
 
 void ARMJtagDebugPort::PostInitProbes(bool /*quiet*/)
@@ -189,8 +208,58 @@ JtagDevice* ARMJtagDebugPort::CreateDevice(
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Initialization
 
+/**
+	@brief Lets other clients sharing the JTAG adapter have a turn (see TestInterface::ReleaseAdapter())
+ */
+void ARMJtagDebugPort::ReleaseAdapter()
+{
+	m_iface->ReleaseAdapter();
+}
+
+/**
+	@brief Writes back any dirty pages in the target memory cache
+ */
+void ARMJtagDebugPort::FlushCaches()
+{
+	if(m_memoryCache)
+		m_memoryCache->Flush();
+}
+
+/**
+	@brief Discards the cached IR, SELECT, AP shadow registers and clean target memory, since another client may have
+	used the DAP
+
+	Dirty memory cache pages are kept (see FlushCaches()), since writing them back here could happen after the adapter
+	has been handed to someone else.
+
+	Every memory and debug register access starts with JtagInterface::CheckDeviceCaches(), so a networked adapter can
+	call this before we trust any of it again.
+ */
+void ARMJtagDebugPort::InvalidateCaches()
+{
+	JtagDevice::InvalidateCaches();
+	m_selectValid = false;
+	InvalidateAPCache();
+	if(m_memoryCache)
+		m_memoryCache->DiscardClean();
+}
+
+/**
+	@brief Drops the shadow copies of SELECT and the AP registers if another client may have used the DAP
+
+	Has to happen before anything decides to skip a SELECT, CSW or TAR write because of a shadow, and not just when
+	the scans go out (JtagDevice::SetIR() checks too, but by then the batch has already been built).
+ */
+void ARMJtagDebugPort::CheckDeviceCaches()
+{
+	m_iface->CheckDeviceCaches();
+}
+
 void ARMJtagDebugPort::EnableDebugging()
 {
+	//We don't know what anybody else did to the DAP before us
+	m_selectValid = false;
+
 	//Clear any stale errors
 	ARMJtagDebugPortStatusRegister stat = GetStatusRegister();
 	if(stat.bits.sticky_err)
@@ -200,10 +269,7 @@ void ARMJtagDebugPort::EnableDebugging()
 	}
 
 	//Power up the system
-	stat.word = 0;
-	stat.bits.sys_pwrup_req = 1;
-	stat.bits.debug_pwrup_req = 1;
-	DPRegisterWrite(REG_CTRL_STAT, stat.word);
+	DPRegisterWrite(REG_CTRL_STAT, m_ctrlStat);
 
 	//Verify it powered up OK
 	stat = GetStatusRegister();
@@ -224,7 +290,7 @@ void ARMJtagDebugPort::EnableDebugging()
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Memory access
 
-///Read a single 32-bit word of memory (TODO support smaller sizes)
+///Read a single 32-bit word of memory
 uint32_t ARMJtagDebugPort::ReadMemory(uint32_t address)
 {
 	//Sanity check
@@ -235,11 +301,13 @@ uint32_t ARMJtagDebugPort::ReadMemory(uint32_t address)
 			"");
 	}
 
+	m_iface->CheckDeviceCaches();
+
 	//Use the default Mem-AP to read it
 	return m_defaultMemAP->ReadWord(address);
 }
 
-///Writes a single 32-bit word of memory (TODO support smaller sizes)
+///Writes a single 32-bit word of memory
 void ARMJtagDebugPort::WriteMemory(uint32_t address, uint32_t value)
 {
 	//Sanity check
@@ -250,10 +318,171 @@ void ARMJtagDebugPort::WriteMemory(uint32_t address, uint32_t value)
 			"");
 	}
 
+	m_iface->CheckDeviceCaches();
+
 	//Use the default Mem-AP to write it
 	m_defaultMemAP->WriteWord(address, value);
 }
 
+uint16_t ARMJtagDebugPort::ReadMemoryHalfword(uint32_t address)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot read memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	m_iface->CheckDeviceCaches();
+	return m_defaultMemAP->ReadHalfword(address);
+}
+
+uint8_t ARMJtagDebugPort::ReadMemoryByte(uint32_t address)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot read memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	m_iface->CheckDeviceCaches();
+	return m_defaultMemAP->ReadByte(address);
+}
+
+void ARMJtagDebugPort::WriteMemoryHalfword(uint32_t address, uint16_t value)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot write memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	m_iface->CheckDeviceCaches();
+	m_defaultMemAP->WriteHalfword(address, value);
+}
+
+void ARMJtagDebugPort::WriteMemoryByte(uint32_t address, uint8_t value)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot write memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	m_iface->CheckDeviceCaches();
+	m_defaultMemAP->WriteByte(address, value);
+}
+
+void ARMJtagDebugPort::ReadMemoryBlock(uint32_t address, uint32_t* data, size_t count)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot read memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	m_iface->CheckDeviceCaches();
+	m_defaultMemAP->ReadBlock(address, data, count);
+}
+
+void ARMJtagDebugPort::WriteMemoryBlock(uint32_t address, const uint32_t* data, size_t count)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot write memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	m_iface->CheckDeviceCaches();
+	m_defaultMemAP->WriteBlock(address, data, count);
+}
+
+/**
+	@brief Converts an access width in bytes to the matching Mem-AP access size
+ */
+static ARMDebugMemAccessPort::AccessSize WidthToAccessSize(unsigned int width)
+{
+	if(width >= 4)
+		return ARMDebugMemAccessPort::ACCESS_WORD;
+	else if(width >= 2)
+		return ARMDebugMemAccessPort::ACCESS_HALFWORD;
+	return ARMDebugMemAccessPort::ACCESS_BYTE;
+}
+
+void ARMJtagDebugPort::ReadMemoryBytes(uint32_t address, uint8_t* data, size_t len, unsigned int maxWidth)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot read memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	m_iface->CheckDeviceCaches();
+	m_defaultMemAP->ReadBytes(address, data, len, WidthToAccessSize(maxWidth));
+}
+
+void ARMJtagDebugPort::WriteMemoryBytes(uint32_t address, const uint8_t* data, size_t len, unsigned int maxWidth)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot write memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	m_iface->CheckDeviceCaches();
+	m_defaultMemAP->WriteBytes(address, data, len, WidthToAccessSize(maxWidth));
+}
+
+void ARMJtagDebugPort::MemoryBatch(vector<MemoryTransfer>& batch)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot access memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	m_iface->CheckDeviceCaches();
+	m_defaultMemAP->TransferBatch(batch);
+}
+
+/**
+	@brief Reads the same word several times in one batch of AP transactions (one DR scan per read after the first)
+ */
+void ARMJtagDebugPort::ReadMemoryRepeated(uint32_t address, uint32_t* data, size_t count)
+{
+	//Sanity check
+	if(m_defaultMemAP == NULL)
+	{
+		throw JtagExceptionWrapper(
+			"Cannot read memory because there is no AHB MEM-AP",
+			"");
+	}
+
+	if(count == 0)
+		return;
+
+	vector<uint32_t> addrs(count, address);
+	m_iface->CheckDeviceCaches();
+	m_defaultMemAP->ReadScattered(&addrs[0], data, count);
+}
+
 uint32_t ARMJtagDebugPort::ReadDebugRegister(uint32_t address)
 {
 	//Sanity check
@@ -264,6 +493,8 @@ uint32_t ARMJtagDebugPort::ReadDebugRegister(uint32_t address)
 			"");
 	}
 
+	m_iface->CheckDeviceCaches();
+
 	//Use the default Mem-AP to read it
 	return m_defaultRegisterAP->ReadWord(address);
 }
@@ -279,6 +510,8 @@ void ARMJtagDebugPort::WriteDebugRegister(uint32_t address, uint32_t value)
 			"");
 	}
 
+	m_iface->CheckDeviceCaches();
+
 	//Use the default Mem-AP to write it
 	m_defaultRegisterAP->WriteWord(address, value);
 }
@@ -390,11 +623,16 @@ ARMJtagDebugPortStatusRegister ARMJtagDebugPort::GetStatusRegister()
 	return stat;
 }
 
+/**
+	@brief Clears the sticky error and overrun bits, and turns overrun detection back off if a burst left it on
+ */
 void ARMJtagDebugPort::ClearStatusRegisterErrors()
 {
 	ARMJtagDebugPortStatusRegister stat;
 	stat.word = DPRegisterRead(REG_CTRL_STAT);
 	stat.bits.sticky_err = 1;
+	stat.bits.sticky_overrun = 1;
+	stat.bits.sticky_overrun_en = 0;
 	DPRegisterWrite(REG_CTRL_STAT, stat.word);
 }
 
@@ -408,57 +646,24 @@ void ARMJtagDebugPort::ClearStatusRegisterErrors()
  */
 uint32_t ARMJtagDebugPort::APRegisterRead(uint8_t ap, ApReg addr)
 {
-	//Set the high bits of the address as the current bank
-	uint32_t select = (ap << 24) | (addr & 0xf0);
-	DPRegisterWrite(REG_AP_SELECT,  select );
-
-	//Do the read
-	SetIR(INST_APACC);
+	CheckDeviceCaches();
 
-	uint32_t data_out;
-
-	//Poll until we get a good read back
-	int i = 0;
-	int nmax = 50;
-	for(; i<nmax; i++)
+	//Remote server? Let it do the whole transaction in one round trip
+	if(m_remote)
 	{
-		//Send the 3-bit A / RnW field to request the read
-		uint8_t addr_flags = ((addr & 0x0c) >> 1) | OP_READ;
-		uint8_t txd[5] = {0};
-		for(int i=0; i<3; i++)
-			PokeBit(txd, i, PeekBit(&addr_flags, i));
-		uint8_t rxd[5];
-		ScanDR(txd, rxd, 35);
-		uint8_t ack_out = 0;
-		for(int i=0; i<3; i++)
-			PokeBit(&ack_out, i, PeekBit(rxd, i));
-
-		//If we got data, crunch it.
-		//Note that the first poll can never return the data since we haven't even done the read request yet!
-		if((ack_out == OK_OR_FAULT) && (i > 0) )
-		{
-			for(int i=0; i<32; i++)
-				PokeBit((unsigned char*)&data_out, i, PeekBit(rxd, i+3));
-			break;
-		}
-
-		//No go? Try again after a millisecond
-		if(i == 1)
-			LogTrace("No go, trying again after 1 ms\n");
-		if(i >= 1)
-			usleep(1 * 1000);
+		vector<APTransaction> batch(1, APTransaction(ap, addr, false));
+		m_remote->DapAPRegisterBatch(m_pos, batch);
+		return batch[0].value;
 	}
-	if(i > 1)
-		LogTrace("Poll ended after %d ms\n", i);
 
-	//Give up if we still got nothing
-	if(i == nmax)
-	{
-		DebugAbort();
-		throw JtagExceptionWrapper(
-			"Failed to read AP register (still waiting after way too long)",
-			"");
-	}
+	//Set the high bits of the address as the current bank
+	SelectAP(ap, addr);
+
+	//Post the read, then collect the result with a read of RDBUFF.
+	//Unlike repeating the AP read, this doesn't start another AP transaction (which would, for example, advance TAR
+	//a second time).
+	Post(INST_APACC, ((addr & 0x0c) >> 1) | OP_READ);
+	uint32_t data_out = Post(INST_DPACC, (REG_RDBUFF << 1) | OP_READ);
 
 	//Verify the read was successful
 	ARMJtagDebugPortStatusRegister stat = GetStatusRegister();
@@ -477,11 +682,42 @@ uint32_t ARMJtagDebugPort::APRegisterRead(uint8_t ap, ApReg addr)
 	return data_out;
 }
 
+/**
+	@brief Points SELECT at the requested AP and register bank, if it isn't already
+ */
+void ARMJtagDebugPort::SelectAP(uint8_t ap, ApReg addr)
+{
+	uint32_t select = (ap << 24) | (addr & 0xf0);
+	if(m_selectValid && (m_select == select) )
+		return;
+
+	m_selectValid = false;
+	DPRegisterWrite(REG_AP_SELECT, select);
+	m_select = select;
+	m_selectValid = true;
+}
+
+/**
+	@brief Discards all shadow copies of DP and AP registers
+
+	Called after the DAP has been aborted, either by us or by a jtagd server that hit an error while running a batch
+	on our behalf.
+ */
+void ARMJtagDebugPort::InvalidateDapState()
+{
+	m_selectValid = false;
+	InvalidateAPCache();
+}
+
 /**
 	@brief Aborts the current AP transaction
+
+	Since we no longer know what state the DAP is in, all shadow copies of DP and AP registers are discarded.
  */
 void ARMJtagDebugPort::DebugAbort()
 {
+	InvalidateDapState();
+
 	SetIR(INST_ABORT);
 
 	//Write to the abort register
@@ -490,9 +726,9 @@ void ARMJtagDebugPort::DebugAbort()
 	unsigned char unused[5];
 	ScanDR(abort_value, unused, 35);
 	auto statreg = GetStatusRegister();
-	if(statreg.bits.sticky_err)
+	if(statreg.bits.sticky_err || statreg.bits.sticky_overrun || statreg.bits.sticky_overrun_en)
 	{
-		LogTrace("Sticky error bit is set, clearing\n");
+		LogTrace("Sticky error or overrun bit is set, clearing\n");
 		ClearStatusRegisterErrors();
 	}
 }
@@ -506,73 +742,26 @@ void ARMJtagDebugPort::DebugAbort()
  */
 void ARMJtagDebugPort::APRegisterWrite(uint8_t ap, ApReg addr, uint32_t wdata)
 {
-	//Set the high bits of the address as the current bank
-	uint32_t select = (ap << 24) | (addr & 0xf0);
-	DPRegisterWrite(REG_AP_SELECT,  select );
-
-	//Do the read
-	SetIR(INST_APACC);
+	CheckDeviceCaches();
 
-	//Concatenate the 3-bit A / RnW field to request the write with the data itself
-	uint8_t addr_flags = ((addr & 0x0c) >> 1) | OP_WRITE;
-	//LogTrace("        addr_flags = %x\n", addr_flags);
-	uint8_t* wdata_p = (uint8_t*)&wdata;
-	uint8_t txd[5];
-	for(int i=0; i<3; i++)
-		PokeBit(txd, i, PeekBit(&addr_flags, i));
-	for(int i=0; i<32; i++)
-		PokeBit(txd, i+3, PeekBit(wdata_p, i));
-		
-	int i = 0;
-	int nmax = 50;
-	unsigned char rxd[5];
-	uint8_t ack_out = 0;
-	for(; i<nmax; i++)
+	//Remote server? Let it do the whole transaction in one round trip
+	if(m_remote)
 	{
-		//Get the data back and extract the reply
-		ScanDR(txd, rxd, 35);
-		for(int i=0; i<3; i++)
-			PokeBit(&ack_out, i, PeekBit(rxd, i));
-
-		//If the original ACK-out was a "wait", we have to do something
-		if(ack_out != WAIT)
-			break;
-			
-		//No go? Try again after a millisecond
-		if(i == 1)
-			LogTrace("No go, trying again after 1 ms\n");
-		if(i >= 1)
-			usleep(1 * 1000);
+		vector<APTransaction> batch(1, APTransaction(ap, addr, true, wdata));
+		m_remote->DapAPRegisterBatch(m_pos, batch);
+		return;
 	}
-	if(i > 1)
-		LogTrace("Poll ended after %d ms\n", i);
 
-	//Give up if we still got nothing
-	if(i == nmax)
-	{
-		DebugAbort();
-		throw JtagExceptionWrapper(
-			"Failed to write AP register (still waiting after way too long)",
-			"");
-	}
+	//Set the high bits of the address as the current bank
+	SelectAP(ap, addr);
 
-	//Send a dummy read to get the response code
-	addr_flags = ((addr & 0x0c) >> 1) | OP_READ;
-	for(int i=0; i<3; i++)
-		PokeBit(txd, i, PeekBit(&addr_flags, i));
-	for(int i=0; i<32; i++)
-		PokeBit(txd, i+3, false);
-	ScanDR(txd, rxd, 35);
-	for(int i=0; i<3; i++)
-		PokeBit(&ack_out, i, PeekBit(rxd, i));
-	if(ack_out != OK_OR_FAULT)
-	{
-		throw JtagExceptionWrapper(
-			"Don't know what to do with WAIT request from DAP",
-			"");
-	}
+	//Do the write, then wait for it to finish with a read of RDBUFF.
+	//DPRegisterRead() doesn't look at the ACK of its first scan, so if that scan were turned away with WAIT while the
+	//write was still running, it would return whatever the next scan captured rather than CTRL/STAT.
+	Post(INST_APACC, ((addr & 0x0c) >> 1) | OP_WRITE, wdata);
+	Post(INST_DPACC, (REG_RDBUFF << 1) | OP_READ);
 
-	//Verify the read was successful
+	//Verify the write was successful
 	ARMJtagDebugPortStatusRegister stat = GetStatusRegister();
 	if(stat.bits.sticky_err)
 	{
@@ -589,6 +778,72 @@ void ARMJtagDebugPort::APRegisterWrite(uint8_t ap, ApReg addr, uint32_t wdata)
 	}
 }
 
+/**
+	@brief Does a single DPACC or APACC scan using whatever instruction is currently loaded
+
+	@param addr_flags	A[3:2] and RnW bits
+	@param wdata		Data to write (ignored for reads)
+	@param rdata		Data captured by the scan (the result of the previous read, if any)
+
+	@return The ACK code for the previous transaction
+ */
+uint8_t ARMJtagDebugPort::ScanAccess(uint8_t addr_flags, uint32_t wdata, uint32_t& rdata)
+{
+	uint8_t txd[5] = {0};
+	for(int i=0; i<3; i++)
+		PokeBit(txd, i, PeekBit(&addr_flags, i));
+	for(int i=0; i<32; i++)
+		PokeBit(txd, i+3, PeekBit((uint8_t*)&wdata, i));
+
+	uint8_t rxd[5];
+	ScanDR(txd, rxd, 35);
+
+	uint8_t ack_out = 0;
+	for(int i=0; i<3; i++)
+		PokeBit(&ack_out, i, PeekBit(rxd, i));
+	for(int i=0; i<32; i++)
+		PokeBit((unsigned char*)&rdata, i, PeekBit(rxd, i+3));
+	return ack_out;
+}
+
+/**
+	@brief Posts a DPACC or APACC transaction, retrying as long as the DAP responds with WAIT
+
+	@param irval		INST_DPACC or INST_APACC
+	@param addr_flags	A[3:2] and RnW bits
+	@param wdata		Data to write (ignored for reads)
+
+	@return The data captured by the accepted scan (the result of the previous read, if any)
+ */
+uint32_t ARMJtagDebugPort::Post(unsigned char irval, uint8_t addr_flags, uint32_t wdata)
+{
+	SetIR(irval);
+
+	uint32_t rdata = 0;
+	int nmax = 50;
+	for(int i=0; i<nmax; i++)
+	{
+		if(ScanAccess(addr_flags, wdata, rdata) != WAIT)
+		{
+			if(i > 1)
+				LogTrace("Poll ended after %d ms\n", i);
+			return rdata;
+		}
+
+		//No go? Try again after a millisecond
+		if(i == 1)
+			LogTrace("No go, trying again after 1 ms\n");
+		if(i >= 1)
+			usleep(1 * 1000);
+	}
+
+	//Give up if we still got nothing
+	DebugAbort();
+	throw JtagExceptionWrapper(
+		"DAP transaction still waiting after way too long",
+		"");
+}
+
 /**
 	@brief Reads from a DP register
 
@@ -699,3 +954,270 @@ void ARMJtagDebugPort::DPRegisterWrite(DpReg addr, uint32_t wdata)
 			"");
 	}
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Batched operations
+
+void ARMJtagDebugPort::APRegisterBatch(vector<APTransaction>& batch)
+{
+	CheckDeviceCaches();
+
+	if(m_remote)
+	{
+		m_remote->DapAPRegisterBatch(m_pos, batch);
+		return;
+	}
+
+	//Split scans can't pad around other devices in the chain yet, so fall back to one transaction at a time
+	if(m_iface->GetDeviceCount() != 1)
+	{
+		ARMDebugPort::APRegisterBatch(batch);
+		return;
+	}
+
+	//A burst that stalls on WAIT tells us exactly how far it got, so pick up from there. Nothing that already ran is
+	//sent again, since AP accesses can have side effects (TAR auto-increment, FIFOs, flash programming).
+	size_t base = 0;
+	int stalls = 0;
+	while(base < batch.size())
+	{
+		size_t count = min((size_t)MAX_AP_BURST, batch.size() - base);
+		size_t done = APRegisterBurst(batch, base, count);
+		base += done;
+		if(done != 0)
+		{
+			stalls = 0;
+			continue;
+		}
+
+		//Still stuck after way too long? Give up
+		if(++stalls >= 50)
+		{
+			DebugAbort();
+			throw JtagExceptionWrapper(
+				"Pipelined AP burst still waiting after way too long",
+				"");
+		}
+		if(stalls > 1)
+			usleep(1 * 1000);
+	}
+}
+
+/**
+	@brief Executes part of a batch as a single pipelined burst of DPACC/APACC scans
+
+	Each scan captures the result of the transaction before it, so the AP reads are issued back to back and every
+	result is picked up by the following scan. The burst ends with a CTRL/STAT read (which collects the last AP read)
+	and a CTRL/STAT write (which collects CTRL/STAT), so the whole burst needs one sticky error check. All of the scans
+	are split scans, so on adapters that support it the burst costs a single turnaround.
+
+	If the DAP answers WAIT to a scan, that request is dropped, but the AP may well catch up before the scans behind
+	it arrive, and those would then run out of order. To stop that, the burst turns on overrun detection
+	(CTRL/STAT.ORUNDETECT) while it runs: after a WAIT the DP sets STICKYORUN and ignores all AP accesses until it is
+	cleared. So the transactions before the one that got WAIT ran exactly once, the ones from it on didn't run at all,
+	and the caller can carry on from there.
+
+	@param batch		The batch being executed
+	@param start		Index of the first transaction in the burst
+	@param count		Number of transactions in the burst
+
+	@throw JtagException if the sticky error bit was set, or AP accesses ran out of order anyway. Any number of
+			transactions may have executed, the DAP has been aborted, and all cached register state was discarded.
+
+	@return Number of transactions (from start) that executed. Less than count if the burst stalled on WAIT.
+ */
+size_t ARMJtagDebugPort::APRegisterBurst(vector<APTransaction>& batch, size_t start, size_t count)
+{
+	//Build the list of scans. Each one records where the data it captures should go, and which transaction it posts.
+	struct Scan
+	{
+		unsigned char	irval;
+		uint8_t			addr_flags;
+		uint32_t		wdata;
+		uint32_t*		result;
+		size_t			txn;
+	};
+	vector<Scan> scans;
+	ARMJtagDebugPortStatusRegister ctrl;
+	ctrl.word = m_ctrlStat;
+	ctrl.bits.sticky_overrun_en = 1;
+	scans.push_back({INST_DPACC, (REG_CTRL_STAT << 1) | OP_WRITE, ctrl.word, NULL, start});
+	uint32_t* pending = NULL;
+	for(size_t i=start; i<start+count; i++)
+	{
+		auto& t = batch[i];
+
+		uint32_t select = (t.ap << 24) | (t.addr & 0xf0);
+		if(!m_selectValid || (m_select != select) )
+		{
+			scans.push_back({INST_DPACC, (REG_AP_SELECT << 1) | OP_WRITE, select, pending, i});
+			pending = NULL;
+			m_select = select;
+			m_selectValid = true;
+		}
+
+		uint8_t addr_flags = ((t.addr & 0x0c) >> 1) | (t.write ? OP_WRITE : OP_READ);
+		scans.push_back({INST_APACC, addr_flags, t.value, pending, i});
+		pending = t.write ? NULL : &t.value;
+	}
+	uint32_t statword = 0;
+	scans.push_back({INST_DPACC, (REG_CTRL_STAT << 1) | OP_READ, 0, pending, start+count});
+	scans.push_back({INST_DPACC, (REG_CTRL_STAT << 1) | OP_WRITE, m_ctrlStat, &statword, start+count});
+
+	//Send the write halves of all the scans, then collect the read halves
+	vector<uint8_t> txd(scans.size() * 5, 0);
+	vector<uint8_t> rxd(scans.size() * 5, 0);
+	for(size_t i=0; i<scans.size(); i++)
+	{
+		auto& sc = scans[i];
+		uint8_t* p = &txd[i*5];
+		for(int j=0; j<3; j++)
+			PokeBit(p, j, PeekBit(&sc.addr_flags, j));
+		for(int j=0; j<32; j++)
+			PokeBit(p, j+3, PeekBit((uint8_t*)&sc.wdata, j));
+
+		SetIRDeferred(sc.irval);
+		ScanDRSplitWrite(p, &rxd[i*5], 35);
+	}
+	for(size_t i=0; i<scans.size(); i++)
+		ScanDRSplitRead(&rxd[i*5], 35);
+
+	//Crunch the results, up to the first scan that didn't go through
+	vector<uint8_t> acks(scans.size());
+	size_t stall = scans.size();
+	for(size_t i=0; i<scans.size(); i++)
+	{
+		uint8_t* p = &rxd[i*5];
+		acks[i] = 0;
+		for(int j=0; j<3; j++)
+			PokeBit(&acks[i], j, PeekBit(p, j));
+		if( (stall == scans.size()) && (acks[i] != OK_OR_FAULT) )
+			stall = i;
+
+		if( (stall == scans.size()) && scans[i].result)
+		{
+			for(int j=0; j<32; j++)
+				PokeBit((unsigned char*)scans[i].result, j, PeekBit(p, j+3));
+		}
+	}
+
+	ARMJtagDebugPortStatusRegister stat;
+	if(stall == scans.size())
+	{
+		stat.word = statword;
+		if(!stat.bits.sticky_err)
+			return count;
+
+		DebugAbort();
+		throw JtagExceptionWrapper(
+			"Pipelined AP burst failed (sticky error bit set)",
+			"");
+	}
+
+	//Stalled. Make sure it was a WAIT, and not a dead link or some other garbage
+	if(acks[stall] != WAIT)
+	{
+		DebugAbort();
+		throw JtagExceptionWrapper(
+			"Pipelined AP burst failed (bad ACK)",
+			"");
+	}
+
+	//The first scan after the stall that got through picked up the read the stalled scan was supposed to collect
+	//(the AP had to be done for it to get through, and nothing after the stall touched the AP)
+	bool apAccepted = false;
+	bool collected = false;
+	for(size_t i=stall+1; i<scans.size(); i++)
+	{
+		if(acks[i] != OK_OR_FAULT)
+			continue;
+		if(scans[i].irval == INST_APACC)
+			apAccepted = true;
+		if(!collected && scans[stall].result)
+		{
+			uint8_t* p = &rxd[i*5];
+			for(int j=0; j<32; j++)
+				PokeBit((unsigned char*)scans[stall].result, j, PeekBit(p, j+3));
+		}
+		collected = true;
+	}
+
+	//SELECT may or may not have been written after the stall
+	m_selectValid = false;
+
+	//Wait for the last transaction that got in to finish (even a write, so the status read below isn't turned away),
+	//and collect its result if nothing did already
+	uint32_t rdata = Post(INST_DPACC, (REG_RDBUFF << 1) | OP_READ);
+	if(!collected && scans[stall].result)
+		*scans[stall].result = rdata;
+
+	//If overrun detection didn't kick in (the stall came before we turned it on, or the DP doesn't implement it), AP
+	//accesses after the stall may have run out of order
+	stat = GetStatusRegister();
+	if(stat.bits.sticky_err)
+	{
+		DebugAbort();
+		throw JtagExceptionWrapper(
+			"Pipelined AP burst failed (sticky error bit set)",
+			"");
+	}
+	if(apAccepted && !stat.bits.sticky_overrun)
+	{
+		DebugAbort();
+		throw JtagExceptionWrapper(
+			"Pipelined AP burst failed (AP accesses ran out of order after a WAIT)",
+			"");
+	}
+
+	//Clear STICKYORUN and turn overrun detection back off
+	ctrl.word = m_ctrlStat;
+	ctrl.bits.sticky_overrun = 1;
+	DPRegisterWrite(REG_CTRL_STAT, ctrl.word);
+
+	return scans[stall].txn - start;
+}
+
+void ARMJtagDebugPort::MemAPReadBlock(uint8_t ap, uint32_t addr, uint32_t* data, size_t count)
+{
+	if(!m_remote)
+	{
+		ARMDebugPort::MemAPReadBlock(ap, addr, data, count);
+		return;
+	}
+
+	//The Mem-AP has already set CSW up for auto-increment, but the server moves TAR without telling it
+	InvalidateAPAddress(ap);
+
+	m_remote->DapMemReadBlock(m_pos, ap, addr, data, count);
+}
+
+void ARMJtagDebugPort::MemAPWriteBlock(uint8_t ap, uint32_t addr, const uint32_t* data, size_t count)
+{
+	if(!m_remote)
+	{
+		ARMDebugPort::MemAPWriteBlock(ap, addr, data, count);
+		return;
+	}
+
+	//The Mem-AP has already set CSW up for auto-increment, but the server moves TAR without telling it
+	InvalidateAPAddress(ap);
+
+	m_remote->DapMemWriteBlock(m_pos, ap, addr, data, count);
+}
+
+bool ARMJtagDebugPort::MemAPPoll(
+	uint8_t ap,
+	uint32_t addr,
+	uint32_t mask,
+	uint32_t match,
+	unsigned int timeout_us,
+	uint32_t& value)
+{
+	if(m_remote)
+	{
+		//The server rewrites TAR behind the Mem-AP's back
+		InvalidateAPAddress(ap);
+		return m_remote->DapMemPoll(m_pos, ap, addr, mask, match, timeout_us, value);
+	}
+	return ARMDebugPort::MemAPPoll(ap, addr, mask, match, timeout_us, value);
+}
@@ -142,6 +142,10 @@ public:
 	};
 
 	virtual void PostInitProbes(bool quiet);
+	virtual void ReleaseAdapter();
+	virtual void FlushCaches();
+	virtual void InvalidateCaches();
+	void InvalidateDapState();
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// General device info
@@ -152,12 +156,26 @@ public:
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Memory access via AHB
 
-	///Read a single 32-bit word of memory (TODO support smaller sizes)
+	///Read a single 32-bit word of memory
 	virtual uint32_t ReadMemory(uint32_t address);
 
-	///Writes a single 32-bit word of memory (TODO support smaller sizes)
+	///Writes a single 32-bit word of memory
 	virtual void WriteMemory(uint32_t address, uint32_t value);
 
+	virtual uint16_t ReadMemoryHalfword(uint32_t address);
+	virtual uint8_t ReadMemoryByte(uint32_t address);
+	virtual void WriteMemoryHalfword(uint32_t address, uint16_t value);
+	virtual void WriteMemoryByte(uint32_t address, uint8_t value);
+
+	virtual void ReadMemoryBlock(uint32_t address, uint32_t* data, size_t count);
+	virtual void WriteMemoryBlock(uint32_t address, const uint32_t* data, size_t count);
+
+	virtual void ReadMemoryBytes(uint32_t address, uint8_t* data, size_t len, unsigned int maxWidth = 4);
+	virtual void WriteMemoryBytes(uint32_t address, const uint8_t* data, size_t len, unsigned int maxWidth = 4);
+
+	virtual void MemoryBatch(std::vector<MemoryTransfer>& batch);
+	virtual void ReadMemoryRepeated(uint32_t address, uint32_t* data, size_t count);
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Debug register access via APB
 
@@ -187,6 +205,10 @@ public:
 
 	virtual void PrintStatusRegister();
 
+	///A JTAG-DP's IDCODE doubles as its DPIDR
+	virtual uint32_t GetDebugPortID()
+	{ return m_idcode; }
+
 protected:
 	void ClearStatusRegisterErrors();
 
@@ -199,10 +221,27 @@ protected:
 	virtual uint32_t APRegisterRead(uint8_t ap, ApReg addr);
 	virtual void APRegisterWrite(uint8_t ap, ApReg addr, uint32_t wdata);
 
+	virtual void APRegisterBatch(std::vector<APTransaction>& batch);
+	virtual void CheckDeviceCaches();
+	size_t APRegisterBurst(std::vector<APTransaction>& batch, size_t start, size_t count);
+	virtual void MemAPReadBlock(uint8_t ap, uint32_t addr, uint32_t* data, size_t count);
+	virtual void MemAPWriteBlock(uint8_t ap, uint32_t addr, const uint32_t* data, size_t count);
+	virtual bool MemAPPoll(
+		uint8_t ap,
+		uint32_t addr,
+		uint32_t mask,
+		uint32_t match,
+		unsigned int timeout_us,
+		uint32_t& value);
+
 	void EnableDebugging();
 
 	void DebugAbort();
 
+	void SelectAP(uint8_t ap, ApReg addr);
+	uint8_t ScanAccess(uint8_t addr_flags, uint32_t wdata, uint32_t& rdata);
+	uint32_t Post(unsigned char irval, uint8_t addr_flags, uint32_t wdata = 0);
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Helpers for chain manipulation
 protected:
@@ -219,6 +258,18 @@ protected:
 
 	///Part number (normally IDCODE_ARM_DAP_JTAG)
 	unsigned int m_partnum;
+
+	///Remote jtagd that executes AP transactions for us (NULL if local, or if the server can't do it)
+	NetworkedJtagInterface* m_remote;
+
+	///True if m_select holds the current contents of the SELECT register
+	bool m_selectValid;
+
+	///Shadow copy of the SELECT register
+	uint32_t m_select;
+
+	///What we keep in CTRL/STAT between bursts (power-up requests, overrun detection off)
+	uint32_t m_ctrlStat;
 };
 
 #endif
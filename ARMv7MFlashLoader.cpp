@@ -0,0 +1,395 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ARMv7MFlashLoader
+ */
+#include "jtaghal.h"
+#include "ARMv7MFlashLoader.h"
+
+using namespace std;
+
+/**
+	@brief The loader itself
+
+	Only uses 16-bit Thumb instructions, so it runs on ARMv6-M parts too. On entry R0 points to the parameter block:
+
+		+0		Address of the flash status register
+		+4		Busy bit mask
+		+8		Error bit mask
+		+12		Error bits seen so far (ORed in after each buffer)
+		+16		Slot 0: work area address, destination address, word count (mailbox)
+		+28		Slot 1: same
+
+	The loader waits for a slot's word count to go nonzero, copies that many words to the destination (waiting for the
+	busy bit to clear after each one), clears the count, and moves on to the other slot. It never returns; the host
+	halts the core once both slots are idle.
+ */
+static const uint16_t g_flashLoaderStub[] =
+{
+	0x2610,		//start:	movs	r6, #16
+	0x1836,		//			adds	r6, r6, r0			; r6 = slot 0
+	0x68b2,		//wait:		ldr		r2, [r6, #8]		; word count
+	0x2a00,		//			cmp		r2, #0
+	0xd0fc,		//			beq		wait
+	0x6833,		//			ldr		r3, [r6, #0]		; source
+	0x6871,		//			ldr		r1, [r6, #4]		; destination
+	0x6804,		//			ldr		r4, [r0, #0]		; status register
+	0x6847,		//			ldr		r7, [r0, #4]		; busy mask
+	0x681d,		//prog:		ldr		r5, [r3, #0]
+	0x600d,		//			str		r5, [r1, #0]
+	0x3304,		//			adds	r3, #4
+	0x3104,		//			adds	r1, #4
+	0x6825,		//busy:		ldr		r5, [r4, #0]
+	0x423d,		//			tst		r5, r7
+	0xd1fc,		//			bne		busy
+	0x3a01,		//			subs	r2, #1
+	0xd1f6,		//			bne		prog
+	0x6825,		//			ldr		r5, [r4, #0]
+	0x6887,		//			ldr		r7, [r0, #8]		; error mask
+	0x403d,		//			ands	r5, r7
+	0x68c7,		//			ldr		r7, [r0, #12]
+	0x432f,		//			orrs	r7, r5
+	0x60c7,		//			str		r7, [r0, #12]
+	0x60b2,		//			str		r2, [r6, #8]		; done, hand the buffer back
+	0x251c,		//			movs	r5, #28
+	0x182d,		//			adds	r5, r5, r0			; r5 = slot 1
+	0x42ae,		//			cmp		r6, r5
+	0xd0e2,		//			beq		start
+	0x002e,		//			movs	r6, r5
+	0xe7e2,		//			b		wait
+	0xbf00		//			nop
+};
+
+/**
+	@brief Checksum routine, for Checksum()
+
+	On entry R0 points to the parameter block:
+
+		+0		Address of the first word
+		+4		Number of words
+		+8		Address to feed each word to (e.g. a CRC unit's data register)
+		+12		AND of every word (output)
+		+16		Value read back from +8 at the end (output)
+		+20		Set to 1 when done
+ */
+static const uint16_t g_checksumStub[] =
+{
+	0x6801,		//			ldr		r1, [r0, #0]		; pointer
+	0x6842,		//			ldr		r2, [r0, #4]		; word count
+	0x6883,		//			ldr		r3, [r0, #8]		; CRC data register
+	0x2400,		//			movs	r4, #0
+	0x43e4,		//			mvns	r4, r4				; AND of everything so far
+	0x2a00,		//			cmp		r2, #0
+	0xd005,		//			beq		done
+	0x680d,		//loop:		ldr		r5, [r1, #0]
+	0x402c,		//			ands	r4, r5
+	0x601d,		//			str		r5, [r3, #0]
+	0x3104,		//			adds	r1, #4
+	0x3a01,		//			subs	r2, #1
+	0xd1f9,		//			bne		loop
+	0x681d,		//done:		ldr		r5, [r3, #0]
+	0x60c4,		//			str		r4, [r0, #12]
+	0x6105,		//			str		r5, [r0, #16]
+	0x2501,		//			movs	r5, #1
+	0x6145,		//			str		r5, [r0, #20]
+	0xe7fe		//idle:		b		idle
+};
+
+///Offset of the parameter block from the start of SRAM (the loader sits below it)
+#define LOADER_PARAMS_OFFSET 0x80
+
+///Offset of the top of the stack from the start of SRAM (the loader doesn't use it, but SP should be sane)
+#define LOADER_STACK_OFFSET 0x100
+
+///Offset of the first work area from the start of SRAM
+#define LOADER_BUFFER_OFFSET 0x100
+
+///Largest work area we'll use, in bytes
+#define LOADER_MAX_BUFFER 0x2000
+
+///Smallest work area worth using, in bytes
+#define LOADER_MIN_BUFFER 0x100
+
+///Offset of the error bits in the parameter block
+#define LOADER_ERRORS 12
+
+///Offset of the first slot in the parameter block
+#define LOADER_SLOT0 16
+
+///Size of each slot in the parameter block
+#define LOADER_SLOT_SIZE 12
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a loader (but doesn't touch the target yet)
+
+	@param cpu				The CPU to run the loader on
+	@param iface			Interface to access target memory through
+	@param ramBase			Start of SRAM that can be used for the loader and work areas
+	@param ramSize			Size of that SRAM, in bytes
+	@param statusRegister	Address of the flash controller's status register
+	@param busyMask			Status register bits that are set while the controller is busy
+	@param errorMask		Status register bits that indicate a programming error
+ */
+ARMv7MFlashLoader::ARMv7MFlashLoader(
+	ARMv7MProcessor* cpu,
+	DebuggerInterface* iface,
+	uint32_t ramBase,
+	uint32_t ramSize,
+	uint32_t statusRegister,
+	uint32_t busyMask,
+	uint32_t errorMask)
+	: m_cpu(cpu)
+	, m_iface(iface)
+	, m_ramBase(ramBase)
+	, m_statusRegister(statusRegister)
+	, m_busyMask(busyMask)
+	, m_errorMask(errorMask)
+	, m_nextSlot(0)
+	, m_running(false)
+{
+	if(ramSize < LOADER_BUFFER_OFFSET + 2*LOADER_MIN_BUFFER)
+	{
+		throw JtagExceptionWrapper(
+			"Not enough SRAM for the flash loader",
+			"");
+	}
+
+	m_bufferWords = min( (ramSize - LOADER_BUFFER_OFFSET) / 2, (uint32_t)LOADER_MAX_BUFFER) / 4;
+}
+
+/**
+	@brief Halts the loader if it's still running (e.g. Finish() wasn't reached because of an error)
+ */
+ARMv7MFlashLoader::~ARMv7MFlashLoader()
+{
+	if(!m_running)
+		return;
+
+	try
+	{
+		m_cpu->DebugHalt();
+	}
+	catch(const JtagException& e)
+	{
+		LogWarning("Couldn't halt the flash loader: %s\n", e.GetDescription().c_str());
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Programming
+
+uint32_t ARMv7MFlashLoader::GetSlotAddress(int slot)
+{
+	return m_ramBase + LOADER_PARAMS_OFFSET + LOADER_SLOT0 + slot*LOADER_SLOT_SIZE;
+}
+
+/**
+	@brief Uploads a routine and its parameter block, and starts the CPU running it (the CPU must be halted)
+
+	Interrupts are masked, since the vector table may well be blank by now.
+ */
+void ARMv7MFlashLoader::RunStub(const uint16_t* code, size_t codeLen, const uint32_t* params, size_t paramCount)
+{
+	//Upload the routine (padded out to a whole number of words)
+	vector<uint32_t> words( (codeLen + 3) / 4);
+	memcpy(&words[0], code, codeLen);
+	m_iface->WriteMemoryBlock(m_ramBase, &words[0], words.size());
+	m_iface->WriteMemoryBlock(m_ramBase + LOADER_PARAMS_OFFSET, params, paramCount);
+
+	vector< pair<ARMv7MProcessor::ARM_V7M_CPU_REGISTERS, uint32_t> > regs;
+	regs.push_back(pair<ARMv7MProcessor::ARM_V7M_CPU_REGISTERS, uint32_t>(
+		ARMv7MProcessor::R0, m_ramBase + LOADER_PARAMS_OFFSET));
+	regs.push_back(pair<ARMv7MProcessor::ARM_V7M_CPU_REGISTERS, uint32_t>(
+		ARMv7MProcessor::MSP, m_ramBase + LOADER_STACK_OFFSET));
+	regs.push_back(pair<ARMv7MProcessor::ARM_V7M_CPU_REGISTERS, uint32_t>(
+		ARMv7MProcessor::CTRL, 0x00000001));								//PRIMASK, MSP, privileged
+	regs.push_back(pair<ARMv7MProcessor::ARM_V7M_CPU_REGISTERS, uint32_t>(
+		ARMv7MProcessor::XPSR, 0x01000000));								//Thumb
+	regs.push_back(pair<ARMv7MProcessor::ARM_V7M_CPU_REGISTERS, uint32_t>(
+		ARMv7MProcessor::DBGRA, m_ramBase));
+	m_cpu->WriteCPURegisters(regs);
+
+	m_cpu->DebugResume();
+	m_running = true;
+}
+
+/**
+	@brief Uploads the loader and starts it running (the CPU must be halted)
+ */
+void ARMv7MFlashLoader::Start()
+{
+	LogTrace("Starting flash loader (%zu byte work areas)\n", m_bufferWords * 4);
+
+	//Parameter block, with both slots idle
+	uint32_t bufs = m_ramBase + LOADER_BUFFER_OFFSET;
+	uint32_t params[] =
+	{
+		m_statusRegister,
+		m_busyMask,
+		m_errorMask,
+		0,
+		bufs,								0, 0,
+		bufs + (uint32_t)m_bufferWords*4,	0, 0
+	};
+	RunStub(g_flashLoaderStub, sizeof(g_flashLoaderStub), params, sizeof(params) / 4);
+	m_nextSlot = 0;
+}
+
+/**
+	@brief Waits until a word in target memory, written by the running routine, has a given value
+ */
+void ARMv7MFlashLoader::WaitForWord(uint32_t addr, uint32_t value)
+{
+	uint32_t current;
+	if(!m_iface->PollMemory(addr, 0xffffffff, value, POLL_FLASH_LOADER, current))
+	{
+		throw JtagExceptionWrapper(
+			"Timed out waiting for the flash loader",
+			"");
+	}
+}
+
+/**
+	@brief Waits until the loader has finished with a work area
+ */
+void ARMv7MFlashLoader::WaitForBuffer(int slot)
+{
+	WaitForWord(GetSlotAddress(slot) + 8, 0);
+}
+
+/**
+	@brief Programs a block of words
+
+	Returns as soon as the data is in a work area, so the next block can be sent while this one is being programmed.
+	Blocks larger than a work area are split up.
+
+	@param addr		Flash address of the first word
+	@param data		Data to write
+	@param count	Number of words
+ */
+void ARMv7MFlashLoader::Write(uint32_t addr, const uint32_t* data, size_t count)
+{
+	if(!m_running)
+	{
+		throw JtagExceptionWrapper(
+			"Flash loader isn't running",
+			"");
+	}
+
+	while(count)
+	{
+		size_t n = min(count, m_bufferWords);
+		uint32_t slot = GetSlotAddress(m_nextSlot);
+		WaitForBuffer(m_nextSlot);
+
+		//Fill the work area, then hand it over (the count goes last since that's what the loader waits on)
+		uint32_t buf = m_ramBase + LOADER_BUFFER_OFFSET + m_nextSlot*m_bufferWords*4;
+		m_iface->WriteMemoryBlock(buf, data, n);
+		uint32_t mailbox[2] = {addr, (uint32_t)n};
+		m_iface->WriteMemoryBlock(slot + 4, mailbox, 2);
+
+		m_nextSlot ^= 1;
+		addr += n*4;
+		data += n;
+		count -= n;
+	}
+}
+
+/**
+	@brief Waits for all outstanding data to be programmed, then halts the CPU
+
+	@throw JtagException if the flash controller reported an error
+ */
+void ARMv7MFlashLoader::Finish()
+{
+	WaitForBuffer(m_nextSlot ^ 1);
+	WaitForBuffer(m_nextSlot);
+	uint32_t errors = m_iface->ReadMemory(m_ramBase + LOADER_PARAMS_OFFSET + LOADER_ERRORS);
+
+	m_cpu->DebugHalt();
+	m_running = false;
+
+	if(errors)
+	{
+		LogDebug("Flash status register error bits: %08x\n", errors);
+		throw JtagExceptionWrapper(
+			"Flash controller reported an error while programming",
+			"");
+	}
+}
+
+/**
+	@brief Checksums a block of memory on the target, rather than reading it all back (instead of Start() etc)
+
+	Computes the AND of every word, which is 0xffffffff if and only if the block is blank. If the part has a CRC unit
+	with a data register that each word can be written to (like the STM32's), every word is also fed to it and its
+	final value is returned. The CPU must be halted, and is halted again afterwards.
+
+	@param addr				Address of the first word
+	@param count			Number of words
+	@param crcRegister		Address of the CRC unit's data register, already reset. Zero if there isn't one.
+	@param allBits			AND of all of the words
+	@param crc				Final value of the CRC data register (zero if there isn't one)
+ */
+void ARMv7MFlashLoader::Checksum(uint32_t addr, size_t count, uint32_t crcRegister, uint32_t& allBits, uint32_t& crc)
+{
+	if(m_running)
+	{
+		throw JtagExceptionWrapper(
+			"Flash loader is already running",
+			"");
+	}
+
+	LogTrace("Checksumming %zu words from 0x%08x on the target\n", count, addr);
+
+	//With no CRC unit, send the words to the CRC output field instead
+	uint32_t paramBase = m_ramBase + LOADER_PARAMS_OFFSET;
+	bool hasCrc = (crcRegister != 0);
+	if(!hasCrc)
+		crcRegister = paramBase + 16;
+
+	uint32_t params[] = { addr, (uint32_t)count, crcRegister, 0, 0, 0 };
+	RunStub(g_checksumStub, sizeof(g_checksumStub), params, sizeof(params) / 4);
+
+	WaitForWord(paramBase + 20, 1);
+	uint32_t results[2];
+	m_iface->ReadMemoryBlock(paramBase + 12, results, 2);
+
+	m_cpu->DebugHalt();
+	m_running = false;
+
+	allBits = results[0];
+	crc = hasCrc ? results[1] : 0;
+}
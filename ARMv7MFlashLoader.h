@@ -0,0 +1,111 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ARMv7MFlashLoader
+ */
+#ifndef ARMv7MFlashLoader_h
+#define ARMv7MFlashLoader_h
+
+class ARMv7MProcessor;
+
+/**
+	@brief Programs flash by running a small loader on the target CPU, fed through double-buffered work areas in SRAM
+
+	The loader is a few dozen bytes of Thumb code, for flash controllers that program one word per bus write and report
+	progress through a busy bit in a status register (e.g. STM32F2/F4/F7 with the program-enable bit set). Data is
+	block-written into one work area while the core copies the other one into flash, and each work area has a mailbox
+	word that the host sets to hand the buffer over and the loader clears once it's been programmed.
+
+	It can also checksum a block of memory on the target, for blank checking and verifying without reading flash back.
+
+	Erasing, unlocking and putting the controller into programming mode is left to the caller.
+
+	\ingroup libjtaghal
+ */
+class ARMv7MFlashLoader
+{
+public:
+	ARMv7MFlashLoader(
+		ARMv7MProcessor* cpu,
+		DebuggerInterface* iface,
+		uint32_t ramBase,
+		uint32_t ramSize,
+		uint32_t statusRegister,
+		uint32_t busyMask,
+		uint32_t errorMask);
+	virtual ~ARMv7MFlashLoader();
+
+	void Start();
+	void Write(uint32_t addr, const uint32_t* data, size_t count);
+	void Finish();
+
+	void Checksum(uint32_t addr, size_t count, uint32_t crcRegister, uint32_t& allBits, uint32_t& crc);
+
+	///Gets the size of each work area, in words
+	size_t GetBufferWords()
+	{ return m_bufferWords; }
+
+protected:
+	void RunStub(const uint16_t* code, size_t codeLen, const uint32_t* params, size_t paramCount);
+	void WaitForWord(uint32_t addr, uint32_t value);
+	void WaitForBuffer(int slot);
+	uint32_t GetSlotAddress(int slot);
+
+	///The CPU that runs the loader
+	ARMv7MProcessor* m_cpu;
+
+	///Interface used to talk to the loader (never cached, since the target changes the mailboxes behind our back)
+	DebuggerInterface* m_iface;
+
+	///Address of the SRAM we've been given
+	uint32_t m_ramBase;
+
+	///Address of the flash controller's status register
+	uint32_t m_statusRegister;
+
+	///Status register bits that are set while the controller is busy
+	uint32_t m_busyMask;
+
+	///Status register bits that indicate a programming error
+	uint32_t m_errorMask;
+
+	///Size of each work area, in words
+	size_t m_bufferWords;
+
+	///Work area the next Write() goes to
+	int m_nextSlot;
+
+	///True between Start() and Finish()
+	bool m_running;
+};
+
+#endif
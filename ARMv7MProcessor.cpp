@@ -42,12 +42,52 @@
 
 using namespace std;
 
+///DHCSR.S_REGRDY: the last DCRSR transfer has completed
+#define DHCSR_S_REGRDY 0x00010000
+
+///DHCSR.S_HALT: the core is in debug state
+#define DHCSR_S_HALT 0x00020000
+
+///DHCSR.S_RETIRE_ST: an instruction has retired since DHCSR was last read (cleared by reading DHCSR)
+#define DHCSR_S_RETIRE_ST 0x01000000
+
+///DHCSR.DBGKEY: must be written to the top half of DHCSR for a write to take effect
+#define DHCSR_DBGKEY 0xa05f0000
+
+///DHCSR.C_DEBUGEN: halting debug enabled
+#define DHCSR_C_DEBUGEN 0x00000001
+
+///DHCSR.C_HALT: request a halt
+#define DHCSR_C_HALT 0x00000002
+
+///DHCSR.C_STEP: single-step the core when it leaves debug state
+#define DHCSR_C_STEP 0x00000004
+
+///DHCSR.C_MASKINTS: mask PendSV, SysTick and external interrupts
+#define DHCSR_C_MASKINTS 0x00000008
+
+///DCRSR.REGWnR: write DCRDR to the selected register (rather than reading it)
+#define DCRSR_REGWNR 0x00010000
+
+///How long to wait for the core to halt, resume or finish a register transfer before giving up
+#define DEBUG_TIMEOUT_US 1000000
+
+static const char* g_fpRegisterNames[] =
+{
+	"S0",  "S1",  "S2",  "S3",  "S4",  "S5",  "S6",  "S7",
+	"S8",  "S9",  "S10", "S11", "S12", "S13", "S14", "S15",
+	"S16", "S17", "S18", "S19", "S20", "S21", "S22", "S23",
+	"S24", "S25", "S26", "S27", "S28", "S29", "S30", "S31"
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
 ARMv7MProcessor::ARMv7MProcessor(DebuggerInterface* iface, ARMDebugMemAccessPort* ap, uint32_t address, ARMDebugPeripheralIDRegisterBits idreg)
 	: DebuggableDevice(iface)
 	, ARMAPBDevice(ap, address, idreg)
+	, m_fpuProbed(false)
+	, m_hasFPU(false)
 	, m_fpb(NULL)
 {
 
@@ -76,8 +116,24 @@ bool ARMv7MProcessor::HaltedDueToUnrecoverableException()
 	return false;
 }
 
+/**
+	@brief Checks if the core has the floating point extension (ARMv7-M arch manual B4.6)
+ */
+bool ARMv7MProcessor::HasFPU()
+{
+	if(!m_fpuProbed)
+	{
+		m_hasFPU = (ReadRegisterByIndex(MVFR0) != 0);
+		m_fpuProbed = true;
+	}
+	return m_hasFPU;
+}
+
 const char* ARMv7MProcessor::GetRegisterName(ARM_V7M_CPU_REGISTERS reg)
 {
+	if( (reg >= S0) && (reg <= S31) )
+		return g_fpRegisterNames[reg - S0];
+
 	switch(reg)
 	{
 		case R0:
@@ -120,28 +176,174 @@ const char* ARMv7MProcessor::GetRegisterName(ARM_V7M_CPU_REGISTERS reg)
 			return "PSP";
 		case CTRL:
 			return "CTRL";
+		case FPSCR:
+			return "FPSCR";
+		default:
+			break;
 	}
 	return "(invalid)";
 }
 
+/**
+	@brief Reads a core register (the CPU must be halted)
+
+	The first read after a halt captures all of the core registers at once (see ReadRegisterSnapshot()), and later
+	reads are served from that snapshot until the CPU resumes.
+ */
 uint32_t ARMv7MProcessor::ReadCPURegister(ARM_V7M_CPU_REGISTERS reg)
 {
-	//Request the read
-	WriteRegisterByIndex(DCRSR, (0x0000 << 16) | reg);	//0000 = read, 0001 = write
+	if(m_registerCache.empty())
+		ReadRegisterSnapshot();
+
+	auto it = m_registerCache.find(reg);
+	if(it != m_registerCache.end())
+		return it->second;
+
+	//Not part of the snapshot (e.g. no FPU), try it anyway
+	uint32_t value = ReadCPURegisterSlow(reg);
+	m_registerCache[reg] = value;
+	return value;
+}
 
-	//Poll DHCSR.S_REGRDY until we're done
-	while(true)
+/**
+	@brief Reads a core register through DCRSR/DCRDR, polling for completion
+ */
+uint32_t ARMv7MProcessor::ReadCPURegisterSlow(ARM_V7M_CPU_REGISTERS reg)
+{
+	//Request the read and poll DHCSR.S_REGRDY until we're done
+	vector< pair<uint32_t, uint32_t> > writes;
+	writes.push_back(pair<uint32_t, uint32_t>(DCRSR, reg));
+	uint32_t dhcsr;
+	if(!PollRegisterByIndex(DHCSR, DHCSR_S_REGRDY, DHCSR_S_REGRDY, DEBUG_TIMEOUT_US, dhcsr, writes))
 	{
-		uint32_t dhcsr = ReadRegisterByIndex(DHCSR);
-		if(dhcsr & 0x00010000)
-			break;
-		usleep(100);
+		throw JtagExceptionWrapper(
+			"Timed out waiting for a core register read",
+			"");
 	}
 
 	//Read the actual data
 	return ReadRegisterByIndex(DCRDR);
 }
 
+/**
+	@brief Writes a core register through DCRSR/DCRDR, polling for completion
+ */
+void ARMv7MProcessor::WriteCPURegisterSlow(ARM_V7M_CPU_REGISTERS reg, uint32_t value)
+{
+	vector< pair<uint32_t, uint32_t> > writes;
+	writes.push_back(pair<uint32_t, uint32_t>(DCRDR, value));
+	writes.push_back(pair<uint32_t, uint32_t>(DCRSR, DCRSR_REGWNR | reg));
+	uint32_t dhcsr;
+	if(!PollRegisterByIndex(DHCSR, DHCSR_S_REGRDY, DHCSR_S_REGRDY, DEBUG_TIMEOUT_US, dhcsr, writes))
+	{
+		throw JtagExceptionWrapper(
+			"Timed out waiting for a core register write",
+			"");
+	}
+}
+
+/**
+	@brief Reads all of the core registers (plus the FP registers, if present) in one pipelined batch
+
+	DHCSR, DCRSR and DCRDR are in the same 16-byte block, so the whole sequence can go through the Mem-AP banked data
+	registers: for each register we write DCRSR, read DHCSR, then read DCRDR. Instead of polling, we check that
+	S_REGRDY was already set by the time DHCSR was read. The transfer only takes a few core clocks, so in practice it
+	always is. If not, everything from that register on is read again the slow way, since the DCRSR write that
+	followed may have clobbered the transfer.
+ */
+void ARMv7MProcessor::ReadRegisterSnapshot()
+{
+	vector<ARM_V7M_CPU_REGISTERS> regs =
+	{
+		R0, R1, R2, R3,  R4,  R5, R6,
+		R7, R8, R9, R10, R11, R12,
+		SP, LR, DBGRA, XPSR, MSP, PSP, CTRL
+	};
+	if(HasFPU())
+	{
+		regs.push_back(FPSCR);
+		for(int i=S0; i<=S31; i++)
+			regs.push_back(static_cast<ARM_V7M_CPU_REGISTERS>(i));
+	}
+
+	vector<ARMDebugMemAccessPort::BankedAccess> batch;
+	for(auto r : regs)
+	{
+		batch.push_back(ARMDebugMemAccessPort::BankedAccess(0x4, true, r));		//DCRSR
+		batch.push_back(ARMDebugMemAccessPort::BankedAccess(0x0, false));		//DHCSR
+		batch.push_back(ARMDebugMemAccessPort::BankedAccess(0x8, false));		//DCRDR
+	}
+	m_ap->BankedBatch(m_address + DHCSR*4, batch);
+
+	m_registerCache.clear();
+	for(size_t i=0; i<regs.size(); i++)
+	{
+		if(!(batch[i*3 + 1].value & DHCSR_S_REGRDY))
+		{
+			LogDebug("Register %s wasn't ready in time, reading the rest one at a time\n", GetRegisterName(regs[i]));
+			for(; i<regs.size(); i++)
+				m_registerCache[regs[i]] = ReadCPURegisterSlow(regs[i]);
+			break;
+		}
+		m_registerCache[regs[i]] = batch[i*3 + 2].value;
+	}
+}
+
+/**
+	@brief Forgets the register snapshot (called whenever the CPU may have run)
+ */
+void ARMv7MProcessor::InvalidateRegisterCache()
+{
+	m_registerCache.clear();
+}
+
+/**
+	@brief Writes a core register (the CPU must be halted)
+ */
+void ARMv7MProcessor::WriteCPURegister(ARM_V7M_CPU_REGISTERS reg, uint32_t value)
+{
+	vector< pair<ARM_V7M_CPU_REGISTERS, uint32_t> > regs;
+	regs.push_back(pair<ARM_V7M_CPU_REGISTERS, uint32_t>(reg, value));
+	WriteCPURegisters(regs);
+}
+
+/**
+	@brief Writes several core registers in one pipelined batch (see ReadRegisterSnapshot())
+
+	For each register we write DCRDR, write DCRSR, then read DHCSR to make sure the transfer finished before the next
+	DCRDR write. The register snapshot (if any) is updated to match.
+ */
+void ARMv7MProcessor::WriteCPURegisters(const vector< pair<ARM_V7M_CPU_REGISTERS, uint32_t> >& regs)
+{
+	vector<ARMDebugMemAccessPort::BankedAccess> batch;
+	for(auto r : regs)
+	{
+		batch.push_back(ARMDebugMemAccessPort::BankedAccess(0x8, true, r.second));			//DCRDR
+		batch.push_back(ARMDebugMemAccessPort::BankedAccess(0x4, true, DCRSR_REGWNR | r.first));	//DCRSR
+		batch.push_back(ARMDebugMemAccessPort::BankedAccess(0x0, false));					//DHCSR
+	}
+	m_ap->BankedBatch(m_address + DHCSR*4, batch);
+
+	for(size_t i=0; i<regs.size(); i++)
+	{
+		if(!(batch[i*3 + 2].value & DHCSR_S_REGRDY))
+		{
+			LogDebug("Register %s wasn't ready in time, writing the rest one at a time\n",
+				GetRegisterName(regs[i].first));
+			for(; i<regs.size(); i++)
+			{
+				WriteCPURegisterSlow(regs[i].first, regs[i].second);
+				if(!m_registerCache.empty())
+					m_registerCache[regs[i].first] = regs[i].second;
+			}
+			break;
+		}
+
+		if(!m_registerCache.empty())
+			m_registerCache[regs[i].first] = regs[i].second;
+	}
+}
+
 /**
 	@brief Prints out all CPU registers
  */
@@ -163,6 +365,16 @@ void ARMv7MProcessor::PrintRegisters()
 	LogIndenter li;
 	for(auto reg : all_regs)
 		LogNotice("%10s: %08x\n", GetRegisterName(reg), ReadCPURegister(reg));
+
+	if(HasFPU())
+	{
+		LogNotice("%10s: %08x\n", GetRegisterName(FPSCR), ReadCPURegister(FPSCR));
+		for(int i=S0; i<=S31; i++)
+		{
+			auto reg = static_cast<ARM_V7M_CPU_REGISTERS>(i);
+			LogNotice("%10s: %08x\n", GetRegisterName(reg), ReadCPURegister(reg));
+		}
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -170,6 +382,10 @@ void ARMv7MProcessor::PrintRegisters()
 
 void ARMv7MProcessor::Reset()
 {
+	//Get any cached writes out before the CPU starts over
+	m_iface->InvalidateMemoryCache();
+	InvalidateRegisterCache();
+
 	//Write AIRCR with a reboot request
 	WriteMemory(0xe000ed0c, 0x05fa0004);
 }
@@ -191,19 +407,23 @@ void ARMv7MProcessor::DebugHalt()
 	LogIndenter li;
 
 	//Set C_DEBUGEN and C_HALT on consecutive writes.
-	//When we halt, also mask interrupts
-	WriteRegisterByIndex(DHCSR, 0xa05f0001);
-	WriteRegisterByIndex(DHCSR, 0xa05f000b);
-
-	//Poll DHCSR.S_HALT until the CPU stops
-	while(true)
+	//When we halt, also mask interrupts.
+	//Then poll DHCSR.S_HALT until the CPU stops, all in one go.
+	vector< pair<uint32_t, uint32_t> > writes;
+	writes.push_back(pair<uint32_t, uint32_t>(DHCSR, DHCSR_DBGKEY | DHCSR_C_DEBUGEN));
+	writes.push_back(pair<uint32_t, uint32_t>(DHCSR, DHCSR_DBGKEY | DHCSR_C_MASKINTS | DHCSR_C_HALT | DHCSR_C_DEBUGEN));
+	uint32_t dhcsr;
+	if(!PollRegisterByIndex(DHCSR, DHCSR_S_HALT, DHCSR_S_HALT, DEBUG_TIMEOUT_US, dhcsr, writes))
 	{
-		uint32_t dhcsr = ReadRegisterByIndex(DHCSR);
-		if(dhcsr & 0x00020000)
-			break;
-		//LogTrace("DHCSR = %08x\n", dhcsr);
-		usleep(1000);
+		LogTrace("DHCSR = %08x\n", dhcsr);
+		throw JtagExceptionWrapper(
+			"Timed out waiting for the CPU to halt",
+			"");
 	}
+
+	//Anything we cached while the CPU was running may be stale
+	m_iface->InvalidateMemoryCache();
+	InvalidateRegisterCache();
 }
 
 
@@ -212,16 +432,65 @@ void ARMv7MProcessor::DebugResume()
 	LogTrace("Resuming CPU...\n");
 	LogIndenter li;
 
-	//Leave debug state
-	WriteRegisterByIndex(DHCSR, 0xa05f0000);
+	//Write back cached memory, and stop trusting it (or the registers) once the CPU runs
+	m_iface->InvalidateMemoryCache();
+	InvalidateRegisterCache();
 
-	//Poll DHCSR.S_HALT until the CPU is running
-	while(true)
+	//Leave debug state, then poll DHCSR.S_HALT until the CPU is running
+	vector< pair<uint32_t, uint32_t> > writes;
+	writes.push_back(pair<uint32_t, uint32_t>(DHCSR, DHCSR_DBGKEY));
+	uint32_t dhcsr;
+	if(!PollRegisterByIndex(DHCSR, DHCSR_S_HALT, 0, DEBUG_TIMEOUT_US, dhcsr, writes))
 	{
-		uint32_t dhcsr = ReadRegisterByIndex(DHCSR);
-		if(! (dhcsr & 0x00020000) )
-			break;
-		//LogTrace("DHCSR = %08x\n", dhcsr);
-		usleep(1000);
+		LogTrace("DHCSR = %08x\n", dhcsr);
+		throw JtagExceptionWrapper(
+			"Timed out waiting for the CPU to resume",
+			"");
+	}
+}
+
+/**
+	@brief Executes a single instruction, then halts again
+
+	S_HALT is already set before the step, so a read that lands before the core leaves debug state can't be told apart
+	from one after it comes back. Instead we wait for S_RETIRE_ST, which is cleared by every read of DHCSR, so one read
+	up front gets rid of anything left over from before the step. The step request (C_HALT cleared with C_STEP set) and
+	the poll go out in the same batch. The core is back in debug state a few clocks after the instruction retires, so
+	S_HALT is almost always set on the same read; if not, we poll for it separately. Interrupts stay masked while
+	stepping.
+
+	See ARMv7-M arch manual C1.6.2
+ */
+void ARMv7MProcessor::DebugStep()
+{
+	LogTrace("Single-stepping CPU...\n");
+	LogIndenter li;
+
+	//The step can touch memory and will change registers
+	m_iface->InvalidateMemoryCache();
+	InvalidateRegisterCache();
+
+	//Clear S_RETIRE_ST
+	ReadRegisterByIndex(DHCSR);
+
+	vector< pair<uint32_t, uint32_t> > writes;
+	writes.push_back(pair<uint32_t, uint32_t>(DHCSR, DHCSR_DBGKEY | DHCSR_C_MASKINTS | DHCSR_C_STEP | DHCSR_C_DEBUGEN));
+	uint32_t dhcsr;
+	if(!PollRegisterByIndex(DHCSR, DHCSR_S_RETIRE_ST, DHCSR_S_RETIRE_ST, DEBUG_TIMEOUT_US, dhcsr, writes))
+	{
+		LogTrace("DHCSR = %08x\n", dhcsr);
+		throw JtagExceptionWrapper(
+			"Timed out waiting for the CPU to execute a single step",
+			"");
+	}
+	if(dhcsr & DHCSR_S_HALT)
+		return;
+
+	if(!PollRegisterByIndex(DHCSR, DHCSR_S_HALT, DHCSR_S_HALT, DEBUG_TIMEOUT_US, dhcsr))
+	{
+		LogTrace("DHCSR = %08x\n", dhcsr);
+		throw JtagExceptionWrapper(
+			"Timed out waiting for the CPU to halt after a single step",
+			"");
 	}
 }
@@ -96,7 +96,8 @@ public:
 		DCRSR		= 0x037d,	//Debug Core Register Selector
 		DCRDR		= 0x037e,	//Debug Core Register Data Register
 		DEMCR		= 0x037f,	//Debug Exception Monitor Control Register
-		STIR		= 0x03c0	//Software Triggered Interrupt Register
+		STIR		= 0x03c0,	//Software Triggered Interrupt Register
+		MVFR0		= 0x03d0	//Media and FP Feature Register 0
 	};
 
 	//register numbers for DCRSR
@@ -121,7 +122,42 @@ public:
 		XPSR	= 16,	//flags etc
 		MSP		= 17,	//main SP
 		PSP		= 18,	//process SP
-		CTRL	= 20	//{CONTROL, FAULTMASK, BASEPRI, PRIMASK}
+		CTRL	= 20,	//{CONTROL, FAULTMASK, BASEPRI, PRIMASK}
+
+		//Only present if the FP extension is implemented (e.g. Cortex-M4F)
+		FPSCR	= 33,
+		S0 		= 64,
+		S1 		= 65,
+		S2 		= 66,
+		S3 		= 67,
+		S4 		= 68,
+		S5 		= 69,
+		S6 		= 70,
+		S7 		= 71,
+		S8 		= 72,
+		S9 		= 73,
+		S10		= 74,
+		S11		= 75,
+		S12		= 76,
+		S13		= 77,
+		S14		= 78,
+		S15		= 79,
+		S16		= 80,
+		S17		= 81,
+		S18		= 82,
+		S19		= 83,
+		S20		= 84,
+		S21		= 85,
+		S22		= 86,
+		S23		= 87,
+		S24		= 88,
+		S25		= 89,
+		S26		= 90,
+		S27		= 91,
+		S28		= 92,
+		S29		= 93,
+		S30		= 94,
+		S31		= 95
 	};
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -136,9 +172,28 @@ public:
 	// CPU register access
 
 	uint32_t ReadCPURegister(ARM_V7M_CPU_REGISTERS reg);
+	void WriteCPURegister(ARM_V7M_CPU_REGISTERS reg, uint32_t value);
+	void WriteCPURegisters(const std::vector< std::pair<ARM_V7M_CPU_REGISTERS, uint32_t> >& regs);
 	const char* GetRegisterName(ARM_V7M_CPU_REGISTERS reg);
 
+	void ReadRegisterSnapshot();
+	void InvalidateRegisterCache();
+
+	bool HasFPU();
+
 protected:
+	uint32_t ReadCPURegisterSlow(ARM_V7M_CPU_REGISTERS reg);
+	void WriteCPURegisterSlow(ARM_V7M_CPU_REGISTERS reg, uint32_t value);
+
+	///Values of the core registers, captured by ReadRegisterSnapshot() and valid until the CPU resumes
+	std::map<ARM_V7M_CPU_REGISTERS, uint32_t> m_registerCache;
+
+	///True once we've checked MVFR0 for an FPU
+	bool m_fpuProbed;
+
+	///True if the core has the FP extension
+	bool m_hasFPU;
+
 	//void PrintIDRegister(ARMv7MDebugIDRegister did);
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -146,6 +201,7 @@ protected:
 public:
 	virtual void DebugHalt();
 	virtual void DebugResume();
+	virtual void DebugStep();
 
 	virtual void Reset();
 
@@ -0,0 +1,318 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ARMv7MProfiler
+ */
+#include "jtaghal.h"
+#include "ARMv7MProfiler.h"
+
+using namespace std;
+
+///DEMCR (the DWT is useless unless TRCENA is set)
+#define SCS_DEMCR 0xe000edfc
+
+///DEMCR.TRCENA: enable the DWT and ITM
+#define DEMCR_TRCENA 0x01000000
+
+///DWT control register
+#define DWT_CTRL 0xe0001000
+
+///DWT cycle counter
+#define DWT_CYCCNT 0xe0001004
+
+///DWT PC sample register
+#define DWT_PCSR 0xe000101c
+
+///DWT_CTRL.CYCCNTENA: enable the cycle counter
+#define DWT_CTRL_CYCCNTENA 0x00000001
+
+///DWT_CTRL.NOCYCCNT: the cycle counter isn't implemented
+#define DWT_CTRL_NOCYCCNT 0x02000000
+
+///DWT_PCSR reads as this when the core is halted, in reset, or otherwise not executing code
+#define PCSR_IDLE 0xffffffff
+
+///Number of samples per batch sent to the Mem-AP
+#define PROFILER_BATCH_SAMPLES 256
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+ARMv7MProfiler::ARMv7MProfiler(ARMv7MProcessor* cpu)
+	: m_cpu(cpu)
+	, m_ap(cpu->GetMemAccessPort())
+	, m_running(false)
+	, m_sampleCycles(false)
+	, m_savedDemcr(0)
+	, m_savedDwtCtrl(0)
+{
+	Clear();
+}
+
+ARMv7MProfiler::~ARMv7MProfiler()
+{
+	if(m_running)
+		Stop();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sampling
+
+/**
+	@brief Turns on the DWT (and the cycle counter, if requested) so that sampling can begin
+
+	The target is left running. The previous DEMCR and DWT_CTRL values are restored by Stop().
+
+	@param sampleCycles		Read DWT_CYCCNT before and after each batch of samples, to measure how many core clocks apart
+							the samples are
+ */
+void ARMv7MProfiler::Start(bool sampleCycles)
+{
+	if(m_running)
+		Stop();
+
+	m_savedDemcr = m_ap->ReadWord(SCS_DEMCR);
+	m_ap->WriteWord(SCS_DEMCR, m_savedDemcr | DEMCR_TRCENA);
+
+	m_savedDwtCtrl = m_ap->ReadWord(DWT_CTRL);
+	if(sampleCycles)
+	{
+		if(m_savedDwtCtrl & DWT_CTRL_NOCYCCNT)
+		{
+			m_ap->WriteWord(SCS_DEMCR, m_savedDemcr);
+			throw JtagExceptionWrapper(
+				"This core doesn't have a cycle counter",
+				"");
+		}
+		m_ap->WriteWord(DWT_CTRL, m_savedDwtCtrl | DWT_CTRL_CYCCNTENA);
+	}
+
+	m_sampleCycles = sampleCycles;
+	m_running = true;
+}
+
+/**
+	@brief Samples the PC continuously for the given amount of time
+
+	Can be called several times between Start() and Stop(); samples accumulate until Clear() is called. Anyone else
+	sharing the adapter gets a turn every so often (see DebuggerInterface::ReleaseAdapterPeriodically()).
+ */
+void ARMv7MProfiler::Run(double seconds)
+{
+	if(!m_running)
+	{
+		throw JtagExceptionWrapper(
+			"Profiler must be started before it can run",
+			"");
+	}
+
+	double start = GetTime();
+	double now = start;
+	double held = start;
+	while(now - start < seconds)
+	{
+		SampleBatch();
+		m_cpu->GetDebugger()->ReleaseAdapterPeriodically(held);
+		now = GetTime();
+	}
+	m_sampleTime += now - start;
+}
+
+/**
+	@brief Reads one batch of samples and adds them to the histogram
+
+	When counting cycles, DWT_CYCCNT is read once before and once after the PCs rather than with every sample: it's in
+	a different 16-byte block from DWT_PCSR, so interleaving them would cost a TAR write (and a SELECT bank switch) per
+	read.
+ */
+void ARMv7MProfiler::SampleBatch()
+{
+	vector<uint32_t> addrs;
+	if(m_sampleCycles)
+		addrs.push_back(DWT_CYCCNT);
+	for(size_t i=0; i<PROFILER_BATCH_SAMPLES; i++)
+		addrs.push_back(DWT_PCSR);
+	if(m_sampleCycles)
+		addrs.push_back(DWT_CYCCNT);
+
+	vector<uint32_t> data(addrs.size());
+	m_ap->ReadScattered(&addrs[0], &data[0], addrs.size());
+
+	size_t first = m_sampleCycles ? 1 : 0;
+	for(size_t i=0; i<PROFILER_BATCH_SAMPLES; i++)
+	{
+		uint32_t pc = data[first + i];
+		if(pc == PCSR_IDLE)
+			m_idleCount ++;
+		else
+			m_histogram[pc] ++;
+	}
+	m_sampleCount += PROFILER_BATCH_SAMPLES;
+
+	//CYCCNT wraps every 2^32 clocks, which is far longer than a batch takes
+	if(m_sampleCycles)
+	{
+		m_cycles += data[data.size() - 1] - data[0];
+		m_cycleIntervals += PROFILER_BATCH_SAMPLES;
+	}
+}
+
+/**
+	@brief Puts DEMCR and DWT_CTRL back the way they were before Start()
+ */
+void ARMv7MProfiler::Stop()
+{
+	if(!m_running)
+		return;
+
+	if(m_sampleCycles)
+		m_ap->WriteWord(DWT_CTRL, m_savedDwtCtrl);
+	m_ap->WriteWord(SCS_DEMCR, m_savedDemcr);
+	m_running = false;
+}
+
+/**
+	@brief Throws away all samples taken so far
+ */
+void ARMv7MProfiler::Clear()
+{
+	m_histogram.clear();
+	m_sampleCount = 0;
+	m_idleCount = 0;
+	m_sampleTime = 0;
+	m_cycles = 0;
+	m_cycleIntervals = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+/**
+	@brief Gets the average number of samples taken per second
+ */
+double ARMv7MProfiler::GetSampleRate()
+{
+	if(m_sampleTime <= 0)
+		return 0;
+	return m_sampleCount / m_sampleTime;
+}
+
+/**
+	@brief Gets the average number of core clocks between samples (zero if cycle counts weren't captured)
+ */
+double ARMv7MProfiler::GetCyclesPerSample()
+{
+	if(m_cycleIntervals == 0)
+		return 0;
+	return static_cast<double>(m_cycles) / m_cycleIntervals;
+}
+
+void ARMv7MProfiler::PrintStatistics()
+{
+	LogNotice("Profiled %s\n", m_cpu->GetDescription().c_str());
+	LogIndenter li;
+	LogNotice("%lu samples in %.3f sec (%.0f samples/sec)\n",
+		(unsigned long)m_sampleCount, m_sampleTime, GetSampleRate());
+	LogNotice("%lu unique PCs, %lu samples not running code\n",
+		(unsigned long)m_histogram.size(), (unsigned long)m_idleCount);
+	if(m_cycleIntervals)
+		LogNotice("%.1f core clocks between samples\n", GetCyclesPerSample());
+
+	if( (m_sampleCount > 0) && (m_histogram.size() == 1) && (m_histogram.begin()->first == 0) )
+		LogWarning("DWT_PCSR always reads as zero, this core probably doesn't implement PC sampling\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Output
+
+/**
+	@brief Writes the raw histogram, one "address count" line per PC, in address order
+ */
+void ARMv7MProfiler::WriteAddressProfile(string fname)
+{
+	FILE* fp = fopen(fname.c_str(), "w");
+	if(!fp)
+	{
+		throw JtagExceptionWrapper(
+			string("Failed to open profile ") + fname,
+			"");
+	}
+
+	fprintf(fp, "# %lu samples, %.0f samples/sec", (unsigned long)m_sampleCount, GetSampleRate());
+	if(m_cycleIntervals)
+		fprintf(fp, ", %.1f core clocks between samples", GetCyclesPerSample());
+	fprintf(fp, "\n");
+	for(auto it : m_histogram)
+		fprintf(fp, "%08x %lu\n", it.first, (unsigned long)it.second);
+
+	fclose(fp);
+}
+
+/**
+	@brief Writes the histogram in folded-stack format ("symbol count" per line, ready for flamegraph.pl)
+
+	Only the sampled PC is known, so each "stack" is a single frame. PCs below the lowest symbol are written as raw
+	addresses.
+
+	@param fname		Output file
+	@param symbols		Map from the start address of each function to its name
+ */
+void ARMv7MProfiler::WriteFoldedProfile(string fname, const map<uint32_t, string>& symbols)
+{
+	map<string, uint64_t> folded;
+	for(auto it : m_histogram)
+	{
+		auto sym = symbols.upper_bound(it.first);
+		if(sym == symbols.begin())
+		{
+			char tmp[16];
+			snprintf(tmp, sizeof(tmp), "0x%08x", it.first);
+			folded[tmp] += it.second;
+		}
+		else
+		{
+			sym --;
+			folded[sym->second] += it.second;
+		}
+	}
+
+	FILE* fp = fopen(fname.c_str(), "w");
+	if(!fp)
+	{
+		throw JtagExceptionWrapper(
+			string("Failed to open profile ") + fname,
+			"");
+	}
+	for(auto it : folded)
+		fprintf(fp, "%s %lu\n", it.first.c_str(), (unsigned long)it.second);
+	fclose(fp);
+}
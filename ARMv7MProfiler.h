@@ -0,0 +1,120 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ARMv7MProfiler
+ */
+#ifndef ARMv7MProfiler_h
+#define ARMv7MProfiler_h
+
+class ARMv7MProcessor;
+
+/**
+	@brief Non-intrusive PC sampling profiler for ARMv7-M cores, using DWT_PCSR (see ARMv7-M arch manual C1.8.12)
+
+	The target runs normally while the debugger reads DWT_PCSR as fast as the adapter can go, in large pipelined
+	batches, so each sample is a single AP transaction. DWT_CYCCNT can optionally be read around each batch to find
+	out how far apart the samples are in core clocks.
+
+	\ingroup libjtaghal
+ */
+class ARMv7MProfiler
+{
+public:
+	ARMv7MProfiler(ARMv7MProcessor* cpu);
+	virtual ~ARMv7MProfiler();
+
+	void Start(bool sampleCycles = false);
+	void Run(double seconds);
+	void Stop();
+	void Clear();
+
+	void PrintStatistics();
+
+	void WriteAddressProfile(std::string fname);
+	void WriteFoldedProfile(std::string fname, const std::map<uint32_t, std::string>& symbols);
+
+	///Gets the number of times each PC was seen
+	const std::map<uint32_t, uint64_t>& GetHistogram()
+	{ return m_histogram; }
+
+	///Gets the total number of samples taken (including ones where the core wasn't running)
+	uint64_t GetSampleCount()
+	{ return m_sampleCount; }
+
+	///Gets the number of samples taken while the core was halted, sleeping or in reset
+	uint64_t GetIdleSampleCount()
+	{ return m_idleCount; }
+
+	double GetSampleRate();
+	double GetCyclesPerSample();
+
+protected:
+	void SampleBatch();
+
+	///The CPU being profiled
+	ARMv7MProcessor* m_cpu;
+
+	///The Mem-AP the CPU's debug registers are on
+	ARMDebugMemAccessPort* m_ap;
+
+	///True between Start() and Stop()
+	bool m_running;
+
+	///True if DWT_CYCCNT is captured along with each PC
+	bool m_sampleCycles;
+
+	///DEMCR before Start(), restored by Stop()
+	uint32_t m_savedDemcr;
+
+	///DWT_CTRL before Start(), restored by Stop()
+	uint32_t m_savedDwtCtrl;
+
+	///Number of times each PC was seen
+	std::map<uint32_t, uint64_t> m_histogram;
+
+	///Total number of samples
+	uint64_t m_sampleCount;
+
+	///Number of samples where DWT_PCSR didn't hold a valid PC
+	uint64_t m_idleCount;
+
+	///Total time spent sampling, in seconds
+	double m_sampleTime;
+
+	///Total core clock cycles spent in cycle-counted batches
+	uint64_t m_cycles;
+
+	///Number of samples taken in cycle-counted batches
+	uint64_t m_cycleIntervals;
+};
+
+#endif
@@ -42,6 +42,9 @@
 
 using namespace std;
 
+///How long to wait for the core to halt or restart before giving up
+#define DEBUG_TIMEOUT_US 1000000
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -149,36 +152,40 @@ void ARMv7Processor::Reset()
  */
 void ARMv7Processor::DebugHalt()
 {
-	//Request a halt by writing to DBGDRCR.HRQ
+	//Request a halt by writing to DBGDRCR.HRQ, then poll DBGDSCR.HALTED until it gets to 1
 	LogTrace("Halting CPU to enter debug state...\n");
 	LogIndenter li;
-	WriteRegisterByIndex(DBGDRCR, 0x00000001);
-
-	//Poll DBGDSCR.HALTED until it gets to 1
-	while(true)
+	vector< pair<uint32_t, uint32_t> > writes;
+	writes.push_back(pair<uint32_t, uint32_t>(DBGDRCR, 0x00000001));
+	uint32_t v;
+	bool ok = PollRegisterByIndex(DBGDSCR_EXT, 0x00000001, 0x00000001, DEBUG_TIMEOUT_US, v, writes);
+	LogTrace("DBGDSCR = %08x\n", v);
+	if(!ok)
 	{
-		uint32_t v = ReadRegisterByIndex(DBGDSCR_EXT);
-		LogTrace("DBGDSCR = %08x\n", v);
-		if(v & 1)
-			break;
-		usleep(1000);
+		throw JtagExceptionWrapper(
+			"Timed out waiting for the CPU to halt",
+			"");
 	}
+
+	//Anything we cached while the CPU was running may be stale
+	m_iface->InvalidateMemoryCache();
 }
 
 void ARMv7Processor::DebugResume()
 {
-	//Request a resume by writing to DBGDRCR.RRQ
+	//Request a resume by writing to DBGDRCR.RRQ, then poll DBGDSCR.RESTARTED until it gets to 1
 	LogTrace("Restarting CPU...\n");
 	LogIndenter li;
-	WriteRegisterByIndex(DBGDRCR, 0x00000002);
-
-	//Poll DBGDSCR.RESTARTED unti it gets to 1
-	while(true)
+	m_iface->InvalidateMemoryCache();
+	vector< pair<uint32_t, uint32_t> > writes;
+	writes.push_back(pair<uint32_t, uint32_t>(DBGDRCR, 0x00000002));
+	uint32_t v;
+	bool ok = PollRegisterByIndex(DBGDSCR_EXT, 0x00000002, 0x00000002, DEBUG_TIMEOUT_US, v, writes);
+	LogTrace("DBGDSCR = %08x\n", v);
+	if(!ok)
 	{
-		uint32_t v = ReadRegisterByIndex(DBGDSCR_EXT);
-		LogTrace("DBGDSCR = %08x\n", v);
-		if(v & 2)
-			break;
-		usleep(1000);
+		throw JtagExceptionWrapper(
+			"Timed out waiting for the CPU to resume",
+			"");
 	}
 }
@@ -57,10 +57,66 @@ DebuggableDevice::~DebuggableDevice()
 
 uint32_t DebuggableDevice::ReadMemory(uint32_t addr)
 {
+	auto cache = m_iface->GetMemoryCache();
+	if(cache)
+		return cache->ReadWord(addr);
 	return m_iface->ReadMemory(addr);
 }
 
 void DebuggableDevice::WriteMemory(uint32_t addr, uint32_t value)
 {
-	m_iface->WriteMemory(addr, value);
+	auto cache = m_iface->GetMemoryCache();
+	if(cache)
+		cache->WriteWord(addr, value);
+	else
+		m_iface->WriteMemory(addr, value);
+}
+
+void DebuggableDevice::ReadMemoryBlock(uint32_t addr, uint32_t* data, size_t count)
+{
+	auto cache = m_iface->GetMemoryCache();
+	if(cache)
+		cache->ReadBytes(addr, reinterpret_cast<uint8_t*>(data), count*4);
+	else
+		m_iface->ReadMemoryBlock(addr, data, count);
+}
+
+void DebuggableDevice::WriteMemoryBlock(uint32_t addr, const uint32_t* data, size_t count)
+{
+	auto cache = m_iface->GetMemoryCache();
+	if(cache)
+		cache->WriteBytes(addr, reinterpret_cast<const uint8_t*>(data), count*4);
+	else
+		m_iface->WriteMemoryBlock(addr, data, count);
+}
+
+void DebuggableDevice::ReadMemoryBytes(uint32_t addr, uint8_t* data, size_t len, unsigned int maxWidth)
+{
+	auto cache = m_iface->GetMemoryCache();
+	if(cache)
+		cache->ReadBytes(addr, data, len, maxWidth);
+	else
+		m_iface->ReadMemoryBytes(addr, data, len, maxWidth);
+}
+
+void DebuggableDevice::WriteMemoryBytes(uint32_t addr, const uint8_t* data, size_t len, unsigned int maxWidth)
+{
+	auto cache = m_iface->GetMemoryCache();
+	if(cache)
+		cache->WriteBytes(addr, data, len, maxWidth);
+	else
+		m_iface->WriteMemoryBytes(addr, data, len, maxWidth);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Debug commands
+
+/**
+	@brief Executes a single instruction, then halts again (the CPU must already be halted)
+ */
+void DebuggableDevice::DebugStep()
+{
+	throw JtagExceptionWrapper(
+		"Single-step not implemented for this CPU yet",
+		"");
 }
@@ -54,8 +54,13 @@ public:
 
 	virtual std::string GetDescription() =0;
 
+	//Memory access, through the interface's TargetMemoryCache if it has one
 	virtual uint32_t ReadMemory(uint32_t addr);
 	virtual void WriteMemory(uint32_t addr, uint32_t value);
+	virtual void ReadMemoryBlock(uint32_t addr, uint32_t* data, size_t count);
+	virtual void WriteMemoryBlock(uint32_t addr, const uint32_t* data, size_t count);
+	virtual void ReadMemoryBytes(uint32_t addr, uint8_t* data, size_t len, unsigned int maxWidth = 4);
+	virtual void WriteMemoryBytes(uint32_t addr, const uint8_t* data, size_t len, unsigned int maxWidth = 4);
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Debug commands
@@ -67,9 +72,16 @@ public:
 	virtual void DebugHalt() =0;
 	virtual void DebugResume() =0;
 
+	//Execute a single instruction and halt again
+	virtual void DebugStep();
+
 	//Print out all registers
 	virtual void PrintRegisters() =0;
 
+	///Gets the debugger this device is attached to
+	DebuggerInterface* GetDebugger()
+	{ return m_iface; }
+
 protected:
 	DebuggerInterface* m_iface;
 };
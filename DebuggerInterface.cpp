@@ -38,14 +38,26 @@
 
 using namespace std;
 
+///How long a long-running loop (polling, streaming, profiling) keeps the adapter before letting others have a turn (us).
+///Well under the server's ownership quantum, so we let go at a point of our choosing rather than being preempted.
+#define ADAPTER_HOLD_TIME_US	100000
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
-DebuggerInterface::~DebuggerInterface()
+DebuggerInterface::DebuggerInterface()
+	: m_memoryCache(NULL)
 {
 
 }
 
+DebuggerInterface::~DebuggerInterface()
+{
+	//Too late to flush here, our derived class is already gone
+	delete m_memoryCache;
+	m_memoryCache = NULL;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Accessors
 
@@ -66,3 +78,321 @@ void DebuggerInterface::AddTarget(DebuggableDevice* target)
 {
 	m_targets.push_back(target);
 }
+
+/**
+	@brief Lets other clients sharing the underlying adapter have a turn (see TestInterface::ReleaseAdapter())
+
+	Called at stopping points the caller chooses, such as after programming a device. Library code never calls it in
+	the middle of a sequence (e.g. with a flash loader running). No-op unless the debugger sits on a networked
+	adapter.
+ */
+void DebuggerInterface::ReleaseAdapter()
+{
+}
+
+/**
+	@brief Called each time around a long-running loop: lets other clients have a turn (see ReleaseAdapter()) once we've
+	held the adapter for ADAPTER_HOLD_TIME_US
+
+	@param since		Time we last let go of the adapter. Updated when we do.
+ */
+void DebuggerInterface::ReleaseAdapterPeriodically(double& since)
+{
+	double now = GetTime();
+	if(now - since < ADAPTER_HOLD_TIME_US * 1e-6)
+		return;
+
+	ReleaseAdapter();
+	since = now;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory access
+
+/**
+	@brief Reads a 16-bit halfword of memory
+
+	The default implementation reads the containing word and extracts the halfword from it.
+
+	@param address		Address to read (must be halfword aligned)
+ */
+uint16_t DebuggerInterface::ReadMemoryHalfword(uint32_t address)
+{
+	if(address & 1)
+	{
+		throw JtagExceptionWrapper(
+			"Halfword accesses must be aligned",
+			"");
+	}
+
+	return ReadMemory(address & ~3) >> ( (address & 2) * 8);
+}
+
+/**
+	@brief Reads a single byte of memory
+
+	The default implementation reads the containing word and extracts the byte from it.
+ */
+uint8_t DebuggerInterface::ReadMemoryByte(uint32_t address)
+{
+	return ReadMemory(address & ~3) >> ( (address & 3) * 8);
+}
+
+/**
+	@brief Writes a 16-bit halfword of memory
+
+	The default implementation does a read-modify-write of the containing word. Interfaces that can do narrow bus
+	accesses should override this, since the read-modify-write is not atomic and touches the neighboring bytes.
+
+	@param address		Address to write (must be halfword aligned)
+	@param value		Data to write
+ */
+void DebuggerInterface::WriteMemoryHalfword(uint32_t address, uint16_t value)
+{
+	if(address & 1)
+	{
+		throw JtagExceptionWrapper(
+			"Halfword accesses must be aligned",
+			"");
+	}
+
+	uint32_t shift = (address & 2) * 8;
+	uint32_t word = ReadMemory(address & ~3);
+	word = (word & ~(0xffff << shift)) | (value << shift);
+	WriteMemory(address & ~3, word);
+}
+
+/**
+	@brief Writes a single byte of memory (see WriteMemoryHalfword())
+ */
+void DebuggerInterface::WriteMemoryByte(uint32_t address, uint8_t value)
+{
+	uint32_t shift = (address & 3) * 8;
+	uint32_t word = ReadMemory(address & ~3);
+	word = (word & ~(0xff << shift)) | (value << shift);
+	WriteMemory(address & ~3, word);
+}
+
+/**
+	@brief Reads a block of consecutive 32-bit words of memory
+
+	The default implementation reads one word at a time. Interfaces that can stream memory (e.g. using address
+	auto-increment) should override this.
+
+	@param address		Address of the first word
+	@param data			Output buffer
+	@param count		Number of words to read
+ */
+void DebuggerInterface::ReadMemoryBlock(uint32_t address, uint32_t* data, size_t count)
+{
+	for(size_t i=0; i<count; i++)
+		data[i] = ReadMemory(address + i*4);
+}
+
+/**
+	@brief Writes a block of consecutive 32-bit words of memory
+
+	@param address		Address of the first word
+	@param data			Data to write
+	@param count		Number of words to write
+ */
+void DebuggerInterface::WriteMemoryBlock(uint32_t address, const uint32_t* data, size_t count)
+{
+	for(size_t i=0; i<count; i++)
+		WriteMemory(address + i*4, data[i]);
+}
+
+/**
+	@brief Performs several block reads and writes, in order
+
+	The default implementation just calls ReadMemoryBlock() and WriteMemoryBlock() for each transfer. Interfaces that
+	can queue up memory accesses override it to run the whole batch in one go, which lets callers do things like
+	reading a buffer and updating the pointer to it in a single round trip.
+
+	@param batch		The transfers to perform
+ */
+void DebuggerInterface::MemoryBatch(vector<MemoryTransfer>& batch)
+{
+	for(auto& t : batch)
+	{
+		if(t.write)
+			WriteMemoryBlock(t.address, t.data, t.count);
+		else
+			ReadMemoryBlock(t.address, t.data, t.count);
+	}
+}
+
+/**
+	@brief Reads the same 32-bit word of memory several times in a row
+
+	Used for polling status registers. The default implementation just calls ReadMemory() in a loop; interfaces that
+	can queue up memory accesses override it to do all of the reads in one round trip.
+
+	@param address		Address of the word
+	@param data			Output buffer, one entry per read
+	@param count		Number of reads
+ */
+void DebuggerInterface::ReadMemoryRepeated(uint32_t address, uint32_t* data, size_t count)
+{
+	for(size_t i=0; i<count; i++)
+		data[i] = ReadMemory(address);
+}
+
+/**
+	@brief Polls a word of memory until (value & mask) == match, or the operation times out
+
+	Each round reads the word PollBackoff::GetDepth() times back to back with ReadMemoryRepeated(), so an operation
+	that finishes within a round trip or two is caught without sleeping. Between rounds we back off on the curve for
+	the operation type. The completion time is recorded in the PollBackoff histograms.
+
+	@param address		Address of the word to poll
+	@param mask			Bits to check
+	@param match		Value the masked bits must have
+	@param op			Type of operation we're waiting for
+	@param value		The last value read
+
+	@return True if the word matched, false on timeout
+ */
+bool DebuggerInterface::PollMemory(uint32_t address, uint32_t mask, uint32_t match, PollOperation op, uint32_t& value)
+{
+	PollBackoff backoff(op);
+	vector<uint32_t> data(backoff.GetDepth());
+	while(true)
+	{
+		ReadMemoryRepeated(address, &data[0], data.size());
+		for(auto d : data)
+		{
+			value = d;
+			if( (value & mask) == match)
+			{
+				backoff.Complete();
+				return true;
+			}
+		}
+
+		if(!backoff.Backoff())
+			return false;
+	}
+}
+
+/**
+	@brief Reads an arbitrary range of bytes from memory
+
+	The word-aligned middle of the range is read with ReadMemoryBlock(), and any unaligned head or tail with the
+	widest single accesses the alignment allows.
+
+	@param address		Address of the first byte
+	@param data			Output buffer
+	@param len			Number of bytes to read
+	@param maxWidth		Widest access (in bytes) the target memory can handle: 1, 2, or 4
+ */
+void DebuggerInterface::ReadMemoryBytes(uint32_t address, uint8_t* data, size_t len, unsigned int maxWidth)
+{
+	while(len > 0)
+	{
+		if( (maxWidth >= 4) && ( (address & 3) == 0) && (len >= 4) )
+		{
+			size_t n = len & ~3;
+			vector<uint32_t> words(n / 4);
+			ReadMemoryBlock(address, &words[0], words.size());
+			memcpy(data, &words[0], n);
+			address += n;
+			data += n;
+			len -= n;
+		}
+		else if( (maxWidth >= 2) && ( (address & 1) == 0) && (len >= 2) )
+		{
+			uint16_t v = ReadMemoryHalfword(address);
+			memcpy(data, &v, 2);
+			address += 2;
+			data += 2;
+			len -= 2;
+		}
+		else
+		{
+			*data = ReadMemoryByte(address);
+			address ++;
+			data ++;
+			len --;
+		}
+	}
+}
+
+/**
+	@brief Writes an arbitrary range of bytes to memory (see ReadMemoryBytes())
+
+	@param address		Address of the first byte
+	@param data			Data to write
+	@param len			Number of bytes to write
+	@param maxWidth		Widest access (in bytes) the target memory can handle: 1, 2, or 4
+ */
+void DebuggerInterface::WriteMemoryBytes(uint32_t address, const uint8_t* data, size_t len, unsigned int maxWidth)
+{
+	while(len > 0)
+	{
+		if( (maxWidth >= 4) && ( (address & 3) == 0) && (len >= 4) )
+		{
+			size_t n = len & ~3;
+			vector<uint32_t> words(n / 4);
+			memcpy(&words[0], data, n);
+			WriteMemoryBlock(address, &words[0], words.size());
+			address += n;
+			data += n;
+			len -= n;
+		}
+		else if( (maxWidth >= 2) && ( (address & 1) == 0) && (len >= 2) )
+		{
+			uint16_t v;
+			memcpy(&v, data, 2);
+			WriteMemoryHalfword(address, v);
+			address += 2;
+			data += 2;
+			len -= 2;
+		}
+		else
+		{
+			WriteMemoryByte(address, *data);
+			address ++;
+			data ++;
+			len --;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory caching
+
+/**
+	@brief Turns on caching of memory accesses made through DebuggableDevice
+
+	Any existing cache is flushed and replaced.
+
+	@param writeBack	True to hold writes in the cache until it's flushed, false to write them through
+ */
+void DebuggerInterface::EnableMemoryCache(bool writeBack)
+{
+	DisableMemoryCache();
+	m_memoryCache = new TargetMemoryCache(this, writeBack);
+}
+
+/**
+	@brief Writes back any cached writes and turns caching off
+ */
+void DebuggerInterface::DisableMemoryCache()
+{
+	if(!m_memoryCache)
+		return;
+
+	m_memoryCache->Flush();
+	delete m_memoryCache;
+	m_memoryCache = NULL;
+}
+
+/**
+	@brief Writes back and forgets all cached memory, if caching is on (see TargetMemoryCache::Invalidate())
+ */
+void DebuggerInterface::InvalidateMemoryCache()
+{
+	if(m_memoryCache)
+		m_memoryCache->Invalidate();
+}
@@ -37,8 +37,10 @@
 #define DebuggerInterface_h
 
 #include <stdlib.h>
+#include "PollBackoff.h"
 
 class DebuggableDevice;
+class TargetMemoryCache;
 
 /**
 	@brief Generic base class for all debugger interfaces (may connect to multiple DebuggableDevice's in a SoC)
@@ -48,6 +50,7 @@ class DebuggableDevice;
 class DebuggerInterface
 {
 public:
+	DebuggerInterface();
 	virtual ~DebuggerInterface();
 
 	///Returns the number of DebuggableDevice's attached to this debugger
@@ -59,14 +62,72 @@ public:
 	///Adds a new debuggable device to this interface (called during topology discovery)
 	void AddTarget(DebuggableDevice* target);
 
-	///Read a single 32-bit word of memory (TODO support smaller sizes)
+	virtual void ReleaseAdapter();
+	void ReleaseAdapterPeriodically(double& since);
+
+	///Read a single 32-bit word of memory
 	virtual uint32_t ReadMemory(uint32_t address) =0;
 
-	///Writes a single 32-bit word of memory (TODO support smaller sizes)
+	///Writes a single 32-bit word of memory
 	virtual void WriteMemory(uint32_t address, uint32_t value) =0;
 
+	virtual uint16_t ReadMemoryHalfword(uint32_t address);
+	virtual uint8_t ReadMemoryByte(uint32_t address);
+	virtual void WriteMemoryHalfword(uint32_t address, uint16_t value);
+	virtual void WriteMemoryByte(uint32_t address, uint8_t value);
+
+	virtual void ReadMemoryBlock(uint32_t address, uint32_t* data, size_t count);
+	virtual void WriteMemoryBlock(uint32_t address, const uint32_t* data, size_t count);
+
+	virtual void ReadMemoryBytes(uint32_t address, uint8_t* data, size_t len, unsigned int maxWidth = 4);
+	virtual void WriteMemoryBytes(uint32_t address, const uint8_t* data, size_t len, unsigned int maxWidth = 4);
+
+	/**
+		@brief One block of 32-bit words to read or write as part of a MemoryBatch()
+	 */
+	struct MemoryTransfer
+	{
+		MemoryTransfer(uint32_t a, bool w, uint32_t* d, size_t c)
+		: address(a)
+		, write(w)
+		, data(d)
+		, count(c)
+		{}
+
+		///Address of the first word
+		uint32_t	address;
+
+		///True for a write, false for a read
+		bool		write;
+
+		///Data to write, or buffer for the data read
+		uint32_t*	data;
+
+		///Number of words
+		size_t		count;
+	};
+
+	virtual void MemoryBatch(std::vector<MemoryTransfer>& batch);
+
+	virtual void ReadMemoryRepeated(uint32_t address, uint32_t* data, size_t count);
+	bool PollMemory(uint32_t address, uint32_t mask, uint32_t match, PollOperation op, uint32_t& value);
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Memory caching (see TargetMemoryCache)
+
+	virtual void EnableMemoryCache(bool writeBack = false);
+	void DisableMemoryCache();
+	void InvalidateMemoryCache();
+
+	///Gets the memory cache used by DebuggableDevice memory accesses, or NULL if caching is off
+	TargetMemoryCache* GetMemoryCache()
+	{ return m_memoryCache; }
+
 protected:
 
+	///The memory cache, if enabled
+	TargetMemoryCache* m_memoryCache;
+
 	///The devices (NOT automatically deleted at destruction time)
 	std::vector<DebuggableDevice*> m_targets;
 };
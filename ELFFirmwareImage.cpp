@@ -0,0 +1,153 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ELFFirmwareImage
+ */
+
+#include "jtaghal.h"
+#include "ELFFirmwareImage.h"
+
+using namespace std;
+
+///Size of an ELF32 file header
+#define ELF32_EHDR_SIZE		52
+
+///Size of an ELF32 program header
+#define ELF32_PHDR_SIZE		32
+
+///Program header type for a loadable segment
+#define ELF_PT_LOAD			1
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Parses an ELF image from memory (the segment data is copied)
+ */
+ELFFirmwareImage::ELFFirmwareImage(const unsigned char* data, size_t len)
+	: m_entry(0)
+{
+	Parse(data, len);
+}
+
+/**
+	@brief Loads an ELF image from a file (the segments point into the mapped file)
+ */
+ELFFirmwareImage::ELFFirmwareImage(string fname)
+	: m_entry(0)
+{
+	MapFile(fname);
+	Parse(m_map, m_mapLen);
+}
+
+ELFFirmwareImage::~ELFFirmwareImage()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parsing
+
+/**
+	@brief Checks for the ELF magic number
+ */
+bool ELFFirmwareImage::Detect(const unsigned char* data, size_t len)
+{
+	return (len >= 4) && (data[0] == 0x7f) && (data[1] == 'E') && (data[2] == 'L') && (data[3] == 'F');
+}
+
+void ELFFirmwareImage::Parse(const uint8_t* data, size_t len)
+{
+	m_format = "ELF";
+
+	if(!Detect(data, len) || (len < ELF32_EHDR_SIZE) )
+	{
+		throw JtagExceptionWrapper(
+			"Not a valid ELF file",
+			"");
+	}
+
+	//e_ident[EI_CLASS]: 1 = 32 bit
+	if(data[4] != 1)
+	{
+		throw JtagExceptionWrapper(
+			"Only 32-bit ELF images are supported",
+			"");
+	}
+
+	//e_ident[EI_DATA]: 1 = little endian, 2 = big endian
+	bool bigEndian = (data[5] == 2);
+	auto read16 = [&](size_t off) -> uint32_t
+	{
+		if(bigEndian)
+			return (data[off] << 8) | data[off+1];
+		return data[off] | (data[off+1] << 8);
+	};
+	auto read32 = [&](size_t off) -> uint32_t
+	{
+		if(bigEndian)
+			return (read16(off) << 16) | read16(off+2);
+		return read16(off) | (read16(off+2) << 16);
+	};
+
+	m_entry = read32(24);
+	uint32_t phoff = read32(28);
+	uint32_t phentsize = read16(42);
+	uint32_t phnum = read16(44);
+	if( (phentsize < ELF32_PHDR_SIZE) || (phoff + (uint64_t)phentsize*phnum > len) )
+	{
+		throw JtagExceptionWrapper(
+			"ELF program header table is truncated",
+			"");
+	}
+
+	for(uint32_t i=0; i<phnum; i++)
+	{
+		size_t ph = phoff + i*phentsize;
+		if(read32(ph) != ELF_PT_LOAD)
+			continue;
+
+		uint32_t offset = read32(ph + 4);
+		uint32_t paddr = read32(ph + 12);
+		uint32_t filesz = read32(ph + 16);
+		if(offset + (uint64_t)filesz > len)
+		{
+			throw JtagExceptionWrapper(
+				"ELF segment runs past the end of the file",
+				"");
+		}
+
+		LogTrace("Segment %u: %u bytes at 0x%08x\n", i, filesz, paddr);
+		AddSegment(paddr, data + offset, filesz);
+	}
+
+	SortSegments();
+}
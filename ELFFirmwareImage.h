@@ -0,0 +1,70 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ELFFirmwareImage
+ */
+
+#ifndef ELFFirmwareImage_h
+#define ELFFirmwareImage_h
+
+#include "SparseFirmwareImage.h"
+
+/**
+	@brief Firmware image loaded from a 32-bit ELF executable
+
+	Each PT_LOAD program header with file contents becomes one segment at its physical (load) address, so initialized
+	data that the startup code copies to RAM is programmed at its flash address. Sections without file contents (.bss)
+	are skipped.
+
+	\ingroup libjtaghal
+ */
+class ELFFirmwareImage : public SparseFirmwareImage
+{
+public:
+	ELFFirmwareImage(const unsigned char* data, size_t len);
+	ELFFirmwareImage(std::string fname);
+	virtual ~ELFFirmwareImage();
+
+	static bool Detect(const unsigned char* data, size_t len);
+
+	///Gets the entry point address from the ELF header
+	uint32_t GetEntryPoint()
+	{ return m_entry; }
+
+protected:
+	void Parse(const uint8_t* data, size_t len);
+
+	///Entry point address
+	uint32_t m_entry;
+};
+
+#endif
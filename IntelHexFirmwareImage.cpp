@@ -0,0 +1,185 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of IntelHexFirmwareImage
+ */
+
+#include "jtaghal.h"
+#include "IntelHexFirmwareImage.h"
+#include <ctype.h>
+
+using namespace std;
+
+///Record types
+enum IntelHexRecordType
+{
+	IHEX_DATA					= 0,
+	IHEX_END_OF_FILE			= 1,
+	IHEX_EXTENDED_SEGMENT		= 2,
+	IHEX_START_SEGMENT			= 3,
+	IHEX_EXTENDED_LINEAR		= 4,
+	IHEX_START_LINEAR			= 5
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Parses an Intel HEX image from memory
+ */
+IntelHexFirmwareImage::IntelHexFirmwareImage(const unsigned char* data, size_t len)
+{
+	Parse(data, len);
+}
+
+/**
+	@brief Loads an Intel HEX image from a file
+ */
+IntelHexFirmwareImage::IntelHexFirmwareImage(string fname)
+{
+	MapFile(fname);
+	Parse(m_map, m_mapLen);
+
+	//Everything was decoded into our own buffers
+	UnmapFile();
+}
+
+IntelHexFirmwareImage::~IntelHexFirmwareImage()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parsing
+
+/**
+	@brief Checks if the data starts with something that looks like a HEX record (a colon and a byte count and address)
+ */
+bool IntelHexFirmwareImage::Detect(const unsigned char* data, size_t len)
+{
+	vector<uint8_t> bytes;
+	return (len >= 7) && (data[0] == ':') && DecodeHex(data + 1, 6, bytes);
+}
+
+void IntelHexFirmwareImage::Parse(const uint8_t* data, size_t len)
+{
+	m_format = "Intel HEX";
+
+	uint32_t base = 0;
+	uint32_t start = 0;
+	vector<uint8_t> segment;
+	vector<uint8_t> bytes;
+	size_t pos = 0;
+	bool done = false;
+	for(unsigned int line = 1; (pos < len) && !done; line++)
+	{
+		//Find the end of the line, ignoring trailing whitespace
+		size_t end = pos;
+		while( (end < len) && (data[end] != '\n') )
+			end ++;
+		size_t next = end + 1;
+		while( (end > pos) && isspace(data[end-1]) )
+			end --;
+
+		const uint8_t* text = data + pos;
+		size_t textlen = end - pos;
+		pos = next;
+		if(textlen == 0)
+			continue;
+
+		//Byte count, address (2), type, data, checksum. All of the bytes sum to zero.
+		if( (text[0] != ':') || !DecodeHex(text + 1, textlen - 1, bytes) ||
+			(bytes.size() < 5) || (bytes.size() != bytes[0] + 5u) )
+		{
+			throw JtagExceptionWrapper(
+				string("Malformed Intel HEX record on line ") + to_string(line),
+				"");
+		}
+		uint8_t sum = 0;
+		for(auto b : bytes)
+			sum += b;
+		if(sum != 0)
+		{
+			throw JtagExceptionWrapper(
+				string("Bad Intel HEX checksum on line ") + to_string(line),
+				"");
+		}
+
+		uint32_t addr = (bytes[1] << 8) | bytes[2];
+		const uint8_t* payload = &bytes[4];
+		size_t count = bytes[0];
+		switch(bytes[3])
+		{
+			case IHEX_DATA:
+				{
+					//Start a new segment unless this carries straight on from the last record
+					uint32_t full = base + addr;
+					if(!segment.empty() && (full != start + segment.size()) )
+						AddSegment(start, segment);
+					if(segment.empty())
+						start = full;
+					segment.insert(segment.end(), payload, payload + count);
+				}
+				break;
+
+			case IHEX_END_OF_FILE:
+				done = true;
+				break;
+
+			case IHEX_EXTENDED_SEGMENT:
+			case IHEX_EXTENDED_LINEAR:
+				if(count != 2)
+				{
+					throw JtagExceptionWrapper(
+						string("Malformed Intel HEX address record on line ") + to_string(line),
+						"");
+				}
+				base = (payload[0] << 8) | payload[1];
+				if(bytes[3] == IHEX_EXTENDED_SEGMENT)
+					base <<= 4;
+				else
+					base <<= 16;
+				break;
+
+			case IHEX_START_SEGMENT:
+			case IHEX_START_LINEAR:
+				break;
+
+			default:
+				throw JtagExceptionWrapper(
+					string("Unknown Intel HEX record type on line ") + to_string(line),
+					"");
+		}
+	}
+
+	AddSegment(start, segment);
+	SortSegments();
+}
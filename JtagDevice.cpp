@@ -62,7 +62,7 @@ JtagDevice::JtagDevice(uint32_t idcode, JtagInterface* iface, size_t pos, size_t
 , m_iface(iface)
 , m_pos(pos)
 {
-	memset(m_cachedIR, 0xFF, sizeof(m_cachedIR));
+	InvalidateIRCache();
 }
 
 /**
@@ -145,6 +145,7 @@ void JtagDevice::SetIRDeferred(const unsigned char* data, int count)
 	if(count & 7)
 		bytecount ++;
 
+	m_iface->CheckDeviceCaches();
 	if( (m_irlength < 32) && (0 == memcmp(data, &m_cachedIR, bytecount)))
 	{
 		//do nothing, cache hit
@@ -176,6 +177,7 @@ void JtagDevice::SetIR(const unsigned char* data, int count)
 			"");
 	}
 
+	m_iface->CheckDeviceCaches();
 	if( (0 == memcmp(data, &m_cachedIR, bytecount)) )
 	{
 		//do nothing, cache hit
@@ -242,6 +244,16 @@ bool JtagDevice::IsSplitScanSupported()
 	return m_iface->IsSplitScanSupported();
 }
 
+/**
+	@brief Wrapper around JtagInterface::ScanDRBulk()
+
+	See JtagInterface documentation for more details.
+ */
+void JtagDevice::ScanDRBulk(const unsigned char* send_data, int count)
+{
+	m_iface->ScanDRBulk((int)m_pos, send_data, count);
+}
+
 /**
 	@brief Wrapper around JtagInterface::ScanDRSplitWrite()
 
@@ -322,6 +334,26 @@ void JtagDevice::ResetToIdle()
 	m_iface->ResetToIdle();
 }
 
+/**
+	@brief Writes back anything the device is holding on the target's behalf (e.g. write-back memory cache pages)
+
+	Nothing is forgotten. Derived classes which defer writes should override this.
+ */
+void JtagDevice::FlushCaches()
+{
+}
+
+/**
+	@brief Discards everything cached about the device's state, since somebody else may have used the chain
+
+	Must not do any I/O, so call FlushCaches() first if deferred writes matter. Derived classes which shadow registers
+	of their own should extend this.
+ */
+void JtagDevice::InvalidateCaches()
+{
+	InvalidateIRCache();
+}
+
 /**
 	@brief Prints lots of general debug / system information
  */
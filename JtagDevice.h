@@ -59,6 +59,15 @@ public:
 
 	virtual void PrintInfo();
 
+	virtual void FlushCaches();
+	virtual void InvalidateCaches();
+
+	/**
+		@brief Forgets what we last loaded into the IR, so the next SetIR() call always does a scan
+	 */
+	void InvalidateIRCache()
+	{ memset(m_cachedIR, 0xFF, sizeof(m_cachedIR)); }
+
 public:
 
 	/**
@@ -82,6 +91,7 @@ public:
 	void SetIR(const unsigned char* data, unsigned char* data_out, int count);
 	void ScanDR(const unsigned char* send_data, unsigned char* rcv_data, int count);
 	void ScanDRDeferred(const unsigned char* send_data, int count);
+	void ScanDRBulk(const unsigned char* send_data, int count);
 	bool IsSplitScanSupported();
 	void ScanDRSplitWrite(const unsigned char* send_data, unsigned char* rcv_data, int count);
 	void ScanDRSplitRead(unsigned char* rcv_data, int count);
@@ -531,6 +531,42 @@ void JtagInterface::ScanDR(unsigned int device, const unsigned char* send_data,
 	Commit();
 }
 
+/**
+	@brief Sets the DR for a specific device in the chain to a large value that is likely to be sent again later, such
+	as an FPGA bitstream. No output data is returned.
+
+	Starts and ends in Run-Test-Idle state.
+
+	@throw JtagException if any shift operation fails.
+
+	@param device		Zero-based index of the target device. All other devices are assumed to be in BYPASS mode and
+						their DR is set to zero.
+	@param send_data	The data value to scan (see ShiftData() for bit/byte ordering)
+	@param count 		Number of bits to scan
+ */
+void JtagInterface::ScanDRBulk(unsigned int device, const unsigned char* send_data, size_t count)
+{
+	EnterShiftDR();
+
+	if(m_devices.size() == 1)
+		ShiftDataBulk(true, send_data, count);
+
+	//Pad the data for devices in BYPASS, same as ScanDR()
+	else
+	{
+		size_t shift_bits = (m_devices.size() - 1) + count;
+		vector<uint8_t> txd((shift_bits + 7) / 8, 0x00);
+		size_t leading_bits = device;
+		for(size_t i=0; i<count; i++)
+			PokeBit(&txd[0], i+leading_bits, PeekBit(send_data, i));
+		ShiftDataBulk(true, &txd[0], shift_bits);
+	}
+
+	LeaveExit1DR();
+
+	Commit();
+}
+
 /**
 	@brief Sets the DR for a specific device in the chain and defers the operation if possible.
 
@@ -638,6 +674,11 @@ void JtagInterface::ScanDRSplitRead(unsigned int /*device*/, unsigned char* rcv_
 	ShiftDataReadOnly(rcv_data, count);
 }
 
+void JtagInterface::ShiftDataBulk(bool last_tms, const unsigned char* send_data, size_t count)
+{
+	ShiftData(last_tms, send_data, NULL, count);
+}
+
 bool JtagInterface::ShiftDataWriteOnly(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count)
 {
 	//default to ShiftData() in base class
@@ -791,3 +832,37 @@ double JtagInterface::GetShiftTime()
 {
 	return m_perfShiftTime;
 }
+
+/**
+	@brief Writes back anything the devices on the chain are holding on the target's behalf (see
+	JtagDevice::FlushCaches())
+ */
+void JtagInterface::FlushDeviceCaches()
+{
+	for(size_t i=0; i<m_devices.size(); i++)
+		GetJtagDevice(i)->FlushCaches();
+}
+
+/**
+	@brief Discards everything the devices on the chain have cached about their own state (IR contents, shadow
+	registers, etc).
+
+	Call this whenever something other than us may have driven the chain, for example after sharing the adapter with
+	other clients (see NetworkedJtagInterface::ReleaseAdapter()). Nothing is sent to the adapter, so anything deferred
+	must be written back with FlushDeviceCaches() first.
+ */
+void JtagInterface::InvalidateDeviceCaches()
+{
+	for(size_t i=0; i<m_devices.size(); i++)
+		GetJtagDevice(i)->InvalidateCaches();
+}
+
+/**
+	@brief Called by devices before they rely on anything they've cached about their own state
+
+	No-op for local adapters. A networked adapter drops the device caches here if the server may have let another
+	client use the chain since we last talked to it.
+ */
+void JtagInterface::CheckDeviceCaches()
+{
+}
@@ -153,6 +153,18 @@ public:
 	 */
 	virtual void ShiftData(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count) =0;
 
+	/**
+		@brief Shifts a large block of write-only data which is likely to be sent again later (e.g. an FPGA bitstream).
+
+		Equivalent to ShiftData() with rcv_data set to NULL. Interfaces that can cache data on the far side of a slow
+		link (see NetworkedJtagInterface) override this to avoid re-sending it.
+
+		@param last_tms		Different TMS value to use for last bit
+		@param send_data	Data to shift into TDI
+		@param count		Number of bits to shift
+	 */
+	virtual void ShiftDataBulk(bool last_tms, const unsigned char* send_data, size_t count);
+
 	/**
 		@brief Sends the requested number of dummy clocks with TMS=0 and flushes the command to the interface.
 
@@ -250,6 +262,7 @@ public:
 	void SetIR(unsigned int device, const unsigned char* data, unsigned char* data_out, size_t count);
 	void ScanDR(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
 	void ScanDRDeferred(unsigned int device, const unsigned char* send_data, size_t count);
+	void ScanDRBulk(unsigned int device, const unsigned char* send_data, size_t count);
 	void ScanDRSplitWrite(unsigned int device, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
 	void ScanDRSplitRead(unsigned int device, unsigned char* rcv_data, size_t count);
 
@@ -262,6 +275,9 @@ protected:
 
 public:
 	void SwapOutDummy(size_t pos, JtagDevice* realdev);
+	void FlushDeviceCaches();
+	void InvalidateDeviceCaches();
+	virtual void CheckDeviceCaches();
 
 protected:
 
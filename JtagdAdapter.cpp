@@ -0,0 +1,91 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of JtagdAdapter
+ */
+
+#include "jtaghal.h"
+#include "JtagdAdapter.h"
+#include "ProtobufHelpers.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Wraps a JTAG adapter for export
+
+	@param iface	The adapter. Its scan chain does not need to be initialized.
+ */
+JtagdAdapter::JtagdAdapter(JtagInterface* iface)
+	: m_iface(iface)
+	, m_jtag(iface)
+	, m_swd(NULL)
+	, m_dap(new ARMJtagDapOffload(iface))
+	, m_transport(Hello::TRANSPORT_JTAG)
+{
+	Init();
+}
+
+/**
+	@brief Wraps a SWD adapter for export
+
+	@param iface	The adapter
+ */
+JtagdAdapter::JtagdAdapter(SWDInterface* iface)
+	: m_iface(iface)
+	, m_jtag(NULL)
+	, m_swd(iface)
+	, m_dap(NULL)
+	, m_transport(Hello::TRANSPORT_SWD)
+{
+	Init();
+}
+
+/**
+	@brief Common initialization for both constructors
+ */
+void JtagdAdapter::Init()
+{
+	m_gpio = dynamic_cast<GPIOInterface*>(m_iface);
+	m_nextSession = 0;
+	m_owner = NULL;
+	m_lastOwner = NULL;
+	m_ownerIdleSince = 0;
+	m_ownerSince = 0;
+	m_tapIdle = true;
+	m_deferredReads = 0;
+}
+
+JtagdAdapter::~JtagdAdapter()
+{
+	delete m_dap;
+}
@@ -0,0 +1,107 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file JtagdAdapter.h
+	@author Andrew D. Zonenberg
+	@brief Declaration of JtagdAdapter
+ */
+
+#ifndef JtagdAdapter_h
+#define JtagdAdapter_h
+
+class JtagdSession;
+class ARMJtagDapOffload;
+
+/**
+	@brief One adapter exported by a JtagdServer, along with the state used to share it between clients
+
+	Each adapter is a separate jtaghal-net channel. Sessions on different channels never wait for each other; sessions
+	on the same channel are arbitrated as described in JtagdServer.
+
+	\ingroup libjtaghal
+ */
+class JtagdAdapter
+{
+public:
+	JtagdAdapter(JtagInterface* iface);
+	JtagdAdapter(SWDInterface* iface);
+	virtual ~JtagdAdapter();
+
+	/// @brief Checks if the adapter is in a state where another client can safely take over
+	bool IsSwitchable()
+	{ return m_tapIdle && (m_deferredReads == 0); }
+
+	///The adapter
+	TestInterface* m_iface;
+
+	///The adapter, if it's JTAG
+	JtagInterface* m_jtag;
+
+	///The adapter, if it's SWD
+	SWDInterface* m_swd;
+
+	///The adapter's GPIOs, if it has any
+	GPIOInterface* m_gpio;
+
+	///ARM DAP executor (JTAG only)
+	ARMJtagDapOffload* m_dap;
+
+	///Hello_TransportType we're serving
+	int m_transport;
+
+	///Sessions using this adapter
+	std::vector<JtagdSession*> m_sessions;
+
+	///Index in m_sessions to start the next round-robin search at
+	size_t m_nextSession;
+
+	///The session currently using the adapter (NULL if nobody is)
+	JtagdSession* m_owner;
+
+	///The last session to use the adapter
+	JtagdSession* m_lastOwner;
+
+	///Time the owner ran out of queued requests (zero if it has some)
+	double m_ownerIdleSince;
+
+	///Time the owner got the adapter
+	double m_ownerSince;
+
+	///True if the TAP is in a stable state (Run-Test/Idle or Test-Logic-Reset)
+	bool m_tapIdle;
+
+	///Number of split scan reads currently deferred inside the adapter
+	size_t m_deferredReads;
+
+protected:
+	void Init();
+};
+
+#endif
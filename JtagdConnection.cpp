@@ -0,0 +1,360 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of JtagdConnection
+ */
+
+#include "jtaghal.h"
+#include "JtagdConnection.h"
+#include "ProtobufHelpers.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <sys/socket.h>
+
+using namespace std;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+///Minimum amount of free space to have in the receive buffer before calling recv()
+#define RX_CHUNK_SIZE		65536
+
+///Stop reading from a client once this many bytes of complete requests are waiting to be executed
+#define MAX_RX_BACKLOG		(4 * 1024 * 1024)
+
+///Largest message we'll accept (a full bitstream for a big FPGA is well under this)
+#define MAX_MESSAGE_SIZE	(256 * 1024 * 1024)
+
+///Maximum number of executed requests to keep around for reuse
+#define MAX_FREE_PACKETS	64
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a connection for a newly accepted client
+
+	@param fd	The socket, already set to non-blocking mode. The connection takes ownership of it.
+ */
+JtagdConnection::JtagdConnection(int fd)
+	: m_epollEvents(0)
+	, m_fd(fd)
+	, m_rxOffset(0)
+	, m_rxLen(0)
+	, m_backlog(0)
+	, m_txOffset(0)
+	, m_closing(false)
+	, m_dead(false)
+	, m_bytesReceived(0)
+	, m_bytesSent(0)
+{
+}
+
+/**
+	@brief Closes the socket. The server must have closed all of our sessions first.
+ */
+JtagdConnection::~JtagdConnection()
+{
+	close(m_fd);
+	for(auto p : m_freePackets)
+		delete p;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Socket I/O
+
+/**
+	@brief Checks if we have room for more inbound data
+
+	We stop reading once a few MB of requests are queued, so one client streaming a bitstream can't make us buffer
+	the whole thing in RAM. A single oversized request is always read in full, though.
+ */
+bool JtagdConnection::WantsRead()
+{
+	if(m_closing)
+		return false;
+
+	size_t avail = m_rxLen - m_rxOffset;
+	if(avail + m_backlog < MAX_RX_BACKLOG)
+		return true;
+
+	uint32_t len;
+	if(avail < sizeof(len))
+		return false;
+	memcpy(&len, &m_rxBuffer[m_rxOffset], sizeof(len));
+	return avail < (sizeof(len) + len);
+}
+
+/**
+	@brief Reads as much data as is available from the socket without blocking
+
+	@return False if the connection was closed or failed
+ */
+bool JtagdConnection::ReadFromSocket()
+{
+	//Discard consumed data once it's taking up a good chunk of the buffer
+	if(m_rxOffset && (m_rxOffset >= (m_rxLen - m_rxOffset)) )
+	{
+		memmove(&m_rxBuffer[0], &m_rxBuffer[m_rxOffset], m_rxLen - m_rxOffset);
+		m_rxLen -= m_rxOffset;
+		m_rxOffset = 0;
+	}
+
+	while(WantsRead())
+	{
+		if(m_rxBuffer.size() - m_rxLen < RX_CHUNK_SIZE)
+			m_rxBuffer.resize(m_rxLen + RX_CHUNK_SIZE);
+
+		ssize_t n = recv(m_fd, &m_rxBuffer[m_rxLen], m_rxBuffer.size() - m_rxLen, 0);
+		if(n > 0)
+		{
+			m_rxLen += n;
+			m_bytesReceived += n;
+			continue;
+		}
+
+		//Orderly shutdown
+		if(n == 0)
+			return false;
+
+		if(errno == EINTR)
+			continue;
+		if( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+			return true;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+	@brief Sends as much queued reply data as the socket will take without blocking
+
+	@return False if the connection failed
+ */
+bool JtagdConnection::WriteToSocket()
+{
+	while(IsTxPending())
+	{
+		ssize_t n = send(m_fd, m_txBuffer.data() + m_txOffset, m_txBuffer.size() - m_txOffset, MSG_NOSIGNAL);
+		if(n > 0)
+		{
+			m_txOffset += n;
+			m_bytesSent += n;
+			continue;
+		}
+
+		if( (n < 0) && (errno == EINTR) )
+			continue;
+		if( (n < 0) && ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) )
+			return true;
+		return false;
+	}
+
+	//Everything went out, reuse the buffer from the start
+	m_txBuffer.clear();
+	m_txOffset = 0;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Requests
+
+/**
+	@brief Parses the next complete request out of the receive buffer
+
+	@param len	Set to the size of the request, which counts against the backlog until it is passed to FreePacket()
+
+	@return The request (owned by the caller until it is passed to FreePacket()), or NULL if no complete request has
+	arrived yet or the connection is closing.
+ */
+JtaghalPacket* JtagdConnection::ParseRequest(size_t& len)
+{
+	if(m_closing)
+		return NULL;
+
+	uint32_t framelen;
+	size_t avail = m_rxLen - m_rxOffset;
+	if(avail < sizeof(framelen))
+		return NULL;
+	memcpy(&framelen, &m_rxBuffer[m_rxOffset], sizeof(framelen));
+	if(framelen > MAX_MESSAGE_SIZE)
+	{
+		LogWarning("Client sent an oversized message (%u bytes), dropping connection\n", framelen);
+		Close();
+		return NULL;
+	}
+	if(avail < sizeof(framelen) + framelen)
+		return NULL;
+
+	auto packet = AllocPacket();
+	if(!packet->ParseFromArray(&m_rxBuffer[m_rxOffset + sizeof(framelen)], framelen))
+	{
+		LogWarning("Failed to parse protobuf\n");
+		FreePacket(packet, 0);
+		Close();
+		return NULL;
+	}
+	m_rxOffset += sizeof(framelen) + framelen;
+	if(m_rxOffset == m_rxLen)
+	{
+		m_rxOffset = 0;
+		m_rxLen = 0;
+	}
+
+	len = framelen;
+	m_backlog += len;
+	return packet;
+}
+
+/**
+	@brief Gets an empty message object, reusing a previously executed request if we have one
+ */
+JtaghalPacket* JtagdConnection::AllocPacket()
+{
+	if(m_freePackets.empty())
+		return new JtaghalPacket;
+
+	auto packet = m_freePackets.back();
+	m_freePackets.pop_back();
+	return packet;
+}
+
+/**
+	@brief Releases a request returned by ParseRequest() once it has been executed (or discarded)
+
+	@param packet	The request
+	@param len		Size of the request, as returned by ParseRequest()
+ */
+void JtagdConnection::FreePacket(JtaghalPacket* packet, size_t len)
+{
+	m_backlog -= len;
+
+	if(m_freePackets.size() >= MAX_FREE_PACKETS)
+		delete packet;
+	else
+	{
+		packet->Clear();
+		m_freePackets.push_back(packet);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Replies
+
+/**
+	@brief Appends a frame header (length, and the channel field if it's not the default) to the transmit buffer
+
+	The channel goes first rather than in field number order; protobuf doesn't care, and it lets the payload be
+	written straight after the header.
+
+	@param channel	Channel the reply is for
+	@param len		Length of the rest of the message
+
+	@return Pointer to where the rest of the message should be written
+ */
+uint8_t* JtagdConnection::AppendFrame(uint32_t channel, uint32_t len)
+{
+	uint32_t chanlen = 0;
+	if(channel)
+	{
+		chanlen =
+			WireFormatLite::TagSize(JtaghalPacket::kChannelFieldNumber, WireFormatLite::TYPE_UINT32) +
+			CodedOutputStream::VarintSize32(channel);
+	}
+	uint32_t framelen = chanlen + len;
+
+	size_t start = m_txBuffer.size();
+	m_txBuffer.resize(start + sizeof(framelen) + framelen);
+	uint8_t* p = (uint8_t*)&m_txBuffer[start];
+	memcpy(p, &framelen, sizeof(framelen));
+	p += sizeof(framelen);
+	if(channel)
+		p = WireFormatLite::WriteUInt32ToArray(JtaghalPacket::kChannelFieldNumber, channel, p);
+	return p;
+}
+
+/**
+	@brief Appends a reply to the transmit buffer
+
+	@param channel	Channel the reply is for
+	@param packet	The reply
+
+	@return False if the reply couldn't be serialized
+ */
+bool JtagdConnection::QueueReply(uint32_t channel, const JtaghalPacket& packet)
+{
+	size_t start = m_txBuffer.size();
+	uint32_t len = packet.ByteSizeLong();
+	uint8_t* p = AppendFrame(channel, len);
+	if(!packet.SerializeToArray(p, len))
+	{
+		LogWarning("Failed to serialize protobuf\n");
+		m_txBuffer.resize(start);
+		return false;
+	}
+	return true;
+}
+
+/**
+	@brief Appends a scanReply to the transmit buffer, encoding it directly from the scan data
+ */
+void JtagdConnection::QueueScanReply(uint32_t channel, const unsigned char* data, size_t len)
+{
+	uint32_t innerlen = 0;
+	if(len)
+	{
+		innerlen =
+			WireFormatLite::TagSize(JtagScanReply::kReadDataFieldNumber, WireFormatLite::TYPE_BYTES) +
+			CodedOutputStream::VarintSize32(len) +
+			len;
+	}
+	uint32_t msglen =
+		WireFormatLite::TagSize(JtaghalPacket::kScanReplyFieldNumber, WireFormatLite::TYPE_MESSAGE) +
+		CodedOutputStream::VarintSize32(innerlen) +
+		innerlen;
+
+	uint8_t* p = AppendFrame(channel, msglen);
+	p = WireFormatLite::WriteTagToArray(
+		JtaghalPacket::kScanReplyFieldNumber,
+		WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+		p);
+	p = CodedOutputStream::WriteVarint32ToArray(innerlen, p);
+	if(len)
+	{
+		p = WireFormatLite::WriteTagToArray(
+			JtagScanReply::kReadDataFieldNumber,
+			WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+			p);
+		p = CodedOutputStream::WriteVarint32ToArray(len, p);
+		memcpy(p, data, len);
+	}
+}
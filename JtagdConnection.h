@@ -0,0 +1,153 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file JtagdConnection.h
+	@author Andrew D. Zonenberg
+	@brief Declaration of JtagdConnection
+ */
+
+#ifndef JtagdConnection_h
+#define JtagdConnection_h
+
+class JtaghalPacket;
+class JtagdSession;
+
+/**
+	@brief One client socket connected to a JtagdServer
+
+	Handles framing of the jtaghal-net stream (32-bit length + protobuf) over a non-blocking socket. Incoming bytes are
+	buffered and split into requests, which the server hands to the JtagdSession for the request's channel, so a client
+	can pipeline any number of requests on any number of channels without waiting for the replies. Replies from all
+	channels are queued in a single transmit buffer that the server flushes whenever the socket is writable.
+
+	\ingroup libjtaghal
+ */
+class JtagdConnection
+{
+public:
+	JtagdConnection(int fd);
+	virtual ~JtagdConnection();
+
+	/// @brief Gets the socket handle for this connection
+	int GetSocket()
+	{ return m_fd; }
+
+	bool ReadFromSocket();
+	bool WriteToSocket();
+
+	bool WantsRead();
+
+	/// @brief Checks if we have reply data that has not yet been sent
+	bool IsTxPending()
+	{ return m_txOffset < m_txBuffer.size(); }
+
+	JtaghalPacket* ParseRequest(size_t& len);
+
+	JtaghalPacket* AllocPacket();
+	void FreePacket(JtaghalPacket* packet, size_t len);
+
+	bool QueueReply(uint32_t channel, const JtaghalPacket& packet);
+	void QueueScanReply(uint32_t channel, const unsigned char* data, size_t len);
+
+	/**
+		@brief Stops reading requests and closes the connection once all queued replies have been sent
+	 */
+	void Close()
+	{ m_closing = true; }
+
+	/**
+		@brief Closes the connection immediately (the peer is gone)
+	 */
+	void Abort()
+	{
+		m_closing = true;
+		m_dead = true;
+	}
+
+	/// @brief Checks if the server should tear down this connection now
+	bool IsReadyToClose()
+	{ return m_dead || (m_closing && !IsTxPending()); }
+
+	/// @brief Checks if we are still accepting requests
+	bool IsClosing()
+	{ return m_closing; }
+
+	size_t GetBytesReceived()
+	{ return m_bytesReceived; }
+
+	size_t GetBytesSent()
+	{ return m_bytesSent; }
+
+public:
+
+	///Sessions on this connection, indexed by channel
+	std::map<uint32_t, JtagdSession*> m_sessions;
+
+	///Epoll events we're currently registered for
+	uint32_t m_epollEvents;
+
+protected:
+	uint8_t* AppendFrame(uint32_t channel, uint32_t len);
+
+	///The socket
+	int m_fd;
+
+	///Buffered inbound data
+	std::vector<uint8_t> m_rxBuffer;
+
+	///Offset of the first unconsumed byte in m_rxBuffer
+	size_t m_rxOffset;
+
+	///Number of valid bytes in m_rxBuffer
+	size_t m_rxLen;
+
+	///Total size of requests which have been parsed but not yet executed
+	size_t m_backlog;
+
+	///Queued outbound data
+	std::string m_txBuffer;
+
+	///Offset of the first unsent byte in m_txBuffer
+	size_t m_txOffset;
+
+	///Executed requests, kept for reuse so steady-state parsing doesn't allocate message objects
+	std::vector<JtaghalPacket*> m_freePackets;
+
+	///Set when we should stop reading requests
+	bool m_closing;
+
+	///Set when the socket is unusable
+	bool m_dead;
+
+	size_t m_bytesReceived;
+	size_t m_bytesSent;
+};
+
+#endif
@@ -0,0 +1,1575 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of JtagdServer
+ */
+
+#include "jtaghal.h"
+#include "JtagdServer.h"
+#include "JtagdAdapter.h"
+#include "JtagdConnection.h"
+#include "JtagdSession.h"
+#include "ProtobufHelpers.h"
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+///Maximum number of epoll events to handle per call
+#define MAX_EVENTS				32
+
+///Maximum number of requests to execute before going back to the event loop to service I/O
+#define MAX_REQUESTS_PER_ROUND	256
+
+///How long the adapter's owner may sit with nothing queued, while someone else is waiting, before we hand it on (us)
+#define OWNER_IDLE_TIMEOUT_US	500000
+
+///How long the adapter's owner may keep it, while someone else is waiting, before we hand it on at the next request
+///boundary even if it has more queued (us)
+#define OWNER_QUANTUM_US		250000
+
+///Maximum total size of the blob cache, in bytes
+#define BLOB_CACHE_MAX			(512 * 1024 * 1024)
+
+///Maximum total size of all unfinished blob uploads, in bytes. Uploads that would go over are dropped.
+#define BLOB_UPLOAD_MAX			(128 * 1024 * 1024)
+
+static bool QueueInfoReply(JtagdSession* session, const string& str, uint64_t num);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a server exporting a JTAG adapter on channel 0. Call Listen() to start accepting clients.
+
+	@param iface	The adapter. Its scan chain does not need to be initialized.
+ */
+JtagdServer::JtagdServer(JtagInterface* iface)
+	: m_listenSocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP)
+{
+	Init();
+	AddAdapter(iface);
+}
+
+/**
+	@brief Creates a server exporting a SWD adapter on channel 0. Call Listen() to start accepting clients.
+
+	@param iface	The adapter
+ */
+JtagdServer::JtagdServer(SWDInterface* iface)
+	: m_listenSocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP)
+{
+	Init();
+	AddAdapter(iface);
+}
+
+/**
+	@brief Common initialization for both constructors
+ */
+void JtagdServer::Init()
+{
+	m_unixListenSocket = -1;
+	m_quit = false;
+	m_requestCount = 0;
+	m_ownerSwitchCount = 0;
+	m_adapterTime = 0;
+	m_blobCacheSize = 0;
+	m_blobUseCounter = 0;
+	m_blobHits = 0;
+	m_uploadBufferSize = 0;
+
+	m_epoll = epoll_create1(EPOLL_CLOEXEC);
+	if(m_epoll < 0)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to create epoll instance",
+			"");
+	}
+}
+
+JtagdServer::~JtagdServer()
+{
+	while(!m_connections.empty())
+		CloseConnection(m_connections[0]);
+
+	if(m_unixListenSocket >= 0)
+	{
+		close(m_unixListenSocket);
+		unlink(m_unixPath.c_str());
+	}
+
+	close(m_epoll);
+	for(auto a : m_adapters)
+		delete a;
+}
+
+/**
+	@brief Exports another JTAG adapter
+
+	@param iface	The adapter. Its scan chain does not need to be initialized.
+
+	@return The channel number clients use to talk to the adapter
+ */
+uint32_t JtagdServer::AddAdapter(JtagInterface* iface)
+{
+	m_adapters.push_back(new JtagdAdapter(iface));
+	return m_adapters.size() - 1;
+}
+
+/**
+	@brief Exports another SWD adapter
+
+	@param iface	The adapter
+
+	@return The channel number clients use to talk to the adapter
+ */
+uint32_t JtagdServer::AddAdapter(SWDInterface* iface)
+{
+	m_adapters.push_back(new JtagdAdapter(iface));
+	return m_adapters.size() - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Connection management
+
+/**
+	@brief Starts accepting clients
+
+	@throw JtagException if the socket could not be set up
+
+	@param port		Port number (in host byte ordering) to listen on
+ */
+void JtagdServer::Listen(uint16_t port)
+{
+	if(!m_listenSocket.SetReuseaddr())
+	{
+		throw JtagExceptionWrapper(
+			"Failed to set SO_REUSEADDR",
+			"");
+	}
+	if(!m_listenSocket.Bind(port))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to bind socket",
+			"");
+	}
+	if(!m_listenSocket.Listen())
+	{
+		throw JtagExceptionWrapper(
+			"Failed to listen on socket",
+			"");
+	}
+
+	AddListener(m_listenSocket);
+	LogVerbose("Listening on port %u\n", port);
+}
+
+/**
+	@brief Starts accepting clients on a Unix-domain socket, for unix: and shm: connections from the same host
+
+	Any existing file at the path is replaced. The socket is removed when the server is destroyed.
+
+	@throw JtagException if the socket could not be set up
+
+	@param path		Filesystem path of the socket
+ */
+void JtagdServer::ListenUnix(const string& path)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(path.length() >= sizeof(addr.sun_path))
+	{
+		throw JtagExceptionWrapper(
+			"Socket path is too long",
+			"");
+	}
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	m_unixListenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(m_unixListenSocket < 0)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to create socket",
+			"");
+	}
+	m_unixPath = path;
+
+	unlink(path.c_str());
+	if(0 != ::bind(m_unixListenSocket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to bind socket",
+			"");
+	}
+	if(0 != listen(m_unixListenSocket, SOMAXCONN))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to listen on socket",
+			"");
+	}
+
+	AddListener(m_unixListenSocket);
+	LogVerbose("Listening on %s\n", path.c_str());
+}
+
+/**
+	@brief Makes a listening socket non-blocking and adds it to the epoll set
+ */
+void JtagdServer::AddListener(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	//Listeners are marked by a NULL connection pointer
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if(0 != epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to add listening socket to epoll set",
+			"");
+	}
+}
+
+/**
+	@brief Accepts all pending connections on the listening sockets
+ */
+void JtagdServer::AcceptClients()
+{
+	int listeners[2] = { m_listenSocket, m_unixListenSocket };
+	for(int i=0; i<2; i++)
+	{
+		if(listeners[i] < 0)
+			continue;
+
+		int fd;
+		while( (fd = accept4(listeners[i], NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+		{
+			//Replies are small and latency sensitive (harmlessly fails on Unix-domain sockets)
+			int yes = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+			AddConnection(fd);
+		}
+
+		if( (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR) )
+			LogWarning("accept() failed\n");
+	}
+}
+
+/**
+	@brief Creates a connection object for a newly accepted client
+ */
+void JtagdServer::AddConnection(int fd)
+{
+	auto conn = new JtagdConnection(fd);
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = conn;
+	if(0 != epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev))
+	{
+		LogWarning("Failed to add client socket to epoll set\n");
+		delete conn;
+		return;
+	}
+	conn->m_epollEvents = EPOLLIN;
+	m_connections.push_back(conn);
+
+	LogVerbose("Client connected (%zu total)\n", m_connections.size());
+}
+
+/**
+	@brief Updates the epoll registration for a connection to match what it's waiting for
+ */
+void JtagdServer::UpdateEvents(JtagdConnection* conn)
+{
+	uint32_t events = 0;
+	if(conn->WantsRead())
+		events |= EPOLLIN;
+	if(conn->IsTxPending())
+		events |= EPOLLOUT;
+	if(events == conn->m_epollEvents)
+		return;
+
+	epoll_event ev;
+	ev.events = events;
+	ev.data.ptr = conn;
+	epoll_ctl(m_epoll, EPOLL_CTL_MOD, conn->GetSocket(), &ev);
+	conn->m_epollEvents = events;
+}
+
+/**
+	@brief Moves newly received requests from a connection into the queues of the sessions they're for
+
+	A channel's session is created by its Hello. Anything else for a channel with no session (one which was closed
+	after an error, for example) is dropped.
+ */
+void JtagdServer::DispatchRequests(JtagdConnection* conn)
+{
+	JtaghalPacket* packet;
+	size_t len;
+	while( (packet = conn->ParseRequest(len)) != NULL)
+	{
+		uint32_t channel = packet->channel();
+		auto it = conn->m_sessions.find(channel);
+		if(it != conn->m_sessions.end())
+		{
+			it->second->PushRequest(packet, len);
+			continue;
+		}
+
+		if(packet->Payload_case() != JtaghalPacket::kHello)
+		{
+			LogDebug("Dropping request for channel %u, which is not open\n", channel);
+			conn->FreePacket(packet, len);
+			continue;
+		}
+		if(channel >= m_adapters.size())
+		{
+			LogWarning("Client tried to open channel %u, but we only have %zu\n", channel, m_adapters.size());
+			JtaghalPacket reply;
+			reply.mutable_disconnectrequest();
+			conn->QueueReply(channel, reply);
+			conn->FreePacket(packet, len);
+			continue;
+		}
+
+		auto adapter = m_adapters[channel];
+		auto session = new JtagdSession(conn, channel, adapter);
+		conn->m_sessions[channel] = session;
+		adapter->m_sessions.push_back(session);
+		session->PushRequest(packet, len);
+
+		LogDebug("Client opened channel %u\n", channel);
+	}
+}
+
+/**
+	@brief Closes one channel of a connection, returning the adapter to a safe state if it was in the middle of
+	something
+
+	The connection itself is closed along with its last session.
+ */
+void JtagdServer::CloseSession(JtagdSession* session)
+{
+	auto adapter = session->GetAdapter();
+	auto jtag = adapter->m_jtag;
+	if(session == adapter->m_owner)
+	{
+		try
+		{
+			for(auto& r : session->m_splitReads)
+			{
+				if(r.m_deferred)
+					jtag->ShiftDataReadOnly(&r.m_data[0], r.m_count);
+			}
+			if(!adapter->m_tapIdle)
+				jtag->ResetToIdle();
+			if(jtag)
+				jtag->Commit();
+		}
+		catch(const JtagException& ex)
+		{
+			LogWarning("Failed to clean up after client: %s\n", ex.GetDescription().c_str());
+		}
+		adapter->m_deferredReads = 0;
+		adapter->m_tapIdle = true;
+		adapter->m_owner = NULL;
+		adapter->m_ownerIdleSince = 0;
+	}
+	if(session == adapter->m_lastOwner)
+		adapter->m_lastOwner = NULL;
+
+	auto& sessions = adapter->m_sessions;
+	for(size_t i=0; i<sessions.size(); i++)
+	{
+		if(sessions[i] != session)
+			continue;
+		sessions.erase(sessions.begin() + i);
+		if(adapter->m_nextSession > i)
+			adapter->m_nextSession --;
+		break;
+	}
+
+	m_uploadBufferSize -= session->m_uploadData.size();
+	UnpinBlob(session);
+
+	auto conn = session->GetConnection();
+	conn->m_sessions.erase(session->GetChannel());
+	if(conn->m_sessions.empty())
+		conn->Close();
+
+	LogDebug("Client closed channel %u after %zu requests\n", session->GetChannel(), session->GetRequestCount());
+	delete session;
+}
+
+/**
+	@brief Disconnects a client, closing all of its sessions
+ */
+void JtagdServer::CloseConnection(JtagdConnection* conn)
+{
+	while(!conn->m_sessions.empty())
+		CloseSession(conn->m_sessions.begin()->second);
+
+	epoll_ctl(m_epoll, EPOLL_CTL_DEL, conn->GetSocket(), NULL);
+
+	for(size_t i=0; i<m_connections.size(); i++)
+	{
+		if(m_connections[i] != conn)
+			continue;
+		m_connections.erase(m_connections.begin() + i);
+		break;
+	}
+
+	LogVerbose("Client disconnected (%zu total)\n", m_connections.size());
+	delete conn;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Event loop
+
+/**
+	@brief Serves clients until Stop() is called
+ */
+void JtagdServer::Run()
+{
+	while(!m_quit)
+		RunOnce(100);
+}
+
+/**
+	@brief Runs one iteration of the event loop
+
+	@param timeout_ms	Maximum time to wait for socket activity if there's no queued work
+ */
+void JtagdServer::RunOnce(int timeout_ms)
+{
+	//Don't sleep if requests are waiting (we stopped early last time to service I/O), and wake up in time to take
+	//the adapter away from an idle owner if someone else wants it
+	if(HasRunnableWork())
+		timeout_ms = 0;
+	else
+	{
+		int handover = GetHandoverTimeout();
+		if( (handover >= 0) && ( (timeout_ms < 0) || (handover < timeout_ms) ) )
+			timeout_ms = handover;
+	}
+
+	epoll_event events[MAX_EVENTS];
+	int n = epoll_wait(m_epoll, events, MAX_EVENTS, timeout_ms);
+	if(n < 0)
+	{
+		if(errno != EINTR)
+		{
+			throw JtagExceptionWrapper(
+				"epoll_wait() failed",
+				"");
+		}
+		n = 0;
+	}
+
+	for(int i=0; i<n; i++)
+	{
+		auto conn = reinterpret_cast<JtagdConnection*>(events[i].data.ptr);
+		if(conn == NULL)
+		{
+			AcceptClients();
+			continue;
+		}
+
+		if(events[i].events & EPOLLIN)
+		{
+			if(!conn->ReadFromSocket())
+				conn->Abort();
+			DispatchRequests(conn);
+		}
+		if(events[i].events & EPOLLOUT)
+		{
+			if(!conn->WriteToSocket())
+				conn->Abort();
+		}
+		if(events[i].events & (EPOLLERR | EPOLLHUP) )
+			conn->Abort();
+	}
+
+	ServiceQueues();
+
+	//Tear down any sessions which were closed while executing requests
+	for(auto c : m_connections)
+	{
+		for(auto it = c->m_sessions.begin(); it != c->m_sessions.end(); )
+		{
+			auto session = it->second;
+			++it;
+			if(session->IsClosing())
+				CloseSession(session);
+		}
+	}
+
+	//Push out replies right away rather than waiting for the next EPOLLOUT, and pick up anything that was left in
+	//the receive buffer because we'd hit the backlog limit
+	for(auto c : m_connections)
+	{
+		if(c->IsTxPending() && !c->WriteToSocket())
+			c->Abort();
+		DispatchRequests(c);
+		UpdateEvents(c);
+	}
+
+	//Tear down anyone who's done
+	for(size_t i=0; i<m_connections.size(); )
+	{
+		if(m_connections[i]->IsReadyToClose())
+			CloseConnection(m_connections[i]);
+		else
+			i++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Arbitration
+
+/**
+	@brief Checks if requests that don't touch the scan chain can be answered while someone else owns the adapter
+ */
+bool JtagdServer::IsOutOfTurnRequest(const JtaghalPacket& packet)
+{
+	switch(packet.Payload_case())
+	{
+		case JtaghalPacket::kHello:
+		case JtaghalPacket::kInfoRequest:
+		case JtaghalPacket::kGpioReadRequest:
+		case JtaghalPacket::kSplitRequest:
+		case JtaghalPacket::kPerfRequest:
+		case JtaghalPacket::kDapSupportedRequest:
+		case JtaghalPacket::kDisconnectRequest:
+		case JtaghalPacket::kShmAttach:
+		case JtaghalPacket::kPingRequest:
+		case JtaghalPacket::kBlobQuery:
+		case JtaghalPacket::kBlobUpload:
+		case JtaghalPacket::kAdapterRelease:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+/**
+	@brief Checks if ServiceQueues() would be able to execute anything
+ */
+bool JtagdServer::HasRunnableWork()
+{
+	for(auto a : m_adapters)
+	{
+		if(a->m_owner)
+		{
+			if(a->m_owner->PeekRequest() != NULL)
+				return true;
+			continue;
+		}
+
+		for(auto s : a->m_sessions)
+		{
+			if(s->PeekRequest())
+				return true;
+		}
+	}
+	return false;
+}
+
+/**
+	@brief Checks if anyone other than the owner has a request waiting for an adapter
+ */
+bool JtagdServer::IsAdapterWanted(JtagdAdapter* adapter)
+{
+	for(auto s : adapter->m_sessions)
+	{
+		if( (s != adapter->m_owner) && s->PeekRequest())
+			return true;
+	}
+	return false;
+}
+
+/**
+	@brief Gets the time until the first idle owner is due to lose its adapter, in milliseconds
+
+	@return Milliseconds to wait, or -1 if no handover is pending
+ */
+int JtagdServer::GetHandoverTimeout()
+{
+	double now = GetTime();
+	double next = -1;
+	for(auto a : m_adapters)
+	{
+		if(!a->m_owner || !a->m_owner->m_preemptible || !a->IsSwitchable() || !IsAdapterWanted(a))
+			continue;
+
+		double left = 0;
+		if(a->m_ownerIdleSince != 0)
+			left = max(0.0, a->m_ownerIdleSince + OWNER_IDLE_TIMEOUT_US * 1e-6 - now);
+		if( (next < 0) || (left < next) )
+			next = left;
+	}
+
+	if(next < 0)
+		return -1;
+	return ceil(next * 1000);
+}
+
+/**
+	@brief Takes the adapter away from an owner that has had nothing to do for a while, if someone else wants it
+
+	Only preemptible owners (see Hello.preemptible) lose the adapter this way; anyone else may be holding a halted core
+	or waiting on something slow on the host side, and is just told that it's wanted (see NotifyAdapterWanted()).
+
+	@return True if the adapter is now free
+ */
+bool JtagdServer::ReclaimIdleAdapter(JtagdAdapter* adapter)
+{
+	if(!adapter->m_owner->m_preemptible)
+	{
+		NotifyAdapterWanted(adapter);
+		return false;
+	}
+
+	double now = GetTime();
+	if(adapter->m_ownerIdleSince == 0)
+		adapter->m_ownerIdleSince = now;
+
+	if(now - adapter->m_ownerIdleSince < OWNER_IDLE_TIMEOUT_US * 1e-6)
+		return false;
+	if(!adapter->IsSwitchable() || !IsAdapterWanted(adapter))
+		return false;
+
+	LogDebug("Handing adapter on after owner was idle for %.1f ms\n", (now - adapter->m_ownerIdleSince) * 1e3);
+	TakeAdapterFromOwner(adapter);
+	return true;
+}
+
+/**
+	@brief Takes the adapter away from an owner that has kept it busy for its whole quantum, if someone else wants it
+
+	Called between two of the owner's requests. The rest of its queue waits until its next turn. As with
+	ReclaimIdleAdapter(), owners that aren't preemptible are only told that the adapter is wanted.
+
+	@return True if the adapter is now free
+ */
+bool JtagdServer::PreemptOwner(JtagdAdapter* adapter)
+{
+	if(!adapter->m_owner->m_preemptible)
+	{
+		NotifyAdapterWanted(adapter);
+		return false;
+	}
+
+	double held = GetTime() - adapter->m_ownerSince;
+	if(held < OWNER_QUANTUM_US * 1e-6)
+		return false;
+	if(!adapter->IsSwitchable() || !IsAdapterWanted(adapter))
+		return false;
+
+	LogDebug("Handing adapter on after owner held it for %.1f ms\n", held * 1e3);
+	TakeAdapterFromOwner(adapter);
+	return true;
+}
+
+/**
+	@brief Tells the owner (once per turn, if it understands the message) that someone else is waiting for the adapter
+ */
+void JtagdServer::NotifyAdapterWanted(JtagdAdapter* adapter)
+{
+	auto owner = adapter->m_owner;
+	if(!owner->m_releaseNotify || owner->m_wantedNotified || !IsAdapterWanted(adapter))
+		return;
+
+	owner->m_wantedNotified = true;
+	JtaghalPacket notify;
+	notify.mutable_adapterwanted();
+	if(!owner->QueueReply(notify))
+		owner->Close();
+}
+
+/**
+	@brief Takes the adapter away from its owner without being asked to
+
+	The owner is told (if it asked to be, see Hello.adapterRelease) so it can forget whatever it had cached about the
+	chain and target.
+ */
+void JtagdServer::TakeAdapterFromOwner(JtagdAdapter* adapter)
+{
+	auto owner = adapter->m_owner;
+	if(owner->m_releaseNotify)
+	{
+		JtaghalPacket notify;
+		notify.mutable_adapterrelease();
+		if(!owner->QueueReply(notify))
+			owner->Close();
+	}
+
+	adapter->m_owner = NULL;
+	adapter->m_ownerIdleSince = 0;
+}
+
+/**
+	@brief Finds the next session (round-robin) with a request waiting for an adapter
+ */
+JtagdSession* JtagdServer::PickNextSession(JtagdAdapter* adapter)
+{
+	auto& sessions = adapter->m_sessions;
+	size_t n = sessions.size();
+	for(size_t i=0; i<n; i++)
+	{
+		size_t idx = (adapter->m_nextSession + i) % n;
+		if(sessions[idx]->PeekRequest())
+		{
+			adapter->m_nextSession = idx + 1;
+			return sessions[idx];
+		}
+	}
+	return NULL;
+}
+
+/**
+	@brief Executes queued requests on every adapter
+ */
+void JtagdServer::ServiceQueues()
+{
+	for(auto a : m_adapters)
+		ServiceAdapter(a);
+}
+
+/**
+	@brief Executes queued requests for one adapter, sharing it fairly between the sessions using it
+ */
+void JtagdServer::ServiceAdapter(JtagdAdapter* adapter)
+{
+	//Cheap queries get answered no matter who's using the adapter
+	for(auto s : adapter->m_sessions)
+	{
+		if(s == adapter->m_owner)
+			continue;
+
+		JtaghalPacket* packet;
+		while( (packet = s->PeekRequest()) && IsOutOfTurnRequest(*packet) )
+		{
+			ExecuteRequest(s, *packet);
+			s->PopRequest();
+		}
+	}
+
+	for(size_t i=0; i<MAX_REQUESTS_PER_ROUND; i++)
+	{
+		//Hand the adapter to the next session in line
+		if(!adapter->m_owner)
+		{
+			adapter->m_owner = PickNextSession(adapter);
+			if(!adapter->m_owner)
+				break;
+
+			if(adapter->m_owner != adapter->m_lastOwner)
+				m_ownerSwitchCount ++;
+			adapter->m_lastOwner = adapter->m_owner;
+			adapter->m_ownerSince = GetTime();
+			adapter->m_owner->m_wantedNotified = false;
+		}
+
+		//The owner keeps the adapter until it releases it or goes away, since it may be holding state (IR, DAP
+		//registers, halted cores...) that another client would clobber. If it said it doesn't mind, and it sits idle
+		//while someone else is waiting or hogs it for longer than its quantum, it loses the adapter anyway.
+		auto owner = adapter->m_owner;
+		JtaghalPacket* packet = owner->PeekRequest();
+		if(!packet)
+		{
+			if(ReclaimIdleAdapter(adapter))
+				continue;
+			break;
+		}
+		if(PreemptOwner(adapter))
+			continue;
+
+		adapter->m_ownerIdleSince = 0;
+		ExecuteRequest(owner, *packet);
+		owner->PopRequest();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Request handlers
+
+/**
+	@brief Executes a single request. Errors close the session.
+ */
+void JtagdServer::ExecuteRequest(JtagdSession* session, const JtaghalPacket& packet)
+{
+	auto adapter = session->GetAdapter();
+	double start = GetTime();
+
+	bool ok = false;
+	try
+	{
+		switch(packet.Payload_case())
+		{
+			case JtaghalPacket::kHello:
+				ok = OnHello(session, packet);
+				break;
+
+			case JtaghalPacket::kInfoRequest:
+				ok = OnInfoRequest(session, packet);
+				break;
+
+			case JtaghalPacket::kFlushRequest:
+				if(adapter->m_jtag)
+					adapter->m_jtag->Commit();
+				ok = true;
+				break;
+
+			case JtaghalPacket::kDisconnectRequest:
+				session->Close();
+				ok = true;
+				break;
+
+			case JtaghalPacket::kBankState:
+				ok = OnGpioWrite(session, packet);
+				break;
+
+			case JtaghalPacket::kGpioReadRequest:
+				ok = OnGpioReadRequest(session);
+				break;
+
+			case JtaghalPacket::kSplitRequest:
+				ok = QueueInfoReply(session, "", adapter->m_jtag != NULL);
+				break;
+
+			case JtaghalPacket::kScanRequest:
+				ok = (adapter->m_jtag != NULL) && OnScanRequest(session, packet.scanrequest());
+				break;
+
+			case JtaghalPacket::kPerfRequest:
+				ok = OnPerfRequest(session, packet);
+				break;
+
+			case JtaghalPacket::kStateRequest:
+				ok = (adapter->m_jtag != NULL) && OnStateRequest(session, packet.staterequest());
+				break;
+
+			case JtaghalPacket::kDapSupportedRequest:
+				ok = QueueInfoReply(session, "", adapter->m_dap != NULL);
+				break;
+
+			case JtaghalPacket::kDapRequest:
+				ok = OnDapRequest(session, packet);
+				break;
+
+			case JtaghalPacket::kShmAttach:
+				ok = OnShmAttach(session, packet);
+				break;
+
+			case JtaghalPacket::kPingRequest:
+				ok = OnPing(session, packet);
+				break;
+
+			case JtaghalPacket::kBlobQuery:
+				ok = OnBlobQuery(session, packet);
+				break;
+
+			case JtaghalPacket::kBlobUpload:
+				ok = OnBlobUpload(session, packet);
+				break;
+
+			case JtaghalPacket::kSwdRequest:
+				ok = OnSwdRequest(session, packet);
+				break;
+
+			case JtaghalPacket::kAdapterRelease:
+				ok = OnAdapterRelease(session);
+				break;
+
+			case JtaghalPacket::kSwdResetRequest:
+				ok = (adapter->m_swd != NULL);
+				if(ok)
+				{
+					adapter->m_swd->ResetInterface();
+					ok = QueueInfoReply(session, "", 1);
+				}
+				break;
+
+			default:
+				LogWarning("Client sent unsupported request type %d\n", packet.Payload_case());
+				break;
+		}
+	}
+	catch(const JtagException& ex)
+	{
+		LogError("Request failed: %s\n", ex.GetDescription().c_str());
+		ok = false;
+	}
+
+	//Let the client know the channel is gone, rather than leaving it waiting for a reply
+	if(!ok)
+	{
+		JtaghalPacket reply;
+		reply.mutable_disconnectrequest();
+		session->QueueReply(reply);
+		session->Close();
+	}
+
+	//Pings don't count toward the session's execution time, since that's what they're used to measure
+	double dt = GetTime() - start;
+	if(packet.Payload_case() != JtaghalPacket::kPingRequest)
+		session->AddExecTime(dt);
+
+	m_requestCount ++;
+	m_adapterTime += dt;
+}
+
+/**
+	@brief Sends an infoReply
+ */
+static bool QueueInfoReply(JtagdSession* session, const string& str, uint64_t num)
+{
+	JtaghalPacket reply;
+	auto r = reply.mutable_inforeply();
+	r->set_str(str);
+	r->set_num(num);
+	return session->QueueReply(reply);
+}
+
+bool JtagdServer::OnHello(JtagdSession* session, const JtaghalPacket& packet)
+{
+	auto adapter = session->GetAdapter();
+	auto& h = packet.hello();
+	if( (h.magic() != "JTAGHAL") || (h.version() != 1) )
+	{
+		LogWarning("ClientHello has wrong magic/version\n");
+		return false;
+	}
+	session->m_releaseNotify = h.adapterrelease();
+	session->m_preemptible = h.preemptible();
+
+	//Reply with our transport even if it's not what the client wanted; it will hang up on us
+	JtaghalPacket reply;
+	auto r = reply.mutable_hello();
+	r->set_magic("JTAGHAL");
+	r->set_version(1);
+	r->set_transport((Hello_TransportType)adapter->m_transport);
+
+	//Include everything the client would otherwise ask for right after connecting
+	auto info = r->mutable_info();
+	info->set_name(adapter->m_iface->GetName());
+	info->set_serial(adapter->m_iface->GetSerial());
+	info->set_userid(adapter->m_iface->GetUserID());
+	info->set_freq(adapter->m_iface->GetFrequency());
+	info->set_splitscan(adapter->m_jtag != NULL);
+	info->set_dapoffload(adapter->m_dap != NULL);
+	info->set_sharedmemory(true);
+	info->set_ping(true);
+	info->set_blobcache(adapter->m_jtag != NULL);
+	info->set_channelcount(m_adapters.size());
+	info->set_adapterrelease(true);
+	info->set_owneridletimeout(OWNER_IDLE_TIMEOUT_US);
+	info->set_ownerquantum(OWNER_QUANTUM_US);
+	ReadGpioState(adapter, info->mutable_gpiostate());
+
+	return session->QueueReply(reply);
+}
+
+/**
+	@brief Hands the adapter back so other sessions can have a turn
+
+	Releasing an adapter you don't own (or asking again after it was already handed on) does nothing. If the owner
+	is in the middle of a scan it keeps the adapter, since nobody else could use it safely anyway.
+ */
+bool JtagdServer::OnAdapterRelease(JtagdSession* session)
+{
+	auto adapter = session->GetAdapter();
+	if(session != adapter->m_owner)
+		return true;
+
+	if(!adapter->IsSwitchable())
+	{
+		LogWarning("Client tried to release the adapter in the middle of a scan, ignoring\n");
+		return true;
+	}
+
+	adapter->m_owner = NULL;
+	adapter->m_ownerIdleSince = 0;
+	return true;
+}
+
+/**
+	@brief Answers a pingRequest, along with how much adapter time this session has used so the client can tell
+	network latency apart from execution time
+ */
+bool JtagdServer::OnPing(JtagdSession* session, const JtaghalPacket& packet)
+{
+	JtaghalPacket reply;
+	auto r = reply.mutable_pingreply();
+	r->set_cookie(packet.pingrequest().cookie());
+	r->set_requestcount(session->GetExecCount());
+	r->set_exectimens(session->GetExecTime() * 1e9);
+	return session->QueueReply(reply);
+}
+
+bool JtagdServer::OnInfoRequest(JtagdSession* session, const JtaghalPacket& packet)
+{
+	auto adapter = session->GetAdapter();
+	switch(packet.inforequest().req())
+	{
+		case InfoRequest::HwName:
+			return QueueInfoReply(session, adapter->m_iface->GetName(), 0);
+
+		case InfoRequest::HwSerial:
+			return QueueInfoReply(session, adapter->m_iface->GetSerial(), 0);
+
+		case InfoRequest::Userid:
+			return QueueInfoReply(session, adapter->m_iface->GetUserID(), 0);
+
+		case InfoRequest::Freq:
+			return QueueInfoReply(session, "", adapter->m_iface->GetFrequency());
+
+		default:
+			LogWarning("Client sent unsupported infoRequest\n");
+			return false;
+	}
+}
+
+bool JtagdServer::OnGpioReadRequest(JtagdSession* session)
+{
+	JtaghalPacket reply;
+	ReadGpioState(session->GetAdapter(), reply.mutable_bankstate());
+	return session->QueueReply(reply);
+}
+
+/**
+	@brief Reads the adapter's GPIO pins into a GpioBankState (left empty if the adapter has no GPIO)
+ */
+void JtagdServer::ReadGpioState(JtagdAdapter* adapter, GpioBankState* state)
+{
+	if(!adapter->m_gpio)
+		return;
+
+	adapter->m_gpio->ReadGpioState();
+	for(int i=0; i<adapter->m_gpio->GetGpioCount(); i++)
+	{
+		auto pin = state->add_states();
+		pin->set_value(adapter->m_gpio->GetGpioValueCached(i));
+		pin->set_is_output(adapter->m_gpio->GetGpioDirection(i));
+	}
+}
+
+bool JtagdServer::OnGpioWrite(JtagdSession* session, const JtaghalPacket& packet)
+{
+	auto adapter = session->GetAdapter();
+	if(!adapter->m_gpio)
+		return false;
+
+	auto& state = packet.bankstate();
+	for(int i=0; (i < state.states_size()) && (i < adapter->m_gpio->GetGpioCount()); i++)
+	{
+		adapter->m_gpio->SetGpioDirectionDeferred(i, state.states(i).is_output());
+		adapter->m_gpio->SetGpioValueDeferred(i, state.states(i).value());
+	}
+	adapter->m_gpio->WriteGpioState();
+	return true;
+}
+
+bool JtagdServer::OnPerfRequest(JtagdSession* session, const JtaghalPacket& packet)
+{
+	auto adapter = session->GetAdapter();
+	if(!adapter->m_jtag)
+		return false;
+
+	switch(packet.perfrequest().req())
+	{
+		case JtagPerformanceRequest::ShiftOps:
+			return QueueInfoReply(session, "", adapter->m_jtag->GetShiftOpCount());
+
+		case JtagPerformanceRequest::DataBits:
+			return QueueInfoReply(session, "", adapter->m_jtag->GetDataBitCount());
+
+		case JtagPerformanceRequest::ModeBits:
+			return QueueInfoReply(session, "", adapter->m_jtag->GetModeBitCount());
+
+		case JtagPerformanceRequest::DummyClocks:
+			return QueueInfoReply(session, "", adapter->m_jtag->GetDummyClockCount());
+
+		default:
+			LogWarning("Client sent unsupported perfRequest\n");
+			return false;
+	}
+}
+
+bool JtagdServer::OnScanRequest(JtagdSession* session, const JtagScanRequest& req)
+{
+	auto adapter = session->GetAdapter();
+	size_t count = req.totallen();
+	size_t bytesize = (count + 7) / 8;
+
+	//Find the write data, either inline or in the shared memory ring
+	auto send_data = reinterpret_cast<const unsigned char*>(req.writedata().data());
+	size_t wlen = req.writedata().size();
+	if(req.shmlength())
+	{
+		send_data = session->m_shm ? session->m_shm->GetTx(req.shmoffset(), req.shmlength()) : NULL;
+		if(!send_data)
+		{
+			LogWarning("Client sent a scanRequest with a bad shared memory position\n");
+			return false;
+		}
+		wlen = req.shmlength();
+	}
+	else if(!req.writeblob().empty())
+	{
+		//Anything we told the client we have is pinned until now, so a miss means the client never asked
+		auto it = m_blobs.find(req.writeblob());
+		if(it == m_blobs.end())
+		{
+			LogWarning("Client sent a scanRequest for a blob we don't have\n");
+			return false;
+		}
+		UnpinBlob(session);
+		it->second.m_lastUse = ++m_blobUseCounter;
+		send_data = &it->second.m_data[0];
+		wlen = it->second.m_data.size();
+		m_blobHits ++;
+	}
+
+	//Read half of a split scan
+	if(req.split() && (wlen == 0) )
+	{
+		if(session->m_splitReads.empty())
+		{
+			LogWarning("Client sent a split read with no matching write\n");
+			return false;
+		}
+		auto& r = session->m_splitReads.front();
+		if(r.m_count != count)
+		{
+			LogWarning("Client sent a split read with the wrong length\n");
+			return false;
+		}
+
+		if(r.m_deferred)
+		{
+			adapter->m_jtag->ShiftDataReadOnly(&r.m_data[0], count);
+			adapter->m_deferredReads --;
+		}
+		if(req.readrequested())
+			QueueScanData(session, &r.m_data[0], bytesize);
+		session->m_splitReads.pop_front();
+		return true;
+	}
+
+	//No data, just clocks
+	if(wlen == 0)
+	{
+		adapter->m_jtag->SendDummyClocks(count);
+		return true;
+	}
+
+	if(wlen < bytesize)
+	{
+		LogWarning("Client sent a scanRequest with too little data\n");
+		return false;
+	}
+
+	//Write half of a split scan. If the adapter can't defer the read, we hold on to the data ourselves.
+	if(req.split())
+	{
+		session->m_splitReads.push_back(JtagdSession::SplitRead(count));
+		auto& r = session->m_splitReads.back();
+		r.m_deferred = adapter->m_jtag->ShiftDataWriteOnly(req.settmsatend(), send_data, &r.m_data[0], count);
+		if(r.m_deferred)
+			adapter->m_deferredReads ++;
+	}
+
+	//Normal scan. Read data goes straight into the shared memory ring if we can.
+	else if(req.readrequested())
+	{
+		uint64_t pos = 0;
+		unsigned char* ring = NULL;
+		if(session->m_shm && (bytesize >= JTAGHAL_SHM_THRESHOLD) )
+			ring = session->m_shm->AllocRx(bytesize, pos);
+
+		if(ring)
+		{
+			adapter->m_jtag->ShiftData(req.settmsatend(), send_data, ring, count);
+			QueueShmScanReply(session, pos, bytesize);
+		}
+		else
+		{
+			m_scanBuffer.resize(bytesize);
+			adapter->m_jtag->ShiftData(req.settmsatend(), send_data, &m_scanBuffer[0], count);
+			session->QueueScanReply(&m_scanBuffer[0], bytesize);
+		}
+	}
+	else
+		adapter->m_jtag->ShiftData(req.settmsatend(), send_data, NULL, count);
+
+	//Done with the write data, let the client reuse the space
+	if(req.shmlength())
+		session->m_shm->ReleaseTx(req.shmoffset(), req.shmlength());
+	return true;
+}
+
+/**
+	@brief Sends scan read data to a client, through shared memory if possible
+ */
+void JtagdServer::QueueScanData(JtagdSession* session, const unsigned char* data, size_t len)
+{
+	uint64_t pos = 0;
+	unsigned char* ring = NULL;
+	if(session->m_shm && (len >= JTAGHAL_SHM_THRESHOLD) )
+		ring = session->m_shm->AllocRx(len, pos);
+
+	if(ring)
+	{
+		memcpy(ring, data, len);
+		QueueShmScanReply(session, pos, len);
+	}
+	else
+		session->QueueScanReply(data, len);
+}
+
+/**
+	@brief Sends a scanReply whose data is already in the shared memory ring
+ */
+void JtagdServer::QueueShmScanReply(JtagdSession* session, uint64_t pos, size_t len)
+{
+	JtaghalPacket reply;
+	auto r = reply.mutable_scanreply();
+	r->set_shmoffset(pos);
+	r->set_shmlength(len);
+	session->QueueReply(reply);
+}
+
+/**
+	@brief Maps the shared memory segment a client created for scan data
+
+	Failure isn't fatal; we tell the client and it keeps sending everything through the socket.
+ */
+bool JtagdServer::OnShmAttach(JtagdSession* session, const JtaghalPacket& packet)
+{
+	bool ok = false;
+	if(!session->m_shm)
+	{
+		session->m_shm = new JtaghalShm;
+		ok = session->m_shm->Attach(packet.shmattach().name());
+		if(!ok)
+		{
+			delete session->m_shm;
+			session->m_shm = NULL;
+		}
+	}
+	return QueueInfoReply(session, "", ok);
+}
+
+bool JtagdServer::OnStateRequest(JtagdSession* session, const JtagStateChangeRequest& req)
+{
+	auto adapter = session->GetAdapter();
+	switch(req.state())
+	{
+		case JtagStateChangeRequest::TestLogicReset:
+			adapter->m_jtag->TestLogicReset();
+			adapter->m_tapIdle = true;
+			return true;
+
+		case JtagStateChangeRequest::EnterShiftIR:
+			adapter->m_jtag->EnterShiftIR();
+			adapter->m_tapIdle = false;
+			return true;
+
+		case JtagStateChangeRequest::LeaveExitIR:
+			adapter->m_jtag->LeaveExit1IR();
+			adapter->m_tapIdle = true;
+			return true;
+
+		case JtagStateChangeRequest::EnterShiftDR:
+			adapter->m_jtag->EnterShiftDR();
+			adapter->m_tapIdle = false;
+			return true;
+
+		case JtagStateChangeRequest::LeaveExitDR:
+			adapter->m_jtag->LeaveExit1DR();
+			adapter->m_tapIdle = true;
+			return true;
+
+		case JtagStateChangeRequest::ResetToIdle:
+			adapter->m_jtag->ResetToIdle();
+			adapter->m_tapIdle = true;
+			return true;
+
+		default:
+			LogWarning("Client sent unsupported stateRequest\n");
+			return false;
+	}
+}
+
+/**
+	@brief Executes a batch of SW-DP transfers
+ */
+bool JtagdServer::OnSwdRequest(JtagdSession* session, const JtaghalPacket& packet)
+{
+	auto adapter = session->GetAdapter();
+	if(!adapter->m_swd)
+		return false;
+
+	auto& req = packet.swdrequest();
+	vector<SWDInterface::SWDTransfer> batch;
+	batch.reserve(req.transfers_size());
+	for(auto& t : req.transfers())
+		batch.push_back(SWDInterface::SWDTransfer(t.regaddr() & 0xc, t.ap(), t.read(), t.wdata()));
+
+	size_t completed = adapter->m_swd->Transfer(batch);
+
+	JtaghalPacket reply;
+	auto r = reply.mutable_swdreply();
+	r->set_completed(completed);
+	if(completed == batch.size())
+		r->set_ack(SwdTransferReply::ACK_OK);
+	else
+		r->set_ack((SwdTransferReply_Ack)batch[completed].m_ack);
+	for(size_t i=0; i<completed; i++)
+		r->add_rdata(batch[i].m_read ? batch[i].m_data : 0);
+	return session->QueueReply(reply);
+}
+
+bool JtagdServer::OnDapRequest(JtagdSession* session, const JtaghalPacket& packet)
+{
+	auto adapter = session->GetAdapter();
+	if(!adapter->m_dap)
+		return false;
+
+	JtaghalPacket reply;
+	adapter->m_dap->Execute(packet.daprequest(), *reply.mutable_dapreply());
+	return session->QueueReply(reply);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Blob cache
+
+bool JtagdServer::OnBlobQuery(JtagdSession* session, const JtaghalPacket& packet)
+{
+	auto it = m_blobs.find(packet.blobquery().hash());
+	if(it == m_blobs.end())
+		return QueueInfoReply(session, "", 0);
+
+	//The blob may not be used until the session gets the adapter, and other clients may upload in the meantime.
+	//Keep it around for the scan that's about to use it.
+	it->second.m_lastUse = ++m_blobUseCounter;
+	PinBlob(session, it->first);
+	return QueueInfoReply(session, "", 1);
+}
+
+/**
+	@brief Handles one chunk of a blob upload, and adds the blob to the cache when it's complete
+ */
+bool JtagdServer::OnBlobUpload(JtagdSession* session, const JtaghalPacket& packet)
+{
+	auto& up = packet.blobupload();
+
+	//First chunk starts a new upload
+	if(up.offset() == 0)
+	{
+		//Empty blobs are never worth caching (the client only uploads big ones), so don't bother with them
+		if( (up.hash().size() != JTAGHAL_BLOB_HASH_SIZE) || (up.totallen() == 0) || (up.totallen() > BLOB_CACHE_MAX) )
+		{
+			LogWarning("Client sent an invalid blobUpload\n");
+			return false;
+		}
+
+		//Don't take the client's word for the size: the buffer only grows as data actually arrives
+		m_uploadBufferSize -= session->m_uploadData.size();
+		session->m_uploadHash = up.hash();
+		session->m_uploadLen = up.totallen();
+		session->m_uploadOffset = 0;
+		session->m_uploadDropped = false;
+		session->m_uploadData.clear();
+		session->m_uploadData.shrink_to_fit();
+	}
+	else if( (up.hash() != session->m_uploadHash) || (up.offset() != session->m_uploadOffset) )
+	{
+		LogWarning("Client sent an out-of-order blobUpload chunk\n");
+		return false;
+	}
+
+	//Append the chunk
+	auto data = reinterpret_cast<const unsigned char*>(up.data().data());
+	size_t oldsize = session->m_uploadData.size();
+	size_t maxlen = oldsize + session->m_uploadLen - session->m_uploadOffset;
+	switch(up.compression())
+	{
+		case BlobUpload::COMPRESSION_NONE:
+			if(up.data().size() > maxlen - oldsize)
+			{
+				LogWarning("Client sent too much blobUpload data\n");
+				return false;
+			}
+			session->m_uploadData.insert(session->m_uploadData.end(), data, data + up.data().size());
+			break;
+
+		case BlobUpload::COMPRESSION_PACKBITS:
+			if(!JtaghalBlob::Decompress(data, up.data().size(), session->m_uploadData, maxlen))
+			{
+				LogWarning("Client sent a malformed blobUpload chunk\n");
+				return false;
+			}
+			break;
+
+		default:
+			LogWarning("Client sent a blobUpload with unsupported compression\n");
+			return false;
+	}
+	size_t chunklen = session->m_uploadData.size() - oldsize;
+	session->m_uploadOffset += chunklen;
+	m_uploadBufferSize += chunklen;
+
+	//If everyone's uploads together have gotten too big, drop this one. We still have to follow along until the last
+	//chunk so the client gets its reply (and falls back to sending the data inline).
+	if(!session->m_uploadDropped && (m_uploadBufferSize > BLOB_UPLOAD_MAX) )
+	{
+		LogWarning("Too much blob data being uploaded at once, dropping a %zu byte blob\n", session->m_uploadLen);
+		session->m_uploadDropped = true;
+	}
+	if(session->m_uploadDropped)
+	{
+		m_uploadBufferSize -= session->m_uploadData.size();
+		session->m_uploadData.clear();
+		session->m_uploadData.shrink_to_fit();
+	}
+
+	if(session->m_uploadOffset < session->m_uploadLen)
+		return true;
+
+	//Upload is complete, make sure it's what the client said it was
+	bool ok = !session->m_uploadDropped;
+	if(ok)
+	{
+		m_uploadBufferSize -= session->m_uploadData.size();
+		ok = (JtaghalBlob::Hash(session->m_uploadData.data(), session->m_uploadLen) == session->m_uploadHash);
+		if(!ok)
+			LogWarning("Uploaded blob does not match its hash\n");
+		else if(AddBlob(session->m_uploadHash, session->m_uploadData))
+			PinBlob(session, session->m_uploadHash);
+		else
+			ok = false;
+	}
+
+	session->m_uploadHash.clear();
+	session->m_uploadData.clear();
+	session->m_uploadData.shrink_to_fit();
+	return QueueInfoReply(session, "", ok);
+}
+
+/**
+	@brief Adds a blob to the cache, evicting the least recently used ones if it gets too big
+
+	Pinned blobs (see PinBlob()) are never evicted, so if they alone leave no room, the new blob isn't cached.
+
+	@param hash		Hash of the blob
+	@param data		Blob content (moved into the cache)
+
+	@return True if the blob is now in the cache
+ */
+bool JtagdServer::AddBlob(const string& hash, vector<uint8_t>& data)
+{
+	if(m_blobs.find(hash) != m_blobs.end())
+		return true;
+
+	size_t pinned = 0;
+	for(auto& it : m_blobs)
+	{
+		if(it.second.m_pins)
+			pinned += it.second.m_data.size();
+	}
+	if(pinned + data.size() > BLOB_CACHE_MAX)
+	{
+		LogDebug("No room for %zu byte blob (%zu bytes in cache are pinned)\n", data.size(), pinned);
+		return false;
+	}
+
+	while(m_blobCacheSize + data.size() > BLOB_CACHE_MAX)
+	{
+		auto victim = m_blobs.end();
+		for(auto it = m_blobs.begin(); it != m_blobs.end(); ++it)
+		{
+			if(it->second.m_pins)
+				continue;
+			if( (victim == m_blobs.end()) || (it->second.m_lastUse < victim->second.m_lastUse) )
+				victim = it;
+		}
+		m_blobCacheSize -= victim->second.m_data.size();
+		m_blobs.erase(victim);
+	}
+
+	auto& b = m_blobs[hash];
+	b.m_data.swap(data);
+	b.m_lastUse = ++m_blobUseCounter;
+	b.m_pins = 0;
+	m_blobCacheSize += b.m_data.size();
+	LogDebug("Cached %zu byte blob (%zu bytes in cache)\n", b.m_data.size(), m_blobCacheSize);
+	return true;
+}
+
+/**
+	@brief Keeps a blob in the cache until the session's next blob scan, since we've just told the client we have it
+
+	Blob queries and uploads are answered out of turn (see IsOutOfTurnRequest()), so other clients' uploads could
+	otherwise evict the blob before the session gets the adapter. Each session pins at most one blob at a time.
+ */
+void JtagdServer::PinBlob(JtagdSession* session, const string& hash)
+{
+	if(session->m_pinnedBlob == hash)
+		return;
+
+	UnpinBlob(session);
+	m_blobs[hash].m_pins ++;
+	session->m_pinnedBlob = hash;
+}
+
+/**
+	@brief Releases the blob pinned by a session, if any, so it can be evicted again
+ */
+void JtagdServer::UnpinBlob(JtagdSession* session)
+{
+	if(session->m_pinnedBlob.empty())
+		return;
+
+	auto it = m_blobs.find(session->m_pinnedBlob);
+	if(it != m_blobs.end())
+		it->second.m_pins --;
+	session->m_pinnedBlob.clear();
+}
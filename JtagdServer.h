@@ -0,0 +1,232 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file JtagdServer.h
+	@author Andrew D. Zonenberg
+	@brief Declaration of JtagdServer
+ */
+
+#ifndef JtagdServer_h
+#define JtagdServer_h
+
+class JtaghalPacket;
+class JtagScanRequest;
+class JtagStateChangeRequest;
+class GpioBankState;
+class JtagdSession;
+class JtagdConnection;
+class JtagdAdapter;
+
+/**
+	@brief Reference jtaghal-net server, exporting one or more local JtagInterface or SWDInterface adapters over the
+	network
+
+	The server is a single-threaded, non-blocking epoll loop. Each client connection (JtagdConnection) carries one or
+	more logical channels, one per adapter (see AddAdapter()); channel 0 is the adapter passed to the constructor.
+	Each channel a client opens gets a JtagdSession. Clients may pipeline as many requests as they like on each
+	channel; requests on a channel are executed in order, but channels are independent, so a client driving several
+	adapters over one connection gets replies for each as soon as that adapter is done.
+
+	Several clients may share one adapter. Requests which don't touch the scan chain (hello, adapter info, GPIO and
+	performance queries) are answered immediately. Everything else is arbitrated round-robin: once a client's request
+	gets the adapter, the client keeps it until it sends an AdapterRelease (see NetworkedJtagInterface::ReleaseAdapter())
+	or disconnects, and the next client in line takes over. Nothing else can happen to the chain while a client owns
+	it, so its cached IR and DAP state stay valid until it lets go.
+
+	An owner that is holding up another client is sent an AdapterWanted, and keeps the adapter until it releases it.
+	Clients can instead say they're preemptible (Hello.preemptible), for example if they never release: such an owner
+	that has nothing queued for OWNER_IDLE_TIMEOUT_US while another client is waiting loses the adapter, and is sent an
+	AdapterRelease of its own so it knows to drop its caches. A preemptible owner that keeps the queue full loses it the
+	same way once it has held it for OWNER_QUANTUM_US while another client is waiting; that happens between two of its
+	requests, so anything it had already queued runs when it gets the adapter back.
+	Handovers, requested or not, only happen at a safe point (TAP in Run-Test/Idle or Test-Logic-Reset, and no split
+	scan reads pending inside the adapter).
+
+	Clients on the same host can connect over a Unix-domain socket (see ListenUnix()) and may additionally pass bulk
+	scan data through shared memory (see JtaghalShm).
+
+	Split (pipelined) scans are always reported as supported. If the adapter can't defer reads itself, the server keeps
+	the read data until the client asks for it, which still saves a network round trip per scan.
+
+	\ingroup libjtaghal
+ */
+class JtagdServer
+{
+public:
+	JtagdServer(JtagInterface* iface);
+	JtagdServer(SWDInterface* iface);
+	virtual ~JtagdServer();
+
+	uint32_t AddAdapter(JtagInterface* iface);
+	uint32_t AddAdapter(SWDInterface* iface);
+
+	/// @brief Gets the number of adapters (and thus channels) we're exporting
+	size_t GetAdapterCount()
+	{ return m_adapters.size(); }
+
+	void Listen(uint16_t port);
+	void ListenUnix(const std::string& path);
+
+	void Run();
+	void RunOnce(int timeout_ms);
+
+	/// @brief Makes Run() return at the end of the current iteration
+	void Stop()
+	{ m_quit = true; }
+
+	//Statistics
+	size_t GetClientCount()
+	{ return m_connections.size(); }
+
+	size_t GetRequestCount()
+	{ return m_requestCount; }
+
+	size_t GetOwnerSwitchCount()
+	{ return m_ownerSwitchCount; }
+
+	double GetAdapterTime()
+	{ return m_adapterTime; }
+
+	size_t GetBlobCacheSize()
+	{ return m_blobCacheSize; }
+
+	size_t GetBlobHitCount()
+	{ return m_blobHits; }
+
+protected:
+	void Init();
+
+	void AcceptClients();
+	void AddConnection(int fd);
+	void AddListener(int fd);
+	void UpdateEvents(JtagdConnection* conn);
+	void DispatchRequests(JtagdConnection* conn);
+	void CloseSession(JtagdSession* session);
+	void CloseConnection(JtagdConnection* conn);
+
+	//Arbitration
+	void ServiceQueues();
+	void ServiceAdapter(JtagdAdapter* adapter);
+	bool HasRunnableWork();
+	JtagdSession* PickNextSession(JtagdAdapter* adapter);
+	bool IsAdapterWanted(JtagdAdapter* adapter);
+	bool ReclaimIdleAdapter(JtagdAdapter* adapter);
+	bool PreemptOwner(JtagdAdapter* adapter);
+	void NotifyAdapterWanted(JtagdAdapter* adapter);
+	void TakeAdapterFromOwner(JtagdAdapter* adapter);
+	int GetHandoverTimeout();
+	bool IsOutOfTurnRequest(const JtaghalPacket& packet);
+
+	//Request handlers
+	void ExecuteRequest(JtagdSession* session, const JtaghalPacket& packet);
+	bool OnHello(JtagdSession* session, const JtaghalPacket& packet);
+	bool OnInfoRequest(JtagdSession* session, const JtaghalPacket& packet);
+	bool OnPing(JtagdSession* session, const JtaghalPacket& packet);
+	bool OnAdapterRelease(JtagdSession* session);
+	bool OnBlobQuery(JtagdSession* session, const JtaghalPacket& packet);
+	bool OnBlobUpload(JtagdSession* session, const JtaghalPacket& packet);
+	bool AddBlob(const std::string& hash, std::vector<uint8_t>& data);
+	void PinBlob(JtagdSession* session, const std::string& hash);
+	void UnpinBlob(JtagdSession* session);
+	bool OnGpioReadRequest(JtagdSession* session);
+	void ReadGpioState(JtagdAdapter* adapter, GpioBankState* state);
+	bool OnGpioWrite(JtagdSession* session, const JtaghalPacket& packet);
+	bool OnPerfRequest(JtagdSession* session, const JtaghalPacket& packet);
+	bool OnShmAttach(JtagdSession* session, const JtaghalPacket& packet);
+	bool OnScanRequest(JtagdSession* session, const JtagScanRequest& req);
+	void QueueScanData(JtagdSession* session, const unsigned char* data, size_t len);
+	void QueueShmScanReply(JtagdSession* session, uint64_t pos, size_t len);
+	bool OnStateRequest(JtagdSession* session, const JtagStateChangeRequest& req);
+	bool OnDapRequest(JtagdSession* session, const JtaghalPacket& packet);
+	bool OnSwdRequest(JtagdSession* session, const JtaghalPacket& packet);
+
+protected:
+
+	///The adapters we're exporting, indexed by channel
+	std::vector<JtagdAdapter*> m_adapters;
+
+	///Socket we accept TCP clients on
+	Socket m_listenSocket;
+
+	///Socket we accept Unix-domain clients on (-1 if none)
+	int m_unixListenSocket;
+
+	///Path of m_unixListenSocket
+	std::string m_unixPath;
+
+	/**
+		@brief A blob uploaded by a client, shared by all sessions
+	 */
+	class CachedBlob
+	{
+	public:
+		std::vector<uint8_t> m_data;
+
+		///Value of m_blobUseCounter when the blob was last used
+		uint64_t m_lastUse;
+
+		///Number of sessions that have been told we have the blob and haven't used it yet (never evicted while
+		///nonzero, see PinBlob())
+		unsigned int m_pins;
+	};
+
+	///Blob cache, indexed by SHA-256
+	std::map<std::string, CachedBlob> m_blobs;
+
+	///Total size of everything in m_blobs
+	size_t m_blobCacheSize;
+
+	///Incremented on every blob use, for LRU eviction
+	uint64_t m_blobUseCounter;
+
+	///Number of scans executed from the blob cache
+	size_t m_blobHits;
+
+	///Total size of the partial blobs held by uploads which are still in progress
+	size_t m_uploadBufferSize;
+
+	///The epoll instance
+	int m_epoll;
+
+	///Set to make Run() return
+	bool m_quit;
+
+	///All connected clients
+	std::vector<JtagdConnection*> m_connections;
+
+	///Scratch buffer for scan read data
+	std::vector<unsigned char> m_scanBuffer;
+
+	size_t m_requestCount;
+	size_t m_ownerSwitchCount;
+	double m_adapterTime;
+};
+
+#endif
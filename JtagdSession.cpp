@@ -0,0 +1,138 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of JtagdSession
+ */
+
+#include "jtaghal.h"
+#include "JtagdSession.h"
+#include "JtagdConnection.h"
+#include "ProtobufHelpers.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a session for a channel which a client has just opened
+
+	@param conn		The connection the channel is on
+	@param channel	The channel number
+	@param adapter	The adapter exported on that channel
+ */
+JtagdSession::JtagdSession(JtagdConnection* conn, uint32_t channel, JtagdAdapter* adapter)
+	: m_releaseNotify(false)
+	, m_preemptible(false)
+	, m_wantedNotified(false)
+	, m_shm(NULL)
+	, m_uploadLen(0)
+	, m_uploadOffset(0)
+	, m_uploadDropped(false)
+	, m_conn(conn)
+	, m_channel(channel)
+	, m_adapter(adapter)
+	, m_closing(false)
+	, m_requestCount(0)
+	, m_execCount(0)
+	, m_execTime(0)
+{
+}
+
+/**
+	@brief Discards any requests which were never executed
+ */
+JtagdSession::~JtagdSession()
+{
+	for(auto& r : m_requests)
+		m_conn->FreePacket(r.first, r.second);
+	delete m_shm;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Request queue
+
+/**
+	@brief Adds a request parsed by the connection to the end of the queue
+
+	@param packet	The request (we own it until it is popped)
+	@param len		Size of the request, as returned by JtagdConnection::ParseRequest()
+ */
+void JtagdSession::PushRequest(JtaghalPacket* packet, size_t len)
+{
+	m_requests.push_back(pair<JtaghalPacket*, size_t>(packet, len));
+}
+
+/**
+	@brief Gets the oldest request which has not yet been executed
+
+	@return The request, or NULL if no request is waiting (or the session is closing). The request remains valid
+	until PopRequest() is called.
+ */
+JtaghalPacket* JtagdSession::PeekRequest()
+{
+	if(m_closing || m_requests.empty())
+		return NULL;
+	return m_requests.front().first;
+}
+
+/**
+	@brief Discards the request returned by PeekRequest()
+ */
+void JtagdSession::PopRequest()
+{
+	auto& r = m_requests.front();
+	m_conn->FreePacket(r.first, r.second);
+	m_requests.pop_front();
+	m_requestCount ++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Replies
+
+/**
+	@brief Queues a reply on our channel
+
+	@return False if the reply couldn't be serialized
+ */
+bool JtagdSession::QueueReply(const JtaghalPacket& packet)
+{
+	return m_conn->QueueReply(m_channel, packet);
+}
+
+/**
+	@brief Queues a scanReply on our channel, encoding it directly from the scan data
+ */
+void JtagdSession::QueueScanReply(const unsigned char* data, size_t len)
+{
+	m_conn->QueueScanReply(m_channel, data, len);
+}
@@ -0,0 +1,187 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file JtagdSession.h
+	@author Andrew D. Zonenberg
+	@brief Declaration of JtagdSession
+ */
+
+#ifndef JtagdSession_h
+#define JtagdSession_h
+
+#include <deque>
+#include <list>
+
+class JtaghalPacket;
+class JtaghalShm;
+class JtagdAdapter;
+class JtagdConnection;
+
+/**
+	@brief State for one channel of a client connection to a JtagdServer
+
+	Each channel of a JtagdConnection talks to one JtagdAdapter. Requests are queued per session and executed in
+	order, so a client can pipeline any number of requests without waiting for the replies, and a busy adapter never
+	holds up requests for the other channels of the same connection.
+
+	\ingroup libjtaghal
+ */
+class JtagdSession
+{
+public:
+	JtagdSession(JtagdConnection* conn, uint32_t channel, JtagdAdapter* adapter);
+	virtual ~JtagdSession();
+
+	/// @brief Gets the connection this session is on
+	JtagdConnection* GetConnection()
+	{ return m_conn; }
+
+	/// @brief Gets the channel number of this session
+	uint32_t GetChannel()
+	{ return m_channel; }
+
+	/// @brief Gets the adapter this session is using
+	JtagdAdapter* GetAdapter()
+	{ return m_adapter; }
+
+	void PushRequest(JtaghalPacket* packet, size_t len);
+	JtaghalPacket* PeekRequest();
+	void PopRequest();
+
+	bool QueueReply(const JtaghalPacket& packet);
+	void QueueScanReply(const unsigned char* data, size_t len);
+
+	/**
+		@brief Stops processing requests. The server closes the session at the end of the current event loop iteration.
+	 */
+	void Close()
+	{ m_closing = true; }
+
+	/// @brief Checks if we are still accepting requests
+	bool IsClosing()
+	{ return m_closing; }
+
+	size_t GetRequestCount()
+	{ return m_requestCount; }
+
+	/// @brief Records time spent executing one of our requests (excluding pings)
+	void AddExecTime(double dt)
+	{
+		m_execCount ++;
+		m_execTime += dt;
+	}
+
+	size_t GetExecCount()
+	{ return m_execCount; }
+
+	double GetExecTime()
+	{ return m_execTime; }
+
+public:
+
+	/**
+		@brief Read half of a split scan which the client has not yet asked for
+	 */
+	class SplitRead
+	{
+	public:
+		SplitRead(size_t bits)
+		: m_count(bits)
+		, m_data((bits + 7) / 8)
+		, m_deferred(false)
+		{}
+
+		///Length of the scan, in bits
+		size_t m_count;
+
+		///Read data (owned by the adapter until ShiftDataReadOnly() is called, if m_deferred is set)
+		std::vector<unsigned char> m_data;
+
+		///True if the adapter deferred the read and we still have to call ShiftDataReadOnly()
+		bool m_deferred;
+	};
+
+	///Split scans awaiting a read request, oldest first. std::list so buffers don't move while the adapter owns them.
+	std::list<SplitRead> m_splitReads;
+
+	///True if the client understands AdapterRelease and AdapterWanted sent by the server (see
+	///JtagdServer::ServiceAdapter())
+	bool m_releaseNotify;
+
+	///True if we may take the adapter away from the client without waiting for it to release it
+	bool m_preemptible;
+
+	///True if we've told the client someone else is waiting for the adapter since it last got it
+	bool m_wantedNotified;
+
+	///Shared memory rings for scan data, if the client sent a shmAttach on this channel
+	JtaghalShm* m_shm;
+
+	///Hash of the blob we last told the client we have, kept in the cache until its next blob scan (empty if none)
+	std::string m_pinnedBlob;
+
+	///Hash of the blob being uploaded (empty if none)
+	std::string m_uploadHash;
+
+	///Expected size of the blob being uploaded
+	size_t m_uploadLen;
+
+	///Number of bytes of the blob received so far (whether or not we kept them)
+	size_t m_uploadOffset;
+
+	///True if we ran out of upload buffer space and are discarding the rest of the blob
+	bool m_uploadDropped;
+
+	///Data received so far for the blob being uploaded
+	std::vector<uint8_t> m_uploadData;
+
+protected:
+
+	///The connection we're on
+	JtagdConnection* m_conn;
+
+	///Our channel number
+	uint32_t m_channel;
+
+	///The adapter we're using
+	JtagdAdapter* m_adapter;
+
+	///Requests waiting to be executed, oldest first, along with their sizes
+	std::deque< std::pair<JtaghalPacket*, size_t> > m_requests;
+
+	///Set when we should stop processing requests
+	bool m_closing;
+
+	size_t m_requestCount;
+	size_t m_execCount;
+	double m_execTime;
+};
+
+#endif
@@ -0,0 +1,243 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of JtaghalBlob
+ */
+#include "jtaghal.h"
+#include "JtaghalBlob.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SHA-256 (FIPS 180-4)
+
+static const uint32_t g_sha256K[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t RotateRight(uint32_t x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+/**
+	@brief Runs the SHA-256 compression function on one 64-byte block
+ */
+static void Sha256Block(uint32_t* state, const unsigned char* block)
+{
+	uint32_t w[64];
+	for(int i=0; i<16; i++)
+	{
+		w[i] =
+			(block[i*4] << 24) |
+			(block[i*4 + 1] << 16) |
+			(block[i*4 + 2] << 8) |
+			block[i*4 + 3];
+	}
+	for(int i=16; i<64; i++)
+	{
+		uint32_t s0 = RotateRight(w[i-15], 7) ^ RotateRight(w[i-15], 18) ^ (w[i-15] >> 3);
+		uint32_t s1 = RotateRight(w[i-2], 17) ^ RotateRight(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	uint32_t a = state[0];
+	uint32_t b = state[1];
+	uint32_t c = state[2];
+	uint32_t d = state[3];
+	uint32_t e = state[4];
+	uint32_t f = state[5];
+	uint32_t g = state[6];
+	uint32_t h = state[7];
+	for(int i=0; i<64; i++)
+	{
+		uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+		uint32_t ch = (e & f) ^ (~e & g);
+		uint32_t t1 = h + s1 + ch + g_sha256K[i] + w[i];
+		uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + maj;
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+/**
+	@brief Computes the hash used to identify a blob
+
+	@param data		The blob
+	@param len		Length of the blob, in bytes
+
+	@return The SHA-256 hash (JTAGHAL_BLOB_HASH_SIZE bytes, binary)
+ */
+string JtaghalBlob::Hash(const unsigned char* data, size_t len)
+{
+	uint32_t state[8] =
+	{
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	//All full blocks straight from the input
+	size_t nblocks = len / 64;
+	for(size_t i=0; i<nblocks; i++)
+		Sha256Block(state, data + i*64);
+
+	//Pad the tail: 0x80, zeroes, then the length in bits (big endian)
+	unsigned char tail[128] = {0};
+	size_t taillen = len - nblocks*64;
+	memcpy(tail, data + nblocks*64, taillen);
+	tail[taillen] = 0x80;
+	size_t padlen = (taillen < 56) ? 64 : 128;
+	uint64_t bits = (uint64_t)len * 8;
+	for(int i=0; i<8; i++)
+		tail[padlen - 1 - i] = bits >> (i*8);
+	for(size_t off=0; off<padlen; off += 64)
+		Sha256Block(state, tail + off);
+
+	string ret(JTAGHAL_BLOB_HASH_SIZE, '\0');
+	for(int i=0; i<8; i++)
+	{
+		ret[i*4]		= state[i] >> 24;
+		ret[i*4 + 1]	= state[i] >> 16;
+		ret[i*4 + 2]	= state[i] >> 8;
+		ret[i*4 + 3]	= state[i];
+	}
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PackBits compression
+
+/**
+	@brief Compresses a buffer with PackBits run-length encoding
+
+	Each run starts with a control byte n: 0...127 means n+1 literal bytes follow, 129...255 means the next byte is
+	repeated 257-n times. (128 is never generated.)
+
+	@param data		Input data
+	@param len		Length of the input data
+	@param out		Compressed data (replaces existing content)
+ */
+void JtaghalBlob::Compress(const unsigned char* data, size_t len, string& out)
+{
+	out.clear();
+	out.reserve(len + len/128 + 1);
+
+	size_t i = 0;
+	while(i < len)
+	{
+		//Look for a run of at least 3 identical bytes
+		size_t run = 1;
+		while( (i + run < len) && (run < 128) && (data[i + run] == data[i]) )
+			run ++;
+		if(run >= 3)
+		{
+			out.push_back((char)(257 - run));
+			out.push_back(data[i]);
+			i += run;
+			continue;
+		}
+
+		//Literal block, up to the start of the next run of 3
+		size_t start = i;
+		while( (i < len) && (i - start < 128) )
+		{
+			if( (i + 2 < len) && (data[i] == data[i+1]) && (data[i] == data[i+2]) )
+				break;
+			i ++;
+		}
+		out.push_back((char)(i - start - 1));
+		out.append((const char*)data + start, i - start);
+	}
+}
+
+/**
+	@brief Decompresses a PackBits buffer and appends it to another
+
+	@param data		Compressed data
+	@param len		Length of the compressed data
+	@param out		Buffer to append the decompressed data to
+	@param maxlen	Maximum size of "out" after decompression
+
+	@return True on success, false if the input is malformed or decompresses to more than maxlen bytes
+ */
+bool JtaghalBlob::Decompress(const unsigned char* data, size_t len, vector<uint8_t>& out, size_t maxlen)
+{
+	size_t i = 0;
+	while(i < len)
+	{
+		uint8_t n = data[i++];
+		if(n < 128)
+		{
+			size_t count = n + 1;
+			if( (i + count > len) || (out.size() + count > maxlen) )
+				return false;
+			out.insert(out.end(), data + i, data + i + count);
+			i += count;
+		}
+		else if(n > 128)
+		{
+			size_t count = 257 - n;
+			if( (i >= len) || (out.size() + count > maxlen) )
+				return false;
+			out.insert(out.end(), count, data[i]);
+			i ++;
+		}
+		else
+			return false;
+	}
+	return true;
+}
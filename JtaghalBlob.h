@@ -0,0 +1,60 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file JtaghalBlob.h
+	@author Andrew D. Zonenberg
+	@brief Declaration of JtaghalBlob
+ */
+
+#ifndef JtaghalBlob_h
+#define JtaghalBlob_h
+
+///Length of a blob hash (SHA-256), in bytes
+#define JTAGHAL_BLOB_HASH_SIZE	32
+
+/**
+	@brief Helpers for the jtaghal-net blob cache
+
+	Large write-only scans that are likely to be repeated (FPGA bitstreams etc) can be uploaded to jtagd once and then
+	referred to by their SHA-256 hash. Uploads are sent in chunks, each of which may be PackBits compressed since
+	bitstreams tend to contain long runs of identical bytes.
+
+	\ingroup libjtaghal
+ */
+class JtaghalBlob
+{
+public:
+	static std::string Hash(const unsigned char* data, size_t len);
+
+	static void Compress(const unsigned char* data, size_t len, std::string& out);
+	static bool Decompress(const unsigned char* data, size_t len, std::vector<uint8_t>& out, size_t maxlen);
+};
+
+#endif
@@ -0,0 +1,173 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of JtaghalMux
+ */
+
+#include "jtaghal.h"
+#include "ProtobufHelpers.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+using namespace std;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates an unconnected socket (TCP unless otherwise specified) with no channels open
+ */
+JtaghalMux::JtaghalMux(int af, int type, int protocol)
+	: m_socket(af, type, protocol)
+{
+}
+
+JtaghalMux::~JtaghalMux()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Channel management
+
+/**
+	@brief Registers a channel, so messages for it are kept until it asks for them
+
+	@throw JtagException if the channel is already in use on this connection
+ */
+void JtaghalMux::AddChannel(uint32_t channel)
+{
+	lock_guard<mutex> lock(m_rxMutex);
+	if(m_pending.find(channel) != m_pending.end())
+	{
+		throw JtagExceptionWrapper(
+			"Channel is already in use on this connection",
+			"");
+	}
+	m_pending[channel];
+}
+
+/**
+	@brief Unregisters a channel, discarding anything received for it
+ */
+void JtaghalMux::RemoveChannel(uint32_t channel)
+{
+	lock_guard<mutex> lock(m_rxMutex);
+	m_pending.erase(channel);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Receive path
+
+/**
+	@brief Gets the next message for a channel, reading from the socket (and queueing messages for other channels)
+	until it arrives
+
+	@param channel	The channel
+	@param buf		Buffer to store the message in (resized as needed)
+	@param len		Set to the length of the message
+
+	@return True on success, false if the connection failed
+ */
+bool JtaghalMux::RecvFrame(uint32_t channel, vector<uint8_t>& buf, size_t& len)
+{
+	lock_guard<mutex> lock(m_rxMutex);
+
+	//Another channel may already have read it for us
+	auto it = m_pending.find(channel);
+	if( (it != m_pending.end()) && !it->second.empty() )
+	{
+		buf.swap(it->second.front());
+		len = buf.size();
+		it->second.pop_front();
+		return true;
+	}
+
+	while(true)
+	{
+		uint32_t framelen;
+		if(!m_socket.RecvLooped((unsigned char*)&framelen, sizeof(framelen)))
+			return false;
+
+		//Only ever grow the buffer, so we don't pay for zero-filling it on every message
+		if(buf.size() < framelen)
+			buf.resize(framelen);
+		if(framelen && !m_socket.RecvLooped(&buf[0], framelen))
+			return false;
+
+		uint32_t target = GetChannel(buf.data(), framelen);
+		if(target == channel)
+		{
+			len = framelen;
+			return true;
+		}
+
+		it = m_pending.find(target);
+		if(it == m_pending.end())
+		{
+			LogDebug("Dropping message for channel %u, which is not open\n", target);
+			continue;
+		}
+		it->second.push_back(vector<uint8_t>(buf.begin(), buf.begin() + framelen));
+	}
+}
+
+/**
+	@brief Finds the channel of a serialized JtaghalPacket without parsing the rest of it
+
+	The payload is skipped over rather than decoded, so this is cheap even for large scan replies.
+
+	@return The channel, or 0 if the message doesn't have one (or is malformed; parsing it will fail later)
+ */
+uint32_t JtaghalMux::GetChannel(const uint8_t* data, size_t len)
+{
+	const uint32_t chantag = WireFormatLite::MakeTag(
+		JtaghalPacket::kChannelFieldNumber,
+		WireFormatLite::WIRETYPE_VARINT);
+
+	CodedInputStream in(data, len);
+	uint32_t tag;
+	while( (tag = in.ReadTag()) != 0)
+	{
+		if(tag == chantag)
+		{
+			uint32_t channel;
+			if(!in.ReadVarint32(&channel))
+				return 0;
+			return channel;
+		}
+		if(!WireFormatLite::SkipField(&in, tag))
+			return 0;
+	}
+	return 0;
+}
@@ -0,0 +1,85 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file JtaghalMux.h
+	@author Andrew D. Zonenberg
+	@brief Declaration of JtaghalMux
+ */
+
+#ifndef JtaghalMux_h
+#define JtaghalMux_h
+
+#include <deque>
+#include <mutex>
+
+/**
+	@brief Client side of a jtaghal-net connection, shared by the ServerInterface for each channel in use
+
+	Every connected ServerInterface has one of these; interfaces for other channels of the same server can share it (see
+	ServerInterface::DoConnectChannel()) so that one connection drives several adapters.
+
+	Outbound batches from different channels are written whole, under m_txMutex. Inbound messages are demultiplexed
+	by whichever channel is waiting for a reply: messages for other channels are queued until their owner asks for
+	them, so each channel sees its own replies in order no matter how the server interleaves them.
+
+	Channels may be used from different threads. A channel waiting for a reply that another thread has already
+	queued may have to wait until that thread has received its own reply.
+
+	\ingroup libjtaghal
+ */
+class JtaghalMux
+{
+public:
+	JtaghalMux(int af = AF_INET6, int type = SOCK_STREAM, int protocol = IPPROTO_TCP);
+	virtual ~JtaghalMux();
+
+	void AddChannel(uint32_t channel);
+	void RemoveChannel(uint32_t channel);
+
+	bool RecvFrame(uint32_t channel, std::vector<uint8_t>& buf, size_t& len);
+
+	static uint32_t GetChannel(const uint8_t* data, size_t len);
+
+	///The socket
+	Socket m_socket;
+
+	///Held while sending on m_socket
+	std::mutex m_txMutex;
+
+protected:
+
+	///Held while receiving from m_socket or touching m_pending
+	std::mutex m_rxMutex;
+
+	///Messages received for each open channel which it has not yet asked for, oldest first
+	std::map<uint32_t, std::deque< std::vector<uint8_t> > > m_pending;
+};
+
+#endif
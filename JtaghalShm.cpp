@@ -0,0 +1,263 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of JtaghalShm
+ */
+
+#include "jtaghal.h"
+
+#ifndef _WIN32
+
+#include "JtaghalShm.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+JtaghalShm::JtaghalShm()
+	: m_created(false)
+	, m_map(NULL)
+	, m_mapSize(0)
+	, m_header(NULL)
+	, m_tx(NULL)
+	, m_txSize(0)
+	, m_rx(NULL)
+	, m_rxSize(0)
+	, m_txHead(0)
+	, m_rxHead(0)
+{
+}
+
+JtaghalShm::~JtaghalShm()
+{
+	Unlink();
+	if(m_map)
+		munmap(m_map, m_mapSize);
+}
+
+/**
+	@brief Creates and maps a new segment (client side)
+
+	@param name		POSIX shared memory object name (must start with a slash)
+	@param txSize	Size of the client-to-server ring
+	@param rxSize	Size of the server-to-client ring
+
+	@return True on success
+ */
+bool JtaghalShm::Create(const string& name, size_t txSize, size_t rxSize)
+{
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd < 0)
+	{
+		LogWarning("Failed to create shared memory object %s\n", name.c_str());
+		return false;
+	}
+	m_name = name;
+	m_created = true;
+
+	size_t size = JTAGHAL_SHM_HEADER_SIZE + txSize + rxSize;
+	if(0 != ftruncate(fd, size))
+	{
+		LogWarning("Failed to resize shared memory object %s\n", name.c_str());
+		close(fd);
+		return false;
+	}
+	bool ok = Map(fd, size);
+	close(fd);
+	if(!ok)
+		return false;
+
+	m_header = new(m_map) JtaghalShmHeader;
+	m_header->magic = JTAGHAL_SHM_MAGIC;
+	m_header->version = JTAGHAL_SHM_VERSION;
+	m_header->txSize = txSize;
+	m_header->rxSize = rxSize;
+	m_header->txConsumed = 0;
+	m_header->rxConsumed = 0;
+
+	m_txSize = txSize;
+	m_rxSize = rxSize;
+	m_tx = reinterpret_cast<unsigned char*>(m_map) + JTAGHAL_SHM_HEADER_SIZE;
+	m_rx = m_tx + txSize;
+	return true;
+}
+
+/**
+	@brief Maps a segment created by a client (server side)
+
+	@param name		POSIX shared memory object name
+
+	@return True on success
+ */
+bool JtaghalShm::Attach(const string& name)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if(fd < 0)
+	{
+		LogWarning("Failed to open shared memory object %s\n", name.c_str());
+		return false;
+	}
+	m_name = name;
+
+	struct stat st;
+	bool ok = (0 == fstat(fd, &st)) && (st.st_size >= JTAGHAL_SHM_HEADER_SIZE) && Map(fd, st.st_size);
+	close(fd);
+	if(!ok)
+		return false;
+
+	//Sanity check the header. Sizes are copied so a misbehaving client can't change them later.
+	m_header = reinterpret_cast<JtaghalShmHeader*>(m_map);
+	m_txSize = m_header->txSize;
+	m_rxSize = m_header->rxSize;
+	if( (m_header->magic != JTAGHAL_SHM_MAGIC) ||
+		(m_header->version != JTAGHAL_SHM_VERSION) ||
+		(m_txSize > m_mapSize) ||
+		(m_rxSize > m_mapSize) ||
+		(JTAGHAL_SHM_HEADER_SIZE + m_txSize + m_rxSize > m_mapSize) )
+	{
+		LogWarning("Shared memory object %s has a bad header\n", name.c_str());
+		return false;
+	}
+
+	m_tx = reinterpret_cast<unsigned char*>(m_map) + JTAGHAL_SHM_HEADER_SIZE;
+	m_rx = m_tx + m_txSize;
+	return true;
+}
+
+/**
+	@brief Maps the object
+ */
+bool JtaghalShm::Map(int fd, size_t size)
+{
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(p == MAP_FAILED)
+	{
+		LogWarning("Failed to map shared memory object %s\n", m_name.c_str());
+		return false;
+	}
+	m_map = p;
+	m_mapSize = size;
+	return true;
+}
+
+/**
+	@brief Removes the name of the object, if we created it. Existing mappings stay valid.
+
+	The client calls this as soon as the server has attached, so nothing is left behind if either side crashes.
+ */
+void JtaghalShm::Unlink()
+{
+	if(!m_created)
+		return;
+	shm_unlink(m_name.c_str());
+	m_created = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Ring management
+
+/**
+	@brief Allocates space for a payload in a ring
+
+	@return Pointer to the space, or NULL if the ring doesn't have room
+ */
+unsigned char* JtaghalShm::Alloc(
+	unsigned char* base,
+	size_t size,
+	uint64_t& head,
+	const atomic<uint64_t>& consumed,
+	size_t len,
+	uint64_t& pos)
+{
+	if( (len == 0) || (len > size) )
+		return NULL;
+
+	//Skip to the start of the ring if we'd straddle the end
+	uint64_t p = head;
+	if( (p % size) + len > size)
+		p += size - (p % size);
+
+	if(p + len - consumed.load(memory_order_acquire) > size)
+		return NULL;
+
+	head = p + len;
+	pos = p;
+	return base + (p % size);
+}
+
+/**
+	@brief Gets a pointer to a payload in a ring, checking that the peer gave us a sane position
+
+	@return Pointer to the payload, or NULL if it's not entirely inside the ring
+ */
+unsigned char* JtaghalShm::Get(unsigned char* base, size_t size, uint64_t pos, size_t len)
+{
+	if( (size == 0) || (len > size) || ( (pos % size) + len > size) )
+		return NULL;
+	return base + (pos % size);
+}
+
+unsigned char* JtaghalShm::AllocTx(size_t len, uint64_t& pos)
+{
+	return Alloc(m_tx, m_txSize, m_txHead, m_header->txConsumed, len, pos);
+}
+
+unsigned char* JtaghalShm::GetTx(uint64_t pos, size_t len)
+{
+	return Get(m_tx, m_txSize, pos, len);
+}
+
+void JtaghalShm::ReleaseTx(uint64_t pos, size_t len)
+{
+	m_header->txConsumed.store(pos + len, memory_order_release);
+}
+
+unsigned char* JtaghalShm::AllocRx(size_t len, uint64_t& pos)
+{
+	return Alloc(m_rx, m_rxSize, m_rxHead, m_header->rxConsumed, len, pos);
+}
+
+unsigned char* JtaghalShm::GetRx(uint64_t pos, size_t len)
+{
+	return Get(m_rx, m_rxSize, pos, len);
+}
+
+void JtaghalShm::ReleaseRx(uint64_t pos, size_t len)
+{
+	m_header->rxConsumed.store(pos + len, memory_order_release);
+}
+
+#endif	//#ifndef _WIN32
@@ -0,0 +1,153 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file JtaghalShm.h
+	@author Andrew D. Zonenberg
+	@brief Declaration of JtaghalShm
+ */
+
+#ifndef JtaghalShm_h
+#define JtaghalShm_h
+
+#include <atomic>
+
+///Magic number at the start of a jtaghal-net shared memory segment ("HSHM")
+#define JTAGHAL_SHM_MAGIC		0x4d485348
+
+///Layout version of the shared memory segment
+#define JTAGHAL_SHM_VERSION		1
+
+///Space reserved for the header at the start of the segment
+#define JTAGHAL_SHM_HEADER_SIZE	4096
+
+///Scan payloads smaller than this are sent inline, since the ring bookkeeping would cost more than it saves
+#define JTAGHAL_SHM_THRESHOLD	4096
+
+/**
+	@brief Header at the start of a jtaghal-net shared memory segment
+
+	Followed (at JTAGHAL_SHM_HEADER_SIZE) by the client-to-server ring, then the server-to-client ring.
+ */
+struct JtaghalShmHeader
+{
+	uint32_t				magic;
+	uint32_t				version;
+	uint64_t				txSize;			//size of the client-to-server ring
+	uint64_t				rxSize;			//size of the server-to-client ring
+	std::atomic<uint64_t>	txConsumed;		//end position of the last client-to-server payload used (server writes)
+	std::atomic<uint64_t>	rxConsumed;		//end position of the last server-to-client payload used (client writes)
+};
+
+/**
+	@brief Shared memory rings for bulk scan data on shm: jtaghal-net connections
+
+	The client creates the segment and tells the server its name with a shmAttach message. Control traffic stays on
+	the socket; scan requests and replies just carry the position and length of their payload in the ring.
+
+	Positions increase monotonically and are reduced modulo the ring size, and a payload never straddles the end of a
+	ring. The producer allocates space only once the consumer has released everything before it, which the consumer
+	does after it has finished with each payload. Since requests and replies are processed in order, this is all the
+	synchronization we need. If a ring is full the producer simply sends the payload inline instead.
+
+	\ingroup libjtaghal
+ */
+class JtaghalShm
+{
+public:
+	JtaghalShm();
+	virtual ~JtaghalShm();
+
+	bool Create(const std::string& name, size_t txSize, size_t rxSize);
+	bool Attach(const std::string& name);
+	void Unlink();
+
+	/// @brief Gets the name of the shared memory object
+	const std::string& GetName()
+	{ return m_name; }
+
+	//Client to server ring
+	unsigned char* AllocTx(size_t len, uint64_t& pos);
+	unsigned char* GetTx(uint64_t pos, size_t len);
+	void ReleaseTx(uint64_t pos, size_t len);
+
+	//Server to client ring
+	unsigned char* AllocRx(size_t len, uint64_t& pos);
+	unsigned char* GetRx(uint64_t pos, size_t len);
+	void ReleaseRx(uint64_t pos, size_t len);
+
+protected:
+	bool Map(int fd, size_t size);
+
+	static unsigned char* Alloc(
+		unsigned char* base,
+		size_t size,
+		uint64_t& head,
+		const std::atomic<uint64_t>& consumed,
+		size_t len,
+		uint64_t& pos);
+	static unsigned char* Get(unsigned char* base, size_t size, uint64_t pos, size_t len);
+
+protected:
+
+	///Name of the shared memory object
+	std::string m_name;
+
+	///True if we created the object (and should unlink it)
+	bool m_created;
+
+	///Base of the mapping
+	void* m_map;
+
+	///Size of the mapping
+	size_t m_mapSize;
+
+	///The header
+	JtaghalShmHeader* m_header;
+
+	///Client-to-server ring
+	unsigned char* m_tx;
+
+	///Size of the client-to-server ring (local copy, the peer can't change it under us)
+	size_t m_txSize;
+
+	///Server-to-client ring
+	unsigned char* m_rx;
+
+	///Size of the server-to-client ring
+	size_t m_rxSize;
+
+	///Next position to allocate in the client-to-server ring
+	uint64_t m_txHead;
+
+	///Next position to allocate in the server-to-client ring
+	uint64_t m_rxHead;
+};
+
+#endif
@@ -411,7 +411,8 @@ EjtagControlRegister MicrochipPIC32Device::WaitForEjtagMemoryOperation(bool firs
 	//Wait for CPU to request a memory transaction
 	EjtagControlRegister write_reg;
 	EjtagControlRegister read_reg;
-	while(true)
+	PollBackoff backoff(POLL_DEBUG_ACCESS);
+	for(unsigned int i=1; ; i++)
 	{
 		write_reg.word = 0;						//default to zero
 		write_reg.bits.proc_access	= 1;		//don't clear processor-access bit
@@ -433,7 +434,16 @@ EjtagControlRegister MicrochipPIC32Device::WaitForEjtagMemoryOperation(bool firs
 		ScanDR((uint8_t*)&write_reg.word, (uint8_t*)&read_reg.word, 32);
 		if(read_reg.bits.proc_access)
 			break;
+
+		//Give it a few back-to-back scans, then start backing off
+		if( ( (i % backoff.GetDepth()) == 0) && !backoff.Backoff() )
+		{
+			throw JtagExceptionWrapper(
+				"Timed out waiting for the CPU to request a memory transaction",
+				"");
+		}
 	}
+	backoff.Complete();
 
 	if(read_reg.bits.access_size != 2)
 		LogWarning("    Request size isn't word (got %d)\n", read_reg.bits.access_size);
@@ -644,14 +654,21 @@ void MicrochipPIC32Device::Erase()
 	//Clear reset
 	SendMchpCommand(MCHP_DE_ASSERT_RST);
 
-	//Poll every 10 ms until status is clear
+	//Poll until status is clear
+	PollBackoff backoff(POLL_MASS_ERASE);
 	while(true)
 	{
 		auto stat = GetStatus();
 		if(!stat.bits.flash_busy && stat.bits.cfg_rdy)
 			break;
-		usleep(10 * 1000);
+		if(!backoff.Backoff())
+		{
+			throw JtagExceptionWrapper(
+				"Timed out waiting for bulk erase to complete",
+				"");
+		}
 	}
+	backoff.Complete();
 
 	//Read back
 
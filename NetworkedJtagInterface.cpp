@@ -37,10 +37,22 @@
 
 using namespace std;
 
+///Bulk scans smaller than this are sent inline, since checking the cache costs a round trip
+#define BLOB_MIN_SIZE		(64 * 1024)
+
+///Size of each blobUpload chunk (before compression)
+#define BLOB_CHUNK_SIZE		(1024 * 1024)
+
 /**
 	@brief Creates the interface object but does not connect to a server.
  */
 NetworkedJtagInterface::NetworkedJtagInterface()
+	: m_splitScanSupported(false)
+	, m_dapOffloadSupported(false)
+	, m_blobCacheSupported(false)
+	, m_perfBlobUploads(0)
+	, m_perfBlobHits(0)
+	, m_perfPipelinedReads(0)
 {
 }
 
@@ -63,27 +75,76 @@ NetworkedJtagInterface::~NetworkedJtagInterface()
 void NetworkedJtagInterface::Connect(const string& server, uint16_t port)
 {
 	ServerInterface::DoConnect(server, port, Hello::TRANSPORT_JTAG);
+	LoadCapabilities();
+}
+
+/**
+	@brief Opens another channel of a jtagd server, sharing an existing connection (see
+	ServerInterface::DoConnectChannel())
+
+	@throw JtagException if the channel could not be opened
+
+	@param peer		Interface which is already connected to the server
+	@param channel	Channel of the JTAG adapter to use
+ */
+void NetworkedJtagInterface::Connect(ServerInterface& peer, uint32_t channel)
+{
+	ServerInterface::DoConnectChannel(peer, channel, Hello::TRANSPORT_JTAG);
+	LoadCapabilities();
+}
 
-	//Check if we support split scans
+/**
+	@brief Finds out which optional features the server supports
+ */
+void NetworkedJtagInterface::LoadCapabilities()
+{
+	//Capabilities normally come with the ServerHello
+	auto info = GetServerInfo();
+	if(info)
+	{
+		m_splitScanSupported = info->splitscan();
+		m_dapOffloadSupported = info->dapoffload();
+		m_blobCacheSupported = info->blobcache();
+		return;
+	}
+
+	//Older server, ask for them one at a time. Check if we support split scans
 	JtaghalPacket packet;
 	packet.mutable_splitrequest();
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send splitScanSupportedRequest",
 			"");
 	}
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kInfoReply))
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
 	{
 		throw JtagExceptionWrapper(
 			"Failed to get reply",
 			"");
 	}
-	auto r = packet.inforeply();
-	if(r.num())
+	if(reply->inforeply().num())
 		m_splitScanSupported = true;
 	else
 		m_splitScanSupported = false;
+
+	//Check if the server can run ARM DAP transactions for us
+	packet.mutable_dapsupportedrequest();
+	if(!SendMessage(packet))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to send dapSupportedRequest",
+			"");
+	}
+	reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to get reply",
+			"");
+	}
+	m_dapOffloadSupported = (reply->inforeply().num() != 0);
 }
 
 string NetworkedJtagInterface::GetName()
@@ -111,39 +172,29 @@ void NetworkedJtagInterface::ShiftData(bool last_tms, const unsigned char* send_
 	double start = GetTime();
 	size_t bytesize =  ceil(count / 8.0f);
 
-	//Send the request data
-	JtaghalPacket packet;
-	auto r = packet.mutable_scanrequest();
-	r->set_readrequested(rcv_data != NULL);
-	r->set_totallen(count);
-	r->set_settmsatend(last_tms);
-	r->set_writedata(string((char*)send_data, bytesize));
-	r->set_split(false);				//not doing a split transfer
-	if(!SendMessage(m_socket, packet))
+	//Send the request data (the scan data itself goes straight from send_data to the socket)
+	JtagScanRequest r;
+	r.set_readrequested(rcv_data != NULL);
+	r.set_totallen(count);
+	r.set_settmsatend(last_tms);
+	r.set_split(false);				//not doing a split transfer
+	if(!SendScanRequest(r, send_data, bytesize))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send scanRequest",
 			"");
 	}
 
-	//Get the reply
+	//Get the reply (copied straight from the receive buffer)
 	if(rcv_data != NULL)
 	{
-		//Get the reply
-		if(!RecvMessage(m_socket, packet, JtaghalPacket::kScanReply))
+		FlushPendingReplies();
+		if(!RecvScanReply(rcv_data, bytesize))
 		{
 			throw JtagExceptionWrapper(
 				"Failed to get scanReply",
 				"");
 		}
-		auto r = packet.scanreply();
-		if(r.readdata().size() != bytesize)
-		{
-			throw JtagExceptionWrapper(
-				"RX byte length mismatch",
-				"");
-		}
-		memcpy(rcv_data, r.readdata().c_str(), bytesize);
 	}
 
 	m_perfShiftTime += GetTime() - start;
@@ -160,66 +211,121 @@ bool NetworkedJtagInterface::ShiftDataWriteOnly(bool last_tms, const unsigned ch
 	size_t bytesize =  ceil(count / 8.0f);
 
 	//Send the request data
-	JtaghalPacket packet;
-	auto r = packet.mutable_scanrequest();
-	r->set_readrequested(rcv_data != NULL);
-	r->set_totallen(count);
-	r->set_settmsatend(last_tms);
-	r->set_writedata(string((char*)send_data, bytesize));
-	r->set_split(true);
-	if(!SendMessage(m_socket, packet))
+	JtagScanRequest r;
+	r.set_readrequested(rcv_data != NULL);
+	r.set_totallen(count);
+	r.set_settmsatend(last_tms);
+	r.set_split(true);
+	if(!SendScanRequest(r, send_data, bytesize))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send scanRequest",
 			"");
 	}
+	m_splitReads.push_back(SplitRead(rcv_data, count));
 
 	m_perfShiftTime += GetTime() - start;
 	return true;
 }
 
+/**
+	@brief Reads data from a ShiftDataWriteOnly() call.
+
+	The first read after a series of split writes requests the read data for all of them at once, so draining N
+	pipelined scans costs about one round trip instead of N. Later calls just pick up replies that are already in
+	flight (or were collected by FlushPendingReplies() in the meantime).
+ */
 bool NetworkedJtagInterface::ShiftDataReadOnly(unsigned char* rcv_data, size_t count)
 {
 	double start = GetTime();
-	size_t bytesize =  ceil(count / 8.0f);
 
-	//Send the request data
-	JtaghalPacket packet;
-	auto r = packet.mutable_scanrequest();
-	r->set_readrequested(true);
-	r->set_totallen(count);
-	//tms is a dontcare
-	r->set_writedata("");
-	r->set_split(true);
-	if(!SendMessage(m_socket, packet))
+	//Not matched with a ShiftDataWriteOnly() of ours, just pass the request through
+	if(m_splitReads.empty())
 	{
-		throw JtagExceptionWrapper(
-			"Failed to send scanRequest",
-			"");
+		LogWarning("NetworkedJtagInterface::ShiftDataReadOnly() without matching ShiftDataWriteOnly()\n");
+		m_splitReads.push_back(SplitRead(rcv_data, count));
 	}
 
-	//Get the reply
-	if(rcv_data != NULL)
+	//Ask for everything that's outstanding, not just this scan
+	auto& r = m_splitReads.front();
+	size_t bytesize =  ceil(r.m_count / 8.0f);
+	if(!r.m_requested)
+		RequestSplitReads();
+	else
+		m_perfPipelinedReads ++;
+
+	//Get the reply (copied straight from the receive buffer)
+	if(!r.m_received && (r.m_data != NULL) )
 	{
-		//Get the reply
-		if(!RecvMessage(m_socket, packet, JtaghalPacket::kScanReply))
+		if(!RecvScanReply(r.m_data, bytesize))
 		{
 			throw JtagExceptionWrapper(
 				"Failed to get scanReply",
 				"");
 		}
-		auto r = packet.scanreply();
-		if(r.readdata().size() != bytesize)
+	}
+
+	//Caller broke the "same rcv_data" rule, but give them the data anyway
+	if( (rcv_data != NULL) && (r.m_data != NULL) && (rcv_data != r.m_data) )
+		memcpy(rcv_data, r.m_data, bytesize);
+
+	m_splitReads.pop_front();
+
+	m_perfShiftTime += GetTime() - start;
+	return true;
+}
+
+/**
+	@brief Sends read requests for every split scan we haven't requested the read data for yet
+ */
+void NetworkedJtagInterface::RequestSplitReads()
+{
+	for(auto& r : m_splitReads)
+	{
+		if(r.m_requested)
+			continue;
+
+		JtagScanRequest req;
+		req.set_readrequested(r.m_data != NULL);		//no reply is sent if we don't want the data
+		req.set_totallen(r.m_count);
+		//tms is a dontcare
+		req.set_split(true);
+		if(!SendScanRequest(req, NULL, 0))
 		{
 			throw JtagExceptionWrapper(
-				"RX byte length mismatch",
+				"Failed to send scanRequest",
 				"");
 		}
-		memcpy(rcv_data, r.readdata().c_str(), bytesize);
+
+		r.m_requested = true;
+		if(r.m_data == NULL)
+			r.m_received = true;
 	}
+}
 
-	m_perfShiftTime += GetTime() - start;
-	return true;
+/**
+	@brief Receives replies to split reads we've requested ahead of time, so the next reply is for whatever we
+	send after them.
+
+	The data goes straight to the buffers the caller passed to ShiftDataWriteOnly().
+ */
+void NetworkedJtagInterface::FlushPendingReplies()
+{
+	for(auto& r : m_splitReads)
+	{
+		if(!r.m_requested)
+			break;
+		if(r.m_received)
+			continue;
+
+		if(!RecvScanReply(r.m_data, ceil(r.m_count / 8.0f)))
+		{
+			throw JtagExceptionWrapper(
+				"Failed to get scanReply",
+				"");
+		}
+		r.m_received = true;
+	}
 }
 
 void NetworkedJtagInterface::ShiftTMS(bool /*tdi*/, const unsigned char* /*send_data*/, size_t /*count*/)
@@ -234,14 +340,12 @@ void NetworkedJtagInterface::SendDummyClocks(size_t n)
 	double start = GetTime();
 
 	//Send the request data
-	JtaghalPacket packet;
-	auto r = packet.mutable_scanrequest();
-	r->set_readrequested(false);
-	r->set_totallen(n);
+	JtagScanRequest r;
+	r.set_readrequested(false);
+	r.set_totallen(n);
 	//tms is a dontcare
-	r->set_writedata("");
-	r->set_split(false);
-	if(!SendMessage(m_socket, packet))
+	r.set_split(false);
+	if(!SendScanRequest(r, NULL, 0))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send scanRequest",
@@ -263,7 +367,7 @@ void NetworkedJtagInterface::TestLogicReset()
 	JtaghalPacket packet;
 	auto r = packet.mutable_staterequest();
 	r->set_state(JtagStateChangeRequest::TestLogicReset);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send infoRequest",
@@ -277,7 +381,7 @@ void NetworkedJtagInterface::EnterShiftIR()
 	JtaghalPacket packet;
 	auto r = packet.mutable_staterequest();
 	r->set_state(JtagStateChangeRequest::EnterShiftIR);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send infoRequest",
@@ -291,7 +395,7 @@ void NetworkedJtagInterface::LeaveExit1IR()
 	JtaghalPacket packet;
 	auto r = packet.mutable_staterequest();
 	r->set_state(JtagStateChangeRequest::LeaveExitIR);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send infoRequest",
@@ -305,7 +409,7 @@ void NetworkedJtagInterface::EnterShiftDR()
 	JtaghalPacket packet;
 	auto r = packet.mutable_staterequest();
 	r->set_state(JtagStateChangeRequest::EnterShiftDR);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send infoRequest",
@@ -319,7 +423,7 @@ void NetworkedJtagInterface::LeaveExit1DR()
 	JtaghalPacket packet;
 	auto r = packet.mutable_staterequest();
 	r->set_state(JtagStateChangeRequest::LeaveExitDR);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send infoRequest",
@@ -333,7 +437,7 @@ void NetworkedJtagInterface::ResetToIdle()
 	JtaghalPacket packet;
 	auto r = packet.mutable_staterequest();
 	r->set_state(JtagStateChangeRequest::ResetToIdle);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send infoRequest",
@@ -346,7 +450,14 @@ void NetworkedJtagInterface::Commit()
 	//Send the flush request
 	JtaghalPacket packet;
 	packet.mutable_flushrequest();
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to send flushRequest",
+			"");
+	}
+
+	if(!FlushTx())
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send flushRequest",
@@ -356,6 +467,408 @@ void NetworkedJtagInterface::Commit()
 	//TODO: should this be a barrier sync where we block?
 }
 
+/**
+	@brief Lets other clients have the adapter (see ServerInterface::ReleaseAdapter()), then forgets the IR contents
+	and device state we had cached, since they may have changed by the time we get it back
+
+	Deferred writes (e.g. dirty write-back memory cache pages) are sent first, while we still own the adapter.
+ */
+void NetworkedJtagInterface::ReleaseAdapter()
+{
+	if(!m_splitReads.empty())
+	{
+		throw JtagExceptionWrapper(
+			"Can't release the adapter with split scan reads outstanding",
+			"");
+	}
+
+	FlushDeviceCaches();
+	ServerInterface::ReleaseAdapter();
+	InvalidateDeviceCaches();
+}
+
+/**
+	@brief Forgets the IR contents and device state we had cached if we've been idle long enough that the server may
+	have given the adapter to another client (see ServerInterface::MayHaveLostAdapter())
+ */
+void NetworkedJtagInterface::CheckDeviceCaches()
+{
+	if(MayHaveLostAdapter())
+		InvalidateDeviceCaches();
+}
+
+/**
+	@brief Forgets the IR contents and device state we had cached, since the server gave the adapter to another client
+	while we were idle
+ */
+void NetworkedJtagInterface::OnAdapterLost()
+{
+	InvalidateDeviceCaches();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Blob cache
+
+/**
+	@brief Checks whether the server can cache bulk scan data for us (see JtaghalBlob)
+ */
+bool NetworkedJtagInterface::IsBlobCacheSupported()
+{
+	return m_blobCacheSupported;
+}
+
+/**
+	@brief Shifts a large write-only block, uploading it to the server's blob cache first if it isn't there already
+
+	Costs one round trip to check the cache, plus the upload the first time a given block is seen.
+ */
+void NetworkedJtagInterface::ShiftDataBulk(bool last_tms, const unsigned char* send_data, size_t count)
+{
+	size_t bytesize = ceil(count / 8.0f);
+	if(!m_blobCacheSupported || (bytesize < BLOB_MIN_SIZE) )
+	{
+		ShiftData(last_tms, send_data, NULL, count);
+		return;
+	}
+
+	double start = GetTime();
+
+	string hash = JtaghalBlob::Hash(send_data, bytesize);
+
+	//See if the server already has it
+	JtaghalPacket packet;
+	packet.mutable_blobquery()->set_hash(hash);
+	if(!SendMessage(packet))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to send blobQuery",
+			"");
+	}
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to get infoReply",
+			"");
+	}
+	if(reply->inforeply().num())
+		m_perfBlobHits ++;
+
+	//Server didn't have room for it, send it the normal way
+	else if(!UploadBlob(hash, send_data, bytesize))
+	{
+		ShiftData(last_tms, send_data, NULL, count);
+		return;
+	}
+
+	//and shift it
+	JtagScanRequest r;
+	r.set_readrequested(false);
+	r.set_totallen(count);
+	r.set_settmsatend(last_tms);
+	r.set_split(false);
+	r.set_writeblob(hash);
+	if(!SendScanRequest(r, NULL, 0))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to send scanRequest",
+			"");
+	}
+
+	m_perfShiftTime += GetTime() - start;
+}
+
+/**
+	@brief Uploads a blob to the server's cache in chunks, compressing each one if that makes it smaller
+
+	@throw JtagException if the upload could not be sent
+
+	@return True if the server cached the blob, false if it had no room for it or computed a different hash
+ */
+bool NetworkedJtagInterface::UploadBlob(const string& hash, const unsigned char* data, size_t len)
+{
+	LogTrace("Uploading %zu byte blob to server\n", len);
+
+	JtaghalPacket packet;
+	auto up = packet.mutable_blobupload();
+	up->set_hash(hash);
+	up->set_totallen(len);
+
+	string compressed;
+	for(size_t off = 0; off < len; off += BLOB_CHUNK_SIZE)
+	{
+		size_t chunklen = len - off;
+		if(chunklen > BLOB_CHUNK_SIZE)
+			chunklen = BLOB_CHUNK_SIZE;
+
+		up->set_offset(off);
+		JtaghalBlob::Compress(data + off, chunklen, compressed);
+		if(compressed.size() < chunklen)
+		{
+			up->set_compression(BlobUpload::COMPRESSION_PACKBITS);
+			up->set_data(compressed);
+		}
+		else
+		{
+			up->set_compression(BlobUpload::COMPRESSION_NONE);
+			up->set_data(data + off, chunklen);
+		}
+
+		if(!SendMessage(packet))
+		{
+			throw JtagExceptionWrapper(
+				"Failed to send blobUpload",
+				"");
+		}
+	}
+
+	//Server acknowledges the last chunk
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to get infoReply",
+			"");
+	}
+	if(!reply->inforeply().num())
+	{
+		LogDebug("Server did not cache %zu byte blob\n", len);
+		return false;
+	}
+	m_perfBlobUploads ++;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ARM DAP offload
+
+/**
+	@brief Checks whether the server can execute ARM DAP operations on our behalf
+ */
+bool NetworkedJtagInterface::IsDapOffloadSupported()
+{
+	return m_dapOffloadSupported;
+}
+
+/**
+	@brief Describes where the JTAG-DP at chain index "pos" sits, so the server can pad its scans
+ */
+void NetworkedJtagInterface::FillDapChainPosition(ArmDapRequest* req, size_t pos)
+{
+	size_t irlen = GetJtagDevice(pos)->GetIRLength();
+	size_t irleading = 0;
+	for(size_t i=0; i<pos; i++)
+		irleading += GetJtagDevice(i)->GetIRLength();
+
+	auto p = req->mutable_position();
+	p->set_irlength(irlen);
+	p->set_irleadingbits(irleading);
+	p->set_irtrailingbits(m_irtotal - irleading - irlen);
+	p->set_drleadingbits(pos);
+	p->set_drtrailingbits(m_devices.size() - pos - 1);
+}
+
+/**
+	@brief Sends a dapRequest and waits for the reply
+
+	@throw JtagException if the server reports a failure
+
+	@param pos		Chain index of the JTAG-DP
+	@param packet	The request to send
+
+	@return The reply, valid until the next message is received
+ */
+const ArmDapReply& NetworkedJtagInterface::ExecuteDapRequest(size_t pos, const JtaghalPacket& packet)
+{
+	double start = GetTime();
+
+	//The server loads its own instructions into the DAP (and BYPASS into everything else), so whatever we think is
+	//in the IRs is wrong from here on
+	for(size_t i=0; i<m_devices.size(); i++)
+		GetJtagDevice(i)->InvalidateIRCache();
+
+	if(!SendMessage(packet))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to send dapRequest",
+			"");
+	}
+	auto reply = RecvMessage(JtaghalPacket::kDapReply);
+	if(!reply)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to get dapReply",
+			"");
+	}
+
+	m_perfShiftTime += GetTime() - start;
+
+	auto& r = reply->dapreply();
+	if(!r.ok())
+	{
+		LogDebug("Remote DAP operation %u failed: %s\n", r.failedop(), r.error().c_str());
+
+		//The server aborted the DAP after the failure, so SELECT and the AP registers may not be what we think
+		auto dp = dynamic_cast<ARMJtagDebugPort*>(GetJtagDevice(pos));
+		if(dp)
+			dp->InvalidateDapState();
+
+		throw JtagExceptionWrapper(
+			"Remote DAP operation failed",
+			"");
+	}
+	return r;
+}
+
+/**
+	@brief Executes a batch of AP register accesses on the server in one round trip
+
+	@param pos		Chain index of the JTAG-DP
+	@param batch	The accesses to perform. Read data is written back to the "value" field of each read.
+ */
+void NetworkedJtagInterface::DapAPRegisterBatch(size_t pos, vector<ARMDebugPort::APTransaction>& batch)
+{
+	JtaghalPacket packet;
+	auto req = packet.mutable_daprequest();
+	FillDapChainPosition(req, pos);
+	for(auto& t : batch)
+	{
+		auto op = req->add_ops();
+		op->set_type(t.write ? ArmDapOperation::ApWrite : ArmDapOperation::ApRead);
+		op->set_ap(t.ap);
+		op->set_reg(t.addr);
+		op->set_value(t.value);
+	}
+
+	auto& r = ExecuteDapRequest(pos, packet);
+	if(r.results_size() != (int)batch.size())
+	{
+		throw JtagExceptionWrapper(
+			"Wrong number of results in dapReply",
+			"");
+	}
+	for(size_t i=0; i<batch.size(); i++)
+	{
+		if(!batch[i].write)
+			batch[i].value = r.results(i).value();
+	}
+}
+
+/**
+	@brief Reads a block of words through a MEM-AP on the server, one round trip per DAP_MAX_BLOCK_WORDS
+
+	The caller is responsible for configuring CSW for 32-bit auto-incrementing accesses.
+ */
+void NetworkedJtagInterface::DapMemReadBlock(size_t pos, uint8_t ap, uint32_t addr, uint32_t* data, size_t count)
+{
+	for(size_t base=0; base<count; base += DAP_MAX_BLOCK_WORDS)
+	{
+		size_t n = min((size_t)DAP_MAX_BLOCK_WORDS, count - base);
+
+		JtaghalPacket packet;
+		auto req = packet.mutable_daprequest();
+		FillDapChainPosition(req, pos);
+		auto op = req->add_ops();
+		op->set_type(ArmDapOperation::MemReadBlock);
+		op->set_ap(ap);
+		op->set_address(addr + base*4);
+		op->set_count(n);
+
+		auto& r = ExecuteDapRequest(pos, packet);
+		if( (r.results_size() != 1) || (r.results(0).data().size() != n*4) )
+		{
+			throw JtagExceptionWrapper(
+				"RX byte length mismatch",
+				"");
+		}
+
+		//Words are little-endian on the wire, whatever either end's byte order is
+		auto p = reinterpret_cast<const uint8_t*>(r.results(0).data().data());
+		for(size_t i=0; i<n; i++)
+			data[base + i] = p[i*4] | (p[i*4 + 1] << 8) | (p[i*4 + 2] << 16) | ((uint32_t)p[i*4 + 3] << 24);
+	}
+}
+
+/**
+	@brief Writes a block of words through a MEM-AP on the server, one round trip per DAP_MAX_BLOCK_WORDS
+
+	The caller is responsible for configuring CSW for 32-bit auto-incrementing accesses.
+ */
+void NetworkedJtagInterface::DapMemWriteBlock(size_t pos, uint8_t ap, uint32_t addr, const uint32_t* data, size_t count)
+{
+	for(size_t base=0; base<count; base += DAP_MAX_BLOCK_WORDS)
+	{
+		size_t n = min((size_t)DAP_MAX_BLOCK_WORDS, count - base);
+
+		JtaghalPacket packet;
+		auto req = packet.mutable_daprequest();
+		FillDapChainPosition(req, pos);
+		auto op = req->add_ops();
+		op->set_type(ArmDapOperation::MemWriteBlock);
+		op->set_ap(ap);
+		op->set_address(addr + base*4);
+
+		//Words are little-endian on the wire, whatever either end's byte order is
+		string* wire = op->mutable_data();
+		wire->resize(n*4);
+		for(size_t i=0; i<n; i++)
+		{
+			uint32_t w = data[base + i];
+			for(size_t j=0; j<4; j++)
+				(*wire)[i*4 + j] = (w >> (j*8)) & 0xff;
+		}
+
+		ExecuteDapRequest(pos, packet);
+	}
+}
+
+/**
+	@brief Polls a word of memory on the server until (value & mask) == match
+
+	@return True if the condition was met, false on timeout
+ */
+bool NetworkedJtagInterface::DapMemPoll(
+	size_t pos,
+	uint8_t ap,
+	uint32_t addr,
+	uint32_t mask,
+	uint32_t match,
+	unsigned int timeout_us,
+	uint32_t& value)
+{
+	double deadline = GetTime() + timeout_us * 1e-6;
+
+	JtaghalPacket packet;
+	auto req = packet.mutable_daprequest();
+	FillDapChainPosition(req, pos);
+	auto op = req->add_ops();
+	op->set_type(ArmDapOperation::MemPoll);
+	op->set_ap(ap);
+	op->set_address(addr);
+	op->set_mask(mask);
+	op->set_match(match);
+
+	//The server only polls for a short time per request, so keep asking until we run out of time
+	while(true)
+	{
+		double remaining = deadline - GetTime();
+		op->set_timeoutus( (remaining > 0) ? (remaining * 1e6) : 0);
+
+		auto& r = ExecuteDapRequest(pos, packet);
+		if(r.results_size() != 1)
+		{
+			throw JtagExceptionWrapper(
+				"Wrong number of results in dapReply",
+				"");
+		}
+		value = r.results(0).value();
+		if(r.results(0).matched())
+			return true;
+		if(GetTime() > deadline)
+			return false;
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Performance profiling
 
@@ -365,7 +878,7 @@ size_t NetworkedJtagInterface::GetShiftOpCount()
 	JtaghalPacket packet;
 	auto r = packet.mutable_perfrequest();
 	r->set_req(JtagPerformanceRequest::ShiftOps);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send perfRequest",
@@ -373,13 +886,14 @@ size_t NetworkedJtagInterface::GetShiftOpCount()
 	}
 
 	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kInfoReply))
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
 	{
 		throw JtagExceptionWrapper(
 			"Failed to get infoReply",
 			"");
 	}
-	return packet.inforeply().num();
+	return reply->inforeply().num();
 }
 
 size_t NetworkedJtagInterface::GetDataBitCount()
@@ -388,7 +902,7 @@ size_t NetworkedJtagInterface::GetDataBitCount()
 	JtaghalPacket packet;
 	auto r = packet.mutable_perfrequest();
 	r->set_req(JtagPerformanceRequest::DataBits);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send perfRequest",
@@ -396,13 +910,14 @@ size_t NetworkedJtagInterface::GetDataBitCount()
 	}
 
 	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kInfoReply))
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
 	{
 		throw JtagExceptionWrapper(
 			"Failed to get infoReply",
 			"");
 	}
-	return packet.inforeply().num();
+	return reply->inforeply().num();
 }
 
 size_t NetworkedJtagInterface::GetModeBitCount()
@@ -411,7 +926,7 @@ size_t NetworkedJtagInterface::GetModeBitCount()
 	JtaghalPacket packet;
 	auto r = packet.mutable_perfrequest();
 	r->set_req(JtagPerformanceRequest::ModeBits);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send perfRequest",
@@ -419,13 +934,14 @@ size_t NetworkedJtagInterface::GetModeBitCount()
 	}
 
 	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kInfoReply))
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
 	{
 		throw JtagExceptionWrapper(
 			"Failed to get infoReply",
 			"");
 	}
-	return packet.inforeply().num();
+	return reply->inforeply().num();
 }
 
 size_t NetworkedJtagInterface::GetDummyClockCount()
@@ -434,7 +950,7 @@ size_t NetworkedJtagInterface::GetDummyClockCount()
 	JtaghalPacket packet;
 	auto r = packet.mutable_perfrequest();
 	r->set_req(JtagPerformanceRequest::DummyClocks);
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send perfRequest",
@@ -442,13 +958,14 @@ size_t NetworkedJtagInterface::GetDummyClockCount()
 	}
 
 	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kInfoReply))
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
 	{
 		throw JtagExceptionWrapper(
 			"Failed to get infoReply",
 			"");
 	}
-	return packet.inforeply().num();
+	return reply->inforeply().num();
 }
 
 //GetShiftTime is measured clientside so no need to override
@@ -36,6 +36,10 @@
 #ifndef NetworkedJtagInterface_h
 #define NetworkedJtagInterface_h
 
+class ArmDapReply;
+class ArmDapRequest;
+class JtaghalPacket;
+
 /**
 	@brief Thin wrapper around TCP sockets for talking to a jtagd instance
 
@@ -50,6 +54,7 @@ public:
 	virtual ~NetworkedJtagInterface();
 
 	void Connect(const std::string& server, uint16_t port);
+	void Connect(ServerInterface& peer, uint32_t channel);
 
 	//shims that just push stuff up to base class
 	virtual std::string GetName();
@@ -62,9 +67,19 @@ public:
 	virtual void SendDummyClocks(size_t n);
 	virtual void SendDummyClocksDeferred(size_t n);
 	virtual void Commit();
+	virtual void ReleaseAdapter();
+	virtual void CheckDeviceCaches();
 	virtual bool IsSplitScanSupported();
 	virtual bool ShiftDataWriteOnly(bool last_tms, const unsigned char* send_data, unsigned char* rcv_data, size_t count);
 	virtual bool ShiftDataReadOnly(unsigned char* rcv_data, size_t count);
+	virtual void ShiftDataBulk(bool last_tms, const unsigned char* send_data, size_t count);
+
+	//Server-side blob cache
+	bool IsBlobCacheSupported();
+	size_t GetBlobUploadCount()
+	{ return m_perfBlobUploads; }
+	size_t GetBlobHitCount()
+	{ return m_perfBlobHits; }
 
 	//Mid level JTAG interface
 	virtual void TestLogicReset();
@@ -74,18 +89,85 @@ public:
 	virtual void LeaveExit1DR();
 	virtual void ResetToIdle();
 
+	//ARM DAP offload (executed by the server, see ARMJtagDapOffload)
+	bool IsDapOffloadSupported();
+	void DapAPRegisterBatch(size_t pos, std::vector<ARMDebugPort::APTransaction>& batch);
+	void DapMemReadBlock(size_t pos, uint8_t ap, uint32_t addr, uint32_t* data, size_t count);
+	void DapMemWriteBlock(size_t pos, uint8_t ap, uint32_t addr, const uint32_t* data, size_t count);
+	bool DapMemPoll(
+		size_t pos,
+		uint8_t ap,
+		uint32_t addr,
+		uint32_t mask,
+		uint32_t match,
+		unsigned int timeout_us,
+		uint32_t& value);
+
 	//Explicit TMS shifting is no longer allowed, only state-level interface
 private:
 	virtual void ShiftTMS(bool tdi, const unsigned char* send_data, size_t count);
 
 protected:
+	void LoadCapabilities();
+	void FillDapChainPosition(ArmDapRequest* req, size_t pos);
+	const ArmDapReply& ExecuteDapRequest(size_t pos, const JtaghalPacket& packet);
+
 
 	virtual size_t GetShiftOpCount();
 	virtual size_t GetDataBitCount();
 	virtual size_t GetModeBitCount();
 	virtual size_t GetDummyClockCount();
 
+	void RequestSplitReads();
+	bool UploadBlob(const std::string& hash, const unsigned char* data, size_t len);
+	virtual void FlushPendingReplies();
+	virtual void OnAdapterLost();
+
 	bool	m_splitScanSupported;
+	bool	m_dapOffloadSupported;
+	bool	m_blobCacheSupported;
+
+	///Number of blobs we had to upload
+	size_t m_perfBlobUploads;
+
+	///Number of bulk scans the server already had cached
+	size_t m_perfBlobHits;
+
+	/**
+		@brief A ShiftDataWriteOnly() whose ShiftDataReadOnly() has not happened yet
+	 */
+	class SplitRead
+	{
+	public:
+		SplitRead(unsigned char* data, size_t count)
+		: m_data(data)
+		, m_count(count)
+		, m_requested(false)
+		, m_received(false)
+		{}
+
+		///Caller's buffer for the read data (NULL if they don't want it)
+		unsigned char* m_data;
+
+		///Number of bits shifted
+		size_t m_count;
+
+		///True if we've sent the read request to the server
+		bool m_requested;
+
+		///True if the reply has already been copied to m_data
+		bool m_received;
+	};
+
+	///Split scans in the order they were issued
+	std::list<SplitRead> m_splitReads;
+
+	///Number of ShiftDataReadOnly() calls that were satisfied without waiting for a round trip of their own
+	size_t m_perfPipelinedReads;
+
+public:
+	size_t GetPipelinedReadCount()
+	{ return m_perfPipelinedReads; }
 };
 
 #endif
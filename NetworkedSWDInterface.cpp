@@ -0,0 +1,288 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of NetworkedSWDInterface
+ */
+#include "jtaghal.h"
+#include "ProtobufHelpers.h"
+
+using namespace std;
+
+///Maximum number of posted writes to hold before sending them on their own
+#define MAX_POSTED_WRITES	64
+
+/**
+	@brief Creates the interface object but does not connect to a server.
+ */
+NetworkedSWDInterface::NetworkedSWDInterface()
+	: m_perfTransfers(0)
+	, m_perfBatches(0)
+{
+}
+
+/**
+	@brief Disconnects from the server
+ */
+NetworkedSWDInterface::~NetworkedSWDInterface()
+{
+	try
+	{
+		if(m_mux && m_mux->m_socket.IsValid())
+			FlushWrites();
+	}
+	catch(const JtagException& ex)
+	{
+		//Nobody left to report this to
+		LogWarning("%s\n", ex.GetDescription().c_str());
+	}
+}
+
+/**
+	@brief Connects to a jtagd server.
+
+	@throw JtagException if the connection could not be established
+
+	@param server	Hostname of the server to connect to
+	@param port		Port number (in host byte ordering) the server is running on
+ */
+void NetworkedSWDInterface::Connect(const string& server, uint16_t port)
+{
+	ServerInterface::DoConnect(server, port, Hello::TRANSPORT_SWD);
+}
+
+/**
+	@brief Opens another channel of a jtagd server, sharing an existing connection (see
+	ServerInterface::DoConnectChannel())
+
+	@throw JtagException if the channel could not be opened
+
+	@param peer		Interface which is already connected to the server
+	@param channel	Channel of the SWD adapter to use
+ */
+void NetworkedSWDInterface::Connect(ServerInterface& peer, uint32_t channel)
+{
+	ServerInterface::DoConnectChannel(peer, channel, Hello::TRANSPORT_SWD);
+}
+
+string NetworkedSWDInterface::GetName()
+{
+	return ServerInterface::GetName();
+}
+
+string NetworkedSWDInterface::GetSerial()
+{
+	return ServerInterface::GetSerial();
+}
+
+string NetworkedSWDInterface::GetUserID()
+{
+	return ServerInterface::GetUserID();
+}
+
+int NetworkedSWDInterface::GetFrequency()
+{
+	return ServerInterface::GetFrequency();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Low level
+
+/**
+	@brief Resets the SWD link layer
+ */
+void NetworkedSWDInterface::ResetInterface()
+{
+	FlushWrites();
+
+	JtaghalPacket packet;
+	packet.mutable_swdresetrequest();
+	if(!SendMessage(packet))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to send swdResetRequest",
+			"");
+	}
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply || !reply->inforeply().num())
+	{
+		throw JtagExceptionWrapper(
+			"SWD reset failed",
+			"");
+	}
+}
+
+/**
+	@brief Queues a SW-DP write, to be sent with the next read or batch
+ */
+void NetworkedSWDInterface::WriteWord(uint8_t reg_addr, bool ap, uint32_t wdata)
+{
+	m_postedWrites.push_back(SWDTransfer(reg_addr, ap, false, wdata));
+	if(m_postedWrites.size() >= MAX_POSTED_WRITES)
+		FlushWrites();
+}
+
+/**
+	@brief Performs a SW-DP read transaction, along with any posted writes
+ */
+uint32_t NetworkedSWDInterface::ReadWord(uint8_t reg_addr, bool ap)
+{
+	vector<SWDTransfer> batch;
+	batch.push_back(SWDTransfer(reg_addr, ap, true));
+	if(Transfer(batch) != 1)
+	{
+		LogDebug("SWD read got ACK %d\n", batch[0].m_ack);
+		throw JtagExceptionWrapper(
+			"SWD read failed",
+			"");
+	}
+	return batch[0].m_data;
+}
+
+/**
+	@brief Sends any posted writes to the server
+
+	@throw JtagException if any of them failed
+ */
+void NetworkedSWDInterface::FlushWrites()
+{
+	if(m_postedWrites.empty())
+		return;
+
+	vector<SWDTransfer> batch;
+	batch.swap(m_postedWrites);
+	size_t completed = ExecuteTransfers(batch);
+	if(completed != batch.size())
+	{
+		LogDebug("Posted SWD write %zu got ACK %d\n", completed, batch[completed].m_ack);
+		throw JtagExceptionWrapper(
+			"Posted SWD write failed",
+			"");
+	}
+}
+
+/**
+	@brief Sends any posted writes, then lets other clients have the adapter (see ServerInterface::ReleaseAdapter())
+ */
+void NetworkedSWDInterface::ReleaseAdapter()
+{
+	FlushWrites();
+	ServerInterface::ReleaseAdapter();
+}
+
+/**
+	@brief Executes a batch of SW-DP transfers on the server in one round trip
+
+	Posted writes are sent in the same request, ahead of the batch.
+
+	@throw JtagException if a posted write failed. Failures within the batch are reported through the return value
+	and the ACK of each transfer, as for SWDInterface::Transfer().
+
+	@return Number of transfers in the batch that completed successfully
+ */
+size_t NetworkedSWDInterface::Transfer(vector<SWDTransfer>& batch)
+{
+	if(m_postedWrites.empty())
+		return ExecuteTransfers(batch);
+
+	size_t nposted = m_postedWrites.size();
+	vector<SWDTransfer> all;
+	all.swap(m_postedWrites);
+	all.insert(all.end(), batch.begin(), batch.end());
+
+	size_t completed = ExecuteTransfers(all);
+	if(completed < nposted)
+	{
+		LogDebug("Posted SWD write %zu got ACK %d\n", completed, all[completed].m_ack);
+		throw JtagExceptionWrapper(
+			"Posted SWD write failed",
+			"");
+	}
+
+	for(size_t i=0; i<batch.size(); i++)
+		batch[i] = all[nposted + i];
+	return completed - nposted;
+}
+
+/**
+	@brief Sends a batch of transfers and waits for the results
+
+	@return Number of transfers that completed successfully
+ */
+size_t NetworkedSWDInterface::ExecuteTransfers(vector<SWDTransfer>& batch)
+{
+	JtaghalPacket packet;
+	auto req = packet.mutable_swdrequest();
+	for(auto& t : batch)
+	{
+		auto x = req->add_transfers();
+		x->set_regaddr(t.m_regAddr);
+		x->set_ap(t.m_ap);
+		x->set_read(t.m_read);
+		if(!t.m_read)
+			x->set_wdata(t.m_data);
+	}
+	if(!SendMessage(packet))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to send swdRequest",
+			"");
+	}
+
+	auto reply = RecvMessage(JtaghalPacket::kSwdReply);
+	if(!reply)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to get swdReply",
+			"");
+	}
+	auto& r = reply->swdreply();
+	size_t completed = r.completed();
+	if( (completed > batch.size()) || ((size_t)r.rdata_size() != completed) )
+	{
+		throw JtagExceptionWrapper(
+			"Malformed swdReply",
+			"");
+	}
+
+	for(size_t i=0; i<completed; i++)
+	{
+		batch[i].m_ack = SWD_ACK_OK;
+		if(batch[i].m_read)
+			batch[i].m_data = r.rdata(i);
+	}
+	if(completed < batch.size())
+		batch[completed].m_ack = (SWDAck)r.ack();
+
+	m_perfTransfers += completed;
+	m_perfBatches ++;
+	return completed;
+}
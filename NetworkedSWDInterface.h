@@ -0,0 +1,91 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file NetworkedSWDInterface.h
+	@author Andrew D. Zonenberg
+	@brief Declaration of NetworkedSWDInterface
+ */
+
+#ifndef NetworkedSWDInterface_h
+#define NetworkedSWDInterface_h
+
+/**
+	@brief Thin wrapper around TCP sockets for talking to a jtagd instance exporting a SWD adapter
+
+	Writes are posted: they are queued locally and sent along with the next read (or Transfer() batch), so a sequence
+	of writes followed by a read costs a single round trip. A write that fails is reported by whichever call sends it.
+
+	\ingroup interfaces
+ */
+class NetworkedSWDInterface
+	: public ServerInterface
+	, public SWDInterface
+{
+public:
+	NetworkedSWDInterface();
+	virtual ~NetworkedSWDInterface();
+
+	void Connect(const std::string& server, uint16_t port);
+	void Connect(ServerInterface& peer, uint32_t channel);
+
+	//shims that just push stuff up to base class
+	virtual std::string GetName();
+	virtual std::string GetSerial();
+	virtual std::string GetUserID();
+	virtual int GetFrequency();
+
+	virtual void ResetInterface();
+	virtual size_t Transfer(std::vector<SWDTransfer>& batch);
+	void FlushWrites();
+	virtual void ReleaseAdapter();
+
+	size_t GetTransferCount()
+	{ return m_perfTransfers; }
+
+	size_t GetBatchCount()
+	{ return m_perfBatches; }
+
+protected:
+	virtual void WriteWord(uint8_t reg_addr, bool ap, uint32_t wdata);
+	virtual uint32_t ReadWord(uint8_t reg_addr, bool ap);
+
+	size_t ExecuteTransfers(std::vector<SWDTransfer>& batch);
+
+	///Writes that have not been sent to the server yet
+	std::vector<SWDTransfer> m_postedWrites;
+
+	///Number of SW-DP transfers executed
+	size_t m_perfTransfers;
+
+	///Number of round trips used to execute them
+	size_t m_perfBatches;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of PollBackoff
+ */
+
+#include "jtaghal.h"
+#include "PollBackoff.h"
+#include <mutex>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Backoff curves
+
+/**
+	@brief Polling parameters for one kind of operation
+ */
+struct PollCurve
+{
+	///Human-readable name
+	const char*		name;
+
+	///Speculative reads per round
+	unsigned int	depth;
+
+	///First sleep, in microseconds
+	double			firstDelay;
+
+	///Factor each sleep grows by
+	double			growth;
+
+	///Longest sleep, in microseconds
+	double			maxDelay;
+
+	///Time to give up after, in microseconds
+	double			timeout;
+};
+
+/**
+	@brief Curves for each PollOperation, indexed by operation
+
+	The timeouts are a couple of times the worst-case datasheet figures for typical MCU flash (e.g. STM32F4 at x32
+	parallelism: 16 us per word, up to 4 s for a 128 KB sector, 32 s for a 2 MB mass erase). The flash loader's timeout
+	covers programming a full work area or checksumming several MB at about 1 us per word. The sleeps grow slowly
+	enough that we never oversleep a finished operation by more than about half.
+ */
+static const PollCurve g_pollCurves[POLL_OPERATION_COUNT] =
+{
+	{ "debug access",	4,	10,		2.0,	1000,		1000000		},
+	{ "word program",	4,	10,		2.0,	100,		100000		},
+	{ "sector erase",	2,	500,	1.5,	20000,		10000000	},
+	{ "mass erase",		1,	10000,	1.5,	250000,		60000000	},
+	{ "flash loader",	2,	100,	1.5,	5000,		10000000	}
+};
+
+///Completion times of every poll so far, by operation (bucket upper bound in microseconds -> count)
+static map<unsigned int, uint64_t> g_pollHistograms[POLL_OPERATION_COUNT];
+
+///Protects g_pollHistograms
+static mutex g_pollHistogramMutex;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Starts timing a poll loop
+
+	@param op	The operation being polled for
+ */
+PollBackoff::PollBackoff(PollOperation op)
+	: m_op(op)
+	, m_start(GetTime())
+	, m_rounds(0)
+	, m_delay(g_pollCurves[op].firstDelay)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Polling
+
+unsigned int PollBackoff::GetDepth()
+{
+	return g_pollCurves[m_op].depth;
+}
+
+/**
+	@brief Gets the time since polling started, in seconds
+ */
+double PollBackoff::GetElapsed()
+{
+	return GetTime() - m_start;
+}
+
+/**
+	@brief Sleeps before the next round of polling
+
+	@return False (without sleeping) if the operation has timed out, true otherwise
+ */
+bool PollBackoff::Backoff()
+{
+	auto& curve = g_pollCurves[m_op];
+	double remaining = curve.timeout - GetElapsed()*1e6;
+	if(remaining <= 0)
+	{
+		LogDebug("Timed out after %u rounds waiting for %s\n", m_rounds, curve.name);
+		return false;
+	}
+
+	//Don't sleep past the deadline; the caller gets one last poll at the timeout
+	usleep(min(m_delay, remaining));
+	m_delay = min(m_delay * curve.growth, curve.maxDelay);
+	m_rounds ++;
+	return true;
+}
+
+/**
+	@brief Records how long the operation took, once the poll loop has seen it finish
+ */
+void PollBackoff::Complete()
+{
+	//Round up to a power of two microseconds
+	double us = GetElapsed() * 1e6;
+	unsigned int bucket = 1;
+	while( (bucket < us) && (bucket < 0x80000000) )
+		bucket <<= 1;
+
+	lock_guard<mutex> lock(g_pollHistogramMutex);
+	g_pollHistograms[m_op][bucket] ++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+const char* PollBackoff::GetName(PollOperation op)
+{
+	return g_pollCurves[op].name;
+}
+
+/**
+	@brief Gets a copy of the completion time histogram for one kind of operation
+
+	Keys are bucket upper bounds in microseconds (each bucket covers (key/2, key]), values are the number of polls.
+ */
+map<unsigned int, uint64_t> PollBackoff::GetHistogram(PollOperation op)
+{
+	lock_guard<mutex> lock(g_pollHistogramMutex);
+	return g_pollHistograms[op];
+}
+
+void PollBackoff::ClearHistograms()
+{
+	lock_guard<mutex> lock(g_pollHistogramMutex);
+	for(auto& h : g_pollHistograms)
+		h.clear();
+}
+
+/**
+	@brief Logs the completion time histogram of every operation type polled so far
+ */
+void PollBackoff::PrintStatistics()
+{
+	lock_guard<mutex> lock(g_pollHistogramMutex);
+	for(int i=0; i<POLL_OPERATION_COUNT; i++)
+	{
+		auto& h = g_pollHistograms[i];
+		if(h.empty())
+			continue;
+
+		uint64_t total = 0;
+		for(auto it : h)
+			total += it.second;
+
+		LogNotice("Completion times for %s (%" PRIu64 " polls):\n", g_pollCurves[i].name, total);
+		LogIndenter li;
+		for(auto it : h)
+			LogNotice("<= %8u us: %" PRIu64 "\n", it.first, it.second);
+	}
+}
@@ -0,0 +1,97 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of PollBackoff
+ */
+#ifndef PollBackoff_h
+#define PollBackoff_h
+
+/**
+	@brief Kinds of slow operation we poll a target for, each with its own backoff curve and timeout
+ */
+enum PollOperation
+{
+	POLL_DEBUG_ACCESS,		///< Debug handshakes, normally done within a scan or two
+	POLL_WORD_PROGRAM,		///< Programming one word (or a short run) of flash
+	POLL_SECTOR_ERASE,		///< Erasing one flash sector or page
+	POLL_MASS_ERASE,		///< Erasing the whole flash array
+	POLL_FLASH_LOADER,		///< A RAM-resident flash loader finishing a work area or a checksum
+
+	POLL_OPERATION_COUNT
+};
+
+/**
+	@brief Paces one poll loop: how many reads to queue per round, how long to sleep between rounds, and when to give up
+
+	Each operation type has a bounded backoff curve: the first sleep is short, each one after it grows by a fixed
+	factor up to a ceiling, and the loop fails once the operation's timeout has passed. Callers queue GetDepth() reads
+	per round where the interface can pipeline them, so a short operation is usually caught without sleeping at all.
+
+	When the loop finishes, Complete() records how long it took in a per-operation histogram (power-of-two microsecond
+	buckets, shared by every poll in the process) so the curves can be tuned against real hardware.
+
+	\ingroup libjtaghal
+ */
+class PollBackoff
+{
+public:
+	PollBackoff(PollOperation op);
+
+	bool Backoff();
+	void Complete();
+
+	///Number of speculative reads to queue per round
+	unsigned int GetDepth();
+
+	double GetElapsed();
+
+	static const char* GetName(PollOperation op);
+	static std::map<unsigned int, uint64_t> GetHistogram(PollOperation op);
+	static void ClearHistograms();
+	static void PrintStatistics();
+
+protected:
+
+	///The operation being polled for
+	PollOperation m_op;
+
+	///Time polling started
+	double m_start;
+
+	///Number of times we've slept so far
+	unsigned int m_rounds;
+
+	///Length of the next sleep, in microseconds
+	double m_delay;
+};
+
+#endif
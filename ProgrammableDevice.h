@@ -63,7 +63,7 @@ public:
 		@param	fname		Name of the image to load
 		@return	Pointer to an FirmwareImage object suitable for passing to Program().
 	 */
-	FirmwareImage* LoadFirmwareImage(std::string fname);
+	virtual FirmwareImage* LoadFirmwareImage(std::string fname);
 
 	/**
 		@brief Parses an in-memory image of a firmware image into a format suitable for loading into the device
@@ -0,0 +1,449 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of RTTClient
+ */
+#include "jtaghal.h"
+#include "RTTClient.h"
+
+using namespace std;
+
+///Control block signature (the rest of the 16-byte ID field is zero)
+static const char g_rttSignature[] = "SEGGER RTT";
+
+///Size of the control block header (ID plus the two buffer counts)
+#define RTT_HEADER_SIZE 24
+
+///Size of one buffer descriptor
+#define RTT_DESCRIPTOR_SIZE 24
+
+///Offset of the write offset within a descriptor
+#define RTT_WROFF 12
+
+///Offset of the read offset within a descriptor
+#define RTT_RDOFF 16
+
+///Largest buffer count we believe (anything more is probably not a real control block)
+#define RTT_MAX_BUFFERS 32
+
+///Longest buffer name we bother reading
+#define RTT_NAME_MAX 32
+
+///Number of bytes of RAM to read at a time when looking for the control block
+#define RTT_SCAN_CHUNK 4096
+
+///How long Run() waits before polling again when no data is moving
+#define RTT_IDLE_SLEEP_US 1000
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+RTTClient::RTTClient(DebuggerInterface* iface)
+	: m_iface(iface)
+	, m_address(0)
+	, m_bytesReceived(0)
+	, m_bytesSent(0)
+	, m_pollCount(0)
+{
+}
+
+RTTClient::~RTTClient()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+
+/**
+	@brief Scans a range of target RAM for the control block, and attaches to the first valid one found
+
+	@param start		Address to start searching at
+	@param len			Number of bytes to search
+
+	@return True if a control block was found
+ */
+bool RTTClient::Find(uint32_t start, uint32_t len)
+{
+	start &= ~3;
+	len &= ~3;
+
+	//Read a little past the end of each chunk so we don't miss a signature that straddles two of them
+	vector<uint32_t> words( (RTT_SCAN_CHUNK + RTT_HEADER_SIZE) / 4);
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&words[0]);
+	for(uint32_t off = 0; off < len; off += RTT_SCAN_CHUNK)
+	{
+		uint32_t chunk = min(len - off, (uint32_t)RTT_SCAN_CHUNK);
+		uint32_t readlen = min(len - off, (uint32_t)(RTT_SCAN_CHUNK + RTT_HEADER_SIZE));
+		m_iface->ReadMemoryBlock(start + off, &words[0], readlen / 4);
+
+		for(uint32_t i=0; (i < chunk) && (i + RTT_HEADER_SIZE <= readlen); i += 4)
+		{
+			if(memcmp(bytes + i, g_rttSignature, sizeof(g_rttSignature)) != 0)
+				continue;
+
+			try
+			{
+				Attach(start + off + i);
+				return true;
+			}
+			catch(const JtagException& e)
+			{
+				LogDebug("Ignoring RTT signature at %08x: %s\n", start + off + i, e.GetDescription().c_str());
+			}
+		}
+	}
+
+	return false;
+}
+
+/**
+	@brief Attaches to the control block at a known address
+
+	@throw JtagException if there's no valid control block there
+ */
+void RTTClient::Attach(uint32_t address)
+{
+	uint32_t header[RTT_HEADER_SIZE / 4];
+	m_iface->ReadMemoryBlock(address, header, RTT_HEADER_SIZE / 4);
+	if(memcmp(header, g_rttSignature, sizeof(g_rttSignature)) != 0)
+	{
+		throw JtagExceptionWrapper(
+			"No RTT control block at the requested address",
+			"");
+	}
+
+	uint32_t nup = header[4];
+	uint32_t ndown = header[5];
+	if( (nup > RTT_MAX_BUFFERS) || (ndown > RTT_MAX_BUFFERS) )
+	{
+		throw JtagExceptionWrapper(
+			"RTT control block has an unreasonable number of buffers",
+			"");
+	}
+
+	m_address = address;
+	m_up.assign(nup, Buffer());
+	m_down.assign(ndown, Buffer());
+	for(size_t i=0; i<nup; i++)
+		m_up[i].descriptor = address + RTT_HEADER_SIZE + i*RTT_DESCRIPTOR_SIZE;
+	for(size_t i=0; i<ndown; i++)
+		m_down[i].descriptor = address + RTT_HEADER_SIZE + (nup + i)*RTT_DESCRIPTOR_SIZE;
+
+	vector<uint32_t> words( (nup + ndown) * RTT_DESCRIPTOR_SIZE / 4);
+	if(!words.empty())
+	{
+		m_iface->ReadMemoryBlock(address + RTT_HEADER_SIZE, &words[0], words.size());
+		ParseDescriptors(&words[0]);
+	}
+
+	//Names are usually string literals in flash, so they never change
+	for(size_t i=0; i<nup; i++)
+		m_up[i].name = ReadName(words[i * RTT_DESCRIPTOR_SIZE / 4]);
+	for(size_t i=0; i<ndown; i++)
+		m_down[i].name = ReadName(words[(nup + i) * RTT_DESCRIPTOR_SIZE / 4]);
+
+	LogDebug("Found RTT control block at %08x (%u up, %u down)\n", address, nup, ndown);
+}
+
+/**
+	@brief Updates our copy of every buffer's address, size and offsets from the raw descriptor array
+ */
+void RTTClient::ParseDescriptors(const uint32_t* words)
+{
+	for(size_t i=0; i<m_up.size() + m_down.size(); i++)
+	{
+		Buffer& b = (i < m_up.size()) ? m_up[i] : m_down[i - m_up.size()];
+		const uint32_t* d = words + i*RTT_DESCRIPTOR_SIZE/4;
+		b.buffer = d[1];
+		b.size = d[2];
+		b.wrOff = d[RTT_WROFF / 4];
+		b.rdOff = d[RTT_RDOFF / 4];
+	}
+}
+
+/**
+	@brief Reads a buffer name from the target (or returns an empty string if there isn't one)
+ */
+string RTTClient::ReadName(uint32_t address)
+{
+	if(address == 0)
+		return "";
+
+	char name[RTT_NAME_MAX + 1] = {0};
+	try
+	{
+		m_iface->ReadMemoryBytes(address, reinterpret_cast<uint8_t*>(name), RTT_NAME_MAX);
+	}
+	catch(const JtagException& e)
+	{
+		return "";
+	}
+
+	string ret;
+	for(size_t i=0; (i < RTT_NAME_MAX) && isprint(name[i]); i++)
+		ret += name[i];
+	return ret;
+}
+
+string RTTClient::GetUpBufferName(size_t channel)
+{
+	if(channel >= m_up.size())
+	{
+		throw JtagExceptionWrapper(
+			"Invalid RTT up-buffer index",
+			"");
+	}
+	return m_up[channel].name;
+}
+
+string RTTClient::GetDownBufferName(size_t channel)
+{
+	if(channel >= m_down.size())
+	{
+		throw JtagExceptionWrapper(
+			"Invalid RTT down-buffer index",
+			"");
+	}
+	return m_down[channel].name;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Streaming
+
+/**
+	@brief Moves data in both directions, and refreshes the buffer state for the next poll
+
+	Up-buffers are drained as far as the write offset seen by the previous poll, and down-buffers are filled as far as
+	the read offset seen by the previous poll. The target can only have moved those offsets forward since, so this is
+	always safe, and the data is always transferred before the offset that hands it over.
+
+	Down-buffer data is written with word accesses wherever possible, so that it can go in the batch; any unaligned
+	bytes at either end of a segment are written with narrow accesses just before the batch.
+
+	@return Number of bytes moved
+ */
+size_t RTTClient::Poll()
+{
+	m_pollCount ++;
+	if(m_up.empty() && m_down.empty())
+		return 0;
+
+	vector<DebuggerInterface::MemoryTransfer> batch;
+	vector<uint32_t> storage;
+	vector<size_t> offsets;
+	auto queue = [&](uint32_t addr, bool write, const uint32_t* data, size_t count)
+	{
+		offsets.push_back(storage.size());
+		if(write)
+			storage.insert(storage.end(), data, data + count);
+		else
+			storage.resize(storage.size() + count);
+		batch.push_back(DebuggerInterface::MemoryTransfer(addr, write, NULL, count));
+	};
+
+	//Up-buffers: read everything between the read and write offsets, then advance the read offset
+	struct Segment
+	{
+		size_t channel;
+		size_t transfer;
+		uint32_t skew;
+		uint32_t len;
+	};
+	vector<Segment> segments;
+	auto readSegment = [&](size_t channel, uint32_t off, uint32_t len)
+	{
+		uint32_t addr = m_up[channel].buffer + off;
+		uint32_t skew = addr & 3;
+		queue(addr - skew, false, NULL, (skew + len + 3) / 4);
+		Segment s = {channel, batch.size() - 1, skew, len};
+		segments.push_back(s);
+	};
+	for(size_t i=0; i<m_up.size(); i++)
+	{
+		Buffer& b = m_up[i];
+		if( (b.size == 0) || (b.wrOff >= b.size) || (b.rdOff >= b.size) || (b.wrOff == b.rdOff) )
+			continue;
+
+		if(b.wrOff > b.rdOff)
+			readSegment(i, b.rdOff, b.wrOff - b.rdOff);
+		else
+		{
+			readSegment(i, b.rdOff, b.size - b.rdOff);
+			if(b.wrOff)
+				readSegment(i, 0, b.wrOff);
+		}
+		queue(b.descriptor + RTT_RDOFF, true, &b.wrOff, 1);
+	}
+
+	//Down-buffers: fill the free space, then advance the write offset
+	vector<size_t> sent(m_down.size(), 0);
+	auto writeSegment = [&](size_t channel, uint32_t off, const uint8_t* data, uint32_t len)
+	{
+		uint32_t addr = m_down[channel].buffer + off;
+		uint32_t mid0 = (addr + 3) & ~3;
+		uint32_t mid1 = (addr + len) & ~3;
+		if(mid0 >= mid1)
+		{
+			m_iface->WriteMemoryBytes(addr, data, len);
+			return;
+		}
+
+		if(addr < mid0)
+			m_iface->WriteMemoryBytes(addr, data, mid0 - addr);
+		if(mid1 < addr + len)
+			m_iface->WriteMemoryBytes(mid1, data + (mid1 - addr), addr + len - mid1);
+
+		vector<uint32_t> words( (mid1 - mid0) / 4);
+		memcpy(&words[0], data + (mid0 - addr), mid1 - mid0);
+		queue(mid0, true, &words[0], words.size());
+	};
+	for(size_t i=0; i<m_down.size(); i++)
+	{
+		Buffer& b = m_down[i];
+		if( (b.size == 0) || (b.wrOff >= b.size) || (b.rdOff >= b.size) || b.pending.empty() )
+			continue;
+
+		//One byte is always left empty so that a full buffer can be told apart from an empty one
+		uint32_t space = (b.rdOff + b.size - b.wrOff - 1) % b.size;
+		uint32_t n = min(space, (uint32_t)b.pending.size());
+		if(n == 0)
+			continue;
+
+		uint32_t first = min(n, b.size - b.wrOff);
+		writeSegment(i, b.wrOff, &b.pending[0], first);
+		if(n > first)
+			writeSegment(i, 0, &b.pending[first], n - first);
+
+		uint32_t wrOff = (b.wrOff + n) % b.size;
+		queue(b.descriptor + RTT_WROFF, true, &wrOff, 1);
+		sent[i] = n;
+	}
+
+	//Then grab the new state of every buffer
+	queue(m_address + RTT_HEADER_SIZE, false, NULL, (m_up.size() + m_down.size()) * RTT_DESCRIPTOR_SIZE / 4);
+
+	for(size_t i=0; i<batch.size(); i++)
+		batch[i].data = &storage[offsets[i]];
+	m_iface->MemoryBatch(batch);
+
+	size_t moved = 0;
+	for(auto& s : segments)
+	{
+		auto p = reinterpret_cast<const uint8_t*>(batch[s.transfer].data) + s.skew;
+		OnData(s.channel, p, s.len);
+		moved += s.len;
+	}
+	m_bytesReceived += moved;
+
+	for(size_t i=0; i<m_down.size(); i++)
+	{
+		if(!sent[i])
+			continue;
+		m_down[i].pending.erase(m_down[i].pending.begin(), m_down[i].pending.begin() + sent[i]);
+		m_bytesSent += sent[i];
+		moved += sent[i];
+	}
+
+	ParseDescriptors(batch.back().data);
+	return moved;
+}
+
+/**
+	@brief Polls continuously for the given amount of time, backing off a little whenever the buffers are idle
+
+	Anyone else sharing the adapter gets a turn every so often (see DebuggerInterface::ReleaseAdapterPeriodically()).
+ */
+void RTTClient::Run(double seconds)
+{
+	double held = GetTime();
+	double end = held + seconds;
+	while(GetTime() < end)
+	{
+		if(Poll() == 0)
+			usleep(RTT_IDLE_SLEEP_US);
+		m_iface->ReleaseAdapterPeriodically(held);
+	}
+}
+
+/**
+	@brief Queues data to be sent to the target through a down-buffer
+
+	The data is moved into the target's buffer by later calls to Poll(), as space becomes available.
+ */
+void RTTClient::Write(size_t channel, const uint8_t* data, size_t len)
+{
+	if(channel >= m_down.size())
+	{
+		throw JtagExceptionWrapper(
+			"Invalid RTT down-buffer index",
+			"");
+	}
+	m_down[channel].pending.insert(m_down[channel].pending.end(), data, data + len);
+}
+
+/**
+	@brief Reads data received from an up-buffer (only if OnData() hasn't been overridden)
+
+	@return Number of bytes actually read
+ */
+size_t RTTClient::Read(size_t channel, uint8_t* data, size_t len)
+{
+	if(channel >= m_up.size())
+	{
+		throw JtagExceptionWrapper(
+			"Invalid RTT up-buffer index",
+			"");
+	}
+
+	auto& p = m_up[channel].pending;
+	size_t n = min(len, p.size());
+	if(n)
+	{
+		memcpy(data, &p[0], n);
+		p.erase(p.begin(), p.begin() + n);
+	}
+	return n;
+}
+
+/**
+	@brief Called by Poll() for every chunk of data received from the target
+
+	The default implementation queues the data for Read().
+
+	@param channel		Index of the up-buffer the data came from
+	@param data			The data
+	@param len			Number of bytes
+ */
+void RTTClient::OnData(size_t channel, const uint8_t* data, size_t len)
+{
+	m_up[channel].pending.insert(m_up[channel].pending.end(), data, data + len);
+}
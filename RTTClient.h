@@ -0,0 +1,168 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of RTTClient
+ */
+#ifndef RTTClient_h
+#define RTTClient_h
+
+class DebuggerInterface;
+
+/**
+	@brief Host side of a SEGGER RTT-style set of ring buffers in target RAM
+
+	The target keeps a control block (a "SEGGER RTT" signature, the buffer counts, then one descriptor per buffer) in
+	RAM. Up-buffers carry data from the target to the host and down-buffers go the other way. Each descriptor holds the
+	buffer address and size plus a write offset (advanced by the producer) and a read offset (advanced by the consumer).
+
+	Every Poll() is a single DebuggerInterface::MemoryBatch(): it reads whatever the up-buffers held at the last poll and
+	moves their read offsets past it, writes queued data into the down-buffers and moves their write offsets, then
+	re-reads all of the descriptors for the next round. Interfaces that can pipeline a batch (e.g. ARMJtagDebugPort)
+	therefore spend one round trip per poll no matter how many buffers are active.
+
+	Received data is passed to OnData(). The default implementation queues it for Read(); derived classes can override
+	it to process the stream as it arrives.
+
+	\ingroup libjtaghal
+ */
+class RTTClient
+{
+public:
+	RTTClient(DebuggerInterface* iface);
+	virtual ~RTTClient();
+
+	bool Find(uint32_t start, uint32_t len);
+	void Attach(uint32_t address);
+
+	///Address of the control block
+	uint32_t GetControlBlockAddress()
+	{ return m_address; }
+
+	///Number of target-to-host buffers
+	size_t GetUpBufferCount()
+	{ return m_up.size(); }
+
+	///Number of host-to-target buffers
+	size_t GetDownBufferCount()
+	{ return m_down.size(); }
+
+	std::string GetUpBufferName(size_t channel);
+	std::string GetDownBufferName(size_t channel);
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Streaming
+
+	size_t Poll();
+	void Run(double seconds);
+
+	void Write(size_t channel, const uint8_t* data, size_t len);
+	size_t Read(size_t channel, uint8_t* data, size_t len);
+
+	///Gets the number of bytes queued by Write() that haven't made it into the target's buffer yet
+	size_t GetPendingWriteCount(size_t channel)
+	{ return m_down[channel].pending.size(); }
+
+	///Gets the number of bytes received and not yet consumed by Read()
+	size_t GetReadableCount(size_t channel)
+	{ return m_up[channel].pending.size(); }
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Statistics
+
+	///Total bytes moved from the target to the host
+	uint64_t GetBytesReceived()
+	{ return m_bytesReceived; }
+
+	///Total bytes moved from the host to the target
+	uint64_t GetBytesSent()
+	{ return m_bytesSent; }
+
+	///Number of calls to Poll()
+	uint64_t GetPollCount()
+	{ return m_pollCount; }
+
+protected:
+	virtual void OnData(size_t channel, const uint8_t* data, size_t len);
+
+	void ParseDescriptors(const uint32_t* words);
+	std::string ReadName(uint32_t address);
+
+	/**
+		@brief Host-side state of one ring buffer
+	 */
+	struct Buffer
+	{
+		///Address of the buffer's descriptor in the control block
+		uint32_t descriptor;
+
+		///Name of the buffer (read from the target once, at attach time)
+		std::string name;
+
+		///Address of the data
+		uint32_t buffer;
+
+		///Size of the data area, in bytes
+		uint32_t size;
+
+		///Producer's offset, as of the last poll
+		uint32_t wrOff;
+
+		///Consumer's offset, as of the last poll
+		uint32_t rdOff;
+
+		///Data received but not yet read (up-buffers), or queued but not yet sent (down-buffers)
+		std::vector<uint8_t> pending;
+	};
+
+	///The interface we use to talk to the target
+	DebuggerInterface* m_iface;
+
+	///Address of the control block
+	uint32_t m_address;
+
+	///Target-to-host buffers
+	std::vector<Buffer> m_up;
+
+	///Host-to-target buffers
+	std::vector<Buffer> m_down;
+
+	///Total bytes received
+	uint64_t m_bytesReceived;
+
+	///Total bytes sent
+	uint64_t m_bytesSent;
+
+	///Number of polls
+	uint64_t m_pollCount;
+};
+
+#endif
@@ -0,0 +1,179 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SRecordFirmwareImage
+ */
+
+#include "jtaghal.h"
+#include "SRecordFirmwareImage.h"
+#include <ctype.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Parses an S-record image from memory
+ */
+SRecordFirmwareImage::SRecordFirmwareImage(const unsigned char* data, size_t len)
+{
+	Parse(data, len);
+}
+
+/**
+	@brief Loads an S-record image from a file
+ */
+SRecordFirmwareImage::SRecordFirmwareImage(string fname)
+{
+	MapFile(fname);
+	Parse(m_map, m_mapLen);
+
+	//Everything was decoded into our own buffers
+	UnmapFile();
+}
+
+SRecordFirmwareImage::~SRecordFirmwareImage()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parsing
+
+/**
+	@brief Checks if the data starts with something that looks like an S-record (S, a type digit, and a byte count)
+ */
+bool SRecordFirmwareImage::Detect(const unsigned char* data, size_t len)
+{
+	vector<uint8_t> bytes;
+	return (len >= 4) && (data[0] == 'S') && isdigit(data[1]) && DecodeHex(data + 2, 2, bytes);
+}
+
+void SRecordFirmwareImage::Parse(const uint8_t* data, size_t len)
+{
+	m_format = "S-record";
+
+	uint32_t start = 0;
+	vector<uint8_t> segment;
+	vector<uint8_t> bytes;
+	size_t pos = 0;
+	bool done = false;
+	for(unsigned int line = 1; (pos < len) && !done; line++)
+	{
+		//Find the end of the line, ignoring trailing whitespace
+		size_t end = pos;
+		while( (end < len) && (data[end] != '\n') )
+			end ++;
+		size_t next = end + 1;
+		while( (end > pos) && isspace(data[end-1]) )
+			end --;
+
+		const uint8_t* text = data + pos;
+		size_t textlen = end - pos;
+		pos = next;
+		if(textlen == 0)
+			continue;
+
+		//Type, then byte count, address, data and checksum.
+		//The count covers everything after itself, and the checksum is the ones complement of the sum of the rest.
+		if( (textlen < 2) || (text[0] != 'S') || !isdigit(text[1]) || !DecodeHex(text + 2, textlen - 2, bytes) ||
+			(bytes.size() < 3) || (bytes.size() != bytes[0] + 1u) )
+		{
+			throw JtagExceptionWrapper(
+				string("Malformed S-record on line ") + to_string(line),
+				"");
+		}
+		uint8_t sum = 0;
+		for(auto b : bytes)
+			sum += b;
+		if(sum != 0xff)
+		{
+			throw JtagExceptionWrapper(
+				string("Bad S-record checksum on line ") + to_string(line),
+				"");
+		}
+
+		//Address length depends on the record type
+		char type = text[1];
+		size_t addrlen;
+		switch(type)
+		{
+			case '1':
+			case '9':
+				addrlen = 2;
+				break;
+
+			case '2':
+			case '8':
+				addrlen = 3;
+				break;
+
+			case '3':
+			case '7':
+				addrlen = 4;
+				break;
+
+			//Header, reserved and record counts: no data
+			default:
+				continue;
+		}
+		if(bytes.size() < addrlen + 2)
+		{
+			throw JtagExceptionWrapper(
+				string("Malformed S-record on line ") + to_string(line),
+				"");
+		}
+
+		//S7/S8/S9 terminate the data
+		if(type >= '7')
+		{
+			done = true;
+			continue;
+		}
+
+		uint32_t addr = 0;
+		for(size_t i=0; i<addrlen; i++)
+			addr = (addr << 8) | bytes[1 + i];
+		const uint8_t* payload = &bytes[1 + addrlen];
+		size_t count = bytes.size() - addrlen - 2;
+
+		//Start a new segment unless this carries straight on from the last record
+		if(!segment.empty() && (addr != start + segment.size()) )
+			AddSegment(start, segment);
+		if(segment.empty())
+			start = addr;
+		segment.insert(segment.end(), payload, payload + count);
+	}
+
+	AddSegment(start, segment);
+	SortSegments();
+}
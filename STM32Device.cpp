@@ -40,6 +40,34 @@
 
 using namespace std;
 
+///Number of words to read at a time when blank checking
+#define BLANK_CHECK_BLOCK_WORDS	1024
+
+///FLASH_SR.BSY
+#define FLASH_SR_BSY 0x00010000
+
+///FLASH_SR error flags (OPERR, WRPERR, PGAERR, PGPERR, PGSERR)
+#define FLASH_SR_ERRORS 0x000000f2
+
+/**
+	@brief Adds one word to a CRC the same way the STM32 CRC unit does
+
+	CRC-32 with polynomial 0x04c11db7, fed a whole word at a time MSB first, with no reflection or final XOR. Start
+	with 0xffffffff (the unit's reset value).
+ */
+static uint32_t Crc32Word(uint32_t crc, uint32_t word)
+{
+	crc ^= word;
+	for(int i=0; i<32; i++)
+	{
+		if(crc & 0x80000000)
+			crc = (crc << 1) ^ 0x04c11db7;
+		else
+			crc <<= 1;
+	}
+	return crc;
+}
+
 STM32Device::STM32Device(
 	unsigned int devid, unsigned int stepping,
 	unsigned int idcode, JtagInterface* iface, size_t pos)
@@ -62,6 +90,9 @@ STM32Device::STM32Device(
 			m_flashSfrBase		= 0x40022000;
 			m_uniqueIDBase		= 0x1ffff7e8;
 			m_flashSizeBase		= 0x1ffff7e0;
+			m_crcBase			= 0x40023000;
+			m_crcClockRegister	= 0x40021014;	//RCC_AHBENR
+			m_crcClockBit		= 0x00000040;
 			break;
 
 		case STM32F411E:
@@ -69,6 +100,9 @@ STM32Device::STM32Device(
 			m_flashSfrBase		= 0x40023C00;
 			m_uniqueIDBase		= 0x1fff7a10;
 			m_flashSizeBase		= 0x1fff7a20;
+			m_crcBase			= 0x40023000;
+			m_crcClockRegister	= 0x40023830;	//RCC_AHB1ENR
+			m_crcClockBit		= 0x00001000;
 			break;
 
 		case STM32F777:
@@ -76,10 +110,14 @@ STM32Device::STM32Device(
 			m_flashSfrBase		= 0x40023C00;
 			m_uniqueIDBase		= 0x1ff0F420;
 			m_flashSizeBase		= 0x1ff0F440;
+			m_crcBase			= 0x40023000;
+			m_crcClockRegister	= 0x40023830;	//RCC_AHB1ENR
+			m_crcClockBit		= 0x00001000;
 			break;
 
 		default:
 			m_ramKB = 0;
+			m_crcBase = 0;
 	}
 
 	//TODO: How portable are these addresses?
@@ -606,37 +644,50 @@ void STM32Device::UnlockFlash()
 		LogTrace("Flash is already unlocked, no action required\n");
 }
 
-void STM32Device::PollUntilFlashNotBusy()
-{
-	//LogTrace("Waiting for Flash to be ready...\n");
-	//LogIndenter li;
+/**
+	@brief Waits for FLASH_SR.BSY to clear
 
-	//Poll FLASH_SR.BSY until it's clear
-	uint32_t sr = m_dap->ReadMemory(m_flashSfrBase + FLASH_SR);
-	//LogTrace("SR = %08x\n", sr);
-	int interval = 1;
-	while(sr & 0x00010000)
+	@param op	What the controller is busy with (picks the polling curve and timeout)
+ */
+void STM32Device::PollUntilFlashNotBusy(PollOperation op)
+{
+	uint32_t sr;
+	if(!m_dap->PollMemory(m_flashSfrBase + FLASH_SR, FLASH_SR_BSY, 0, op, sr))
 	{
-		//LogTrace("SR = %08x\n", sr);
-		usleep(100 * interval);
-		sr = m_dap->ReadMemory(m_flashSfrBase + FLASH_SR);
-
-		//Exponential back-off on polling interval
-		interval *= 10;
+		throw JtagExceptionWrapper(
+			"Timed out waiting for the flash controller",
+			"");
 	}
 }
 
+/**
+	@brief Erases the whole flash array, then lets anyone sharing the adapter have a turn
+ */
 void STM32Device::Erase()
+{
+	MassErase();
+	m_dap->ReleaseAdapter();
+}
+
+/**
+	@brief Erases the whole flash array
+
+	Keeps the adapter, since Program() carries on from here.
+ */
+void STM32Device::MassErase()
 {
 	LogTrace("Erasing...\n");
 
+	//Flash contents are about to change behind any cached copy
+	m_dap->InvalidateMemoryCache();
+
 	//Look up FLASH_OPTCR
 	uint32_t optcr = m_dap->ReadMemory(m_flashSfrBase + FLASH_OPTCR);
 	LogTrace("FLASH_OPTCR = %08x\n", optcr);
 
 	//Unlock flash and make sure it's ready
 	UnlockFlash();
-	PollUntilFlashNotBusy();
+	PollUntilFlashNotBusy(POLL_SECTOR_ERASE);
 
 	//Do a full-chip erase with x32 parallelism
 	//bit9:8 = 10 = x64
@@ -645,11 +696,124 @@ void STM32Device::Erase()
 	m_dap->WriteMemory(m_flashSfrBase + FLASH_CR, 0x10204);
 
 	//Wait for it to finish the erase operation
-	PollUntilFlashNotBusy();
+	PollUntilFlashNotBusy(POLL_MASS_ERASE);
 
 	//Don't blank check by default
 }
 
+/**
+	@brief Gets the flash sector layout
+
+	Only known for the F4 and F7 (in single-bank mode) so far. For anything else the list comes back empty and the
+	caller has to fall back to a mass erase.
+ */
+void STM32Device::GetFlashSectors(vector<FlashSector>& sectors)
+{
+	sectors.clear();
+
+	//Four small sectors, one medium, then large ones up to the end of flash (sizes in KB)
+	uint32_t small;
+	uint32_t medium;
+	uint32_t large;
+	switch(m_deviceID)
+	{
+		//RM0383 table 4
+		case STM32F411E:
+			small	= 16;
+			medium	= 64;
+			large	= 128;
+			break;
+
+		//RM0410 table 3 (single bank)
+		case STM32F777:
+			small	= 32;
+			medium	= 128;
+			large	= 256;
+			break;
+
+		default:
+			return;
+	}
+
+	uint32_t offset = 0;
+	for(size_t i=0; offset < m_flashKB*1024; i++)
+	{
+		uint32_t kb = large;
+		if(i < 4)
+			kb = small;
+		else if(i == 4)
+			kb = medium;
+
+		FlashSector sector = {offset, kb*1024};
+		sectors.push_back(sector);
+		offset += kb*1024;
+	}
+}
+
+/**
+	@brief Erases a single sector (flash must already be unlocked)
+ */
+void STM32Device::EraseSector(unsigned int sector)
+{
+	LogTrace("Erasing sector %u...\n", sector);
+
+	//Flash contents are about to change behind any cached copy
+	m_dap->InvalidateMemoryCache();
+
+	//bit16 = go do it
+	//bit9:8 = 10 = x32
+	//bit6:3 = sector number
+	//bit1 = sector erase
+	m_dap->WriteMemory(m_flashSfrBase + FLASH_CR, 0x10202 | (sector << 3));
+	PollUntilFlashNotBusy(POLL_SECTOR_ERASE);
+}
+
+/**
+	@brief Checksums part of flash by running a small routine on the CPU, rather than reading it all back
+
+	The CPU is halted first, and left halted (with SRAM and the registers trashed).
+
+	@param offset		Offset of the block from the start of flash
+	@param len			Length of the block, in bytes
+	@param allBits		AND of every word in the block (0xffffffff if it's blank)
+	@param crc			CRC of the block as calculated by the CRC unit (zero if we don't know where it is)
+
+	@return False if the target can't do this (no SRAM we know about, read protected, CPU won't halt etc), in which
+			case the caller has to read the flash instead
+ */
+bool STM32Device::ChecksumFlash(uint32_t offset, uint32_t len, uint32_t& allBits, uint32_t& crc)
+{
+	ProbeLocksNondestructive();
+	auto cpu = GetCPU();
+	if( (m_ramKB == 0) || (m_protectionLevel != 0) || (cpu == NULL) )
+		return false;
+
+	try
+	{
+		cpu->DebugHalt();
+
+		//Turn on the CRC unit's clock, then reset it
+		uint32_t crcRegister = 0;
+		if(m_crcBase != 0)
+		{
+			uint32_t enables = m_dap->ReadMemory(m_crcClockRegister);
+			m_dap->WriteMemory(m_crcClockRegister, enables | m_crcClockBit);
+			m_dap->WriteMemory(m_crcBase + CRC_CR, 1);
+			crcRegister = m_crcBase + CRC_DR;
+		}
+
+		ARMv7MFlashLoader loader(cpu, m_dap, m_sramMemoryBase, m_ramKB * 1024, 0, 0, 0);
+		loader.Checksum(m_flashMemoryBase + offset, len / 4, crcRegister, allBits, crc);
+		return true;
+	}
+	catch(const JtagException& e)
+	{
+		LogDebug("Couldn't checksum flash on the target, falling back to reading it: %s\n",
+			e.GetDescription().c_str());
+		return false;
+	}
+}
+
 bool STM32Device::BlankCheck()
 {
 	LogDebug("Blank checking...\n");
@@ -658,11 +822,29 @@ bool STM32Device::BlankCheck()
 	bool quitImmediately = true;
 
 	uint32_t flashBytes = m_flashKB * 1024;
+
+	//Try doing it on the target first, since that only takes a handful of transactions
+	uint32_t allBits;
+	uint32_t crc;
+	if(ChecksumFlash(0, flashBytes, allBits, crc))
+	{
+		//The checksum routine trashed SRAM and the registers, so start over
+		GetCPU()->Reset();
+		GetCPU()->DebugResume();
+
+		if(allBits != 0xffffffff)
+		{
+			LogNotice("Device is NOT blank\n");
+			return false;
+		}
+		return true;
+	}
 	uint32_t addrMax = m_flashMemoryBase + flashBytes;
 	uint32_t addr = m_flashMemoryBase;
 	LogTrace("Checking address range from 0x%08x to 0x%08x...\n", addr, addrMax);
 	bool blank = true;
-	for(; addr<addrMax; addr += 4)
+	uint32_t rdata[BLANK_CHECK_BLOCK_WORDS];
+	while(addr < addrMax)
 	{
 		if( (addr & 0x3fff) == 0)
 		{
@@ -670,15 +852,21 @@ bool STM32Device::BlankCheck()
 			LogDebug("%08x (%.1f %%)\n", addr, fracDone * 100.0f);
 		}
 
-		uint32_t rdata = m_dap->ReadMemory(addr);
-		if(rdata != 0xffffffff)
+		//Read a block at a time
+		size_t count = min((size_t)BLANK_CHECK_BLOCK_WORDS, (size_t)(addrMax - addr) / 4);
+		m_dap->ReadMemoryBlock(addr, rdata, count);
+		for(size_t i=0; i<count; i++)
 		{
-			LogNotice("Device is NOT blank. Found data 0x%08x at flash address 0x%08x\n",
-				rdata, addr);
-			if(quitImmediately)
-				return false;
-			blank = false;
+			if(rdata[i] != 0xffffffff)
+			{
+				LogNotice("Device is NOT blank. Found data 0x%08x at flash address 0x%08x\n",
+					rdata[i], addr + (uint32_t)i*4);
+				if(quitImmediately)
+					return false;
+				blank = false;
+			}
 		}
+		addr += count*4;
 	}
 
 	return blank;
@@ -695,10 +883,14 @@ void STM32Device::Reset()
 /**
 	@brief Loads the firmware
 
-	For now assume it's a raw ROM image, no ELF etc supported
+	ELF, Intel HEX and S-record files become a SparseFirmwareImage. Anything else is taken to be a raw ROM image.
  */
 FirmwareImage* STM32Device::LoadFirmwareImage(const unsigned char* data, size_t len)
 {
+	auto sparse = SparseFirmwareImage::Create(data, len);
+	if(sparse)
+		return sparse;
+
 	ByteArrayFirmwareImage* img = new ByteArrayFirmwareImage;
 	img->raw_bitstream_len = len;
 
@@ -714,73 +906,498 @@ FirmwareImage* STM32Device::LoadFirmwareImage(const unsigned char* data, size_t
 }
 
 /**
-	@brief Programs a firmware image to the device
+	@brief Loads the firmware from a file
 
-	For now. assume the image is a flat binary to be burned to flash.
+	ELF, Intel HEX and S-record files are memory mapped rather than read into a buffer.
  */
-void STM32Device::Program(FirmwareImage* image)
+FirmwareImage* STM32Device::LoadFirmwareImage(string fname)
 {
-	//TODO: take ELF images directly?
+	auto sparse = SparseFirmwareImage::Create(fname);
+	if(sparse)
+		return sparse;
+
+	return ProgrammableDevice::LoadFirmwareImage(fname);
+}
+
+/**
+	@brief Lays a firmware image out as flash words, noting which words it actually covers
+
+	A raw binary covers everything from the start of flash to the end of the image. Segments of a sparse image may be
+	at either their flash address or the alias at 0 (where flash is mapped when booting from it), and anything
+	between segments is a hole that should be left alone. Words a segment only partly covers are filled in with what's
+	in flash now, so the bytes of the hole that share the word are kept.
+
+	Sparse images can only be placed if we know how big the flash is, since otherwise a segment somewhere else in the
+	address space (option bytes, RAM...) would look like it's just a long way into flash.
+
+	@param image		The image
+	@param words		Contents of flash from the start up to the last word the image covers (0xffffffff in holes)
+	@param populated	True for each word the image covers
+ */
+void STM32Device::FlattenImage(FirmwareImage* image, vector<uint32_t>& words, vector<bool>& populated)
+{
+	words.clear();
+	populated.clear();
+
 	auto bimage = dynamic_cast<ByteArrayFirmwareImage*>(image);
-	if(!bimage)
+	if(bimage)
+	{
+		size_t nwords = (bimage->raw_bitstream_len + 3) / 4;
+		words.resize(nwords, 0xffffffff);
+		populated.resize(nwords, true);
+		if(nwords)
+			memcpy(&words[0], bimage->raw_bitstream, bimage->raw_bitstream_len);
+		return;
+	}
+
+	auto simage = dynamic_cast<SparseFirmwareImage*>(image);
+	if(!simage)
 	{
 		throw JtagExceptionWrapper(
-			"STM32Device::Program() needs a byte array firmware image",
+			"STM32Device needs a raw binary, ELF, Intel HEX or S-record firmware image",
 			"");
 	}
 
+	if(m_flashKB == 0)
+	{
+		throw JtagExceptionWrapper(
+			"Can't program a sparse firmware image because the flash size is unknown",
+			"");
+	}
+
+	//Figure out where each segment goes, and how much flash the image spans
+	auto& segments = simage->GetSegments();
+	vector<uint32_t> offsets;
+	size_t span = 0;
+	for(auto& seg : segments)
+	{
+		uint32_t offset = seg.address;
+		if(offset >= m_flashMemoryBase)
+			offset -= m_flashMemoryBase;
+		if(offset + (uint64_t)seg.len > m_flashKB*1024)
+		{
+			char err[128];
+			snprintf(err, sizeof(err), "Firmware image segment at 0x%08x is outside flash", seg.address);
+			throw JtagExceptionWrapper(
+				err,
+				"");
+		}
+		offsets.push_back(offset);
+		span = max(span, offset + seg.len);
+	}
+
+	//Copy the segments in, keeping track of which bytes of each word they cover
+	size_t nwords = (span + 3) / 4;
+	words.resize(nwords, 0xffffffff);
+	populated.resize(nwords, false);
+	vector<uint8_t> covered(nwords, 0);
+	uint8_t* bytes = reinterpret_cast<uint8_t*>(words.data());
+	for(size_t i=0; i<segments.size(); i++)
+	{
+		size_t start = offsets[i];
+		size_t end = start + segments[i].len;
+		if(start == end)
+			continue;
+		memcpy(bytes + start, segments[i].data, segments[i].len);
+
+		size_t b = start;
+		for(; (b < end) && (b & 3); b++)
+			covered[b / 4] |= 1 << (b & 3);
+		for(; b + 4 <= end; b += 4)
+			covered[b / 4] = 0xf;
+		for(; b < end; b++)
+			covered[b / 4] |= 1 << (b & 3);
+	}
+
+	//Fill in the rest of any partly covered words from flash
+	for(size_t w=0; w<nwords; w++)
+	{
+		if(covered[w] == 0)
+			continue;
+		populated[w] = true;
+		if(covered[w] == 0xf)
+			continue;
+
+		uint32_t current = m_dap->ReadMemory(m_flashMemoryBase + w*4);
+		for(int j=0; j<4; j++)
+		{
+			if(!(covered[w] & (1 << j)))
+				bytes[w*4 + j] = reinterpret_cast<uint8_t*>(&current)[j];
+		}
+	}
+}
+
+/**
+	@brief Programs a firmware image to the device
+
+	Only the words the image covers are programmed. If a sector has to be erased, whatever was in the holes of a
+	sparse image is written back afterwards.
+ */
+void STM32Device::Program(FirmwareImage* image)
+{
+	vector<uint32_t> words;
+	vector<bool> populated;
+	FlattenImage(image, words, populated);
+	size_t nwords = words.size();
+	bool sparse = (dynamic_cast<SparseFirmwareImage*>(image) != NULL);
+
 	//Halt the CPU
 	auto cpu = GetCPU();
 	cpu->DebugHalt();
 
-	//Check if the beginning of the vector table is blank.
-	//If not blank, trigger a bulk erase
-	//This is a quick check for normally-programmed chips.
-	//If the vector table is blank but there's data later in memory, a user-initiated bulk erase is required.
-	if(m_dap->ReadMemory(m_flashMemoryBase) != 0xffffffff)
+	//Figure out which words need to be programmed
+	vector<FlashSector> sectors;
+	GetFlashSectors(sectors);
+
+	//The end of the last sector a sparse image touches is a hole too, so we can put it back if we erase the sector
+	if(sparse)
 	{
-		LogDebug("Flash is not blank, erasing...\n");
-		Erase();
+		for(auto& sector : sectors)
+		{
+			size_t end = (sector.offset + sector.size) / 4;
+			if( (sector.offset / 4 < nwords) && (end > nwords) )
+			{
+				words.resize(end, 0xffffffff);
+				populated.resize(end, false);
+				nwords = end;
+				break;
+			}
+		}
 	}
 
-	//Unlock flash and make sure it's ready
-	UnlockFlash();
-	PollUntilFlashNotBusy();
+	vector<bool> dirty(nwords);
+	if(sectors.empty())
+	{
+		//Check if the beginning of the vector table is blank.
+		//If not blank, trigger a bulk erase
+		//This is a quick check for normally-programmed chips.
+		//If the vector table is blank but there's data later in memory, a user-initiated bulk erase is required.
+		//Anything in the holes of a sparse image is lost.
+		if(m_dap->ReadMemory(m_flashMemoryBase) != 0xffffffff)
+		{
+			LogDebug("Flash is not blank, erasing...\n");
+			MassErase();
+		}
+
+		//Unlock flash and make sure it's ready
+		UnlockFlash();
+		PollUntilFlashNotBusy(POLL_SECTOR_ERASE);
+
+		for(size_t i=0; i<nwords; i++)
+			dirty[i] = populated[i] && (words[i] != 0xffffffff);
+	}
+	else
+	{
+		UnlockFlash();
+		PollUntilFlashNotBusy(POLL_SECTOR_ERASE);
+
+		//Compare each sector the image touches against what's already there.
+		//Sectors that already match are skipped, and a sector is only erased if some word would need bits set back
+		//to 1; otherwise we just program the words that differ. Sectors the image doesn't cover are left alone.
+		//If the target can checksum a sector, only read it back if it's neither identical nor blank (or has holes,
+		//since we need to know what's in them).
+		size_t changed = 0;
+		size_t erased = 0;
+		bool useChecksum = true;
+		vector<uint32_t> current;
+		for(size_t s=0; s<sectors.size(); s++)
+		{
+			size_t first = sectors[s].offset / 4;
+			if(first >= nwords)
+				break;
+
+			size_t count = sectors[s].size / 4;
+			size_t covered = 0;
+			for(size_t i=0; (i < count) && (first + i < nwords); i++)
+			{
+				if(populated[first + i])
+					covered ++;
+			}
+			if(covered == 0)
+				continue;
+
+			//A raw binary counts as blank from its end to the end of the sector, but anything in the holes of a
+			//sparse image has to be kept
+			bool holes = sparse && (covered != count);
+
+			uint32_t allBits;
+			uint32_t crc;
+			if(useChecksum && ChecksumFlash(sectors[s].offset, sectors[s].size, allBits, crc))
+			{
+				uint32_t expected = 0xffffffff;
+				for(size_t i=0; i<count; i++)
+					expected = Crc32Word(expected, (first + i < nwords) ? words[first + i] : 0xffffffff);
+				if(!holes && (m_crcBase != 0) && (crc == expected) )
+					continue;
+
+				//If the sector has holes, check just the parts the image covers
+				bool match;
+				if(holes && (m_crcBase != 0) && (allBits != 0xffffffff) &&
+					ChecksumRuns(words, populated, first, count, match) && match)
+				{
+					continue;
+				}
+
+				if(allBits == 0xffffffff)
+					current.assign(count, 0xffffffff);
+				else
+				{
+					current.resize(count);
+					m_dap->ReadMemoryBlock(m_flashMemoryBase + sectors[s].offset, &current[0], count);
+				}
+			}
+			else
+			{
+				useChecksum = false;
+				current.resize(count);
+				m_dap->ReadMemoryBlock(m_flashMemoryBase + sectors[s].offset, &current[0], count);
+			}
+
+			bool differs = false;
+			bool needErase = false;
+			for(size_t i=0; i<count; i++)
+			{
+				uint32_t want = 0xffffffff;
+				if(first + i < nwords)
+					want = populated[first + i] ? words[first + i] : current[i];
+				if(current[i] == want)
+					continue;
+				differs = true;
+				if(current[i] != 0xffffffff)
+					needErase = true;
+			}
+			if(!differs)
+				continue;
+
+			changed ++;
+			if(needErase)
+			{
+				EraseSector(s);
+				erased ++;
+			}
+			for(size_t i=0; (i < count) && (first + i < nwords); i++)
+			{
+				if(!populated[first + i])
+					words[first + i] = current[i];
+				uint32_t have = needErase ? 0xffffffff : current[i];
+				dirty[first + i] = (words[first + i] != have);
+			}
+		}
+
+		LogDebug("%zu sectors changed, %zu of them erased\n", changed, erased);
+	}
 
 	LogDebug("Programming address range from 0x%08x to 0x%08x...\n",
-		m_flashMemoryBase, m_flashMemoryBase + (uint32_t)bimage->raw_bitstream_len);
+		m_flashMemoryBase, m_flashMemoryBase + (uint32_t)nwords*4);
 
-	uint32_t oldcr = m_dap->ReadMemory(m_flashSfrBase + FLASH_CR) & 0xfffffcfe;	//mask off PG bit and op size
+	uint32_t oldcr = m_dap->ReadMemory(m_flashSfrBase + FLASH_CR) & 0xfffffc00;	//mask off PG/SER/MER, SNB and op size
 	oldcr |= 0x200;		//set op size to x32
-	for(size_t offset=0; offset < bimage->raw_bitstream_len; offset=offset+4)
+
+	//Set PG bit in CR to configure flash for programming.
+	//It can stay set for as many writes as we like, so leave it on for the whole image.
+	m_dap->WriteMemory(m_flashSfrBase + FLASH_CR, oldcr | 0x1);
+
+	//Run a loader on the CPU if we know where its SRAM is, so the host only has to stream data into SRAM.
+	//Otherwise, do every write from here.
+	unique_ptr<ARMv7MFlashLoader> loader;
+	if(m_ramKB != 0)
 	{
-		//Look up the data word
-		uint32_t addr = m_flashMemoryBase + offset;
-		uint32_t* ptr = reinterpret_cast<uint32_t*>(bimage->raw_bitstream + offset);
+		//Clear stale error flags so that the loader only reports its own
+		m_dap->WriteMemory(m_flashSfrBase + FLASH_SR, FLASH_SR_ERRORS);
+
+		loader.reset(new ARMv7MFlashLoader(
+			cpu,
+			m_dap,
+			m_sramMemoryBase,
+			m_ramKB * 1024,
+			m_flashSfrBase + FLASH_SR,
+			FLASH_SR_BSY,
+			FLASH_SR_ERRORS));
+		loader->Start();
+	}
 
-		//Status print
-		if( (offset & 0x3fff) == 0)
+	size_t i = 0;
+	int lastRegion = -1;
+	while(i < nwords)
+	{
+		//Skip words that are already right (including blank words, since the flash is already blank there)
+		if(!dirty[i])
 		{
-			float fracDone = offset * 1.0f / bimage->raw_bitstream_len;
-			LogDebug("%08x (%.1f %%)\n", addr, fracDone * 100.0f);
-		}
-
-		//OPTIMIZATION: if the data word is 0xffffffff, then no need to program it since the flash is already blank
-		if(*ptr == 0xffffffff)
+			i++;
 			continue;
+		}
 
-		//Set PG bit in CR to configure flash for programming
-		m_dap->WriteMemory(m_flashSfrBase + FLASH_CR, oldcr | 0x1);
+		//Find the end of this run of words to program, stopping at the next status print
+		size_t end = i + 1;
+		while( (end < nwords) && dirty[end] && ( ((end*4) & 0x3fff) != 0) )
+			end ++;
 
-		//Write the actual data word and wait until it finishes
-		m_dap->WriteMemory(addr, *ptr);
-		PollUntilFlashNotBusy();
+		//Status print (once per 16 KB)
+		uint32_t addr = m_flashMemoryBase + i*4;
+		int region = (i*4) >> 14;
+		if(region != lastRegion)
+		{
+			float fracDone = i * 1.0f / nwords;
+			LogDebug("%08x (%.1f %%)\n", addr, fracDone * 100.0f);
+			lastRegion = region;
+		}
 
-		//Clear PG bit to exit programming mode
-		m_dap->WriteMemory(m_flashSfrBase + FLASH_CR, oldcr);
+		//The loader programs the run while we send the next one.
+		//Without it, write the whole run in one go and wait until it finishes.
+		//The flash controller stalls bus accesses while a word is being programmed (the debugger sees this as WAIT),
+		//so the writes can't get ahead of it.
+		if(loader)
+			loader->Write(addr, &words[i], end - i);
+		else
+		{
+			m_dap->WriteMemoryBlock(addr, &words[i], end - i);
+			PollUntilFlashNotBusy(POLL_WORD_PROGRAM);
+		}
+		i = end;
 	}
+	if(loader)
+		loader->Finish();
+
+	//Clear PG bit to exit programming mode
+	m_dap->WriteMemory(m_flashSfrBase + FLASH_CR, oldcr);
 
 	//Automatically reset/resume at the end
 	cpu->Reset();
 	cpu->DebugResume();
+
+	if(!Verify(image))
+	{
+		throw JtagExceptionWrapper(
+			"Flash contents don't match the image after programming",
+			"");
+	}
+
+	//All done, so let anyone sharing the adapter have a turn
+	m_dap->ReleaseAdapter();
+}
+
+/**
+	@brief Finds the runs of populated words in part of an image
+
+	@param populated	Which words the image covers
+	@param first		First word to look at
+	@param count		Number of words to look at
+	@param runs			Each run found, as (first word, word count)
+ */
+void STM32Device::FindRuns(
+	const vector<bool>& populated,
+	size_t first,
+	size_t count,
+	vector< pair<size_t, size_t> >& runs)
+{
+	runs.clear();
+	for(size_t i=first; (i < first + count) && (i < populated.size()); i++)
+	{
+		if(!populated[i])
+			continue;
+		if(!runs.empty() && (runs.back().first + runs.back().second == i) )
+			runs.back().second ++;
+		else
+			runs.push_back(pair<size_t, size_t>(i, 1));
+	}
+}
+
+/**
+	@brief Checks the populated runs of part of an image against flash, using the CRC unit on the target
+
+	Stops at the first run that doesn't match. The CPU is left halted, with SRAM and the registers trashed.
+
+	@param words		Flattened image
+	@param populated	Which words the image covers
+	@param first		First word to check
+	@param count		Number of words to check
+	@param match		Set to true if every run matched
+
+	@return False if the target couldn't do the checksums
+ */
+bool STM32Device::ChecksumRuns(
+	const vector<uint32_t>& words,
+	const vector<bool>& populated,
+	size_t first,
+	size_t count,
+	bool& match)
+{
+	vector< pair<size_t, size_t> > runs;
+	FindRuns(populated, first, count, runs);
+
+	match = true;
+	for(auto& run : runs)
+	{
+		uint32_t allBits;
+		uint32_t crc;
+		if(!ChecksumFlash(run.first*4, run.second*4, allBits, crc))
+			return false;
+
+		uint32_t expected = 0xffffffff;
+		for(size_t i=0; i<run.second; i++)
+			expected = Crc32Word(expected, words[run.first + i]);
+		if(crc != expected)
+		{
+			LogTrace("CRC of flash at 0x%08x is 0x%08x, expected 0x%08x\n",
+				m_flashMemoryBase + (uint32_t)run.first*4, crc, expected);
+			match = false;
+			break;
+		}
+	}
+	return true;
+}
+
+/**
+	@brief Checks that flash matches a firmware image
+
+	Has the CRC unit checksum each populated run of the image on the target and compares the results with ones
+	calculated here, then resets the CPU. If the target can't do that (e.g. read protection, or the CPU won't halt),
+	reads the flash back instead. Holes in a sparse image aren't checked.
+
+	@return True if the flash matches the image
+ */
+bool STM32Device::Verify(FirmwareImage* image)
+{
+	vector<uint32_t> words;
+	vector<bool> populated;
+	FlattenImage(image, words, populated);
+	size_t nwords = words.size();
+
+	LogDebug("Verifying...\n");
+	LogIndenter li;
+
+	bool match;
+	if( (m_crcBase != 0) && ChecksumRuns(words, populated, 0, nwords, match) )
+	{
+		//The checksum routine trashed SRAM and the registers, so start over
+		GetCPU()->Reset();
+		GetCPU()->DebugResume();
+
+		if(!match)
+			LogNotice("Verify failed: flash CRC doesn't match the image\n");
+		return match;
+	}
+
+	vector< pair<size_t, size_t> > runs;
+	FindRuns(populated, 0, nwords, runs);
+	vector<uint32_t> rdata(BLANK_CHECK_BLOCK_WORDS);
+	for(auto& run : runs)
+	{
+		size_t end = run.first + run.second;
+		for(size_t i=run.first; i<end; i += BLANK_CHECK_BLOCK_WORDS)
+		{
+			size_t count = min((size_t)BLANK_CHECK_BLOCK_WORDS, end - i);
+			m_dap->ReadMemoryBlock(m_flashMemoryBase + i*4, &rdata[0], count);
+			for(size_t j=0; j<count; j++)
+			{
+				if(rdata[j] != words[i+j])
+				{
+					LogNotice("Verify failed: found 0x%08x at flash address 0x%08x, expected 0x%08x\n",
+						rdata[j], m_flashMemoryBase + (uint32_t)(i+j)*4, words[i+j]);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
 }
@@ -86,14 +86,45 @@ public:
 	virtual void Reset();
 
 	virtual void Program(FirmwareImage* image);
+	virtual bool Verify(FirmwareImage* image);
 	virtual FirmwareImage* LoadFirmwareImage(const unsigned char* data, size_t len);
+	virtual FirmwareImage* LoadFirmwareImage(std::string fname);
 
 protected:
 	void UnlockFlash();
-	void PollUntilFlashNotBusy();
+	void PollUntilFlashNotBusy(PollOperation op);
+	void MassErase();
 	bool BlankCheck();
 	void UnlockFlashOptions();
 
+	///One individually erasable block of flash
+	struct FlashSector
+	{
+		///Offset from the start of flash, in bytes
+		uint32_t offset;
+
+		///Size in bytes
+		uint32_t size;
+	};
+
+	void GetFlashSectors(std::vector<FlashSector>& sectors);
+	void EraseSector(unsigned int sector);
+
+	bool ChecksumFlash(uint32_t offset, uint32_t len, uint32_t& allBits, uint32_t& crc);
+
+	void FlattenImage(FirmwareImage* image, std::vector<uint32_t>& words, std::vector<bool>& populated);
+	void FindRuns(
+		const std::vector<bool>& populated,
+		size_t first,
+		size_t count,
+		std::vector< std::pair<size_t, size_t> >& runs);
+	bool ChecksumRuns(
+		const std::vector<uint32_t>& words,
+		const std::vector<bool>& populated,
+		size_t first,
+		size_t count,
+		bool& match);
+
 public:
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Serial numbering
@@ -133,6 +164,12 @@ public:
 		FLASH_OPTCR		= 0x14
 	};
 
+	enum CrcSfrOffsets
+	{
+		CRC_DR			= 0x00,
+		CRC_CR			= 0x08
+	};
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Find our CPU
 
@@ -166,6 +203,11 @@ protected:
 	uint32_t m_uniqueIDBase;
 	uint32_t m_flashSizeBase;
 
+	//CRC unit (zero base if we don't know where it is)
+	uint32_t m_crcBase;
+	uint32_t m_crcClockRegister;
+	uint32_t m_crcClockBit;
+
 	bool m_locksProbed;
 	int m_protectionLevel;
 };
@@ -35,6 +35,8 @@
 
 #include "jtaghal.h"
 
+using namespace std;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -81,6 +83,43 @@ uint32_t SWDInterface::ReadMemory(uint32_t address)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Autodetection
 */
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Batched access
+
+/**
+	@brief Executes a batch of SW-DP transfers in order, stopping at the first one that doesn't get an OK ACK
+
+	The default implementation just calls ReadWord() / WriteWord() for each transfer. Those report failures as
+	exceptions without saying which ACK caused them, so a failed transfer is reported as SWD_ACK_NONE. Adapters which
+	can queue transfers, or see the actual ACK, should override this.
+
+	@param batch	The transfers to perform. Read data and ACKs are written back to each transfer.
+
+	@return Number of transfers that completed successfully
+ */
+size_t SWDInterface::Transfer(vector<SWDTransfer>& batch)
+{
+	for(size_t i=0; i<batch.size(); i++)
+	{
+		auto& t = batch[i];
+		try
+		{
+			if(t.m_read)
+				t.m_data = ReadWord(t.m_regAddr, t.m_ap);
+			else
+				WriteWord(t.m_regAddr, t.m_ap, t.m_data);
+			t.m_ack = SWD_ACK_OK;
+		}
+		catch(const JtagException& ex)
+		{
+			LogDebug("SWD transfer %zu failed: %s\n", i, ex.GetDescription().c_str());
+			t.m_ack = SWD_ACK_NONE;
+			return i;
+		}
+	}
+	return batch.size();
+}
+
 void SWDInterface::InitializeChain(bool /*quiet*/)
 {
 
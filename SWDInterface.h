@@ -108,6 +108,50 @@ protected:
 	 */
 	virtual uint32_t ReadWord(uint8_t reg_addr, bool ap) =0;
 
+	//Batched SW-DP access
+public:
+
+	///ACK values returned by the SW-DP (plus SWD_ACK_NONE for transfers that got no valid ACK at all)
+	enum SWDAck
+	{
+		SWD_ACK_NONE	= 0,
+		SWD_ACK_OK		= 1,
+		SWD_ACK_WAIT	= 2,
+		SWD_ACK_FAULT	= 4
+	};
+
+	/**
+		@brief A single SW-DP read or write, as part of a batch passed to Transfer()
+	 */
+	class SWDTransfer
+	{
+	public:
+		SWDTransfer(uint8_t reg_addr, bool ap, bool read, uint32_t data = 0)
+		: m_regAddr(reg_addr)
+		, m_ap(ap)
+		, m_read(read)
+		, m_data(data)
+		, m_ack(SWD_ACK_NONE)
+		{}
+
+		///Register address within the DP or AP bank (0x0, 0x4, 0x8 or 0xc)
+		uint8_t m_regAddr;
+
+		///True for an AP access, false for DP
+		bool m_ap;
+
+		///True for a read, false for a write
+		bool m_read;
+
+		///Write data, or read data once the transfer has completed
+		uint32_t m_data;
+
+		///ACK we got for this transfer (SWD_ACK_NONE if it was never executed)
+		SWDAck m_ack;
+	};
+
+	virtual size_t Transfer(std::vector<SWDTransfer>& batch);
+
 public:
 
 	//Scanning stuff
@@ -34,8 +34,45 @@
  */
 #include "jtaghal.h"
 #include "ProtobufHelpers.h"
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <atomic>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <sys/un.h>
+#endif
 
 using namespace std;
+using google::protobuf::Arena;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+///Size of the initial (reused) block of the inbound message arena
+#define RX_ARENA_BLOCK_SIZE 4096
+
+///Size of each shared memory ring on shm: connections
+#define SHM_RING_SIZE (16 * 1024 * 1024)
+
+///Scan payloads at least this big bypass the transmit batch and are sent straight from the caller's buffer
+#define TX_INLINE_MAX 4096
+
+///Send the transmit batch once it gets this big, regardless of the request count
+#define TX_BATCH_MAX_BYTES (64 * 1024)
+
+///Upper bound on the number of requests per batch
+#define TX_BATCH_MAX_REQUESTS 256
+
+///Batch size used until we've measured the link (or if the server can't be pinged)
+#define TX_BATCH_DEFAULT 16
+
+///Number of pings per link probe (we keep the fastest)
+#define PROBE_PING_COUNT 4
+
+///Re-probe the link when the adapter is released at least this long (in seconds) after the last probe
+#define PROBE_INTERVAL 5.0
 
 bool SendMessage(Socket& s, const JtaghalPacket& msg)
 {
@@ -88,25 +125,512 @@ bool RecvMessage(Socket& s, JtaghalPacket& msg, JtaghalPacket::PayloadCase expec
 	@brief Creates the interface object but does not connect to a server.
  */
 ServerInterface::ServerInterface()
-	: m_socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP)
+	: m_channel(0)
+	, m_channelHeaderLen(0)
+	, m_txPending(0)
+	, m_txBatchLimit(TX_BATCH_DEFAULT)
+	, m_pingCookie(0)
+	, m_rtt(0)
+	, m_serverRequestTime(0)
+	, m_lastProbe(0)
+	, m_probeRequests(0)
+	, m_probeExecNs(0)
+	, m_preemptible(false)
+	, m_adapterWanted(false)
+	, m_lastActivity(0)
+	, m_rxLen(0)
+	, m_rxArenaBlock(new char[RX_ARENA_BLOCK_SIZE])
+	, m_shm(NULL)
+	, m_info(new AdapterInfo)
+	, m_serverSentInfo(false)
+	, m_infoValid(0)
+	, m_perfBytesSent(0)
+	, m_perfBytesReceived(0)
+	, m_perfBytesCopied(0)
+	, m_perfTxFlushes(0)
+	, m_perfTxRequests(0)
 {
+	//Inbound messages are parsed into an arena that is reset before each message, so steady-state
+	//receives don't touch the heap for the message objects themselves
+	google::protobuf::ArenaOptions opts;
+	opts.initial_block = m_rxArenaBlock;
+	opts.initial_block_size = RX_ARENA_BLOCK_SIZE;
+	m_rxArena = new Arena(opts);
 }
 
 ServerInterface::~ServerInterface()
 {
 	try
 	{
-		if(m_socket.IsValid())
+		if(m_mux && m_mux->m_socket.IsValid())
 		{
 			JtaghalPacket packet;
 			packet.mutable_disconnectrequest();
-			SendMessage(m_socket, packet);
+			SendMessage(packet);
+			FlushTx();
 		}
 	}
 	catch(const JtagInterface& ex)
 	{
 		//Ignore errors in the write_looped call since we're disconnecting anyway
 	}
+	if(m_mux)
+		m_mux->RemoveChannel(m_channel);
+
+#ifndef _WIN32
+	delete m_shm;
+#endif
+	delete m_info;
+	delete m_rxArena;
+	delete[] m_rxArenaBlock;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Message I/O
+
+/**
+	@brief Appends a frame header (length, and our channel unless it's the default) to the transmit batch
+
+	The channel goes first rather than in field number order; protobuf doesn't care, and it lets the payload be
+	written straight after the header.
+
+	@param len		Length of the part of the message which will be written to the batch
+	@param extra	Length of any trailing payload which will be appended (or sent) separately
+
+	@return Pointer to where the next "len" bytes of the message should be written
+ */
+uint8_t* ServerInterface::AppendFrame(uint32_t len, uint32_t extra)
+{
+	uint32_t framelen = m_channelHeaderLen + len + extra;
+	size_t off = m_txBuffer.size();
+	m_txBuffer.resize(off + sizeof(framelen) + m_channelHeaderLen + len);
+	uint8_t* p = (uint8_t*)&m_txBuffer[off];
+	memcpy(p, &framelen, sizeof(framelen));
+	p += sizeof(framelen);
+	if(m_channel)
+		p = WireFormatLite::WriteUInt32ToArray(JtaghalPacket::kChannelFieldNumber, m_channel, p);
+	return p;
+}
+
+/**
+	@brief Serializes a message and appends it, with its length header, to the transmit batch
+
+	The batch is sent when it reaches the current batch limit (see UpdateBatchPolicy()), when we're about to wait for
+	a reply, or when FlushTx() is called.
+
+	@return True on success, false on failure
+ */
+bool ServerInterface::SendMessage(const JtaghalPacket& msg)
+{
+	size_t off = m_txBuffer.size();
+	uint32_t len = msg.ByteSizeLong();
+	uint8_t* p = AppendFrame(len);
+	if(!msg.SerializeToArray(p, len))
+	{
+		LogWarning("Failed to serialize protobuf\n");
+		m_txBuffer.resize(off);
+		return false;
+	}
+	m_perfBytesCopied += len;
+
+	return OnRequestQueued();
+}
+
+/**
+	@brief Sends a scanRequest whose writeData is taken directly from the caller's buffer
+
+	Only the length header and the (small) scanRequest header are serialized. Small scans are appended to the transmit
+	batch; large ones (e.g. FPGA bitstreams) flush the batch and are handed to the kernel straight from "data" in the
+	same sendmsg() call, so they are never copied in userspace.
+
+	On shm: connections, large payloads are copied into the shared memory ring instead and only their position is
+	sent.
+
+	@param req		The scan request. writeData must be empty; it is appended from "data".
+	@param data		Scan data to send (may be NULL if len is zero)
+	@param len		Length of the scan data, in bytes
+
+	@return True on success, false on failure
+ */
+bool ServerInterface::SendScanRequest(const JtagScanRequest& req, const unsigned char* data, size_t len)
+{
+#ifndef _WIN32
+	uint64_t pos;
+	unsigned char* ring;
+	if(m_shm && (len >= JTAGHAL_SHM_THRESHOLD) && (ring = m_shm->AllocTx(len, pos)) )
+	{
+		memcpy(ring, data, len);
+		m_perfBytesCopied += len;
+
+		JtagScanRequest shmreq(req);
+		shmreq.set_shmoffset(pos);
+		shmreq.set_shmlength(len);
+		return SendScanRequest(shmreq, NULL, 0);
+	}
+#endif
+
+	//Figure out how big everything is
+	uint32_t reqlen = req.ByteSizeLong();
+	uint32_t datahdrlen = 0;
+	if(len)
+	{
+		datahdrlen =
+			WireFormatLite::TagSize(JtagScanRequest::kWriteDataFieldNumber, WireFormatLite::TYPE_BYTES) +
+			CodedOutputStream::VarintSize32(len);
+	}
+	uint32_t innerlen = reqlen + datahdrlen + len;
+	uint32_t outerhdrlen =
+		WireFormatLite::TagSize(JtaghalPacket::kScanRequestFieldNumber, WireFormatLite::TYPE_MESSAGE) +
+		CodedOutputStream::VarintSize32(innerlen);
+
+	//Serialize everything but the scan data: length header, channel, packet field header, request fields,
+	//writeData header
+	size_t off = m_txBuffer.size();
+	uint8_t* p = AppendFrame(outerhdrlen + reqlen + datahdrlen, len);
+	p = WireFormatLite::WriteTagToArray(
+		JtaghalPacket::kScanRequestFieldNumber,
+		WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+		p);
+	p = CodedOutputStream::WriteVarint32ToArray(innerlen, p);
+	if(!req.SerializeToArray(p, reqlen))
+	{
+		LogWarning("Failed to serialize protobuf\n");
+		m_txBuffer.resize(off);
+		return false;
+	}
+	p += reqlen;
+	if(len)
+	{
+		p = WireFormatLite::WriteTagToArray(
+			JtagScanRequest::kWriteDataFieldNumber,
+			WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+			p);
+		p = CodedOutputStream::WriteVarint32ToArray(len, p);
+	}
+	m_perfBytesCopied += reqlen;
+
+	//Big payloads go out right away, straight from the caller's buffer
+	if(len >= TX_INLINE_MAX)
+	{
+		m_txPending ++;
+		return FlushTx(data, len);
+	}
+
+	//Small ones are cheaper to copy into the batch than to send on their own
+	if(len)
+	{
+		m_txBuffer.append((const char*)data, len);
+		m_perfBytesCopied += len;
+	}
+	return OnRequestQueued();
+}
+
+/**
+	@brief Called after a request has been appended to the transmit batch. Sends the batch if it's full.
+ */
+bool ServerInterface::OnRequestQueued()
+{
+	m_txPending ++;
+	if( (m_txPending >= m_txBatchLimit) || (m_txBuffer.size() >= TX_BATCH_MAX_BYTES) )
+		return FlushTx();
+	return true;
+}
+
+/**
+	@brief Sends everything in the transmit batch, optionally followed by a payload that is not in the batch
+
+	@param data		Extra data to send after the batch, or NULL
+	@param len		Length of the extra data
+
+	@return True on success, false on failure
+ */
+bool ServerInterface::FlushTx(const unsigned char* data, size_t len)
+{
+	if(m_txBuffer.empty() && !len)
+		return true;
+
+	size_t total = m_txBuffer.size() + len;
+
+	//Other channels on the connection may be sending too, and each batch has to go out in one piece
+	lock_guard<mutex> lock(m_mux->m_txMutex);
+
+#ifdef _WIN32
+	//No sendmsg(), fall back to a single contiguous buffer
+	if(len)
+	{
+		m_txBuffer.append((const char*)data, len);
+		m_perfBytesCopied += len;
+	}
+	if(!m_mux->m_socket.SendLooped((const unsigned char*)m_txBuffer.data(), m_txBuffer.size()))
+		return false;
+#else
+	struct iovec iov[2];
+	iov[0].iov_base = &m_txBuffer[0];
+	iov[0].iov_len = m_txBuffer.size();
+	iov[1].iov_base = const_cast<unsigned char*>(data);
+	iov[1].iov_len = len;
+
+	struct msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = iov;
+	mh.msg_iovlen = len ? 2 : 1;
+
+	//Keep going until both buffers are gone, resuming mid-iovec after short writes
+	while(mh.msg_iovlen)
+	{
+		ssize_t n = sendmsg((ZSOCKET)m_mux->m_socket, &mh, MSG_NOSIGNAL);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+
+		while(mh.msg_iovlen && ((size_t)n >= mh.msg_iov->iov_len) )
+		{
+			n -= mh.msg_iov->iov_len;
+			mh.msg_iov ++;
+			mh.msg_iovlen --;
+		}
+		if(mh.msg_iovlen)
+		{
+			mh.msg_iov->iov_base = (uint8_t*)mh.msg_iov->iov_base + n;
+			mh.msg_iov->iov_len -= n;
+		}
+	}
+#endif
+
+	m_perfBytesSent += total;
+	m_perfTxFlushes ++;
+	m_lastActivity = GetTime();
+	m_perfTxRequests += m_txPending;
+
+	m_txBuffer.clear();
+	m_txPending = 0;
+	return true;
+}
+
+/**
+	@brief Reads the next message for our channel into the reusable receive buffer
+
+	@return True on success, false on failure
+ */
+bool ServerInterface::RecvFrame()
+{
+	//Whatever we're waiting for can't come back until the server has seen our requests
+	if(!FlushTx())
+		return false;
+
+	while(true)
+	{
+		if(!m_mux->RecvFrame(m_channel, m_rxBuffer, m_rxLen))
+			return false;
+		m_perfBytesReceived += sizeof(uint32_t) + m_rxLen;
+
+		//The server may tell us someone else is waiting for the adapter, or (if we're preemptible) that it has handed
+		//it to them. Either comes ahead of whatever reply we're waiting for.
+		if(IsPayloadFrame(JtaghalPacket::kAdapterWantedFieldNumber))
+		{
+			LogDebug("Another client is waiting for the adapter\n");
+			m_adapterWanted = true;
+			continue;
+		}
+		if(!IsPayloadFrame(JtaghalPacket::kAdapterReleaseFieldNumber))
+			return true;
+		LogDebug("Server gave the adapter to another client\n");
+		OnAdapterLost();
+	}
+}
+
+/**
+	@brief Checks if the frame in the receive buffer carries the given JtaghalPacket payload field
+
+	Fields can come in any order (jtagd writes the channel ahead of the payload on every channel but 0, see
+	JtagdConnection::AppendFrame()), so this walks the top-level tags, skipping over anything that isn't the payload,
+	rather than doing a full parse.
+ */
+bool ServerInterface::IsPayloadFrame(int field)
+{
+	const uint32_t payloadtag = WireFormatLite::MakeTag(field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+
+	CodedInputStream in(m_rxBuffer.data(), m_rxLen);
+	while(true)
+	{
+		uint32_t tag = in.ReadTag();
+		if(tag == 0)
+			return false;
+		if(tag == payloadtag)
+			return true;
+		if(!WireFormatLite::SkipField(&in, tag))
+			return false;
+	}
+}
+
+/**
+	@brief Receives a message
+
+	@return The message, or NULL on failure. The message lives in an arena owned by this object and is only valid
+	until the next call to RecvMessage() or RecvScanReply().
+ */
+JtaghalPacket* ServerInterface::RecvMessage()
+{
+	if(!RecvFrame())
+		return NULL;
+
+	m_rxArena->Reset();
+	JtaghalPacket* msg = Arena::CreateMessage<JtaghalPacket>(m_rxArena);
+	if(!msg->ParseFromArray(m_rxBuffer.data(), m_rxLen))
+	{
+		LogWarning("Failed to parse protobuf\n");
+		return NULL;
+	}
+	m_perfBytesCopied += m_rxLen;
+	return msg;
+}
+
+/**
+	@brief Receives a message and checks that it has the expected type
+
+	@param expectedType	The JtaghalPacket::PayloadCase we expect
+
+	@return The message, or NULL on failure (see RecvMessage())
+ */
+JtaghalPacket* ServerInterface::RecvMessage(int expectedType)
+{
+	//Anything we pipelined ahead of this request gets its reply first
+	FlushPendingReplies();
+
+	JtaghalPacket* msg = RecvMessage();
+	if(!msg)
+		return NULL;
+	if(msg->Payload_case() != expectedType)
+	{
+		if(msg->Payload_case() == JtaghalPacket::kDisconnectRequest)
+			LogWarning("Server closed the connection\n");
+		else
+			LogWarning("Got incorrect message type\n");
+		return NULL;
+	}
+	return msg;
+}
+
+/**
+	@brief Receives a scanReply and copies its readData straight from the receive buffer to the caller's buffer
+
+	The reply is walked in place rather than parsed, so the scan data is only copied once.
+
+	@throw JtagException if the reply has the wrong length
+
+	@param rcv_data	Buffer to store the scan data in
+	@param len		Expected length of the scan data, in bytes
+
+	@return True on success, false on failure
+ */
+bool ServerInterface::RecvScanReply(unsigned char* rcv_data, size_t len)
+{
+	if(!RecvFrame())
+		return false;
+
+	const uint32_t outertag = WireFormatLite::MakeTag(
+		JtaghalPacket::kScanReplyFieldNumber,
+		WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+	const uint32_t datatag = WireFormatLite::MakeTag(
+		JtagScanReply::kReadDataFieldNumber,
+		WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+	const uint32_t shmofftag = WireFormatLite::MakeTag(
+		JtagScanReply::kShmOffsetFieldNumber,
+		WireFormatLite::WIRETYPE_VARINT);
+	const uint32_t shmlentag = WireFormatLite::MakeTag(
+		JtagScanReply::kShmLengthFieldNumber,
+		WireFormatLite::WIRETYPE_VARINT);
+
+	CodedInputStream in(m_rxBuffer.data(), m_rxLen);
+	bool found = false;
+	const uint8_t* rdata = NULL;
+	uint32_t rlen = 0;
+	uint64_t shmoff = 0;
+	uint32_t shmlen = 0;
+	uint32_t tag;
+	while( (tag = in.ReadTag()) != 0)
+	{
+		if(tag != outertag)
+		{
+			if(!WireFormatLite::SkipField(&in, tag))
+				return false;
+			continue;
+		}
+
+		uint32_t msglen;
+		if(!in.ReadVarint32(&msglen))
+			return false;
+		auto limit = in.PushLimit(msglen);
+		while( (tag = in.ReadTag()) != 0)
+		{
+			if(tag == datatag)
+			{
+				if(!in.ReadVarint32(&rlen))
+					return false;
+				rdata = m_rxBuffer.data() + in.CurrentPosition();
+				if(!in.Skip(rlen))
+					return false;
+			}
+			else if(tag == shmofftag)
+			{
+				if(!in.ReadVarint64(&shmoff))
+					return false;
+			}
+			else if(tag == shmlentag)
+			{
+				if(!in.ReadVarint32(&shmlen))
+					return false;
+			}
+			else if(!WireFormatLite::SkipField(&in, tag))
+				return false;
+		}
+		in.PopLimit(limit);
+		found = true;
+	}
+
+	if(!found)
+	{
+		LogWarning("Got incorrect message type\n");
+		return false;
+	}
+
+#ifndef _WIN32
+	//Data is in the shared memory ring, copy it out and give the space back
+	if(shmlen)
+	{
+		const uint8_t* p = m_shm ? m_shm->GetRx(shmoff, shmlen) : NULL;
+		if(!p)
+		{
+			LogWarning("Got scanReply with a bad shared memory position\n");
+			return false;
+		}
+		if(shmlen != len)
+		{
+			throw JtagExceptionWrapper(
+				"RX byte length mismatch",
+				"");
+		}
+		memcpy(rcv_data, p, len);
+		m_shm->ReleaseRx(shmoff, shmlen);
+		m_perfBytesCopied += len;
+		return true;
+	}
+#endif
+	if(rlen != len)
+	{
+		throw JtagExceptionWrapper(
+			"RX byte length mismatch",
+			"");
+	}
+	if(len)
+	{
+		memcpy(rcv_data, rdata, len);
+		m_perfBytesCopied += len;
+	}
+	return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -115,38 +639,111 @@ ServerInterface::~ServerInterface()
 /**
 	@brief Connects to a jtagd server.
 
+	The server may be given as:
+	\li A hostname or address, to connect over TCP
+	\li unix:/path/to/socket, to connect to a server on the same host over a Unix-domain socket
+	\li shm:/path/to/socket, as for unix: but with bulk scan data passed through shared memory (see JtaghalShm)
+
 	@throw JtagException if the connection could not be established
 
-	@param server	Hostname of the server to connect to
-	@param port		Port number (in host byte ordering) the server is running on
+	@param server	Server to connect to
+	@param port		Port number (in host byte ordering) the server is running on. Ignored for local endpoints.
  */
 void ServerInterface::DoConnect(const string& server, uint16_t port, int transport)
 {
-	Hello_TransportType tp = (Hello_TransportType)transport;
+	bool shm = false;
+	if(server.find("unix:") == 0)
+		ConnectUnix(server.substr(5));
+	else if(server.find("shm:") == 0)
+	{
+		ConnectUnix(server.substr(4));
+		shm = true;
+	}
+	else
+	{
+		//Connect to the port
+		m_mux = make_shared<JtaghalMux>();
+		if(!m_mux->m_socket.Connect(server, port))
+		{
+			throw JtagExceptionWrapper(
+				"Failed to connect to server",
+				"");
+		}
 
-	//Connect to the port
-	if(!m_socket.Connect(server, port))
+		//Set no-delay flag
+		if(!m_mux->m_socket.DisableNagle())
+		{
+			throw JtagExceptionWrapper(
+				"Failed to set TCP_NODELAY",
+				"");
+		}
+	}
+
+	m_mux->AddChannel(m_channel);
+	Handshake(transport);
+
+	if(shm)
 	{
-		throw JtagExceptionWrapper(
-			"Failed to connect to server",
-			"");
+		if(m_serverSentInfo && !m_info->sharedmemory())
+			LogWarning("Server does not support shared memory, using the socket for all scan data\n");
+		else
+			AttachSharedMemory();
 	}
+}
+
+/**
+	@brief Opens another channel of a server we're already connected to, sharing the connection
+
+	Requests and replies for each channel are independent, so this is an efficient way to drive several adapters on
+	the same server at once. Shared memory (on shm: connections) is only used by the interface that made the
+	connection.
 
-	//Set no-delay flag
-	if(!m_socket.DisableNagle())
+	@throw JtagException if the channel could not be opened
+
+	@param peer		Interface which is already connected to the server (on any channel)
+	@param channel	The channel to open
+ */
+void ServerInterface::DoConnectChannel(ServerInterface& peer, uint32_t channel, int transport)
+{
+	if(!peer.m_mux || !peer.m_mux->m_socket.IsValid())
 	{
 		throw JtagExceptionWrapper(
-			"Failed to set TCP_NODELAY",
+			"Peer interface is not connected",
 			"");
 	}
 
+	peer.m_mux->AddChannel(channel);
+	m_mux = peer.m_mux;
+	m_channel = channel;
+	m_channelHeaderLen = 0;
+	if(channel)
+	{
+		m_channelHeaderLen =
+			WireFormatLite::TagSize(JtaghalPacket::kChannelFieldNumber, WireFormatLite::TYPE_UINT32) +
+			CodedOutputStream::VarintSize32(channel);
+	}
+
+	Handshake(transport);
+}
+
+/**
+	@brief Exchanges Hellos on our channel and loads the adapter information
+
+	@throw JtagException if the server rejected us
+ */
+void ServerInterface::Handshake(int transport)
+{
+	Hello_TransportType tp = (Hello_TransportType)transport;
+
 	//Send the ClientHello
 	JtaghalPacket packet;
 	auto h = packet.mutable_hello();
 	h->set_magic("JTAGHAL");
 	h->set_version(1);
 	h->set_transport(tp);
-	if(!SendMessage(m_socket, packet))
+	h->set_adapterrelease(true);
+	h->set_preemptible(m_preemptible);
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send clienthello",
@@ -154,13 +751,14 @@ void ServerInterface::DoConnect(const string& server, uint16_t port, int transpo
 	}
 
 	//Get the server-hello message
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kHello))
+	auto reply = RecvMessage(JtaghalPacket::kHello);
+	if(!reply)
 	{
 		throw JtagExceptionWrapper(
 			"Failed to get serverhello",
 			"");
 	}
-	auto sh = packet.hello();
+	auto& sh = reply->hello();
 	if( (sh.magic() != "JTAGHAL") || (sh.version() != 1) )
 	{
 		throw JtagExceptionWrapper(
@@ -176,12 +774,116 @@ void ServerInterface::DoConnect(const string& server, uint16_t port, int transpo
 			"");
 	}
 
-	//All good, query the GPIO stats
-	if(IsGPIOCapable())
+	//Newer servers tell us everything we'd otherwise ask about one request at a time
+	if(sh.has_info())
 	{
-		//Load the GPIO pin state from the server
+		*m_info = sh.info();
+		m_serverSentInfo = true;
+		m_infoValid =
+			(1 << InfoRequest::HwName) |
+			(1 << InfoRequest::HwSerial) |
+			(1 << InfoRequest::Userid) |
+			(1 << InfoRequest::Freq);
+	}
+
+	//All good, load the GPIO pin state
+	if(m_serverSentInfo)
+		LoadGpioState(m_info->gpiostate());
+	else if(IsGPIOCapable())
 		ReadGpioState();
+
+	//See how far away the server is, so we can pick a sensible batch size
+	ProbeLink();
+}
+
+/**
+	@brief Connects to the server through a Unix-domain socket at the given path
+
+	@throw JtagException if the connection could not be established
+ */
+void ServerInterface::ConnectUnix(const string& path)
+{
+#ifdef _WIN32
+	throw JtagExceptionWrapper(
+		"Unix-domain sockets are not supported on this platform",
+		"");
+#else
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(path.length() >= sizeof(addr.sun_path))
+	{
+		throw JtagExceptionWrapper(
+			"Socket path is too long",
+			"");
+	}
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	m_mux = make_shared<JtaghalMux>(AF_UNIX, SOCK_STREAM, 0);
+	if(!m_mux->m_socket.IsValid())
+	{
+		throw JtagExceptionWrapper(
+			"Failed to create socket",
+			"");
+	}
+	ZSOCKET fd = (ZSOCKET)m_mux->m_socket;
+
+	if(0 != connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to connect to server",
+			"");
 	}
+#endif
+}
+
+/**
+	@brief Creates the shared memory rings and asks the server to use them
+
+	If the server can't attach (e.g. it's an older version, or in a different IPC namespace) we carry on with all data
+	going through the socket.
+ */
+void ServerInterface::AttachSharedMemory()
+{
+#ifndef _WIN32
+	//Interfaces may be connected from several threads at once, and each needs its own segment name
+	static atomic<unsigned int> count(0);
+	char name[64];
+	snprintf(name, sizeof(name), "/jtaghal-%d-%u", (int)getpid(), count++);
+
+	m_shm = new JtaghalShm;
+	if(!m_shm->Create(name, SHM_RING_SIZE, SHM_RING_SIZE))
+	{
+		delete m_shm;
+		m_shm = NULL;
+		return;
+	}
+
+	JtaghalPacket packet;
+	packet.mutable_shmattach()->set_name(name);
+	if(!SendMessage(packet))
+	{
+		throw JtagExceptionWrapper(
+			"Failed to send shmAttach",
+			"");
+	}
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
+	{
+		throw JtagExceptionWrapper(
+			"Failed to get infoReply",
+			"");
+	}
+
+	//The server has it mapped (or never will), so the name isn't needed any more
+	m_shm->Unlink();
+	if(!reply->inforeply().num())
+	{
+		LogVerbose("Server could not attach to shared memory, using the socket for all data\n");
+		delete m_shm;
+		m_shm = NULL;
+	}
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -203,13 +905,33 @@ int ServerInterface::GetInterfaceCount()
 	return 1;
 }
 
-string ServerInterface::GetName()
+/**
+	@brief Gets the number of channels (adapters) the server exports
+
+	@return The channel count, or 1 if the server predates channels
+ */
+size_t ServerInterface::GetChannelCount()
+{
+	if(m_serverSentInfo && m_info->channelcount())
+		return m_info->channelcount();
+	return 1;
+}
+
+/**
+	@brief Sends an infoRequest and waits for the reply
+
+	@param req	The InfoRequest::InfoType to query
+	@param num	If not NULL, the numeric field of the reply is stored here
+
+	@return The string field of the reply
+ */
+string ServerInterface::DoInfoRequest(int req, uint64_t* num)
 {
 	//Send the infoRequest
 	JtaghalPacket packet;
 	auto r = packet.mutable_inforequest();
-	r->set_req(InfoRequest::HwName);
-	if(!SendMessage(m_socket, packet))
+	r->set_req((InfoRequest_InfoType)req);
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send infoRequest",
@@ -217,84 +939,241 @@ string ServerInterface::GetName()
 	}
 
 	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kInfoReply))
+	auto reply = RecvMessage(JtaghalPacket::kInfoReply);
+	if(!reply)
 	{
 		throw JtagExceptionWrapper(
 			"Failed to get infoReply",
 			"");
 	}
-	return packet.inforeply().str();
+	if(num)
+		*num = reply->inforeply().num();
+	return reply->inforeply().str();
 }
 
-string ServerInterface::GetSerial()
+//Adapter metadata doesn't change over the life of a connection, so each field is only ever fetched once
+//(and not at all if the ServerHello carried it)
+
+string ServerInterface::GetName()
 {
-	//Send the infoRequest
-	JtaghalPacket packet;
-	auto r = packet.mutable_inforequest();
-	r->set_req(InfoRequest::HwSerial);
-	if(!SendMessage(m_socket, packet))
+	if(!(m_infoValid & (1 << InfoRequest::HwName)))
 	{
-		throw JtagExceptionWrapper(
-			"Failed to send infoRequest",
-			"");
+		m_info->set_name(DoInfoRequest(InfoRequest::HwName));
+		m_infoValid |= (1 << InfoRequest::HwName);
 	}
+	return m_info->name();
+}
 
-	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kInfoReply))
+string ServerInterface::GetSerial()
+{
+	if(!(m_infoValid & (1 << InfoRequest::HwSerial)))
 	{
-		throw JtagExceptionWrapper(
-			"Failed to get infoReply",
-			"");
+		m_info->set_serial(DoInfoRequest(InfoRequest::HwSerial));
+		m_infoValid |= (1 << InfoRequest::HwSerial);
 	}
-	return packet.inforeply().str();
+	return m_info->serial();
 }
 
 string ServerInterface::GetUserID()
 {
-	//Send the infoRequest
-	JtaghalPacket packet;
-	auto r = packet.mutable_inforequest();
-	r->set_req(InfoRequest::Userid);
-	if(!SendMessage(m_socket, packet))
+	if(!(m_infoValid & (1 << InfoRequest::Userid)))
 	{
-		throw JtagExceptionWrapper(
-			"Failed to send infoRequest",
-			"");
+		m_info->set_userid(DoInfoRequest(InfoRequest::Userid));
+		m_infoValid |= (1 << InfoRequest::Userid);
 	}
+	return m_info->userid();
+}
 
-	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kInfoReply))
+int ServerInterface::GetFrequency()
+{
+	if(!(m_infoValid & (1 << InfoRequest::Freq)))
 	{
-		throw JtagExceptionWrapper(
-			"Failed to get infoReply",
-			"");
+		uint64_t freq;
+		DoInfoRequest(InfoRequest::Freq, &freq);
+		m_info->set_freq(freq);
+		m_infoValid |= (1 << InfoRequest::Freq);
 	}
-	return packet.inforeply().str();
+	return m_info->freq();
 }
 
-int ServerInterface::GetFrequency()
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Adapter sharing
+
+/**
+	@brief Checks whether the server lets us hold the adapter across requests until we call ReleaseAdapter()
+
+	Older servers may hand the adapter to another client between any two of our requests. Newer ones only take it away
+	if we said we're preemptible (see SetPreemptible() and MayHaveLostAdapter()); otherwise they tell us when someone
+	else is waiting for it (see IsAdapterWanted()) and leave it to us to release it.
+ */
+bool ServerInterface::IsAdapterReleaseSupported()
 {
-	//Send the infoRequest
-	JtaghalPacket packet;
-	auto r = packet.mutable_inforequest();
-	r->set_req(InfoRequest::Freq);
-	if(!SendMessage(m_socket, packet))
+	return m_serverSentInfo && m_info->adapterrelease();
+}
+
+/**
+	@brief Lets other clients sharing the adapter have a turn
+
+	The server keeps the adapter for us from our first request until we release it or disconnect, so long-running
+	clients should call this between logical operations (e.g. after programming a device, or each time through a
+	polling loop). Our next request waits until the adapter is free again.
+
+	The TAP must be idle and nothing may be left half-done (for example split scan reads) when this is called.
+	Derived classes discard anything they have cached about the chain or target, since it may have changed by the
+	time we get the adapter back.
+
+	Does nothing (other than the cache invalidation) if the server doesn't support it.
+
+	Nothing is in flight at this point, so it's also where we re-measure the link every so often (see
+	MaybeProbeLink()), rather than stalling a pipeline of scans to do it.
+ */
+void ServerInterface::ReleaseAdapter()
+{
+	m_adapterWanted = false;
+	if(IsAdapterReleaseSupported())
 	{
-		throw JtagExceptionWrapper(
-			"Failed to send infoRequest",
-			"");
+		JtaghalPacket packet;
+		packet.mutable_adapterrelease();
+		if(!SendMessage(packet) || !FlushTx())
+		{
+			throw JtagExceptionWrapper(
+				"Failed to send adapterRelease",
+				"");
+		}
 	}
 
-	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kInfoReply))
+	MaybeProbeLink();
+}
+
+/**
+	@brief Checks if we've been quiet long enough that the server may have handed the adapter to another client
+
+	Never true unless we're preemptible (see SetPreemptible()). The server only takes the adapter from a preemptible
+	client once it has had nothing queued for AdapterInfo.ownerIdleTimeout, and its clock can't start before our last
+	send got there. Half the timeout, less a round trip for anything still queued ahead of us, is safe. It tells us
+	when it happens (see OnAdapterLost()), but not until our next receive, by which time we may already have sent
+	requests based on what we had cached. Callers drop their caches when this returns true, and it then returns false
+	until we've been quiet for that long again.
+ */
+bool ServerInterface::MayHaveLostAdapter()
+{
+	if(!m_preemptible || !m_serverSentInfo || (m_info->owneridletimeout() == 0) )
+		return false;
+
+	double now = GetTime();
+	if(now - m_lastActivity < m_info->owneridletimeout() * 0.5e-6 - m_rtt)
+		return false;
+
+	m_lastActivity = now;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Link measurement and batching policy
+
+/**
+	@brief Measures the round trip time to the server, and how long it takes to execute our requests
+
+	The fastest of a few pings is used as the round trip time, since anything slower was delayed by something other
+	than the link. Server-side execution time is averaged over all requests since the previous probe.
+
+	@return True if the link was measured, false if the server doesn't support pings
+ */
+bool ServerInterface::ProbeLink()
+{
+	if(!m_serverSentInfo || !m_info->ping())
+		return false;
+
+	//Nothing else can be in flight, or we'd be timing it too
+	FlushPendingReplies();
+	if(!FlushTx())
 	{
 		throw JtagExceptionWrapper(
-			"Failed to get infoReply",
+			"Failed to send requests",
 			"");
 	}
-	return packet.inforeply().num();
+
+	double best = -1;
+	uint64_t requests = 0;
+	uint64_t execns = 0;
+	for(int i=0; i<PROBE_PING_COUNT; i++)
+	{
+		JtaghalPacket packet;
+		packet.mutable_pingrequest()->set_cookie(++m_pingCookie);
+
+		double start = GetTime();
+		if(!SendMessage(packet))
+		{
+			throw JtagExceptionWrapper(
+				"Failed to send pingRequest",
+				"");
+		}
+		auto reply = RecvMessage(JtaghalPacket::kPingReply);
+		if(!reply || (reply->pingreply().cookie() != m_pingCookie) )
+		{
+			throw JtagExceptionWrapper(
+				"Failed to get pingReply",
+				"");
+		}
+		double dt = GetTime() - start;
+
+		if( (best < 0) || (dt < best) )
+			best = dt;
+		requests = reply->pingreply().requestcount();
+		execns = reply->pingreply().exectimens();
+	}
+	m_rtt = best;
+
+	//The first probe only sets the baseline, since connection setup isn't representative of normal requests
+	if( (m_lastProbe != 0) && (requests > m_probeRequests) )
+		m_serverRequestTime = (execns - m_probeExecNs) * 1e-9 / (requests - m_probeRequests);
+	m_probeRequests = requests;
+	m_probeExecNs = execns;
+	m_lastProbe = GetTime();
+
+	UpdateBatchPolicy();
+	return true;
+}
+
+/**
+	@brief Re-measures the link if it's been a while since we last did
+
+	Probing costs PROBE_PING_COUNT round trips and has to wait for every reply in flight first, so it's only done at
+	idle points (see ReleaseAdapter()), never from the scan path.
+ */
+void ServerInterface::MaybeProbeLink()
+{
+	if(GetTime() - m_lastProbe >= PROBE_INTERVAL)
+		ProbeLink();
 }
 
+/**
+	@brief Picks the transmit batch size based on the last link measurement
+
+	Requests that don't need a reply are held back until we have about one round trip's worth of server-side work
+	queued up. On a fast local link that means flushing every few requests, so the server never sits idle waiting for
+	us; on a slow link it means sending up to TX_BATCH_MAX_REQUESTS at once instead of paying per-packet overhead
+	for each. Anything that waits for a reply flushes the batch first, so this never adds latency to reads.
+ */
+void ServerInterface::UpdateBatchPolicy()
+{
+	//Don't trust execution times below a microsecond, they're mostly timer noise
+	double reqtime = m_serverRequestTime;
+	if(reqtime < 1e-6)
+		reqtime = 1e-6;
+
+	double limit = m_rtt / reqtime;
+	if(limit < 1)
+		m_txBatchLimit = 1;
+	else if(limit > TX_BATCH_MAX_REQUESTS)
+		m_txBatchLimit = TX_BATCH_MAX_REQUESTS;
+	else
+		m_txBatchLimit = limit;
+
+	LogTrace("Link RTT %.1f us, server time %.2f us/request, batching up to %zu requests\n",
+		m_rtt * 1e6, m_serverRequestTime * 1e6, m_txBatchLimit);
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // GPIO stuff
@@ -306,10 +1185,13 @@ int ServerInterface::GetFrequency()
  */
 bool ServerInterface::IsGPIOCapable()
 {
+	if(m_serverSentInfo)
+		return (m_info->gpiostate().states_size() != 0);
+
 	//Send the gpioReadRequest
 	JtaghalPacket packet;
 	packet.mutable_gpioreadrequest();
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send gpioReadRequest",
@@ -317,13 +1199,14 @@ bool ServerInterface::IsGPIOCapable()
 	}
 
 	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kBankState))
+	auto reply = RecvMessage(JtaghalPacket::kBankState);
+	if(!reply)
 	{
 		throw JtagExceptionWrapper(
 			"Failed to get bankState",
 			"");
 	}
-	auto state = packet.bankstate();
+	auto& state = reply->bankstate();
 	if(state.states_size() != 0)
 		return true;
 	else
@@ -335,7 +1218,7 @@ void ServerInterface::ReadGpioState()
 	//Send the gpioReadRequest
 	JtaghalPacket packet;
 	packet.mutable_gpioreadrequest();
-	if(!SendMessage(m_socket, packet))
+	if(!SendMessage(packet))
 	{
 		throw JtagExceptionWrapper(
 			"Failed to send gpioReadRequest",
@@ -343,14 +1226,21 @@ void ServerInterface::ReadGpioState()
 	}
 
 	//Get the reply
-	if(!RecvMessage(m_socket, packet, JtaghalPacket::kBankState))
+	auto reply = RecvMessage(JtaghalPacket::kBankState);
+	if(!reply)
 	{
 		throw JtagExceptionWrapper(
 			"Failed to get bankState",
 			"");
 	}
-	auto state = packet.bankstate();
+	LoadGpioState(reply->bankstate());
+}
 
+/**
+	@brief Updates our cached GPIO state from a GpioBankState sent by the server
+ */
+void ServerInterface::LoadGpioState(const GpioBankState& state)
+{
 	//Enlarge our GPIO state buffer as needed
 	m_gpioDirection.resize(state.states_size());
 	m_gpioValue.resize(state.states_size());
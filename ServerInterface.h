@@ -35,10 +35,28 @@
 #ifndef ServerInterface_h
 #define ServerInterface_h
 
+class JtaghalPacket;
+class JtagScanRequest;
+class AdapterInfo;
+class GpioBankState;
+class JtaghalShm;
+class JtaghalMux;
+
+namespace google
+{
+	namespace protobuf
+	{
+		class Arena;
+	}
+}
+
 /**
 	@brief Transport-agnostic code for talking to a jtagd instance
 
 	Contains logic for GPIO, querying adapter information, etc
+
+	A server may export several adapters, each on its own channel. Each ServerInterface talks to one channel; several
+	of them may share a connection (see DoConnectChannel()).
  */
 class ServerInterface : public GPIOInterface
 {
@@ -60,12 +78,189 @@ public:
 	virtual void WriteGpioState();
 	bool IsGPIOCapable();
 
-protected:
-	/// @brief The TCP socket used for communication with the server
-	Socket m_socket;
+	//Client-side performance counters
+	size_t GetBytesSent()
+	{ return m_perfBytesSent; }
+
+	size_t GetBytesReceived()
+	{ return m_perfBytesReceived; }
+
+	size_t GetBytesCopied()
+	{ return m_perfBytesCopied; }
+
+	/// @brief Round trip time to the server as of the last link probe, in seconds (0 if never measured)
+	double GetRoundTripTime()
+	{ return m_rtt; }
+
+	/// @brief Average server-side execution time of our requests as of the last link probe, in seconds
+	double GetServerRequestTime()
+	{ return m_serverRequestTime; }
+
+	/// @brief Maximum number of requests currently held back before sending them as one batch
+	size_t GetTxBatchLimit()
+	{ return m_txBatchLimit; }
+
+	/// @brief Number of batches sent to the server
+	size_t GetTxFlushCount()
+	{ return m_perfTxFlushes; }
+
+	/// @brief Number of requests sent to the server (divide by GetTxFlushCount() for the average batch size)
+	size_t GetTxRequestCount()
+	{ return m_perfTxRequests; }
+
+	bool ProbeLink();
+
+	/// @brief Gets the channel (adapter index on the server) we're talking to
+	uint32_t GetChannel()
+	{ return m_channel; }
+
+	size_t GetChannelCount();
+
+	//Sharing the adapter with other clients
+	bool IsAdapterReleaseSupported();
+	virtual void ReleaseAdapter();
+	bool MayHaveLostAdapter();
+
+	/**
+		@brief Lets the server take the adapter away from us while someone else is waiting, rather than wait for us to
+		release it. Must be called before connecting.
+	 */
+	void SetPreemptible(bool preemptible)
+	{ m_preemptible = preemptible; }
+
+	/// @brief Checks if the server told us another client is waiting for the adapter since we last released it
+	bool IsAdapterWanted()
+	{ return m_adapterWanted; }
 
 protected:
 	void DoConnect(const std::string& server, uint16_t port, int transport);
+	void DoConnectChannel(ServerInterface& peer, uint32_t channel, int transport);
+	void ConnectUnix(const std::string& path);
+	void Handshake(int transport);
+	void AttachSharedMemory();
+
+	std::string DoInfoRequest(int req, uint64_t* num = NULL);
+	void LoadGpioState(const GpioBankState& state);
+
+	/**
+		@brief Adapter metadata and capabilities from the ServerHello, or NULL if the server is too old to send them
+	 */
+	const AdapterInfo* GetServerInfo()
+	{ return m_serverSentInfo ? m_info : NULL; }
+
+	//Message I/O
+	uint8_t* AppendFrame(uint32_t len, uint32_t extra = 0);
+	bool SendMessage(const JtaghalPacket& msg);
+	bool SendScanRequest(const JtagScanRequest& req, const unsigned char* data, size_t len);
+	JtaghalPacket* RecvMessage();
+	JtaghalPacket* RecvMessage(int expectedType);
+	bool RecvScanReply(unsigned char* rcv_data, size_t len);
+	bool OnRequestQueued();
+	bool FlushTx(const unsigned char* data = NULL, size_t len = 0);
+
+	void MaybeProbeLink();
+	void UpdateBatchPolicy();
+
+	bool RecvFrame();
+	bool IsPayloadFrame(int field);
+
+	/**
+		@brief Called when the server tells us it gave the adapter to another client while we were idle
+
+		May be called from inside any receive, so derived classes must only drop cached state here, not do any I/O.
+	 */
+	virtual void OnAdapterLost()
+	{}
+
+	/**
+		@brief Called before waiting for a non-scan reply, so derived classes can first collect any scan replies
+		they have requested but not yet consumed.
+	 */
+	virtual void FlushPendingReplies()
+	{}
+
+	/// @brief The connection to the server (possibly shared with interfaces for other channels), NULL until we connect
+	std::shared_ptr<JtaghalMux> m_mux;
+
+	/// @brief The channel we're talking to
+	uint32_t m_channel;
+
+	/// @brief Size of the channel field at the start of each message we send (0 on channel 0)
+	uint32_t m_channelHeaderLen;
+
+	/// @brief Outbound messages (length header and protobuf) that have not been sent yet
+	std::string m_txBuffer;
+
+	/// @brief Number of requests in m_txBuffer
+	size_t m_txPending;
+
+	/// @brief Send m_txBuffer once it holds this many requests (see UpdateBatchPolicy())
+	size_t m_txBatchLimit;
+
+	/// @brief Cookie of the last pingRequest we sent
+	uint64_t m_pingCookie;
+
+	/// @brief Round trip time measured by the last link probe, in seconds
+	double m_rtt;
+
+	/// @brief Average server-side execution time per request measured by the last link probe, in seconds
+	double m_serverRequestTime;
+
+	/// @brief Timestamp of the last link probe
+	double m_lastProbe;
+
+	/// @brief Server's request count and total execution time for our session as of the last link probe
+	uint64_t m_probeRequests;
+	uint64_t m_probeExecNs;
+
+	/// @brief True if the server may take the adapter away from us without waiting for a release
+	bool m_preemptible;
+
+	/// @brief True if the server sent an adapterWanted since we last released the adapter
+	bool m_adapterWanted;
+
+	/// @brief Last time the server can't have taken the adapter away from us yet: when we last sent anything, or
+	/// last dropped our caches (see MayHaveLostAdapter())
+	double m_lastActivity;
+
+	/// @brief Reusable buffer for the inbound message currently being processed
+	std::vector<uint8_t> m_rxBuffer;
+
+	/// @brief Length of the message in m_rxBuffer
+	size_t m_rxLen;
+
+	/// @brief Initial block for m_rxArena, reused across messages
+	char* m_rxArenaBlock;
+
+	/// @brief Arena that inbound messages are parsed into. Reset before each message.
+	google::protobuf::Arena* m_rxArena;
+
+	/// @brief Shared memory rings for scan data (shm: connections only)
+	JtaghalShm* m_shm;
+
+	/// @brief Cached adapter metadata (from the ServerHello, or filled in one query at a time for older servers)
+	AdapterInfo* m_info;
+
+	/// @brief True if m_info was sent in full by the server
+	bool m_serverSentInfo;
+
+	/// @brief Bitmask of (1 << InfoRequest::InfoType) for fields of m_info that are valid
+	uint32_t m_infoValid;
+
+	/// @brief Number of bytes sent to the server, including framing
+	size_t m_perfBytesSent;
+
+	/// @brief Number of bytes received from the server, including framing
+	size_t m_perfBytesReceived;
+
+	/// @brief Number of bytes copied in userspace (serialization, parsing, and extraction of scan data)
+	size_t m_perfBytesCopied;
+
+	/// @brief Number of batches sent
+	size_t m_perfTxFlushes;
+
+	/// @brief Number of requests sent
+	size_t m_perfTxRequests;
 };
 
 #endif
@@ -0,0 +1,331 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SparseFirmwareImage
+ */
+
+#include "jtaghal.h"
+#include "SparseFirmwareImage.h"
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Initializes this object to empty
+ */
+SparseFirmwareImage::SparseFirmwareImage()
+	: m_map(NULL)
+	, m_mapLen(0)
+{
+}
+
+SparseFirmwareImage::~SparseFirmwareImage()
+{
+	UnmapFile();
+}
+
+/**
+	@brief Parses an in-memory firmware image, if it's in a format we know
+
+	The data is copied, so the buffer can be freed once this returns.
+
+	@return The image, or NULL if the data isn't ELF, Intel HEX or S-records (e.g. it's a raw binary)
+ */
+SparseFirmwareImage* SparseFirmwareImage::Create(const unsigned char* data, size_t len)
+{
+	if(ELFFirmwareImage::Detect(data, len))
+		return new ELFFirmwareImage(data, len);
+	if(IntelHexFirmwareImage::Detect(data, len))
+		return new IntelHexFirmwareImage(data, len);
+	if(SRecordFirmwareImage::Detect(data, len))
+		return new SRecordFirmwareImage(data, len);
+	return NULL;
+}
+
+/**
+	@brief Loads a firmware image from a file, if it's in a format we know
+
+	@return The image, or NULL if the file isn't ELF, Intel HEX or S-records (e.g. it's a raw binary)
+ */
+SparseFirmwareImage* SparseFirmwareImage::Create(string fname)
+{
+	//Only need the first few bytes to figure out the format
+	FILE* fp = fopen(fname.c_str(), "rb");
+	if(!fp)
+	{
+		throw JtagExceptionWrapper(
+			string("Failed to open firmware image ") + fname,
+			"");
+	}
+	unsigned char head[16];
+	size_t len = fread(head, 1, sizeof(head), fp);
+	fclose(fp);
+
+	if(ELFFirmwareImage::Detect(head, len))
+		return new ELFFirmwareImage(fname);
+	if(IntelHexFirmwareImage::Detect(head, len))
+		return new IntelHexFirmwareImage(fname);
+	if(SRecordFirmwareImage::Detect(head, len))
+		return new SRecordFirmwareImage(fname);
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Gets the total number of bytes in all segments
+ */
+size_t SparseFirmwareImage::GetSize()
+{
+	size_t size = 0;
+	for(auto& s : m_segments)
+		size += s.len;
+	return size;
+}
+
+string SparseFirmwareImage::GetDescription()
+{
+	char retval[1024];
+	if(m_srcfname.empty())
+	{
+		snprintf(retval, sizeof(retval), "%s firmware (%zu segments, %zu bytes)",
+			m_format.c_str(), m_segments.size(), GetSize());
+	}
+	else
+	{
+		snprintf(retval, sizeof(retval), "%s firmware \"%s\" (%zu segments, %zu bytes)",
+			m_format.c_str(), m_srcfname.c_str(), m_segments.size(), GetSize());
+	}
+	return retval;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Loading helpers
+
+/**
+	@brief Maps a file into memory (read only) as m_map
+
+	On Windows the file is just read into a buffer.
+ */
+void SparseFirmwareImage::MapFile(string fname)
+{
+	m_srcfname = fname;
+
+#ifdef _WIN32
+	FILE* fp = fopen(fname.c_str(), "rb");
+	if(!fp)
+	{
+		throw JtagExceptionWrapper(
+			string("Failed to open firmware image ") + fname,
+			"");
+	}
+	fseek(fp, 0, SEEK_END);
+	m_mapLen = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	m_map = new uint8_t[m_mapLen];
+	if(m_mapLen != fread(m_map, 1, m_mapLen, fp))
+	{
+		fclose(fp);
+		UnmapFile();
+		throw JtagExceptionWrapper(
+			"Failed to read firmware image",
+			"");
+	}
+	fclose(fp);
+#else
+	int fd = open(fname.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		throw JtagExceptionWrapper(
+			string("Failed to open firmware image ") + fname,
+			"");
+	}
+
+	struct stat st;
+	if(0 != fstat(fd, &st))
+	{
+		close(fd);
+		throw JtagExceptionWrapper(
+			"Failed to stat firmware image",
+			"");
+	}
+
+	//Can't map an empty file, but there's nothing in it anyway
+	m_mapLen = st.st_size;
+	if(m_mapLen != 0)
+	{
+		void* p = mmap(NULL, m_mapLen, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(p == MAP_FAILED)
+		{
+			close(fd);
+			m_mapLen = 0;
+			throw JtagExceptionWrapper(
+				"Failed to map firmware image",
+				"");
+		}
+		m_map = static_cast<uint8_t*>(p);
+	}
+	close(fd);
+#endif
+}
+
+/**
+	@brief Releases the file mapping (segments must not point into it any more)
+ */
+void SparseFirmwareImage::UnmapFile()
+{
+	if(!m_map)
+		return;
+
+#ifdef _WIN32
+	delete[] m_map;
+#else
+	munmap(m_map, m_mapLen);
+#endif
+
+	m_map = NULL;
+	m_mapLen = 0;
+}
+
+/**
+	@brief Adds a segment
+
+	If the data is inside the file mapping the segment just points to it, otherwise it's copied.
+ */
+void SparseFirmwareImage::AddSegment(uint32_t address, const uint8_t* data, size_t len)
+{
+	if(len == 0)
+		return;
+
+	if( (m_map != NULL) && (data >= m_map) && (data + len <= m_map + m_mapLen) )
+	{
+		if(address + (uint64_t)len > 0x100000000ULL)
+		{
+			throw JtagExceptionWrapper(
+				"Firmware image segment runs past the end of the address space",
+				"");
+		}
+
+		Segment s = {address, len, data};
+		m_segments.push_back(s);
+	}
+	else
+	{
+		vector<uint8_t> copy(data, data + len);
+		AddSegment(address, copy);
+	}
+}
+
+/**
+	@brief Adds a segment, taking ownership of the data (the vector is left empty)
+ */
+void SparseFirmwareImage::AddSegment(uint32_t address, vector<uint8_t>& data)
+{
+	if(data.empty())
+		return;
+
+	if(address + (uint64_t)data.size() > 0x100000000ULL)
+	{
+		throw JtagExceptionWrapper(
+			"Firmware image segment runs past the end of the address space",
+			"");
+	}
+
+	m_buffers.push_back(vector<uint8_t>());
+	m_buffers.back().swap(data);
+
+	auto& buf = m_buffers.back();
+	Segment s = {address, buf.size(), &buf[0]};
+	m_segments.push_back(s);
+}
+
+/**
+	@brief Sorts the segments by address once loading is done, and makes sure none of them overlap
+ */
+void SparseFirmwareImage::SortSegments()
+{
+	sort(m_segments.begin(), m_segments.end(),
+		[](const Segment& a, const Segment& b) { return a.address < b.address; });
+
+	for(size_t i=1; i<m_segments.size(); i++)
+	{
+		auto& prev = m_segments[i-1];
+		if(prev.address + (uint64_t)prev.len > m_segments[i].address)
+		{
+			throw JtagExceptionWrapper(
+				"Firmware image has overlapping segments",
+				"");
+		}
+	}
+}
+
+/**
+	@brief Decodes a string of hex digit pairs (as used by the Intel HEX and S-record formats)
+
+	@return False if there's an odd number of digits or anything that isn't a hex digit
+ */
+bool SparseFirmwareImage::DecodeHex(const uint8_t* text, size_t len, vector<uint8_t>& bytes)
+{
+	bytes.clear();
+	if(len & 1)
+		return false;
+
+	for(size_t i=0; i<len; i+=2)
+	{
+		uint8_t b = 0;
+		for(size_t j=0; j<2; j++)
+		{
+			char c = text[i+j];
+			b <<= 4;
+			if( (c >= '0') && (c <= '9') )
+				b |= c - '0';
+			else if( (c >= 'a') && (c <= 'f') )
+				b |= c - 'a' + 10;
+			else if( (c >= 'A') && (c <= 'F') )
+				b |= c - 'A' + 10;
+			else
+				return false;
+		}
+		bytes.push_back(b);
+	}
+	return true;
+}
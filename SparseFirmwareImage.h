@@ -0,0 +1,116 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SparseFirmwareImage
+ */
+
+#ifndef SparseFirmwareImage_h
+#define SparseFirmwareImage_h
+
+#include <list>
+#include <string>
+#include <vector>
+
+/**
+	@brief Firmware image made up of blocks of data at arbitrary addresses, with holes between them
+
+	Unlike a ByteArrayFirmwareImage, anything not covered by a segment is left alone by the programmer rather than
+	being written with filler. Segments are sorted by address and never overlap.
+
+	When an image is loaded from a file, the file is memory mapped. Formats that store the data verbatim (ELF) point
+	their segments straight into the mapping; text formats (Intel HEX, S-records) decode into buffers owned by the
+	image and release the mapping once they're done.
+
+	\ingroup libjtaghal
+ */
+class SparseFirmwareImage : public FirmwareImage
+{
+public:
+	SparseFirmwareImage();
+	virtual ~SparseFirmwareImage();
+
+	/**
+		@brief One contiguous block of data
+	 */
+	struct Segment
+	{
+		///Target address of the first byte
+		uint32_t		address;
+
+		///Length, in bytes
+		size_t			len;
+
+		///The data (owned by the image)
+		const uint8_t*	data;
+	};
+
+	///Gets the segments, sorted by address
+	const std::vector<Segment>& GetSegments()
+	{ return m_segments; }
+
+	size_t GetSize();
+
+	static SparseFirmwareImage* Create(const unsigned char* data, size_t len);
+	static SparseFirmwareImage* Create(std::string fname);
+
+	virtual std::string GetDescription();
+
+protected:
+	void MapFile(std::string fname);
+	void UnmapFile();
+
+	void AddSegment(uint32_t address, const uint8_t* data, size_t len);
+	void AddSegment(uint32_t address, std::vector<uint8_t>& data);
+	void SortSegments();
+
+	static bool DecodeHex(const uint8_t* text, size_t len, std::vector<uint8_t>& bytes);
+
+	///The segments
+	std::vector<Segment> m_segments;
+
+	///Storage for segment data that isn't in the mapping (a list so pointers into it stay valid)
+	std::list< std::vector<uint8_t> > m_buffers;
+
+	///Memory mapped contents of the source file, or NULL
+	uint8_t* m_map;
+
+	///Size of m_map
+	size_t m_mapLen;
+
+	///Source file name (empty if loaded from memory)
+	std::string m_srcfname;
+
+	///Human-readable name of the file format
+	std::string m_format;
+};
+
+#endif
@@ -0,0 +1,364 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of TargetMemoryCache
+ */
+
+#include "jtaghal.h"
+#include "TargetMemoryCache.h"
+
+using namespace std;
+
+///Size of a cache page, in bytes (matches the 1 KB TAR auto-increment range of an ARM MEM-AP)
+#define CACHE_PAGE_SIZE 1024
+
+///Maximum number of pages to hold before evicting the least recently used one
+#define CACHE_MAX_PAGES 256
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a cache
+
+	@param iface		The interface to cache accesses to
+	@param writeBack	True to hold writes in the cache until Flush(), false to write them through immediately
+ */
+TargetMemoryCache::TargetMemoryCache(DebuggerInterface* iface, bool writeBack)
+	: m_iface(iface)
+	, m_writeBack(writeBack)
+	, m_useCounter(0)
+	, m_hits(0)
+	, m_misses(0)
+	, m_uncached(0)
+	, m_writebacks(0)
+{
+
+}
+
+/**
+	@brief Destroys the cache.
+
+	Dirty pages are NOT written back, since the interface may already be partly torn down by now. Call Flush() first.
+ */
+TargetMemoryCache::~TargetMemoryCache()
+{
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory access
+
+uint32_t TargetMemoryCache::ReadWord(uint32_t addr)
+{
+	//Uncacheable words get exactly one bus access, same as without the cache
+	if( ( (addr & 3) == 0) && !IsCacheable(addr) )
+	{
+		m_uncached ++;
+		return m_iface->ReadMemory(addr);
+	}
+
+	uint32_t value;
+	ReadBytes(addr, reinterpret_cast<uint8_t*>(&value), 4);
+	return value;
+}
+
+void TargetMemoryCache::WriteWord(uint32_t addr, uint32_t value)
+{
+	if( ( (addr & 3) == 0) && !IsCacheable(addr) )
+	{
+		m_uncached ++;
+		m_iface->WriteMemory(addr, value);
+		return;
+	}
+
+	WriteBytes(addr, reinterpret_cast<const uint8_t*>(&value), 4);
+}
+
+/**
+	@brief Reads a range of bytes, from the cache if possible
+
+	@param addr			Address of the first byte
+	@param data			Output buffer
+	@param len			Number of bytes to read
+	@param maxWidth		Widest access to use for any part of the range that bypasses the cache
+						(see DebuggerInterface::ReadMemoryBytes())
+ */
+void TargetMemoryCache::ReadBytes(uint32_t addr, uint8_t* data, size_t len, unsigned int maxWidth)
+{
+	while(len > 0)
+	{
+		uint32_t base = addr & ~(CACHE_PAGE_SIZE - 1);
+		uint32_t off = addr - base;
+		size_t n = min(len, (size_t)(CACHE_PAGE_SIZE - off));
+
+		Page* page = GetPage(base);
+		if(page)
+			memcpy(data, &page->data[off], n);
+		else
+		{
+			m_uncached ++;
+			m_iface->ReadMemoryBytes(addr, data, n, maxWidth);
+		}
+
+		addr += n;
+		data += n;
+		len -= n;
+	}
+}
+
+/**
+	@brief Writes a range of bytes
+
+	In write-through mode the data goes straight to the target, and any cached copy is updated to match. In write-back
+	mode the page is pulled into the cache (if it isn't there already) and the write is held until Flush().
+
+	@param addr			Address of the first byte
+	@param data			Data to write
+	@param len			Number of bytes to write
+	@param maxWidth		Widest access to use when writing to the target
+ */
+void TargetMemoryCache::WriteBytes(uint32_t addr, const uint8_t* data, size_t len, unsigned int maxWidth)
+{
+	while(len > 0)
+	{
+		uint32_t base = addr & ~(CACHE_PAGE_SIZE - 1);
+		uint32_t off = addr - base;
+		size_t n = min(len, (size_t)(CACHE_PAGE_SIZE - off));
+
+		Page* page = m_writeBack ? GetPage(base) : NULL;
+		if(page)
+		{
+			memcpy(&page->data[off], data, n);
+			if(page->dirty)
+			{
+				page->dirtyStart = min(page->dirtyStart, off);
+				page->dirtyEnd = max(page->dirtyEnd, (uint32_t)(off + n));
+			}
+			else
+			{
+				page->dirty = true;
+				page->dirtyStart = off;
+				page->dirtyEnd = off + n;
+			}
+		}
+
+		else
+		{
+			if(!IsCacheable(addr))
+				m_uncached ++;
+
+			//If the write fails partway through, we no longer know what's in the page
+			try
+			{
+				m_iface->WriteMemoryBytes(addr, data, n, maxWidth);
+			}
+			catch(const JtagException& e)
+			{
+				m_pages.erase(base);
+				throw;
+			}
+
+			auto it = m_pages.find(base);
+			if(it != m_pages.end())
+				memcpy(&it->second.data[off], data, n);
+		}
+
+		addr += n;
+		data += n;
+		len -= n;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cache management
+
+/**
+	@brief Finds a page in the cache, filling it from the target on a miss
+
+	@return The page, or NULL if it can't be cached (uncacheable, or the block read failed)
+ */
+TargetMemoryCache::Page* TargetMemoryCache::GetPage(uint32_t base)
+{
+	if(!IsCacheable(base))
+		return NULL;
+
+	auto it = m_pages.find(base);
+	if(it != m_pages.end())
+	{
+		m_hits ++;
+		it->second.lastUse = ++m_useCounter;
+		return &it->second;
+	}
+
+	//Miss: fetch the whole page in one go
+	vector<uint32_t> words(CACHE_PAGE_SIZE / 4);
+	try
+	{
+		m_iface->ReadMemoryBlock(base, &words[0], words.size());
+	}
+	catch(const JtagException& e)
+	{
+		LogDebug("Couldn't fill cache page at 0x%08x, accessing it uncached\n", base);
+		return NULL;
+	}
+	m_misses ++;
+
+	if(m_pages.size() >= CACHE_MAX_PAGES)
+		Evict();
+
+	Page& page = m_pages[base];
+	page.data.resize(CACHE_PAGE_SIZE);
+	memcpy(&page.data[0], &words[0], CACHE_PAGE_SIZE);
+	page.lastUse = ++m_useCounter;
+	page.dirty = false;
+	page.dirtyStart = 0;
+	page.dirtyEnd = 0;
+	return &page;
+}
+
+/**
+	@brief Writes the dirty part of a page back to the target
+ */
+void TargetMemoryCache::WriteBack(uint32_t base, Page& page)
+{
+	if(!page.dirty)
+		return;
+
+	m_iface->WriteMemoryBytes(base + page.dirtyStart, &page.data[page.dirtyStart], page.dirtyEnd - page.dirtyStart);
+	page.dirty = false;
+	m_writebacks ++;
+}
+
+/**
+	@brief Drops the least recently used page, writing it back first if needed
+ */
+void TargetMemoryCache::Evict()
+{
+	auto victim = m_pages.begin();
+	for(auto it = m_pages.begin(); it != m_pages.end(); it++)
+	{
+		if(it->second.lastUse < victim->second.lastUse)
+			victim = it;
+	}
+
+	WriteBack(victim->first, victim->second);
+	m_pages.erase(victim);
+}
+
+/**
+	@brief Writes all dirty pages back to the target, but keeps them cached
+ */
+void TargetMemoryCache::Flush()
+{
+	for(auto& it : m_pages)
+		WriteBack(it.first, it.second);
+}
+
+/**
+	@brief Writes back all dirty pages, then forgets everything.
+
+	Must be called before anything that can change target memory behind our back (resuming or stepping the CPU,
+	resetting it, flash programming...)
+ */
+void TargetMemoryCache::Invalidate()
+{
+	Flush();
+	m_pages.clear();
+}
+
+/**
+	@brief Forgets every page with nothing waiting to be written back, without touching the target
+
+	For when target memory may have changed behind our back but we've already written back anything we care about
+	(or can't do I/O right now). Dirty pages are kept, so their writes still go out at the next Flush().
+ */
+void TargetMemoryCache::DiscardClean()
+{
+	for(auto it = m_pages.begin(); it != m_pages.end(); )
+	{
+		if(it->second.dirty)
+			it++;
+		else
+			it = m_pages.erase(it);
+	}
+}
+
+/**
+	@brief Marks a range of addresses as uncacheable (e.g. peripherals with side effects on read)
+
+	Caching is done a page at a time, so any page overlapping the region is uncacheable too.
+ */
+void TargetMemoryCache::AddUncacheableRegion(uint32_t base, uint32_t size)
+{
+	m_uncacheable.push_back(pair<uint32_t, uint32_t>(base, size));
+
+	//Drop anything we already cached there
+	for(auto it = m_pages.begin(); it != m_pages.end(); )
+	{
+		if(!IsCacheable(it->first))
+		{
+			WriteBack(it->first, it->second);
+			it = m_pages.erase(it);
+		}
+		else
+			it++;
+	}
+}
+
+/**
+	@brief Checks if the page containing an address may be cached
+ */
+bool TargetMemoryCache::IsCacheable(uint32_t addr)
+{
+	uint64_t pstart = addr & ~(CACHE_PAGE_SIZE - 1);
+	uint64_t pend = pstart + CACHE_PAGE_SIZE;
+	for(auto r : m_uncacheable)
+	{
+		uint64_t rstart = r.first;
+		uint64_t rend = rstart + r.second;
+		if( (rstart < pend) && (pstart < rend) )
+			return false;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+void TargetMemoryCache::ResetStats()
+{
+	m_hits = 0;
+	m_misses = 0;
+	m_uncached = 0;
+	m_writebacks = 0;
+}
@@ -0,0 +1,153 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of TargetMemoryCache
+ */
+
+#ifndef TargetMemoryCache_h
+#define TargetMemoryCache_h
+
+class DebuggerInterface;
+
+/**
+	@brief Page-granular cache of target memory, for use while the target is halted
+
+	Debugger front ends (register views, stack unwinders, watches) tend to read the same words over and over while the
+	CPU is stopped. The cache sits between DebuggableDevice and the DebuggerInterface: misses fill a whole page with a
+	block read, and later accesses to that page are served from host memory.
+
+	Writes are either passed straight through (updating any cached copy), or held in the cache until Flush() is
+	called (write-back). Regions with side effects on read (peripherals) can be excluded with AddUncacheableRegion().
+
+	The cache knows nothing about the target running, so whoever resumes, steps or resets the CPU must call
+	Invalidate() first. DebuggableDevice does this for the CPU classes in the tree.
+
+	\ingroup libjtaghal
+ */
+class TargetMemoryCache
+{
+public:
+	TargetMemoryCache(DebuggerInterface* iface, bool writeBack = false);
+	virtual ~TargetMemoryCache();
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Memory access
+
+	uint32_t ReadWord(uint32_t addr);
+	void WriteWord(uint32_t addr, uint32_t value);
+
+	void ReadBytes(uint32_t addr, uint8_t* data, size_t len, unsigned int maxWidth = 4);
+	void WriteBytes(uint32_t addr, const uint8_t* data, size_t len, unsigned int maxWidth = 4);
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Cache management
+
+	void Flush();
+	void Invalidate();
+	void DiscardClean();
+
+	void AddUncacheableRegion(uint32_t base, uint32_t size);
+	bool IsCacheable(uint32_t addr);
+
+	bool IsWriteBack()
+	{ return m_writeBack; }
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Statistics
+
+	///Number of page lookups that found the page already cached
+	size_t GetHitCount()
+	{ return m_hits; }
+
+	///Number of page lookups that had to fill the page from the target
+	size_t GetMissCount()
+	{ return m_misses; }
+
+	///Number of accesses that bypassed the cache (uncacheable regions, or pages that couldn't be filled)
+	size_t GetUncachedCount()
+	{ return m_uncached; }
+
+	///Number of dirty pages written back to the target
+	size_t GetWritebackCount()
+	{ return m_writebacks; }
+
+	void ResetStats();
+
+protected:
+
+	/**
+		@brief One cached page of target memory
+	 */
+	struct Page
+	{
+		///Contents of the page
+		std::vector<uint8_t> data;
+
+		///Value of m_useCounter at the last access (for LRU eviction)
+		uint64_t lastUse;
+
+		///True if the page contains data not yet written to the target
+		bool dirty;
+
+		///Offset of the first dirty byte
+		uint32_t dirtyStart;
+
+		///Offset after the last dirty byte
+		uint32_t dirtyEnd;
+	};
+
+	Page* GetPage(uint32_t base);
+	void WriteBack(uint32_t base, Page& page);
+	void Evict();
+
+	///The interface we cache accesses to
+	DebuggerInterface* m_iface;
+
+	///True for write-back, false for write-through
+	bool m_writeBack;
+
+	///The cached pages, indexed by base address
+	std::map<uint32_t, Page> m_pages;
+
+	///Uncacheable regions (base, size)
+	std::vector< std::pair<uint32_t, uint32_t> > m_uncacheable;
+
+	///Incremented on every page access, to track LRU order
+	uint64_t m_useCounter;
+
+	size_t m_hits;
+	size_t m_misses;
+	size_t m_uncached;
+	size_t m_writebacks;
+};
+
+#endif
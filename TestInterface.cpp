@@ -68,6 +68,20 @@ void TestInterface::Commit()
 
 }
 
+/**
+	@brief Marks a natural stopping point (device programmed, end of a polling loop...) at which other clients
+	sharing the adapter may have a turn
+
+	No-op for local adapters. Networked adapters hand the adapter back to the server (see
+	ServerInterface::ReleaseAdapter()) and forget whatever they had cached about the chain.
+
+	@throw JtagException in case of error
+ */
+void TestInterface::ReleaseAdapter()
+{
+
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Accessors
 
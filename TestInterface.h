@@ -90,6 +90,7 @@ public:
 	virtual int GetFrequency() =0;
 
 	virtual void Commit();
+	virtual void ReleaseAdapter();
 
 	//Probing / enumeration of attached resources
 public:
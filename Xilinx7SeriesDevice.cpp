@@ -346,7 +346,7 @@ void Xilinx7SeriesDevice::Program(FirmwareImage* image)
 	//Send the bitstream to the FPGA
 	LogVerbose("Loading new bitstream...\n");
 	SetIR(INST_CFG_IN);
-	ScanDR(flipped_bitstream, NULL, xbit->raw_bitstream_len * 8);
+	ScanDRBulk(flipped_bitstream, xbit->raw_bitstream_len * 8);
 
 	//Start up the FPGA
 	SetIR(INST_JSTART);
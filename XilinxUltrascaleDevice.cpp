@@ -402,7 +402,7 @@ void XilinxUltrascaleDevice::Program(FirmwareImage* /*image*/)
 		//Need to toggle TMS at the end of the last block
 		bool last_block = (block_bytes == bytes_to_send);
 
-		m_iface->ShiftData(last_block, flipped_bitstream + bytes_sent, NULL, block_bytes * 8);
+		m_iface->ShiftDataBulk(last_block, flipped_bitstream + bytes_sent, block_bytes * 8);
 
 		LogDebug("Programming... 0x%08zx bytes sent, 0x%08zx bytes left\n",
 			bytes_sent, bytes_to_send);
@@ -0,0 +1,244 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2018 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Reference jtaghal-net server
+ */
+
+#include "../jtaghal.h"
+#include <signal.h>
+
+using namespace std;
+
+static void ShowUsage();
+static void OnQuit(int signal);
+
+/**
+	@brief Command-line settings for one adapter
+ */
+class AdapterConfig
+{
+public:
+	AdapterConfig()
+	: api("pipe")
+	, ndev(0)
+	{}
+
+	string api;
+	string serial;
+	string layout;
+	int ndev;
+};
+
+static TestInterface* OpenAdapter(const AdapterConfig& config, JtagInterface*& jtag, SWDInterface*& swd);
+
+///The server (global so the signal handler can stop it)
+static JtagdServer* g_server = NULL;
+
+int main(int argc, char* argv[])
+{
+	Severity console_verbosity = Severity::NOTICE;
+
+	//Each --api after the first starts another adapter; the other adapter options apply to the latest one
+	vector<AdapterConfig> configs(1);
+	bool sawapi = false;
+	uint16_t port = 2542;
+	string unixpath;
+
+	//Parse command-line arguments
+	for(int i=1; i<argc; i++)
+	{
+		string s(argv[i]);
+
+		if(ParseLoggerArguments(i, argc, argv, console_verbosity))
+			continue;
+
+		if( (s == "--help") || (s == "-h") )
+		{
+			ShowUsage();
+			return 0;
+		}
+		else if( (s == "--api") && (i+1 < argc) )
+		{
+			if(sawapi)
+				configs.push_back(AdapterConfig());
+			configs.back().api = argv[++i];
+			sawapi = true;
+		}
+		else if( (s == "--serial") && (i+1 < argc) )
+			configs.back().serial = argv[++i];
+		else if( (s == "--layout") && (i+1 < argc) )
+			configs.back().layout = argv[++i];
+#ifdef HAVE_DJTG
+		else if( (s == "--device") && (i+1 < argc) )
+			configs.back().ndev = atoi(argv[++i]);
+#endif
+		else if( (s == "--port") && (i+1 < argc) )
+			port = atoi(argv[++i]);
+		else if( (s == "--unix") && (i+1 < argc) )
+			unixpath = argv[++i];
+		else
+		{
+			fprintf(stderr, "Unrecognized command-line argument \"%s\", use --help\n", s.c_str());
+			return 1;
+		}
+	}
+
+	g_log_sinks.emplace(g_log_sinks.begin(), new ColoredSTDLogSink(console_verbosity));
+
+	vector<TestInterface*> ifaces;
+	try
+	{
+		//Open the adapters and export each on its own channel
+		for(size_t i=0; i<configs.size(); i++)
+		{
+			JtagInterface* jtag = NULL;
+			SWDInterface* swd = NULL;
+			TestInterface* iface = OpenAdapter(configs[i], jtag, swd);
+			if(!iface)
+				return 1;
+			ifaces.push_back(iface);
+
+			LogNotice("Exporting %s (serial %s, user ID %s) at %.2f MHz on channel %zu\n",
+				iface->GetName().c_str(),
+				iface->GetSerial().c_str(),
+				iface->GetUserID().c_str(),
+				iface->GetFrequency() / 1e6,
+				i);
+
+			if(i == 0)
+			{
+				if(jtag)
+					g_server = new JtagdServer(jtag);
+				else
+					g_server = new JtagdServer(swd);
+			}
+			else if(jtag)
+				g_server->AddAdapter(jtag);
+			else
+				g_server->AddAdapter(swd);
+		}
+
+		//Serve them
+		g_server->Listen(port);
+		if(!unixpath.empty())
+			g_server->ListenUnix(unixpath);
+
+		signal(SIGINT, OnQuit);
+		signal(SIGTERM, OnQuit);
+		signal(SIGPIPE, SIG_IGN);
+
+		double start = GetTime();
+		g_server->Run();
+		double dt = GetTime() - start;
+
+		LogNotice("Served %zu requests in %.3f s (%.3f s using the adapters, %zu owner switches)\n",
+			g_server->GetRequestCount(),
+			dt,
+			g_server->GetAdapterTime(),
+			g_server->GetOwnerSwitchCount());
+
+		delete g_server;
+		for(auto iface : ifaces)
+			delete iface;
+	}
+	catch(const JtagException& ex)
+	{
+		LogError("%s\n", ex.GetDescription().c_str());
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+	@brief Opens an adapter
+
+	@param config	Settings for the adapter
+	@param jtag		Set to the adapter if it's JTAG
+	@param swd		Set to the adapter if it's SWD
+
+	@return The adapter, or NULL if the API is not supported
+ */
+static TestInterface* OpenAdapter(const AdapterConfig& config, JtagInterface*& jtag, SWDInterface*& swd)
+{
+	const string& api = config.api;
+	if(api == "pipe")
+		jtag = new PipeJtagInterface;
+#ifdef HAVE_FTD2XX
+	else if(api == "ftdi")
+		jtag = new FTDIJtagInterface(config.serial, config.layout);
+	else if(api == "ftdi-swd")
+		swd = new FTDISWDInterface(config.serial, config.layout);
+#endif
+#ifdef HAVE_DJTG
+	else if(api == "djtg")
+		jtag = new DigilentJtagInterface(config.ndev);
+#endif
+#if HAVE_LIBUSB
+	else if(api == "glasgow")
+		swd = new GlasgowSWDInterface(config.serial);
+#endif
+	else
+	{
+		LogError("Unsupported API \"%s\"\n", api.c_str());
+		return NULL;
+	}
+
+	if(jtag)
+		return jtag;
+	return swd;
+}
+
+static void OnQuit(int /*signal*/)
+{
+	if(g_server)
+		g_server->Stop();
+}
+
+static void ShowUsage()
+{
+	printf(
+		"Usage: jtagd [options]\n"
+		"\n"
+		"    --api <api>        Adapter driver: pipe (simulation, default), ftdi, ftdi-swd, djtg, glasgow\n"
+		"    --serial <serial>  Serial number of the adapter (ftdi, ftdi-swd, glasgow)\n"
+		"    --layout <layout>  Pin layout of the adapter (ftdi, ftdi-swd)\n"
+		"    --device <index>   Index of the adapter (djtg)\n"
+		"    --port <port>      TCP port to listen on (default 2542)\n"
+		"    --unix <path>      Also listen on a Unix-domain socket, for unix:<path> and shm:<path> clients\n"
+		"\n"
+		"    Repeat --api (each followed by its own --serial, --layout or --device) to export several adapters.\n"
+		"    Each is a separate jtaghal-net channel, numbered from 0 in command-line order.\n"
+		"\n"
+		"    Standard logger arguments (--debug, --verbose, --quiet, etc) are also accepted\n"
+		);
+}
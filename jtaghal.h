@@ -73,7 +73,9 @@
 
 #include <list>
 #include <map>
+#include <memory>
 #include <string>
+#include <tuple>
 #include <vector>
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -112,8 +114,14 @@
 #include "FTDIJtagInterface.h"
 #include "FTDISWDInterface.h"
 #include "GlasgowSWDInterface.h"
+#ifndef _WIN32
+#include "JtaghalShm.h"
+#endif
+#include "JtaghalBlob.h"
+#include "JtaghalMux.h"
 #include "ServerInterface.h"
 #include "NetworkedJtagInterface.h"
+#include "NetworkedSWDInterface.h"
 #include "PipeJtagInterface.h"
 //#include "NocJtagInterface.h"
 
@@ -125,11 +133,18 @@
 #include "FirmwareImage.h"
 #include "ByteArrayFirmwareImage.h"
 #include "RawBinaryFirmwareImage.h"
+#include "SparseFirmwareImage.h"
+#include "ELFFirmwareImage.h"
+#include "IntelHexFirmwareImage.h"
+#include "SRecordFirmwareImage.h"
 #include "CPLDBitstream.h"
 #include "FPGABitstream.h"
 
 //Device classes
+#include "PollBackoff.h"
 #include "DebuggerInterface.h"
+#include "TargetMemoryCache.h"
+#include "RTTClient.h"
 #include "DebuggableDevice.h"
 #include "ProgrammableDevice.h"
 #include "ProgrammableLogicDevice.h"
@@ -150,6 +165,7 @@
 //Vendor device classes (and support stuff)
 #include "ARMDebugPort.h"
 #include "ARMJtagDebugPort.h"
+#include "ARMJtagDapOffload.h"
 #include "ARMDebugMemAccessPort.h"
 #include "ARMAPBDevice.h"
 #include "ARMCoreSightDevice.h"
@@ -157,6 +173,8 @@
 #include "ARMv7Processor.h"
 #include "ARMv8Processor.h"
 #include "ARMv7MProcessor.h"
+#include "ARMv7MProfiler.h"
+#include "ARMv7MFlashLoader.h"
 #include "ARMCortexA57.h"
 #include "ARMCortexA9.h"
 #include "ARMCortexM4.h"
@@ -182,6 +200,14 @@
 #include "DebuggableDevice.h"
 #include "DebuggerInterface.h"
 
+//Server side of jtaghal-net
+#ifdef __linux__
+#include "JtagdAdapter.h"
+#include "JtagdConnection.h"
+#include "JtagdSession.h"
+#include "JtagdServer.h"
+#endif
+
 //NoC classes (TODO move to antikernel repo or something?)
 //#include "RPCMessage.h"
 //#include "NameServer.h"